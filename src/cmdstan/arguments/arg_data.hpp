@@ -3,6 +3,7 @@
 
 #include <cmdstan/arguments/categorical_argument.hpp>
 
+#include <cmdstan/arguments/arg_data_batch_file.hpp>
 #include <cmdstan/arguments/arg_data_file.hpp>
 
 namespace cmdstan {
@@ -14,6 +15,7 @@ class arg_data : public categorical_argument {
     _description = "Input data options";
 
     _subarguments.push_back(new arg_data_file());
+    _subarguments.push_back(new arg_data_batch_file());
   }
 };
 
@@ -0,0 +1,23 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_DATA_BATCH_FILE_HPP
+#define CMDSTAN_ARGUMENTS_ARG_DATA_BATCH_FILE_HPP
+
+#include <cmdstan/arguments/singleton_argument.hpp>
+
+namespace cmdstan {
+
+class arg_data_batch_file : public string_argument {
+ public:
+  arg_data_batch_file() : string_argument() {
+    _name = "batch_file";
+    _description
+        = "File listing one data file per line. The method is run once for "
+          "each data file, with numbered output files";
+    _validity = "Path to existing file";
+    _default = "\"\"";
+    _default_value = "";
+    _value = _default_value;
+  }
+};
+
+}  // namespace cmdstan
+#endif
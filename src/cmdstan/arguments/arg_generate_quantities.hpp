@@ -2,6 +2,7 @@
 #define CMDSTAN_ARGUMENTS_ARG_GENERATE_QUANTITIES_HPP
 
 #include <cmdstan/arguments/arg_generate_quantities_fitted_params.hpp>
+#include <cmdstan/arguments/arg_single_bool.hpp>
 #include <cmdstan/arguments/arg_single_int_pos.hpp>
 #include <cmdstan/arguments/categorical_argument.hpp>
 
@@ -16,6 +17,13 @@ class arg_generate_quantities : public categorical_argument {
     _subarguments.push_back(new arg_generate_quantities_fitted_params());
     _subarguments.push_back(
         new arg_single_int_pos("num_chains", "Number of chains", 1));
+    _subarguments.push_back(new arg_single_int_pos(
+        "chunk_size", "Number of draws read from each file at a time", 1000));
+    _subarguments.push_back(new arg_single_bool(
+        "parallel_draws",
+        "When true, process the draws of each chain in parallel, with a "
+        "random number stream per draw",
+        false));
   }
 };
 
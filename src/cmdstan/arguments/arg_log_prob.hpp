@@ -28,6 +28,11 @@ class arg_log_prob : public categorical_argument {
                             "When true, include change-of-variables adjustment"
                             " for constraining parameter transforms",
                             true));
+    _subarguments.push_back(
+        new arg_single_bool("hessian",
+                            "When true, also return the Hessian, computed by"
+                            " finite differences of gradients",
+                            false));
   }
 };
 
@@ -10,15 +10,17 @@ namespace cmdstan {
  * and should contain a variable 'params_r' with either a vector or list/array
  * of vectors of unconstrained parameter values. Like the 'init' argument, if
  * the file has a '.json' extension it is treated as a JSON file, otherwise it
- * is treated as an RDump file.
+ * is treated as an RDump file.  Large sets of parameter values can instead be
+ * given as a NumPy '.npy' file or a '.bin' file of raw little-endian doubles,
+ * one row per set, which are memory-mapped and read in chunks.
  */
 class arg_log_prob_unconstrained_params : public string_argument {
  public:
   arg_log_prob_unconstrained_params() : string_argument() {
     _name = "unconstrained_params";
     _description
-        = "Input file (JSON or R dump) of parameter values on unconstrained "
-          "scale";
+        = "Input file (JSON, R dump, .npy or .bin matrix) of parameter "
+          "values on unconstrained scale";
     _validity = "Path to existing file";
     _default = "\"\"";
     _default_value = "";
@@ -6,6 +6,7 @@
 #include <cmdstan/arguments/arg_optimize.hpp>
 #include <cmdstan/arguments/arg_pathfinder.hpp>
 #include <cmdstan/arguments/arg_sample.hpp>
+#include <cmdstan/arguments/arg_server.hpp>
 #include <cmdstan/arguments/arg_variational.hpp>
 #include <cmdstan/arguments/arg_log_prob.hpp>
 #include <cmdstan/arguments/arg_laplace.hpp>
@@ -27,6 +28,7 @@ class arg_method : public list_argument {
     _values.push_back(new arg_pathfinder());
     _values.push_back(new arg_log_prob());
     _values.push_back(new arg_laplace());
+    _values.push_back(new arg_server());
 
     _default_cursor = 0;
     _cursor = _default_cursor;
@@ -24,6 +24,13 @@ class arg_optimize : public categorical_argument {
         new arg_single_int_pos("iter", "Total number of iterations", 2000));
     _subarguments.push_back(new arg_single_bool(
         "save_iterations", "Stream optimization progress to output?", false));
+    _subarguments.push_back(new arg_single_int_pos(
+        "num_starts",
+        "Number of optimizations to run in parallel from different initial "
+        "values, the best mode is written to output",
+        1));
+    _subarguments.push_back(new arg_single_bool(
+        "save_starts", "Save the output of each optimization?", false));
   }
 };
 
@@ -2,7 +2,9 @@
 #define CMDSTAN_ARGUMENTS_ARG_OUTPUT_HPP
 
 #include <cmdstan/arguments/arg_diagnostic_file.hpp>
+#include <cmdstan/arguments/arg_output_compression.hpp>
 #include <cmdstan/arguments/arg_output_file.hpp>
+#include <cmdstan/arguments/arg_output_format.hpp>
 #include <cmdstan/arguments/arg_output_sig_figs.hpp>
 #include <cmdstan/arguments/arg_profile_file.hpp>
 #include <cmdstan/arguments/arg_refresh.hpp>
@@ -21,12 +23,19 @@ class arg_output : public categorical_argument {
     _subarguments.push_back(new arg_diagnostic_file());
     _subarguments.push_back(new arg_refresh());
     _subarguments.push_back(new arg_output_sig_figs());
+    _subarguments.push_back(new arg_output_format());
+    _subarguments.push_back(new arg_output_compression());
     _subarguments.push_back(new arg_profile_file());
     _subarguments.push_back(new arg_single_bool(
         "save_cmdstan_config",
         "Save the CmdStan configuration (parsed arguments + default values) as "
         "JSON alongside the output files",
         false));
+    _subarguments.push_back(new arg_single_bool(
+        "async",
+        "Write the output files from a background thread, so that sampling "
+        "doesn't wait on file I/O",
+        false));
   }
 };
 
@@ -0,0 +1,27 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_OUTPUT_COMPRESSION_HPP
+#define CMDSTAN_ARGUMENTS_ARG_OUTPUT_COMPRESSION_HPP
+
+#include <cmdstan/arguments/arg_output_compression_gzip.hpp>
+#include <cmdstan/arguments/arg_output_compression_none.hpp>
+#include <cmdstan/arguments/arg_output_compression_zstd.hpp>
+#include <cmdstan/arguments/list_argument.hpp>
+
+namespace cmdstan {
+
+class arg_output_compression : public list_argument {
+ public:
+  arg_output_compression() {
+    _name = "compression";
+    _description = "Compression of the sample and diagnostic output files";
+
+    _values.push_back(new arg_output_compression_none());
+    _values.push_back(new arg_output_compression_gzip());
+    _values.push_back(new arg_output_compression_zstd());
+
+    _default_cursor = 0;
+    _cursor = _default_cursor;
+  }
+};
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,29 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_OUTPUT_COMPRESSION_GZIP_HPP
+#define CMDSTAN_ARGUMENTS_ARG_OUTPUT_COMPRESSION_GZIP_HPP
+
+#include <cmdstan/arguments/arg_single_int_bounded.hpp>
+#include <cmdstan/arguments/arg_single_int_pos.hpp>
+#include <cmdstan/arguments/categorical_argument.hpp>
+
+namespace cmdstan {
+
+class arg_output_compression_gzip : public categorical_argument {
+ public:
+  arg_output_compression_gzip() {
+    _name = "gzip";
+    _description
+        = "gzip compressed output, written to files with suffix \".gz\". "
+          "Requires CmdStan built with CMDSTAN_ZLIB=true";
+
+    _subarguments.push_back(
+        new arg_single_int_bounded("level", "Compression level", 6, 1, 9));
+    _subarguments.push_back(new arg_single_int_pos(
+        "frame_size",
+        "Amount of output in KiB compressed as one independently readable "
+        "gzip member",
+        1024));
+  }
+};
+
+}  // namespace cmdstan
+#endif
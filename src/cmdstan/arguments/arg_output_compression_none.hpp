@@ -0,0 +1,17 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_OUTPUT_COMPRESSION_NONE_HPP
+#define CMDSTAN_ARGUMENTS_ARG_OUTPUT_COMPRESSION_NONE_HPP
+
+#include <cmdstan/arguments/unvalued_argument.hpp>
+
+namespace cmdstan {
+
+class arg_output_compression_none : public unvalued_argument {
+ public:
+  arg_output_compression_none() {
+    _name = "none";
+    _description = "Uncompressed output";
+  }
+};
+
+}  // namespace cmdstan
+#endif
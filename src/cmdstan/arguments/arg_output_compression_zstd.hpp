@@ -0,0 +1,29 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_OUTPUT_COMPRESSION_ZSTD_HPP
+#define CMDSTAN_ARGUMENTS_ARG_OUTPUT_COMPRESSION_ZSTD_HPP
+
+#include <cmdstan/arguments/arg_single_int_bounded.hpp>
+#include <cmdstan/arguments/arg_single_int_pos.hpp>
+#include <cmdstan/arguments/categorical_argument.hpp>
+
+namespace cmdstan {
+
+class arg_output_compression_zstd : public categorical_argument {
+ public:
+  arg_output_compression_zstd() {
+    _name = "zstd";
+    _description
+        = "Zstandard compressed output, written to files with suffix \".zst\". "
+          "Requires CmdStan built with CMDSTAN_ZSTD=true";
+
+    _subarguments.push_back(
+        new arg_single_int_bounded("level", "Compression level", 3, 1, 19));
+    _subarguments.push_back(new arg_single_int_pos(
+        "frame_size",
+        "Amount of output in KiB compressed as one independently readable "
+        "zstd frame",
+        1024));
+  }
+};
+
+}  // namespace cmdstan
+#endif
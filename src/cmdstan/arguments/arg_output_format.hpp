@@ -0,0 +1,25 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_OUTPUT_FORMAT_HPP
+#define CMDSTAN_ARGUMENTS_ARG_OUTPUT_FORMAT_HPP
+
+#include <cmdstan/arguments/arg_output_format_binary.hpp>
+#include <cmdstan/arguments/arg_output_format_csv.hpp>
+#include <cmdstan/arguments/list_argument.hpp>
+
+namespace cmdstan {
+
+class arg_output_format : public list_argument {
+ public:
+  arg_output_format() {
+    _name = "format";
+    _description = "Storage format for the draws in the output file";
+
+    _values.push_back(new arg_output_format_csv());
+    _values.push_back(new arg_output_format_binary());
+
+    _default_cursor = 0;
+    _cursor = _default_cursor;
+  }
+};
+
+}  // namespace cmdstan
+#endif
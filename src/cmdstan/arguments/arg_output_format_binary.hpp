@@ -0,0 +1,19 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_OUTPUT_FORMAT_BINARY_HPP
+#define CMDSTAN_ARGUMENTS_ARG_OUTPUT_FORMAT_BINARY_HPP
+
+#include <cmdstan/arguments/unvalued_argument.hpp>
+
+namespace cmdstan {
+
+class arg_output_format_binary : public unvalued_argument {
+ public:
+  arg_output_format_binary() {
+    _name = "binary";
+    _description
+        = "Columnar chunks of little-endian doubles with a JSON header, "
+          "written to a .bin file";
+  }
+};
+
+}  // namespace cmdstan
+#endif
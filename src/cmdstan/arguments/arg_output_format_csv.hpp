@@ -0,0 +1,17 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_OUTPUT_FORMAT_CSV_HPP
+#define CMDSTAN_ARGUMENTS_ARG_OUTPUT_FORMAT_CSV_HPP
+
+#include <cmdstan/arguments/unvalued_argument.hpp>
+
+namespace cmdstan {
+
+class arg_output_format_csv : public unvalued_argument {
+ public:
+  arg_output_format_csv() {
+    _name = "csv";
+    _description = "Stan CSV text file";
+  }
+};
+
+}  // namespace cmdstan
+#endif
@@ -12,8 +12,8 @@ class arg_output_sig_figs : public int_argument {
     _description
         = "The number of significant figures used for the output CSV files.";
     _validity
-        = "0 <= integer <= 18 or -1 to use the default number of significant "
-          "figures";
+        = "0 <= integer <= 18 or -1 to use the fewest significant figures "
+          "which preserve the value exactly";
     _default = "-1";
     _default_value = -1;
     _value = _default_value;
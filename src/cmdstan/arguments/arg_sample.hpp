@@ -3,9 +3,11 @@
 
 #include <cmdstan/arguments/arg_adapt.hpp>
 #include <cmdstan/arguments/arg_sample_algo.hpp>
+#include <cmdstan/arguments/arg_sample_stop_rule.hpp>
 #include <cmdstan/arguments/arg_single_bool.hpp>
 #include <cmdstan/arguments/arg_single_int_nonneg.hpp>
 #include <cmdstan/arguments/arg_single_int_pos.hpp>
+#include <cmdstan/arguments/arg_single_string.hpp>
 #include <cmdstan/arguments/categorical_argument.hpp>
 
 namespace cmdstan {
@@ -27,6 +29,31 @@ class arg_sample : public categorical_argument {
     _subarguments.push_back(new arg_sample_algo());
     _subarguments.push_back(
         new arg_single_int_pos("num_chains", "Number of chains", 1));
+    _subarguments.push_back(new arg_single_bool(
+        "mpi_chains",
+        "Spread the chains over the MPI processes, each of which writes "
+        "the output files of its own chains?",
+        false));
+    _subarguments.push_back(new arg_sample_stop_rule());
+    _subarguments.push_back(new arg_single_string(
+        "warm_start",
+        "Output file of a previous run to take inits, step size and "
+        "metric from, empty for none",
+        ""));
+    _subarguments.push_back(new arg_single_int_nonneg(
+        "warm_start_warmup",
+        "Number of warmup iterations of a warm start, which only adapt "
+        "the step size",
+        100));
+    _subarguments.push_back(new arg_single_string(
+        "checkpoint_file",
+        "Base name of per-chain checkpoint files, empty for no checkpoints",
+        ""));
+    _subarguments.push_back(new arg_single_int_pos(
+        "checkpoint_every", "Number of sampling draws between checkpoints",
+        100));
+    _subarguments.push_back(new arg_single_bool(
+        "resume", "Resume an interrupted run from its checkpoints?", false));
   }
 };
 
@@ -0,0 +1,25 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_SAMPLE_STOP_RULE_HPP
+#define CMDSTAN_ARGUMENTS_ARG_SAMPLE_STOP_RULE_HPP
+
+#include <cmdstan/arguments/arg_sample_stop_rule_ess.hpp>
+#include <cmdstan/arguments/arg_sample_stop_rule_none.hpp>
+#include <cmdstan/arguments/list_argument.hpp>
+
+namespace cmdstan {
+
+class arg_sample_stop_rule : public list_argument {
+ public:
+  arg_sample_stop_rule() {
+    _name = "stop_rule";
+    _description = "Rule for ending sampling before num_samples iterations";
+
+    _values.push_back(new arg_sample_stop_rule_none());
+    _values.push_back(new arg_sample_stop_rule_ess());
+
+    _default_cursor = 0;
+    _cursor = _default_cursor;
+  }
+};
+
+}  // namespace cmdstan
+#endif
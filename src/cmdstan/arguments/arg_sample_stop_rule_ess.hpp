@@ -0,0 +1,30 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_SAMPLE_STOP_RULE_ESS_HPP
+#define CMDSTAN_ARGUMENTS_ARG_SAMPLE_STOP_RULE_ESS_HPP
+
+#include <cmdstan/arguments/arg_single_int_pos.hpp>
+#include <cmdstan/arguments/arg_single_real_bounded.hpp>
+#include <cmdstan/arguments/arg_single_real_pos.hpp>
+#include <cmdstan/arguments/categorical_argument.hpp>
+
+namespace cmdstan {
+
+class arg_sample_stop_rule_ess : public categorical_argument {
+ public:
+  arg_sample_stop_rule_ess() {
+    _name = "ess";
+    _description
+        = "Stop all chains once the bulk and tail ESS and the R-hat of all "
+          "parameters meet their targets. Not used by the fixed_param sampler";
+
+    _subarguments.push_back(new arg_single_real_pos(
+        "target_ess", "Minimum bulk and tail effective sample size", 400));
+    _subarguments.push_back(new arg_single_real_bounded(
+        "max_rhat", "Maximum split R-hat", 1.01, 1, 2));
+    _subarguments.push_back(new arg_single_int_pos(
+        "check_every",
+        "Number of saved draws per chain between convergence checks", 100));
+  }
+};
+
+}  // namespace cmdstan
+#endif
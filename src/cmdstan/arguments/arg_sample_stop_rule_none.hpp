@@ -0,0 +1,17 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_SAMPLE_STOP_RULE_NONE_HPP
+#define CMDSTAN_ARGUMENTS_ARG_SAMPLE_STOP_RULE_NONE_HPP
+
+#include <cmdstan/arguments/unvalued_argument.hpp>
+
+namespace cmdstan {
+
+class arg_sample_stop_rule_none : public unvalued_argument {
+ public:
+  arg_sample_stop_rule_none() {
+    _name = "none";
+    _description = "Run all sampling iterations";
+  }
+};
+
+}  // namespace cmdstan
+#endif
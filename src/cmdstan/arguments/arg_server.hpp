@@ -0,0 +1,38 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_SERVER_HPP
+#define CMDSTAN_ARGUMENTS_ARG_SERVER_HPP
+
+#include <cmdstan/arguments/arg_single_int_pos.hpp>
+#include <cmdstan/arguments/arg_single_string.hpp>
+#include <cmdstan/arguments/categorical_argument.hpp>
+
+namespace cmdstan {
+
+/**
+ * Argument used for running the model executable as a server which
+ * reads job requests, one per line, each holding the arguments of a
+ * single run of the model.  Jobs which don't set `random seed` use the
+ * server's seed.
+ */
+class arg_server : public categorical_argument {
+ public:
+  arg_server() {
+    _name = "server";
+    _description
+        = "Run jobs for this model read from stdin or a Unix socket, "
+          "one line of arguments per job";
+
+    _subarguments.push_back(new arg_single_string(
+        "socket",
+        "Path of a Unix socket to listen on, or empty to read jobs from "
+        "stdin",
+        ""));
+    _subarguments.push_back(new arg_single_int_pos(
+        "max_models",
+        "Number of instantiated models kept for reuse, keyed on data and "
+        "seed; jobs without a seed use the server's",
+        8));
+  }
+};
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,35 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_SINGLE_INT_BOUNDED_HPP
+#define CMDSTAN_ARGUMENTS_ARG_SINGLE_INT_BOUNDED_HPP
+
+#include <cmdstan/arguments/singleton_argument.hpp>
+#include <string>
+
+/** Generic bounded int value argument */
+
+namespace cmdstan {
+
+class arg_single_int_bounded : public int_argument {
+  int _lb;
+  int _ub;
+
+ public:
+  arg_single_int_bounded(const char* name, const char* desc, int def, int lb,
+                         int ub)
+      : int_argument() {
+    _name = name;
+    _description = desc;
+    _validity
+        = std::to_string(lb).append(" <= ").append(name).append(" <= ").append(
+            std::to_string(ub));
+    _default = std::to_string(def);
+    _default_value = def;
+    _value = _default_value;
+    _lb = lb;
+    _ub = ub;
+  }
+
+  bool is_valid(int value) { return _lb <= value && value <= _ub; }
+};
+
+}  // namespace cmdstan
+#endif
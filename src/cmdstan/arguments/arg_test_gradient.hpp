@@ -1,6 +1,8 @@
 #ifndef CMDSTAN_ARGUMENTS_ARG_TEST_GRADIENT_HPP
 #define CMDSTAN_ARGUMENTS_ARG_TEST_GRADIENT_HPP
 
+#include <cmdstan/arguments/arg_single_int_nonneg.hpp>
+#include <cmdstan/arguments/arg_single_string.hpp>
 #include <cmdstan/arguments/arg_test_grad_eps.hpp>
 #include <cmdstan/arguments/arg_test_grad_err.hpp>
 #include <cmdstan/arguments/categorical_argument.hpp>
@@ -15,6 +17,15 @@ class arg_test_gradient : public categorical_argument {
 
     _subarguments.push_back(new arg_test_grad_eps());
     _subarguments.push_back(new arg_test_grad_err());
+    _subarguments.push_back(new arg_single_string(
+        "params",
+        "Comma-separated names of the unconstrained parameters to test, "
+        "or of variables to test all their elements, empty to test all",
+        ""));
+    _subarguments.push_back(new arg_single_int_nonneg(
+        "num_params",
+        "Number of the parameters to test, chosen at random, 0 to test all",
+        0));
   }
 };
 
@@ -0,0 +1,365 @@
+#ifndef CMDSTAN_ASYNC_WRITER_HPP
+#define CMDSTAN_ASYNC_WRITER_HPP
+
+#include <cmdstan/output_writer.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cmdstan {
+
+namespace internal {
+
+/**
+ * One writer callback, captured so that it can be replayed on the
+ * I/O thread.
+ */
+struct async_record {
+  enum kind_t { NAMES, VALUES, MATRIX, ROW_VECTOR, COL_VECTOR, BLANK, MESSAGE };
+  kind_t kind = BLANK;
+  std::vector<std::string> names;
+  std::vector<double> values;  // column-major for matrices
+  Eigen::Index rows = 0;
+  Eigen::Index cols = 0;
+  std::string message;
+};
+
+/**
+ * Bounded single-producer, single-consumer queue of records in front of
+ * one output writer.
+ *
+ * The producer is the chain writing to the output, the consumer is the
+ * I/O thread.  Slots are swapped rather than copied in and out, so the
+ * vectors and strings of consumed records are reused by the producer
+ * and steady-state sampling doesn't allocate.
+ */
+class async_channel {
+ public:
+  async_channel(output_writer &&target, size_t capacity)
+      : target_(std::move(target)), slots_(capacity + 1) {}
+
+  /**
+   * Enqueue a record, leaving a consumed record in its place.
+   *
+   * @param rec record to enqueue
+   * @return false if the queue is full
+   */
+  bool try_push(async_record &rec) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t next = (tail + 1) % slots_.size();
+    if (next == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    std::swap(slots_[tail], rec);
+    tail_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Write up to `max_records` queued records to the target writer.  After
+   * the target fails, records are dropped so that the producer never
+   * blocks on a dead queue; the error is kept for `error()`.
+   *
+   * @param max_records maximum number of records to write
+   * @return number of records dequeued
+   */
+  size_t drain(size_t max_records) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    size_t n = 0;
+    for (; head != tail && n < max_records; ++n) {
+      if (!failed_.load(std::memory_order_relaxed)) {
+        try {
+          write(slots_[head]);
+        } catch (...) {
+          error_ = std::current_exception();
+          failed_.store(true, std::memory_order_release);
+        }
+      }
+      head = (head + 1) % slots_.size();
+      head_.store(head, std::memory_order_release);
+    }
+    return n;
+  }
+
+  bool empty() const {
+    return head_.load(std::memory_order_acquire)
+           == tail_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Return the exception thrown by the target writer, if any.
+   */
+  std::exception_ptr error() const {
+    return failed_.load(std::memory_order_acquire) ? error_ : nullptr;
+  }
+
+ private:
+  output_writer target_;
+  std::vector<async_record> slots_;
+  std::atomic<size_t> head_{0};
+  std::atomic<size_t> tail_{0};
+  std::atomic<bool> failed_{false};
+  std::exception_ptr error_;
+
+  void write(async_record &rec) {
+    switch (rec.kind) {
+      case async_record::NAMES:
+        target_(rec.names);
+        break;
+      case async_record::VALUES:
+        target_(rec.values);
+        break;
+      case async_record::MATRIX: {
+        Eigen::Map<Eigen::MatrixXd> values(rec.values.data(), rec.rows,
+                                           rec.cols);
+        target_(Eigen::Ref<Eigen::MatrixXd>(values));
+        break;
+      }
+      case async_record::ROW_VECTOR: {
+        Eigen::Map<Eigen::RowVectorXd> values(rec.values.data(), rec.cols);
+        target_(Eigen::Ref<Eigen::RowVectorXd>(values));
+        break;
+      }
+      case async_record::COL_VECTOR: {
+        Eigen::Map<Eigen::VectorXd> values(rec.values.data(), rec.rows);
+        target_(Eigen::Ref<Eigen::VectorXd>(values));
+        break;
+      }
+      case async_record::BLANK:
+        target_();
+        break;
+      case async_record::MESSAGE:
+        target_(rec.message);
+        break;
+    }
+  }
+};
+
+}  // namespace internal
+
+/**
+ * Background thread which does the file I/O for a set of writers.
+ *
+ * Each writer handed to `add_channel` gets its own bounded queue.  The
+ * thread visits the queues in turn and writes a batch of records from
+ * each, so a slow file delays only the thread, not the chains.  When a
+ * queue is full the chain writing to it yields until there is room
+ * again, which bounds the memory held by queued draws.
+ */
+class async_writer_thread {
+ public:
+  /**
+   * Start the I/O thread.
+   *
+   * @param capacity number of records each queue holds
+   * @param batch_size maximum records written from one queue before
+   *   moving on to the next
+   */
+  explicit async_writer_thread(size_t capacity = 1024, size_t batch_size = 64)
+      : capacity_(capacity), batch_size_(batch_size) {
+    thread_ = std::thread([this] { run(); });
+  }
+
+  async_writer_thread(const async_writer_thread &) = delete;
+  async_writer_thread &operator=(const async_writer_thread &) = delete;
+
+  ~async_writer_thread() {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  /**
+   * Create a queue in front of a writer.  The writer is owned by the
+   * queue and released when this object is destroyed.
+   *
+   * @param target writer which receives the records
+   * @return queue to push records to
+   */
+  std::shared_ptr<internal::async_channel> add_channel(output_writer &&target) {
+    auto channel = std::make_shared<internal::async_channel>(std::move(target),
+                                                             capacity_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    channels_.push_back(channel);
+    return channel;
+  }
+
+  /**
+   * Wake the I/O thread, e.g. because a queue is full.
+   */
+  void notify() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_ = true;
+    }
+    cv_.notify_one();
+  }
+
+  /**
+   * Return true once `close` has stopped the I/O thread.  Queues must then
+   * be drained by their producers.
+   */
+  bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+  /**
+   * Write all queued records, stop the I/O thread and rethrow the first
+   * error raised by any of the writers.
+   */
+  void close() {
+    if (!closed()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      cv_.notify_one();
+      thread_.join();
+      closed_.store(true, std::memory_order_release);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &channel : channels_) {
+      channel->drain(static_cast<size_t>(-1));
+    }
+    for (auto &channel : channels_) {
+      if (channel->error()) {
+        std::rethrow_exception(channel->error());
+      }
+    }
+  }
+
+ private:
+  size_t capacity_;
+  size_t batch_size_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  bool pending_ = false;
+  std::atomic<bool> closed_{false};
+  std::vector<std::shared_ptr<internal::async_channel>> channels_;
+  std::thread thread_;
+
+  void run() {
+    std::vector<std::shared_ptr<internal::async_channel>> channels;
+    while (true) {
+      bool stopping;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping = stop_;
+        if (channels.size() != channels_.size()) {
+          channels = channels_;
+        }
+      }
+      size_t num_written = 0;
+      for (auto &channel : channels) {
+        num_written += channel->drain(batch_size_);
+      }
+      if (num_written > 0) {
+        continue;
+      }
+      if (stopping) {
+        return;
+      }
+      // queues are only polled; producers signal when they are full
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait_for(lock, std::chrono::milliseconds(1),
+                   [this] { return stop_ || pending_; });
+      pending_ = false;
+    }
+  }
+};
+
+/**
+ * Writer which queues its callbacks for an `async_writer_thread` to
+ * write, so that the thread calling it doesn't wait on file I/O.
+ */
+class async_writer : public stan::callbacks::writer {
+ public:
+  /**
+   * Construct an asynchronous writer.
+   *
+   * @param io thread which does the writing
+   * @param target writer which receives the output
+   */
+  async_writer(std::shared_ptr<async_writer_thread> io, output_writer &&target)
+      : io_(std::move(io)), channel_(io_->add_channel(std::move(target))) {}
+
+  void operator()(const std::vector<std::string> &names) {
+    record_.kind = internal::async_record::NAMES;
+    record_.names = names;
+    push();
+  }
+
+  void operator()(const std::vector<double> &state) {
+    record_.kind = internal::async_record::VALUES;
+    record_.values.assign(state.begin(), state.end());
+    push();
+  }
+
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, -1, -1>> &values) {
+    record_.kind = internal::async_record::MATRIX;
+    copy_values(values);
+    push();
+  }
+
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, 1, -1>> &values) {
+    record_.kind = internal::async_record::ROW_VECTOR;
+    copy_values(values);
+    push();
+  }
+
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, -1, 1>> &values) {
+    record_.kind = internal::async_record::COL_VECTOR;
+    copy_values(values);
+    push();
+  }
+
+  void operator()() {
+    record_.kind = internal::async_record::BLANK;
+    push();
+  }
+
+  void operator()(const std::string &message) {
+    record_.kind = internal::async_record::MESSAGE;
+    record_.message = message;
+    push();
+  }
+
+ private:
+  std::shared_ptr<async_writer_thread> io_;
+  std::shared_ptr<internal::async_channel> channel_;
+  internal::async_record record_;
+
+  template <typename T>
+  void copy_values(const T &values) {
+    record_.rows = values.rows();
+    record_.cols = values.cols();
+    record_.values.resize(values.size());
+    Eigen::Map<Eigen::MatrixXd>(record_.values.data(), values.rows(),
+                                values.cols())
+        = values;
+  }
+
+  void push() {
+    while (!channel_->try_push(record_)) {
+      if (io_->closed()) {
+        channel_->drain(static_cast<size_t>(-1));
+      } else {
+        io_->notify();
+        std::this_thread::yield();
+      }
+    }
+  }
+};
+
+}  // namespace cmdstan
+#endif
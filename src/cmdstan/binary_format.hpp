@@ -0,0 +1,155 @@
+#ifndef CMDSTAN_BINARY_FORMAT_HPP
+#define CMDSTAN_BINARY_FORMAT_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+
+namespace cmdstan {
+
+/**
+ * Layout of the binary draws file written by `output format=binary`.
+ *
+ * The file starts with the 8-byte magic string, the format version and
+ * a JSON header:
+ *
+ *   magic[8] | uint32 version | uint64 header_size | header (JSON)
+ *
+ * The header holds the config lines which `write_config` emits as CSV
+ * comments and the column names:
+ *
+ *   {"version": 1, "config": ["...", ...], "columns": ["lp__", ...]}
+ *
+ * The header is followed by a sequence of records, each introduced by
+ * a single tag byte:
+ *
+ *   'D' | uint64 num_rows | uint64 num_cols | num_rows * num_cols doubles
+ *   'C' | uint64 size | size bytes of comment text
+ *
+ * Draws records store their values in column-major order so that a
+ * reader can copy whole columns.  All integers and doubles are stored
+ * little-endian.  A file is read up to its last complete record, so
+ * the draws written before an interrupted run remain readable.
+ */
+namespace binary_format {
+
+constexpr char MAGIC[8] = {'S', 'T', 'A', 'N', 'B', 'I', 'N', '\0'};
+constexpr std::uint32_t VERSION = 1;
+constexpr char DRAWS_RECORD = 'D';
+constexpr char COMMENT_RECORD = 'C';
+constexpr const char *SUFFIX = ".bin";
+
+/**
+ * Return true if this host stores multi-byte values little-endian.
+ */
+inline bool host_is_little_endian() {
+  const std::uint16_t probe = 1;
+  unsigned char first_byte;
+  std::memcpy(&first_byte, &probe, 1);
+  return first_byte == 1;
+}
+
+/**
+ * Copy the bytes of a value into a buffer in little-endian order.
+ *
+ * @tparam T trivially copyable type
+ * @param value value to encode
+ * @param buf destination, at least sizeof(T) bytes
+ */
+template <typename T>
+inline void encode_le(const T &value, char *buf) {
+  std::memcpy(buf, &value, sizeof(T));
+  if (!host_is_little_endian()) {
+    for (size_t i = 0; i < sizeof(T) / 2; ++i) {
+      std::swap(buf[i], buf[sizeof(T) - 1 - i]);
+    }
+  }
+}
+
+/**
+ * Decode a value stored in little-endian order.
+ *
+ * @tparam T trivially copyable type
+ * @param buf source, at least sizeof(T) bytes
+ * @return decoded value
+ */
+template <typename T>
+inline T decode_le(const char *buf) {
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, buf, sizeof(T));
+  if (!host_is_little_endian()) {
+    for (size_t i = 0; i < sizeof(T) / 2; ++i) {
+      std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+    }
+  }
+  T value;
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
+
+template <typename T>
+inline void write_le(std::ostream &out, const T &value) {
+  char buf[sizeof(T)];
+  encode_le(value, buf);
+  out.write(buf, sizeof(T));
+}
+
+/**
+ * Read a little-endian value from a stream.
+ *
+ * @return false if the stream ended before the value was complete
+ */
+template <typename T>
+inline bool read_le(std::istream &in, T &value) {
+  char buf[sizeof(T)];
+  if (!in.read(buf, sizeof(T)))
+    return false;
+  value = decode_le<T>(buf);
+  return true;
+}
+
+/**
+ * Append a JSON string literal, with quotes and escapes, to a buffer.
+ *
+ * @param out JSON text being assembled
+ * @param value string to quote
+ */
+inline void append_json_string(std::string &out, const std::string &value) {
+  static const char hex[] = "0123456789abcdef";
+  out += '"';
+  for (char c : value) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          out += "\\u00";
+          out += hex[(c >> 4) & 0xf];
+          out += hex[c & 0xf];
+        } else {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+}
+
+}  // namespace binary_format
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,216 @@
+#ifndef CMDSTAN_BINARY_READER_HPP
+#define CMDSTAN_BINARY_READER_HPP
+
+#include <cmdstan/binary_format.hpp>
+#include <cmdstan/compression.hpp>
+#include <cmdstan/csv_reader.hpp>
+#include <stan/io/stan_csv_reader.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <rapidjson/document.h>
+
+namespace cmdstan {
+
+/**
+ * Check whether a file starts with the magic string of the binary
+ * output format, after decompression if it is compressed.
+ *
+ * @param fname name of file
+ * @return true if the file is a binary output file
+ */
+inline bool is_binary_output(const std::string &fname) {
+  std::unique_ptr<std::istream> in;
+  char magic[sizeof(binary_format::MAGIC)];
+  try {
+    in = compression::open_input(fname, true);
+    if (!in->read(magic, sizeof(magic)))
+      return false;
+  } catch (const std::exception &e) {
+    return false;
+  }
+  return std::memcmp(magic, binary_format::MAGIC, sizeof(magic)) == 0;
+}
+
+namespace internal {
+
+/**
+ * Read the magic string, version and JSON header of a binary output
+ * file, leaving the stream at the first record.
+ *
+ * @param in stream positioned at the start of the file
+ * @param fname name of file, for error messages
+ * @param prettify_names if true, column names are converted from the
+ *   `theta.1` to the `theta[1]` style, as by the Stan CSV reader
+ * @param[out] result receives the metadata and column names
+ */
+inline void read_binary_header(std::istream &in, const std::string &fname,
+                               bool prettify_names,
+                               stan::io::stan_csv &result) {
+  std::stringstream msg;
+  char magic[sizeof(binary_format::MAGIC)];
+  std::uint32_t version = 0;
+  std::uint64_t header_size = 0;
+  if (!in.read(magic, sizeof(magic))
+      || std::memcmp(magic, binary_format::MAGIC, sizeof(magic)) != 0
+      || !binary_format::read_le(in, version)
+      || !binary_format::read_le(in, header_size)) {
+    msg << "Not a binary output file: \"" << fname << "\"" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  if (version > binary_format::VERSION) {
+    msg << "Unsupported binary output version " << version << " in file \""
+        << fname << "\"" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  std::string header_json(header_size, '\0');
+  rapidjson::Document header;
+  if (!in.read(&header_json[0], header_size)
+      || header.Parse(header_json.c_str()).HasParseError()
+      || !header.IsObject() || !header.HasMember("config")
+      || !header.HasMember("columns") || !header["config"].IsArray()
+      || !header["columns"].IsArray()) {
+    msg << "Corrupt header in binary output file: \"" << fname << "\""
+        << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+
+  std::stringstream config;
+  for (const auto &line : header["config"].GetArray()) {
+    config << "# " << line.GetString() << "\n";
+  }
+  stan::io::stan_csv_reader::read_metadata(config, result.metadata);
+  for (const auto &name : header["columns"].GetArray()) {
+    std::string column(name.GetString());
+    if (prettify_names) {
+      stan::io::prettify_stan_csv_name(column);
+    }
+    result.header.push_back(column);
+  }
+}
+
+}  // namespace internal
+
+/**
+ * Read a file in the binary output format into the same structure the
+ * Stan CSV reader produces, so that downstream consumers don't need to
+ * know which format the sampler wrote.
+ *
+ * Config and adaptation comments are handed to the Stan CSV reader as
+ * comment text, which keeps metadata parsing in one place.  A trailing
+ * record cut short by an interrupted run is ignored.  Compressed files
+ * are decompressed while reading.
+ *
+ * @param fname name of file which exists and has read perms
+ * @param prettify_names if true, column names are converted from the
+ *   `theta.1` to the `theta[1]` style, as by the Stan CSV reader
+ * @param include_params names of the model columns to read, as for
+ *   `read_stan_csv`; if empty, all columns are read
+ * @return parsed draws, header, metadata, adaptation and timing
+ */
+inline stan::io::stan_csv read_binary_output(
+    const std::string &fname, bool prettify_names = true,
+    const std::vector<std::string> &include_params = {}) {
+  std::stringstream msg;
+  auto input = compression::open_input(fname, true);
+  std::istream &in = *input;
+  stan::io::stan_csv result;
+  internal::read_binary_header(in, fname, prettify_names, result);
+
+  // draws chunks in file order, plus the comment blocks around them
+  std::vector<Eigen::MatrixXd> chunks;
+  std::stringstream adaptation;
+  bool in_adaptation = false;
+  size_t num_rows = 0;
+  const size_t num_cols = result.header.size();
+  const std::vector<int> keep
+      = internal::project_columns(result.header, include_params);
+  while (true) {
+    char tag;
+    if (!in.get(tag))
+      break;
+    if (tag == binary_format::DRAWS_RECORD) {
+      std::uint64_t rows = 0;
+      std::uint64_t cols = 0;
+      if (!binary_format::read_le(in, rows)
+          || !binary_format::read_le(in, cols))
+        break;
+      if (cols != num_cols) {
+        msg << "Mismatch between header and draws in binary output file: \""
+            << fname << "\"" << std::endl;
+        throw std::invalid_argument(msg.str());
+      }
+      std::vector<char> bytes(rows * cols * sizeof(double));
+      if (!in.read(bytes.data(), bytes.size()))
+        break;
+      Eigen::MatrixXd chunk(rows, result.header.size());
+      const char *pos = bytes.data();
+      for (size_t j = 0; j < cols; ++j) {
+        const int idx = keep.empty() ? j : keep[j];
+        if (idx < 0) {
+          pos += rows * sizeof(double);
+          continue;
+        }
+        for (Eigen::Index i = 0; i < chunk.rows(); ++i) {
+          chunk(i, idx) = binary_format::decode_le<double>(pos);
+          pos += sizeof(double);
+        }
+      }
+      num_rows += rows;
+      chunks.emplace_back(std::move(chunk));
+      in_adaptation = false;
+    } else if (tag == binary_format::COMMENT_RECORD) {
+      std::uint64_t size = 0;
+      if (!binary_format::read_le(in, size))
+        break;
+      std::string line(size, '\0');
+      if (size > 0 && !in.read(&line[0], size))
+        break;
+      if (line.find("Adaptation terminated") != std::string::npos)
+        in_adaptation = true;
+      if (in_adaptation) {
+        adaptation << "# " << line << "\n";
+      }
+      if (line.find("(Warm-up)") != std::string::npos) {
+        result.timing.warmup = internal::parse_elapsed_seconds(line);
+      } else if (line.find("(Sampling)") != std::string::npos) {
+        result.timing.sampling = internal::parse_elapsed_seconds(line);
+      }
+    } else {
+      msg << "Corrupt record in binary output file: \"" << fname << "\""
+          << std::endl;
+      throw std::invalid_argument(msg.str());
+    }
+  }
+  if (!adaptation.str().empty()) {
+    stan::io::stan_csv_reader::read_adaptation(adaptation, result.adaptation);
+  }
+
+  // as in the Stan CSV reader, saved warmup draws are not returned
+  size_t skip_rows = 0;
+  if (result.metadata.save_warmup && result.metadata.thin > 0) {
+    skip_rows = (result.metadata.num_warmup + result.metadata.thin - 1)
+                / result.metadata.thin;
+    skip_rows = std::min(skip_rows, num_rows);
+  }
+  result.samples.resize(num_rows - skip_rows, result.header.size());
+  size_t row = 0;
+  for (const auto &chunk : chunks) {
+    for (Eigen::Index i = 0; i < chunk.rows(); ++i, ++row) {
+      if (row >= skip_rows) {
+        result.samples.row(row - skip_rows) = chunk.row(i);
+      }
+    }
+  }
+  return result;
+}
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,217 @@
+#ifndef CMDSTAN_BINARY_WRITER_HPP
+#define CMDSTAN_BINARY_WRITER_HPP
+
+#include <cmdstan/binary_format.hpp>
+#include <cmdstan/compression.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * Writer which stores draws in the binary columnar format described in
+ * `binary_format.hpp` instead of as CSV text.
+ *
+ * Messages received before the column names are the config comments and
+ * go into the JSON header.  Draws are buffered and written as one
+ * column-major chunk of roughly `chunk_bytes` bytes; messages received
+ * after the header (adaptation info, timing) are written as comment
+ * records, in order with the draws around them.
+ */
+class binary_writer : public stan::callbacks::writer {
+ public:
+  /**
+   * Construct a binary writer.
+   *
+   * @param output stream to write to, opened in binary mode
+   * @param chunk_bytes target size of a draws chunk
+   */
+  explicit binary_writer(std::unique_ptr<std::ostream> &&output,
+                         size_t chunk_bytes = 1 << 20)
+      : output_(std::move(output)), chunk_bytes_(chunk_bytes) {}
+
+  binary_writer(binary_writer &&other) = default;
+
+  /**
+   * Writes any buffered draws.  Errors can't be reported from here; the
+   * stream's badbit is the only trace of a failed final write.
+   */
+  ~binary_writer() {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  using stan::callbacks::writer::operator();
+
+  /**
+   * Write the header, which fixes the number of columns of all draws.
+   *
+   * @param names column names
+   */
+  void operator()(const std::vector<std::string> &names) {
+    if (header_written_) {
+      return;
+    }
+    names_ = names;
+    write_header();
+  }
+
+  /**
+   * Buffer a single draw.
+   *
+   * @param state values of the draw, one per column
+   */
+  void operator()(const std::vector<double> &state) {
+    if (!header_written_) {
+      write_header();
+    }
+    if (num_cols_ == 0) {
+      num_cols_ = state.size();
+    } else if (state.size() != num_cols_) {
+      flush_draws();
+      num_cols_ = state.size();
+    }
+    buffer_.insert(buffer_.end(), state.begin(), state.end());
+    ++num_rows_;
+    if (buffer_.size() * sizeof(double) >= chunk_bytes_) {
+      flush_draws();
+    }
+  }
+
+  /**
+   * Buffer each row of a matrix as a draw.
+   *
+   * @param values matrix of draws, one draw per row
+   */
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, -1, -1>> &values) {
+    std::vector<double> row(values.cols());
+    for (Eigen::Index i = 0; i < values.rows(); ++i) {
+      for (Eigen::Index j = 0; j < values.cols(); ++j) {
+        row[j] = values(i, j);
+      }
+      (*this)(row);
+    }
+  }
+
+  /**
+   * Write an empty comment.
+   */
+  void operator()() { (*this)(std::string()); }
+
+  /**
+   * Write a comment.  Comments before the header become part of the config.
+   *
+   * @param message comment text
+   */
+  void operator()(const std::string &message) {
+    if (output_ == nullptr) {
+      return;
+    }
+    if (!header_written_) {
+      config_.push_back(message);
+      return;
+    }
+    flush_draws();
+    output_->put(binary_format::COMMENT_RECORD);
+    binary_format::write_le<std::uint64_t>(*output_, message.size());
+    output_->write(message.data(), message.size());
+  }
+
+  /**
+   * Write buffered draws and flush the stream, without closing the
+   * output.
+   */
+  void flush() {
+    if (output_ == nullptr || !header_written_) {
+      return;
+    }
+    flush_draws();
+    compression::flush(*output_);
+  }
+
+  /**
+   * Write buffered draws and flush the stream.  A header is written if
+   * there is none yet so that even an empty run leaves a valid file.
+   */
+  void close() {
+    if (output_ == nullptr) {
+      return;
+    }
+    if (!header_written_) {
+      write_header();
+    }
+    flush_draws();
+    output_->flush();
+  }
+
+ private:
+  std::unique_ptr<std::ostream> output_;
+  size_t chunk_bytes_;
+  bool header_written_ = false;
+  std::vector<std::string> config_;
+  std::vector<std::string> names_;
+  size_t num_cols_ = 0;
+  size_t num_rows_ = 0;
+  std::vector<double> buffer_;  // row-major, num_rows_ x num_cols_
+
+  void write_header() {
+    header_written_ = true;
+    if (output_ == nullptr) {
+      return;
+    }
+    std::string json("{\"version\": ");
+    json += std::to_string(binary_format::VERSION);
+    json += ", \"config\": [";
+    for (size_t i = 0; i < config_.size(); ++i) {
+      if (i > 0)
+        json += ", ";
+      binary_format::append_json_string(json, config_[i]);
+    }
+    json += "], \"columns\": [";
+    for (size_t i = 0; i < names_.size(); ++i) {
+      if (i > 0)
+        json += ", ";
+      binary_format::append_json_string(json, names_[i]);
+    }
+    json += "]}";
+    output_->write(binary_format::MAGIC, sizeof(binary_format::MAGIC));
+    binary_format::write_le<std::uint32_t>(*output_, binary_format::VERSION);
+    binary_format::write_le<std::uint64_t>(*output_, json.size());
+    output_->write(json.data(), json.size());
+    config_.clear();
+  }
+
+  /**
+   * Transpose the buffered draws into a column-major chunk and write it.
+   */
+  void flush_draws() {
+    if (num_rows_ == 0 || output_ == nullptr) {
+      return;
+    }
+    std::vector<char> chunk(num_rows_ * num_cols_ * sizeof(double));
+    char *pos = chunk.data();
+    for (size_t j = 0; j < num_cols_; ++j) {
+      for (size_t i = 0; i < num_rows_; ++i) {
+        binary_format::encode_le(buffer_[i * num_cols_ + j], pos);
+        pos += sizeof(double);
+      }
+    }
+    output_->put(binary_format::DRAWS_RECORD);
+    binary_format::write_le<std::uint64_t>(*output_, num_rows_);
+    binary_format::write_le<std::uint64_t>(*output_, num_cols_);
+    output_->write(chunk.data(), chunk.size());
+    buffer_.clear();
+    num_rows_ = 0;
+  }
+};
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,520 @@
+#ifndef CMDSTAN_CHECKPOINT_HPP
+#define CMDSTAN_CHECKPOINT_HPP
+
+#include <cmdstan/binary_format.hpp>
+#include <cmdstan/draws_reader.hpp>
+#include <cmdstan/output_writer.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/io/ends_with.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cmdstan {
+
+namespace checkpoint_format {
+constexpr char MAGIC[8] = {'S', 'T', 'A', 'N', 'C', 'K', 'P', 'T'};
+constexpr std::uint32_t VERSION = 1;
+}  // namespace checkpoint_format
+
+/**
+ * Sampler state of one chain after adaptation, as saved in a checkpoint
+ * file.  The state is recovered from the chain's output: the step size
+ * and inverse metric from the adaptation comments and the position from
+ * the parameter values of the last draw.
+ */
+struct chain_checkpoint {
+  enum metric_t : std::uint8_t { UNIT_E = 0, DIAG_E = 1, DENSE_E = 2 };
+  std::uint64_t num_rows = 0;         // draws in the output file
+  std::uint64_t num_warmup_rows = 0;  // of which saved warmup draws
+  double stepsize = 0;
+  metric_t metric = UNIT_E;
+  std::vector<double> inv_metric;  // diagonal, or dense in row-major order
+  std::vector<double> params;      // constrained parameters of last draw
+
+  /**
+   * Return the number of sampling draws in the output file.
+   */
+  std::uint64_t num_sampling_rows() const {
+    return num_rows - num_warmup_rows;
+  }
+};
+
+/**
+ * Write a checkpoint in its binary format.
+ *
+ * @param out stream to write to
+ * @param state checkpoint
+ */
+inline void write_checkpoint(std::ostream &out, const chain_checkpoint &state) {
+  out.write(checkpoint_format::MAGIC, sizeof(checkpoint_format::MAGIC));
+  binary_format::write_le<std::uint32_t>(out, checkpoint_format::VERSION);
+  binary_format::write_le<std::uint64_t>(out, state.num_rows);
+  binary_format::write_le<std::uint64_t>(out, state.num_warmup_rows);
+  binary_format::write_le<double>(out, state.stepsize);
+  out.put(static_cast<char>(state.metric));
+  for (const auto *values : {&state.inv_metric, &state.params}) {
+    binary_format::write_le<std::uint64_t>(out, values->size());
+    for (double x : *values) {
+      binary_format::write_le<double>(out, x);
+    }
+  }
+}
+
+/**
+ * Read a checkpoint file.
+ *
+ * @param fname name of file
+ * @return checkpoint
+ * @throw std::invalid_argument if the file can't be read or isn't a
+ *   checkpoint
+ */
+inline chain_checkpoint read_checkpoint(const std::string &fname) {
+  std::ifstream in(fname, std::ios::binary);
+  if (!in.is_open()) {
+    throw std::invalid_argument("Can't open checkpoint file \"" + fname
+                                + "\"");
+  }
+  std::string bad_file("Corrupt checkpoint file \"" + fname + "\"");
+  char magic[sizeof(checkpoint_format::MAGIC)];
+  std::uint32_t version = 0;
+  if (!in.read(magic, sizeof(magic))
+      || !std::equal(magic, magic + sizeof(magic), checkpoint_format::MAGIC)
+      || !binary_format::read_le(in, version)) {
+    throw std::invalid_argument(bad_file);
+  }
+  if (version != checkpoint_format::VERSION) {
+    throw std::invalid_argument("Unsupported version " + std::to_string(version)
+                                + " of checkpoint file \"" + fname + "\"");
+  }
+  chain_checkpoint state;
+  char metric;
+  if (!binary_format::read_le(in, state.num_rows)
+      || !binary_format::read_le(in, state.num_warmup_rows)
+      || !binary_format::read_le(in, state.stepsize) || !in.get(metric)
+      || metric > chain_checkpoint::DENSE_E
+      || state.num_warmup_rows > state.num_rows) {
+    throw std::invalid_argument(bad_file);
+  }
+  state.metric = static_cast<chain_checkpoint::metric_t>(metric);
+  for (auto *values : {&state.inv_metric, &state.params}) {
+    std::uint64_t size = 0;
+    if (!binary_format::read_le(in, size) || size > (1ULL << 32)) {
+      throw std::invalid_argument(bad_file);
+    }
+    values->resize(size);
+    for (double &x : *values) {
+      if (!binary_format::read_le(in, x)) {
+        throw std::invalid_argument(bad_file);
+      }
+    }
+  }
+  return state;
+}
+
+/**
+ * Background thread which writes checkpoint files, so that chains only
+ * hand over their state and don't wait on the file system.
+ *
+ * Only the latest state posted for a file is written; older states
+ * still pending are replaced.  Each file is written under a temporary
+ * name and renamed, so that a run killed while writing leaves the
+ * previous checkpoint intact.
+ */
+class checkpoint_thread {
+ public:
+  checkpoint_thread() : thread_([this] { run(); }) {}
+
+  checkpoint_thread(const checkpoint_thread &) = delete;
+  checkpoint_thread &operator=(const checkpoint_thread &) = delete;
+
+  ~checkpoint_thread() {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  /**
+   * Queue a checkpoint for writing.
+   *
+   * @param fname name of checkpoint file
+   * @param state checkpoint
+   */
+  void post(const std::string &fname, chain_checkpoint &&state) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto &pending : pending_) {
+        if (pending.first == fname) {
+          pending.second = std::move(state);
+          return;
+        }
+      }
+      pending_.emplace_back(fname, std::move(state));
+    }
+    cv_.notify_one();
+  }
+
+  /**
+   * Write the pending checkpoints, stop the thread and rethrow the first
+   * error raised while writing.
+   */
+  void close() {
+    if (thread_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      cv_.notify_one();
+      thread_.join();
+    }
+    if (error_) {
+      std::exception_ptr error = error_;
+      error_ = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::pair<std::string, chain_checkpoint>> pending_;
+  bool stop_ = false;
+  std::exception_ptr error_;
+  std::thread thread_;
+
+  void run() {
+    while (true) {
+      std::vector<std::pair<std::string, chain_checkpoint>> pending;
+      bool stopping;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+        pending.swap(pending_);
+        stopping = stop_;
+      }
+      for (auto &checkpoint : pending) {
+        if (error_) {
+          break;
+        }
+        try {
+          write(checkpoint.first, checkpoint.second);
+        } catch (...) {
+          error_ = std::current_exception();
+        }
+      }
+      if (stopping) {
+        return;
+      }
+    }
+  }
+
+  static void write(const std::string &fname, const chain_checkpoint &state) {
+    std::string tmp_name = fname + ".tmp";
+    {
+      std::ofstream out(tmp_name, std::ios::binary | std::ios::trunc);
+      write_checkpoint(out, state);
+      out.close();
+      if (!out) {
+        throw std::runtime_error("Can't write checkpoint file \"" + tmp_name
+                                 + "\"");
+      }
+    }
+    // std::rename doesn't replace an existing file on Windows
+    if (std::rename(tmp_name.c_str(), fname.c_str()) != 0
+        && (std::remove(fname.c_str()) != 0
+            || std::rename(tmp_name.c_str(), fname.c_str()) != 0)) {
+      throw std::runtime_error("Can't replace checkpoint file \"" + fname
+                               + "\"");
+    }
+  }
+};
+
+/**
+ * Writer which forwards a chain's output and saves a checkpoint of the
+ * chain every `every` sampling draws.
+ *
+ * The step size and inverse metric are taken from the comments which
+ * the sampler writes once adaptation has ended, and the position from
+ * the parameter columns of the draw at which the checkpoint is taken.
+ * The output is flushed before the checkpoint is posted, so the output
+ * file always holds at least the draws counted by the checkpoint file.
+ *
+ * A writer resuming from a checkpoint first copies the draws counted by
+ * that checkpoint from the interrupted output: the warmup draws after
+ * the header and the sampling draws before the first new draw.  The
+ * adaptation comments are written from the checkpoint between them,
+ * as the resumed chain runs without adaptation.
+ */
+class checkpoint_writer : public stan::callbacks::writer {
+ public:
+  /**
+   * Construct a checkpointing writer.
+   *
+   * @param io thread which writes the checkpoint files
+   * @param fname name of this chain's checkpoint file
+   * @param every number of sampling draws between checkpoints
+   * @param num_params number of constrained model parameters
+   * @param draw_stepsize if true, the step size is taken from the
+   *   `stepsize__` column of the draws rather than from the comments,
+   *   which round it; only valid without step size jitter
+   * @param target writer which receives the output
+   */
+  checkpoint_writer(std::shared_ptr<checkpoint_thread> io, std::string fname,
+                    size_t every, size_t num_params, bool draw_stepsize,
+                    output_writer &&target)
+      : io_(std::move(io)),
+        fname_(std::move(fname)),
+        every_(every),
+        num_params_(num_params),
+        draw_stepsize_(draw_stepsize),
+        target_(std::move(target)) {}
+
+  /**
+   * Resume from a checkpoint, copying draws from an interrupted output.
+   *
+   * @param state checkpoint to resume from
+   * @param interrupted_file output file of the interrupted run
+   */
+  void resume(const chain_checkpoint &state,
+              const std::string &interrupted_file) {
+    resume_ = state;
+    previous_ = std::make_unique<draws_reader>(interrupted_file);
+  }
+
+  void operator()(const std::vector<std::string> &names) {
+    target_(names);
+    stepsize_col_ = names.size();
+    param_col_ = names.size();
+    for (size_t j = 0; j < names.size(); ++j) {
+      if (names[j] == "stepsize__") {
+        stepsize_col_ = j;
+      }
+      if (!stan::io::ends_with("__", names[j])) {
+        param_col_ = j;
+        break;
+      }
+    }
+    if (previous_) {
+      if (previous_->header() != names) {
+        throw std::invalid_argument(
+            "Columns of interrupted output \"" + previous_->filename()
+            + "\" don't match the model, can't resume sampling.");
+      }
+      copy_previous(resume_.num_warmup_rows);
+      // the resumed chain has no warmup
+      adapted_ = true;
+      state_.stepsize = resume_.stepsize;
+      state_.metric = resume_.metric;
+      state_.inv_metric = resume_.inv_metric;
+      write_adaptation();
+    }
+  }
+
+  void operator()(const std::vector<double> &state) {
+    if (previous_) {
+      copy_previous(resume_.num_sampling_rows());
+      previous_.reset();
+    }
+    target_(state);
+    count(state);
+  }
+
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, -1, -1>> &values) {
+    target_(values);
+  }
+
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, 1, -1>> &values) {
+    target_(values);
+  }
+
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, -1, 1>> &values) {
+    target_(values);
+  }
+
+  void operator()() { target_(); }
+
+  void operator()(const std::string &message) {
+    target_(message);
+    if (message == "Adaptation terminated") {
+      adapted_ = true;
+      state_.metric = chain_checkpoint::UNIT_E;
+      state_.inv_metric.clear();
+      reading_metric_ = false;
+      return;
+    }
+    if (!adapted_ || sampling_) {
+      return;
+    }
+    const std::string stepsize_prefix("Step size = ");
+    if (message.compare(0, stepsize_prefix.size(), stepsize_prefix) == 0) {
+      state_.stepsize = std::stod(message.substr(stepsize_prefix.size()));
+    } else if (message == "Diagonal elements of inverse mass matrix:") {
+      state_.metric = chain_checkpoint::DIAG_E;
+      reading_metric_ = true;
+    } else if (message == "Elements of inverse mass matrix:") {
+      state_.metric = chain_checkpoint::DENSE_E;
+      reading_metric_ = true;
+    } else if (reading_metric_ && !parse_values(message, state_.inv_metric)) {
+      reading_metric_ = false;
+    }
+  }
+
+  /**
+   * Copy the rest of the interrupted output if the chain ended without
+   * writing another draw, then save a final checkpoint.
+   */
+  void finish() {
+    if (previous_) {
+      copy_previous(resume_.num_sampling_rows());
+      previous_.reset();
+    }
+    if (sampling_ && state_.num_rows != last_posted_) {
+      post();
+    }
+  }
+
+ private:
+  std::shared_ptr<checkpoint_thread> io_;
+  std::string fname_;
+  size_t every_;
+  size_t num_params_;
+  bool draw_stepsize_;
+  output_writer target_;
+  chain_checkpoint state_;
+  chain_checkpoint resume_;
+  std::unique_ptr<draws_reader> previous_;
+  size_t stepsize_col_ = 0;
+  size_t param_col_ = 0;
+  bool adapted_ = false;
+  bool sampling_ = false;
+  bool reading_metric_ = false;
+  std::uint64_t last_posted_ = 0;
+
+  void count(const std::vector<double> &draw) {
+    ++state_.num_rows;
+    if (!adapted_) {
+      ++state_.num_warmup_rows;
+      return;
+    }
+    if (!sampling_) {
+      sampling_ = true;
+      if (draw_stepsize_ && stepsize_col_ < draw.size()) {
+        state_.stepsize = draw[stepsize_col_];
+      }
+    }
+    if (param_col_ + num_params_ <= draw.size()) {
+      state_.params.assign(draw.begin() + param_col_,
+                           draw.begin() + param_col_ + num_params_);
+    }
+    if (state_.num_sampling_rows() % every_ == 0) {
+      post();
+    }
+  }
+
+  void post() {
+    target_.flush();
+    last_posted_ = state_.num_rows;
+    io_->post(fname_, chain_checkpoint(state_));
+  }
+
+  /**
+   * Write the adaptation comments of the checkpoint, as the sampler
+   * writes them at the end of warmup.
+   */
+  void write_adaptation() {
+    target_("Adaptation terminated");
+    std::stringstream stepsize;
+    stepsize << "Step size = " << state_.stepsize;
+    target_(stepsize.str());
+    if (state_.metric == chain_checkpoint::UNIT_E) {
+      target_("No free parameters for unit metric");
+      return;
+    }
+    size_t num_cols = state_.inv_metric.size();
+    if (state_.metric == chain_checkpoint::DIAG_E) {
+      target_("Diagonal elements of inverse mass matrix:");
+    } else {
+      target_("Elements of inverse mass matrix:");
+      num_cols = std::lround(std::sqrt(state_.inv_metric.size()));
+    }
+    for (size_t i = 0; i < state_.inv_metric.size(); i += num_cols) {
+      std::stringstream row;
+      for (size_t j = 0; j < num_cols; ++j) {
+        row << (j > 0 ? ", " : "") << state_.inv_metric[i + j];
+      }
+      target_(row.str());
+    }
+  }
+
+  void copy_previous(std::uint64_t num_draws) {
+    std::vector<double> draws;
+    const size_t num_cols = previous_->header().size();
+    while (num_draws > 0) {
+      size_t num_read
+          = previous_->read(std::min<std::uint64_t>(num_draws, 1000), draws);
+      if (num_read == 0) {
+        throw std::invalid_argument(
+            "Interrupted output \"" + previous_->filename()
+            + "\" holds fewer draws than its checkpoint, can't resume "
+              "sampling.");
+      }
+      std::vector<double> draw(num_cols);
+      for (size_t i = 0; i < num_read; ++i) {
+        std::copy(draws.begin() + i * num_cols,
+                  draws.begin() + (i + 1) * num_cols, draw.begin());
+        target_(draw);
+        count(draw);
+      }
+      num_draws -= num_read;
+    }
+  }
+
+  /**
+   * Parse a comment line of comma-separated numbers.
+   *
+   * @param line comment line
+   * @param[in,out] values numbers are appended
+   * @return false if the line isn't a list of numbers
+   */
+  static bool parse_values(const std::string &line,
+                           std::vector<double> &values) {
+    std::stringstream in(line);
+    std::string item;
+    size_t num_values = 0;
+    while (std::getline(in, item, ',')) {
+      try {
+        size_t end = 0;
+        double x = std::stod(item, &end);
+        if (item.find_first_not_of(" \t", end) != std::string::npos) {
+          break;
+        }
+        values.push_back(x);
+        ++num_values;
+      } catch (const std::exception &e) {
+        break;
+      }
+    }
+    if (num_values == 0 || in) {
+      values.resize(values.size() - num_values);
+      return false;
+    }
+    return true;
+  }
+};
+
+}  // namespace cmdstan
+#endif
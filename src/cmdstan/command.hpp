@@ -10,31 +10,39 @@
 #include <cmdstan/arguments/arg_opencl.hpp>
 #include <cmdstan/arguments/arg_profile_file.hpp>
 #include <cmdstan/arguments/argument_parser.hpp>
+#include <cmdstan/async_writer.hpp>
+#include <cmdstan/binary_format.hpp>
+#include <cmdstan/checkpoint.hpp>
 #include <cmdstan/command_helper.hpp>
+#include <cmdstan/compression.hpp>
+#include <cmdstan/convergence_monitor.hpp>
+#include <cmdstan/csv_writer.hpp>
+#include <cmdstan/output_writer.hpp>
+#include <cmdstan/param_matrix.hpp>
 #include <cmdstan/return_codes.hpp>
+#include <cmdstan/server.hpp>
 #include <cmdstan/write_model.hpp>
 #include <cmdstan/write_stan.hpp>
 #include <cmdstan/write_config.hpp>
 #include <stan/math/prim/fun/Eigen.hpp>
 #include <stan/math/prim/core/init_threadpool_tbb.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 #include <stan/callbacks/interrupt.hpp>
 #include <stan/callbacks/json_writer.hpp>
 #include <stan/callbacks/logger.hpp>
 #include <stan/callbacks/stream_logger.hpp>
 #include <stan/callbacks/stream_writer.hpp>
-#include <stan/callbacks/unique_stream_writer.hpp>
 #include <stan/callbacks/writer.hpp>
 #include <stan/io/dump.hpp>
 #include <stan/io/ends_with.hpp>
 #include <stan/io/stan_csv_reader.hpp>
 #include <stan/io/json/json_data.hpp>
 #include <stan/model/model_base.hpp>
-#include <stan/services/diagnose/diagnose.hpp>
 #include <stan/services/experimental/advi/fullrank.hpp>
 #include <stan/services/experimental/advi/meanfield.hpp>
 #include <stan/services/optimize/bfgs.hpp>
 #include <stan/services/optimize/lbfgs.hpp>
-#include <stan/services/optimize/laplace_sample.hpp>
 #include <stan/services/optimize/newton.hpp>
 #include <stan/services/pathfinder/multi.hpp>
 #include <stan/services/pathfinder/single.hpp>
@@ -65,6 +73,8 @@
 #include <stan/math/prim/functor/mpi_cluster.hpp>
 #include <stan/math/prim/functor/mpi_command.hpp>
 #include <stan/math/prim/functor/mpi_distributed_apply.hpp>
+#include <cmdstan/mpi_convergence_exchange.hpp>
+#include <boost/mpi/environment.hpp>
 #endif
 
 // forward declaration for function defined in another translation unit
@@ -76,23 +86,50 @@ namespace cmdstan {
 
 #ifdef STAN_MPI
 stan::math::mpi_cluster &get_mpi_cluster() {
+  // MPI is initialized before the cluster, so that the chains spread
+  // over processes can share their convergence checks from any thread
+  static boost::mpi::environment env(boost::mpi::threading::serialized);
   static stan::math::mpi_cluster cluster;
   return cluster;
 }
 #endif
 
-int command(int argc, const char *argv[]) {
-  stan::callbacks::stream_writer info(std::cout);
-  stan::callbacks::stream_writer err(std::cerr);
-  stan::callbacks::stream_logger logger(std::cout, std::cout, std::cout,
-                                        std::cerr, std::cerr);
-
+/**
+ * Run the model executable with command line arguments.
+ *
+ * @param argc number of arguments
+ * @param argv arguments, starting with the name of the executable
+ * @param models models held by a server for reuse, or nullptr to
+ *   instantiate the model for this run only
+ * @param job data and output files if this is one run of a batch,
+ *   otherwise nullptr
+ * @return return code
+ */
+int command(int argc, const char *argv[], model_cache *models = nullptr,
+            const batch_job *job = nullptr) {
+  std::ofstream log_stream;
+  if (job != nullptr) {
+    log_stream.open(job->log_file);
+    if (!log_stream.is_open()) {
+      throw std::invalid_argument("Can't create log file \"" + job->log_file
+                                  + "\"");
+    }
+  }
 #ifdef STAN_MPI
   stan::math::mpi_cluster &cluster = get_mpi_cluster();
-  cluster.listen();
-  if (cluster.rank_ != 0)
-    return 0;
+  // all processes read the arguments, only the first one reports
+  bool quiet = cluster.rank_ != 0;
+#else
+  bool quiet = false;
 #endif
+  std::ostream null_stream(nullptr);
+  std::ostream &console
+      = job != nullptr ? log_stream : quiet ? null_stream : std::cout;
+  std::ostream &console_err = job != nullptr ? log_stream : std::cerr;
+  stan::callbacks::stream_writer info(console);
+  stan::callbacks::stream_writer err(quiet ? null_stream : console_err);
+  stan::callbacks::stream_logger logger(console, console, console, console_err,
+                                        console_err);
 
   // Read arguments
   std::vector<argument *> valid_arguments;
@@ -107,8 +144,11 @@ int command(int argc, const char *argv[]) {
 #endif
   argument_parser parser(valid_arguments);
   int err_code = parser.parse_args(argc, argv, info, err);
+  if (job != nullptr && err_code == 0) {
+    apply_batch_job(parser, *job);
+  }
   if (err_code == stan::services::error_codes::USAGE) {
-    if (argc > 1)
+    if (argc > 1 && !quiet)
       std::cerr << "Failed to parse command arguments, cannot run model."
                 << std::endl;
     return return_codes::NOT_OK;
@@ -119,6 +159,30 @@ int command(int argc, const char *argv[]) {
   if (parser.help_printed())
     return return_codes::OK;
 
+  bool mpi_chains
+      = parser.arg("method")->arg("sample")
+        && get_arg_val<bool_argument>(parser, "method", "sample",
+                                      "mpi_chains");
+  // a process running one chain of several names its files by the chain id
+  bool number_chains = false;
+#ifdef STAN_MPI
+  if (mpi_chains) {
+    // each process runs its own chains on its own threads
+    number_chains
+        = apply_mpi_chains(parser, cluster.rank_, cluster.world_.size());
+  } else {
+    // the other processes serve the first one, e.g. for map_rect
+    cluster.listen();
+    if (cluster.rank_ != 0)
+      return 0;
+  }
+#else
+  if (mpi_chains) {
+    throw std::invalid_argument(
+        "Argument 'mpi_chains' requires a model built with STAN_MPI.");
+  }
+#endif
+
 #ifdef STAN_OPENCL
   int opencl_device_id = get_arg_val<int_argument>(parser, "opencl", "device");
   int opencl_platform_id
@@ -146,6 +210,103 @@ int command(int argc, const char *argv[]) {
     }
   }
   stan::math::init_threadpool_tbb(num_threads);
+  if (parser.arg("method")->arg("server")) {
+    if (models != nullptr) {
+      throw std::invalid_argument(
+          "A server job can't run the server method.");
+    }
+#ifdef STAN_MPI
+    throw std::invalid_argument(
+        "The server method is not available with MPI.");
+#endif
+    model_cache server_models(
+        [](const std::string &data_file, unsigned int seed) {
+          return std::unique_ptr<stan::model::model_base>(
+              &new_model(*get_var_context(data_file), seed, &std::cout));
+        },
+        get_arg_val<int_argument>(parser, "method", "server", "max_models"),
+        dynamic_cast<arg_seed *>(parser.arg("random")->arg("seed"))
+            ->random_value());
+    job_runner run_job = [&](const std::vector<std::string> &args) {
+      std::vector<const char *> job_argv{argv[0]};
+      for (const auto &arg : args) {
+        job_argv.push_back(arg.c_str());
+      }
+      return command(job_argv.size(), job_argv.data(), &server_models);
+    };
+    std::string socket
+        = get_arg_val<string_argument>(parser, "method", "server", "socket");
+    if (socket.empty()) {
+      serve_stdin(run_job);
+    } else {
+      serve_socket(socket, run_job);
+    }
+    for (size_t i = 0; i < valid_arguments.size(); ++i) {
+      delete valid_arguments.at(i);
+    }
+    return return_codes::OK;
+  }
+  if (!get_arg_val<string_argument>(parser, "data", "batch_file").empty()) {
+#ifdef STAN_MPI
+    throw std::invalid_argument(
+        "Argument 'batch_file' is not available with MPI.");
+#endif
+    std::vector<batch_job> jobs = read_batch_jobs(parser);
+    std::vector<int> job_codes(jobs.size(), return_codes::NOT_OK);
+    std::vector<std::string> job_errors(jobs.size());
+    auto run_job = [&](size_t i) {
+      try {
+        job_codes[i] = command(argc, argv, nullptr, &jobs[i]);
+      } catch (const std::exception &e) {
+        job_errors[i] = e.what();
+      }
+    };
+    // all runs record their profiles in the one global map, so if the
+    // first run shows that the model is profiled, the runs go one at a
+    // time and each writes only its own profiles
+    stan::math::profile_map &profile_data = get_stan_profile_data();
+    run_job(0);
+    if (profile_data.size() > 0) {
+      profile_data.clear();
+      for (size_t i = 1; i < jobs.size(); ++i) {
+        run_job(i);
+        profile_data.clear();
+      }
+    } else {
+      // one data file per task, so that idle threads steal the remaining
+      // runs
+      tbb::parallel_for(tbb::blocked_range<size_t>(1, jobs.size(), 1),
+                        [&](const tbb::blocked_range<size_t> &r) {
+                          for (size_t i = r.begin(); i < r.end(); ++i) {
+                            run_job(i);
+                          }
+                        });
+    }
+    size_t num_failed = 0;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      if (job_codes[i] != return_codes::OK) {
+        ++num_failed;
+        std::cerr << "Run for data file " << jobs[i].data_file
+                  << " failed, see " << jobs[i].log_file << ". "
+                  << job_errors[i] << std::endl;
+      }
+    }
+    std::cout << "Completed " << jobs.size() - num_failed << " of "
+              << jobs.size() << " runs." << std::endl;
+    for (size_t i = 0; i < valid_arguments.size(); ++i) {
+      delete valid_arguments.at(i);
+    }
+    return num_failed == 0 ? return_codes::OK : return_codes::NOT_OK;
+  }
+  if (models != nullptr) {
+    // a server job without a seed takes the server's, otherwise every
+    // such job would draw its own seed and never reuse a model
+    arg_seed *job_seed
+        = dynamic_cast<arg_seed *>(parser.arg("random")->arg("seed"));
+    if (job_seed->is_default()) {
+      job_seed->set_value(models->seed());
+    }
+  }
   unsigned int id = get_arg_val<int_argument>(parser, "id");
   unsigned int num_chains = get_num_chains(parser, id);
   check_file_config(parser);
@@ -164,11 +325,18 @@ int command(int argc, const char *argv[]) {
 
   std::string filename = get_arg_val<string_argument>(parser, "data", "file");
 
-  std::shared_ptr<stan::io::var_context> var_context
-      = get_var_context(filename);
-
+  // the models of batch jobs are freed with the job, a single run's
+  // model lives until the process ends
+  std::unique_ptr<stan::model::model_base> job_model;
+  if (models == nullptr && job != nullptr) {
+    job_model.reset(
+        &new_model(*get_var_context(filename), random_seed, &console));
+  }
   stan::model::model_base &model
-      = new_model(*var_context, random_seed, &std::cout);
+      = models != nullptr ? models->get(filename, random_seed)
+        : job_model     ? *job_model
+                        : new_model(*get_var_context(filename), random_seed,
+                                    &console);
 
   std::stringstream msg;
 
@@ -182,19 +350,45 @@ int command(int argc, const char *argv[]) {
       = get_arg_val<string_argument>(parser, "output", "file");
   std::string diagnostic_file
       = get_arg_val<string_argument>(parser, "output", "diagnostic_file");
+  bool binary_output
+      = get_arg_val<list_argument>(parser, "output", "format") == "binary";
+  if (binary_output && user_method->arg("pathfinder")) {
+    msg << "Output format 'binary' is not available for the pathfinder "
+        << "method." << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  compression::options compression_opts = get_compression_options(parser);
+  bool async_output = get_arg_val<bool_argument>(parser, "output", "async");
+  if (async_output
+      && (user_method->arg("pathfinder") || user_method->arg("log_prob"))) {
+    msg << "Output option 'async' is not available for the "
+        << (user_method->arg("pathfinder") ? "pathfinder" : "log_prob")
+        << " method." << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
 
-  stan::callbacks::interrupt interrupt;
+  stan::callbacks::interrupt default_interrupt;
   stan::callbacks::json_writer<std::ofstream> dummy_json_writer;  // pathfinder
   stan::callbacks::writer init_writer;  // unused - save param initializations
   std::vector<stan::callbacks::writer> init_writers{num_chains,
                                                     stan::callbacks::writer{}};
-  std::vector<stan::callbacks::unique_stream_writer<std::ofstream>>
-      sample_writers;
-  std::vector<stan::callbacks::unique_stream_writer<std::ofstream>>
-      diagnostic_csv_writers;
+  std::vector<output_writer> sample_writers;
+  std::vector<output_writer> diagnostic_csv_writers;
   std::vector<stan::callbacks::json_writer<std::ofstream>>
       diagnostic_json_writers;
   std::vector<stan::callbacks::json_writer<std::ofstream>> metric_json_writers;
+  std::shared_ptr<async_writer_thread> async_io;
+  std::shared_ptr<checkpoint_thread> checkpoint_io;
+  std::vector<checkpoint_writer *> checkpoint_writers;
+  std::vector<std::string> interrupted_files;
+  std::vector<chain_checkpoint> resume_from;
+  if (user_method->arg("sample")) {
+    // before the output files of an interrupted run are replaced
+    resume_from = load_checkpoints(parser, num_chains, id, output_file,
+                                   binary_output, compression_opts,
+                                   async_output, interrupted_files,
+                                   number_chains);
+  }
 
   bool save_single_paths
       = user_method->arg("pathfinder")
@@ -206,21 +400,23 @@ int command(int argc, const char *argv[]) {
       diagnostic_file = output_file;
     }
     if (num_chains == 1) {
-      init_filestream_writers(sample_writers, num_chains, id, output_file, "",
-                              ".csv", sig_figs, "# ");
+      init_csv_writers(sample_writers, num_chains, id, output_file, "",
+                       sig_figs, compression_opts);
       if (!diagnostic_file.empty()) {
         save_single_paths = true;
         init_filestream_writers(diagnostic_json_writers, num_chains, id,
-                                diagnostic_file, "", ".json", sig_figs);
+                                number_chains, diagnostic_file, "", ".json",
+                                sig_figs);
       } else {
         init_null_writers(diagnostic_json_writers, num_chains);
       }
     } else {
       if (save_single_paths || !diagnostic_file.empty()) {
-        init_filestream_writers(sample_writers, num_chains, id, output_file,
-                                "_path", ".csv", sig_figs, "# ");
+        init_csv_writers(sample_writers, num_chains, id, output_file, "_path",
+                         sig_figs, compression_opts);
         init_filestream_writers(diagnostic_json_writers, num_chains, id,
-                                diagnostic_file, "_path", ".json", sig_figs);
+                                number_chains, diagnostic_file, "_path",
+                                ".json", sig_figs);
       } else {
         init_null_writers(sample_writers, num_chains);
         init_null_writers(diagnostic_json_writers, num_chains);
@@ -228,24 +424,51 @@ int command(int argc, const char *argv[]) {
     }
     init_null_writers(diagnostic_csv_writers, num_chains);
   } else {
-    init_filestream_writers(sample_writers, num_chains, id, output_file, "",
-                            ".csv", sig_figs, "# ");
+    if (binary_output) {
+      init_binary_writers(sample_writers, num_chains, id, output_file, "",
+                          compression_opts, number_chains);
+    } else {
+      init_csv_writers(sample_writers, num_chains, id, output_file, "",
+                       sig_figs, compression_opts, number_chains);
+    }
     if (!diagnostic_file.empty()) {
       if (user_method->arg("laplace")) {
         init_filestream_writers(diagnostic_json_writers, num_chains, id,
-                                diagnostic_file, "", ".json", sig_figs);
+                                number_chains, diagnostic_file, "", ".json",
+                                sig_figs);
         init_null_writers(diagnostic_csv_writers, num_chains);
 
       } else {
-        init_filestream_writers(diagnostic_csv_writers, num_chains, id,
-                                diagnostic_file, "", ".csv", sig_figs, "# ");
+        init_csv_writers(diagnostic_csv_writers, num_chains, id,
+                         diagnostic_file, "", sig_figs, compression_opts,
+                         number_chains);
         init_null_writers(diagnostic_json_writers, num_chains);
       }
     } else {
       init_null_writers(diagnostic_csv_writers, num_chains);
       init_null_writers(diagnostic_json_writers, num_chains);
     }
+    if (async_output) {
+      async_io = std::make_shared<async_writer_thread>();
+      init_async_writers(sample_writers, async_io);
+      init_async_writers(diagnostic_csv_writers, async_io);
+    }
   }
+  std::shared_ptr<convergence_monitor> monitor;
+  if (user_method->arg("sample")) {
+    checkpoint_writers = init_checkpoint_writers(
+        parser, model, sample_writers, id, resume_from, interrupted_files,
+        checkpoint_io, number_chains);
+    monitor = init_convergence_monitor(parser, sample_writers);
+#ifdef STAN_MPI
+    if (monitor && mpi_chains) {
+      monitor->share(
+          std::make_shared<mpi_convergence_exchange>(cluster.world_));
+    }
+#endif
+  }
+  stan::callbacks::interrupt &interrupt
+      = monitor ? *monitor : default_interrupt;
   if (user_method->arg("sample")
       && get_arg_val<bool_argument>(parser, "method", "sample", "adapt",
                                     "save_metric")) {
@@ -257,8 +480,9 @@ int command(int argc, const char *argv[]) {
           << std::endl;
       throw std::invalid_argument(msg.str());
     }
-    init_filestream_writers(metric_json_writers, num_chains, id, output_file,
-                            "_metric", ".json", sig_figs);
+    init_filestream_writers(metric_json_writers, num_chains, id,
+                            number_chains, output_file, "_metric", ".json",
+                            sig_figs);
   } else {
     init_null_writers(metric_json_writers, num_chains);
   }
@@ -274,11 +498,21 @@ int command(int argc, const char *argv[]) {
   }
 
   std::vector<std::shared_ptr<stan::io::var_context>> init_contexts
-      = get_vec_var_context(init, num_chains, id);
+      = get_vec_var_context(init, num_chains, id, number_chains);
+  context_vector warm_start_metrics;
+  if (user_method->arg("sample")) {
+    // before the config is written, as the warm start changes the warmup
+    warm_start_metrics
+        = apply_warm_start(parser, model, num_chains, id, init_contexts,
+                           number_chains);
+  }
 
-  if (get_arg_val<bool_argument>(parser, "output", "save_cmdstan_config")) {
+  // with mpi_chains, the first process writes the config
+  if (get_arg_val<bool_argument>(parser, "output", "save_cmdstan_config")
+      && !quiet) {
+    std::string output_base = compression::split_suffix(output_file).first;
     auto config_filename
-        = file::get_basename_suffix(output_file).first + "_config.json";
+        = file::get_basename_suffix(output_base).first + "_config.json";
     auto ofs_args = file::safe_create(config_filename, sig_figs);
     stan::callbacks::json_writer<std::ostream> json_args(std::move(ofs_args));
     write_config(json_args, parser, model);
@@ -341,11 +575,14 @@ int command(int argc, const char *argv[]) {
           save_single_paths, refresh, interrupt, logger, init_writer,
           sample_writers[0], diagnostic_json_writers[0], calculate_lp);
     } else {
-      auto output_filenames
-          = file::make_filenames(output_file, "", ".csv", 1, id);
-      auto ofs = file::safe_create(output_filenames[0], sig_figs);
-      stan::callbacks::unique_stream_writer<std::ofstream> pathfinder_writer(
-          std::move(ofs), "# ");
+      auto output_filenames = file::make_filenames(
+          compression::split_suffix(output_file).first, "", ".csv", 1, id);
+      auto ofs = file::safe_create(
+          output_filenames[0] + compression::suffix(compression_opts.codec),
+          sig_figs, compression_opts.codec != "none");
+      csv_writer pathfinder_writer(
+          compression::compress(std::move(ofs), compression_opts), "# ",
+          sig_figs);
       write_config(pathfinder_writer, parser, model);
       return_code = stan::services::pathfinder::pathfinder_lbfgs_multi<
           stan::model::model_base>(
@@ -366,26 +603,22 @@ int command(int argc, const char *argv[]) {
           "Missing fitted_params argument, cannot run generate_quantities "
           "without fitted sample.");
     }
-    auto file_info = file::get_basename_suffix(fname);
-    if (file_info.second != ".csv") {
-      throw std::invalid_argument("Fitted params file must be a CSV file.");
+    auto compressed_info = compression::split_suffix(fname);
+    auto file_info = file::get_basename_suffix(compressed_info.first);
+    if (file_info.second != ".csv"
+        && file_info.second != binary_format::SUFFIX) {
+      throw std::invalid_argument(
+          "Fitted params file must be a CSV or binary output file.");
     }
     std::vector<std::string> fname_vec
-        = file::make_filenames(file_info.first, "", ".csv", num_chains, id);
-    std::vector<std::string> param_names = get_constrained_param_names(model);
-    std::vector<Eigen::MatrixXd> fitted_params_vec;
-    fitted_params_vec.reserve(num_chains);
-    for (int i = 0; i < num_chains; ++i) {
-      stan::io::stan_csv fitted_params;
-      size_t col_offset, num_rows, num_cols;
-      parse_stan_csv(fname_vec[i], model, param_names, fitted_params,
-                     col_offset, num_rows, num_cols);
-      fitted_params_vec.emplace_back(
-          fitted_params.samples.block(0, col_offset, num_rows, num_cols));
-    }
-    return_code = stan::services::standalone_generate(
-        model, num_chains, fitted_params_vec, random_seed, interrupt, logger,
-        sample_writers);
+        = file::make_filenames(file_info.first, "",
+                               file_info.second + compressed_info.second,
+                               num_chains, id);
+    size_t chunk_size = get_arg_val<int_argument>(*gq_arg, "chunk_size");
+    bool parallel_draws = get_arg_val<bool_argument>(*gq_arg, "parallel_draws");
+    return_code = services_generate_quantities(
+        model, fname_vec, random_seed, id, chunk_size, parallel_draws,
+        interrupt, logger, sample_writers);
     // ---- generate_quantities end ---- //
   } else if (user_method->arg("laplace")) {
     // ---- laplace start ---- //
@@ -401,15 +634,10 @@ int command(int argc, const char *argv[]) {
     bool calculate_lp
         = get_arg_val<bool_argument>(*laplace_arg, "calculate_lp");
     int draws = get_arg_val<int_argument>(*laplace_arg, "draws");
-    if (jacobian) {
-      return_code = stan::services::laplace_sample<true>(
-          model, theta_hat, draws, calculate_lp, random_seed, refresh,
-          interrupt, logger, sample_writers[0], diagnostic_json_writers[0]);
-    } else {
-      return_code = stan::services::laplace_sample<false>(
-          model, theta_hat, draws, calculate_lp, random_seed, refresh,
-          interrupt, logger, sample_writers[0], diagnostic_json_writers[0]);
-    }
+    return_code = services_laplace_sample(
+        model, jacobian, theta_hat, draws, calculate_lp, random_seed, id,
+        refresh, interrupt, logger, sample_writers[0],
+        diagnostic_json_writers[0]);
     // ---- laplace end ---- //
   } else if (user_method->arg("log_prob")) {
     // ---- log_prob start ---- //
@@ -419,6 +647,7 @@ int command(int argc, const char *argv[]) {
     std::string cpars_file
         = get_arg_val<string_argument>(*log_prob_arg, "constrained_params");
     bool jacobian = get_arg_val<bool_argument>(*log_prob_arg, "jacobian");
+    bool hessian = get_arg_val<bool_argument>(*log_prob_arg, "hessian");
     if (upars_file.length() == 0 && cpars_file.length() == 0) {
       msg << "No input parameter files provided, "
           << "cannot calculate log probability density.";
@@ -430,7 +659,12 @@ int command(int argc, const char *argv[]) {
       throw std::invalid_argument(msg.str());
     }
     std::vector<std::vector<double>> params_r_ind;
-    if (upars_file.length() > 0) {
+    std::unique_ptr<param_matrix> upars_matrix;
+    std::string upars_suffix = file::get_suffix(upars_file);
+    if (upars_suffix == ".npy" || upars_suffix == ".bin") {
+      upars_matrix
+          = std::make_unique<param_matrix>(upars_file, model.num_params_r());
+    } else if (upars_file.length() > 0) {
       params_r_ind = get_uparams_r(upars_file, model);
     } else if (cpars_file.length() > 0) {
       std::vector<std::string> param_names = get_constrained_param_names(model);
@@ -446,8 +680,14 @@ int command(int argc, const char *argv[]) {
       }
     }
     try {
-      services_log_prob_grad(model, jacobian, params_r_ind, sig_figs,
-                             sample_writers[0].get_stream());
+      if (upars_matrix) {
+        services_log_prob_grad(model, jacobian, hessian, *upars_matrix,
+                               sig_figs, sample_writers[0]);
+      } else {
+        internal::param_rows params_rows(params_r_ind);
+        services_log_prob_grad(model, jacobian, hessian, params_rows,
+                               sig_figs, sample_writers[0]);
+      }
       return_code = return_codes::OK;
     } catch (const std::exception &e) {
       msg << "Error during log_prob calculation:" << std::endl;
@@ -463,9 +703,14 @@ int command(int argc, const char *argv[]) {
     if (test->value() == "gradient") {
       double epsilon = get_arg_val<real_argument>(*test, "gradient", "epsilon");
       double error = get_arg_val<real_argument>(*test, "gradient", "error");
-      return_code = stan::services::diagnose::diagnose(
+      std::string params
+          = get_arg_val<string_argument>(*test, "gradient", "params");
+      int num_params
+          = get_arg_val<int_argument>(*test, "gradient", "num_params");
+      return_code = services_diagnose_gradient(
           model, *(init_contexts[0]), random_seed, id, init_radius, epsilon,
-          error, interrupt, logger, init_writers[0], sample_writers[0]);
+          error, params, num_params, interrupt, logger, init_writers[0],
+          sample_writers[0]);
     }
     // ---- diagnose end ---- //
   } else if (user_method->arg("optimize")) {
@@ -476,77 +721,113 @@ int command(int argc, const char *argv[]) {
         parser, "method", "optimize", "save_iterations");
     bool jacobian
         = get_arg_val<bool_argument>(parser, "method", "optimize", "jacobian");
+    unsigned int num_starts = get_arg_val<int_argument>(
+        parser, "method", "optimize", "num_starts");
     list_argument *algo = dynamic_cast<list_argument *>(
         parser.arg("method")->arg("optimize")->arg("algorithm"));
-    if (algo->value() == "newton") {
-      if (jacobian) {
-        return_code
-            = stan::services::optimize::newton<stan::model::model_base, true>(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_iterations, save_iterations, interrupt, logger,
-                init_writers[0], sample_writers[0]);
-      } else {
-        return_code
-            = stan::services::optimize::newton<stan::model::model_base, false>(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_iterations, save_iterations, interrupt, logger,
-                init_writers[0], sample_writers[0]);
-      }
-    } else if (algo->value() == "bfgs") {
-      double init_alpha
-          = get_arg_val<real_argument>(*algo, "bfgs", "init_alpha");
-      double tol_obj = get_arg_val<real_argument>(*algo, "bfgs", "tol_obj");
-      double tol_rel_obj
-          = get_arg_val<real_argument>(*algo, "bfgs", "tol_rel_obj");
-      double tol_grad = get_arg_val<real_argument>(*algo, "bfgs", "tol_grad");
-      double tol_rel_grad
-          = get_arg_val<real_argument>(*algo, "bfgs", "tol_rel_grad");
-      double tol_param = get_arg_val<real_argument>(*algo, "bfgs", "tol_param");
-
-      if (jacobian) {
-        return_code
-            = stan::services::optimize::bfgs<stan::model::model_base, true>(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                init_alpha, tol_obj, tol_rel_obj, tol_grad, tol_rel_grad,
-                tol_param, num_iterations, save_iterations, refresh, interrupt,
-                logger, init_writers[0], sample_writers[0]);
-      } else {
-        return_code
-            = stan::services::optimize::bfgs<stan::model::model_base, false>(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                init_alpha, tol_obj, tol_rel_obj, tol_grad, tol_rel_grad,
-                tol_param, num_iterations, save_iterations, refresh, interrupt,
-                logger, init_writers[0], sample_writers[0]);
+    std::string algo_name = algo->value();
+    auto optimize = [&](stan::io::var_context &init_context,
+                        unsigned int chain,
+                        stan::callbacks::writer &init_writer,
+                        stan::callbacks::writer &parameter_writer) -> int {
+      if (algo_name == "newton") {
+        if (jacobian) {
+          return stan::services::optimize::newton<stan::model::model_base,
+                                                  true>(
+              model, init_context, random_seed, chain, init_radius,
+              num_iterations, save_iterations, interrupt, logger, init_writer,
+              parameter_writer);
+        }
+        return stan::services::optimize::newton<stan::model::model_base,
+                                                false>(
+            model, init_context, random_seed, chain, init_radius,
+            num_iterations, save_iterations, interrupt, logger, init_writer,
+            parameter_writer);
+      } else if (algo_name == "bfgs") {
+        double init_alpha
+            = get_arg_val<real_argument>(*algo, "bfgs", "init_alpha");
+        double tol_obj = get_arg_val<real_argument>(*algo, "bfgs", "tol_obj");
+        double tol_rel_obj
+            = get_arg_val<real_argument>(*algo, "bfgs", "tol_rel_obj");
+        double tol_grad
+            = get_arg_val<real_argument>(*algo, "bfgs", "tol_grad");
+        double tol_rel_grad
+            = get_arg_val<real_argument>(*algo, "bfgs", "tol_rel_grad");
+        double tol_param
+            = get_arg_val<real_argument>(*algo, "bfgs", "tol_param");
+
+        if (jacobian) {
+          return stan::services::optimize::bfgs<stan::model::model_base, true>(
+              model, init_context, random_seed, chain, init_radius,
+              init_alpha, tol_obj, tol_rel_obj, tol_grad, tol_rel_grad,
+              tol_param, num_iterations, save_iterations, refresh, interrupt,
+              logger, init_writer, parameter_writer);
+        }
+        return stan::services::optimize::bfgs<stan::model::model_base, false>(
+            model, init_context, random_seed, chain, init_radius, init_alpha,
+            tol_obj, tol_rel_obj, tol_grad, tol_rel_grad, tol_param,
+            num_iterations, save_iterations, refresh, interrupt, logger,
+            init_writer, parameter_writer);
+      } else if (algo_name == "lbfgs") {
+        int history_size
+            = get_arg_val<int_argument>(*algo, "lbfgs", "history_size");
+        double init_alpha
+            = get_arg_val<real_argument>(*algo, "lbfgs", "init_alpha");
+        double tol_obj
+            = get_arg_val<real_argument>(*algo, "lbfgs", "tol_obj");
+        double tol_rel_obj
+            = get_arg_val<real_argument>(*algo, "lbfgs", "tol_rel_obj");
+        double tol_grad
+            = get_arg_val<real_argument>(*algo, "lbfgs", "tol_grad");
+        double tol_rel_grad
+            = get_arg_val<real_argument>(*algo, "lbfgs", "tol_rel_grad");
+        double tol_param
+            = get_arg_val<real_argument>(*algo, "lbfgs", "tol_param");
+
+        if (jacobian) {
+          return stan::services::optimize::lbfgs<stan::model::model_base,
+                                                 true>(
+              model, init_context, random_seed, chain, init_radius,
+              history_size, init_alpha, tol_obj, tol_rel_obj, tol_grad,
+              tol_rel_grad, tol_param, num_iterations, save_iterations,
+              refresh, interrupt, logger, init_writer, parameter_writer);
+        }
+        return stan::services::optimize::lbfgs<stan::model::model_base,
+                                               false>(
+            model, init_context, random_seed, chain, init_radius,
+            history_size, init_alpha, tol_obj, tol_rel_obj, tol_grad,
+            tol_rel_grad, tol_param, num_iterations, save_iterations,
+            refresh, interrupt, logger, init_writer, parameter_writer);
       }
-    } else if (algo->value() == "lbfgs") {
-      int history_size
-          = get_arg_val<int_argument>(*algo, "lbfgs", "history_size");
-      double init_alpha
-          = get_arg_val<real_argument>(*algo, "lbfgs", "init_alpha");
-      double tol_obj = get_arg_val<real_argument>(*algo, "lbfgs", "tol_obj");
-      double tol_rel_obj
-          = get_arg_val<real_argument>(*algo, "lbfgs", "tol_rel_obj");
-      double tol_grad = get_arg_val<real_argument>(*algo, "lbfgs", "tol_grad");
-      double tol_rel_grad
-          = get_arg_val<real_argument>(*algo, "lbfgs", "tol_rel_grad");
-      double tol_param
-          = get_arg_val<real_argument>(*algo, "lbfgs", "tol_param");
-
-      if (jacobian) {
-        return_code
-            = stan::services::optimize::lbfgs<stan::model::model_base, true>(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                history_size, init_alpha, tol_obj, tol_rel_obj, tol_grad,
-                tol_rel_grad, tol_param, num_iterations, save_iterations,
-                refresh, interrupt, logger, init_writers[0], sample_writers[0]);
+      return return_codes::NOT_OK;
+    };
+    if (num_starts == 1) {
+      return_code = optimize(*(init_contexts[0]), id, init_writers[0],
+                             sample_writers[0]);
+    } else {
+      // each start has its own initial values and output
+      context_vector start_contexts
+          = get_vec_var_context(init, num_starts, id);
+      std::vector<output_writer> start_writers;
+      if (!get_arg_val<bool_argument>(parser, "method", "optimize",
+                                      "save_starts")) {
+        init_null_writers(start_writers, num_starts);
+      } else if (binary_output) {
+        init_binary_writers(start_writers, num_starts, id, output_file,
+                            "_start", compression_opts);
       } else {
-        return_code
-            = stan::services::optimize::lbfgs<stan::model::model_base, false>(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                history_size, init_alpha, tol_obj, tol_rel_obj, tol_grad,
-                tol_rel_grad, tol_param, num_iterations, save_iterations,
-                refresh, interrupt, logger, init_writers[0], sample_writers[0]);
+        init_csv_writers(start_writers, num_starts, id, output_file,
+                         "_start", sig_figs, compression_opts);
       }
+      return_code = services_multi_start_optimize(
+          model, start_contexts, id,
+          [&](stan::io::var_context &init_context, unsigned int chain,
+              stan::callbacks::writer &parameter_writer) {
+            stan::callbacks::writer no_init_writer;
+            return optimize(init_context, chain, no_init_writer,
+                            parameter_writer);
+          },
+          logger, start_writers, sample_writers[0]);
     }
     // ---- optimize end ---- //
   } else if (user_method->arg("sample")) {
@@ -573,218 +854,280 @@ int command(int argc, const char *argv[]) {
       throw std::invalid_argument(msg.str());
     }
 
-    if (algo_name == "fixed_param") {
-      return_code = stan::services::sample::fixed_param(
-          model, num_chains, init_contexts, random_seed, id, init_radius,
-          num_samples, num_thin, refresh, interrupt, logger, init_writers,
-          sample_writers, diagnostic_csv_writers);
-    } else if (algo_name == "hmc") {
-      list_argument *metric_arg
-          = dynamic_cast<list_argument *>(parser.arg("method")
-                                              ->arg("sample")
-                                              ->arg("algorithm")
-                                              ->arg("hmc")
-                                              ->arg("metric"));
-      std::string metric = metric_arg->value();
-      std::string metric_file = get_arg_val<string_argument>(
-          parser, "method", "sample", "algorithm", "hmc", "metric_file");
-      bool metric_supplied = !metric_file.empty();
-      context_vector metric_contexts;
-      if (metric_supplied) {
-        metric_contexts = get_vec_var_context(metric_file, num_chains, id);
-      }
-      double stepsize = get_arg_val<real_argument>(
-          parser, "method", "sample", "algorithm", "hmc", "stepsize");
-      double jitter = get_arg_val<real_argument>(
-          parser, "method", "sample", "algorithm", "hmc", "stepsize_jitter");
-      list_argument *hmc_engine
-          = dynamic_cast<list_argument *>(algo->arg("hmc")->arg("engine"));
-      std::string engine = hmc_engine->value();
-      if (engine == "nuts") {
-        int max_depth
-            = get_arg_val<int_argument>(parser, "method", "sample", "algorithm",
-                                        "hmc", "engine", "nuts", "max_depth");
-        if (adapt_engaged == false) {
-          // NUTS, no adaptation
-          if (metric == "dense_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_nuts_dense_e(
-                model, num_chains, init_contexts, metric_contexts, random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, max_depth, interrupt, logger,
-                init_writers, sample_writers, diagnostic_csv_writers);
-          } else if (metric == "dense_e") {
-            return_code = stan::services::sample::hmc_nuts_dense_e(
-                model, num_chains, init_contexts, random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, max_depth, interrupt, logger, init_writers,
-                sample_writers, diagnostic_csv_writers);
-          } else if (metric == "diag_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_nuts_diag_e(
-                model, num_chains, init_contexts, metric_contexts, random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, max_depth, interrupt, logger,
-                init_writers, sample_writers, diagnostic_csv_writers);
-          } else if (metric == "diag_e") {
-            return_code = stan::services::sample::hmc_nuts_diag_e(
-                model, num_chains, init_contexts, random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, max_depth, interrupt, logger, init_writers,
-                sample_writers, diagnostic_csv_writers);
-          } else if (metric == "unit_e") {
-            return_code = stan::services::sample::hmc_nuts_unit_e(
-                model, num_chains, init_contexts, random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, max_depth, interrupt, logger, init_writers,
-                sample_writers, diagnostic_csv_writers);
-          }
-        } else {
-          // NUTS adaptation
-          double delta = get_arg_val<real_argument>(parser, "method", "sample",
-                                                    "adapt", "delta");
-          double gamma = get_arg_val<real_argument>(parser, "method", "sample",
-                                                    "adapt", "gamma");
-          double kappa = get_arg_val<real_argument>(parser, "method", "sample",
-                                                    "adapt", "kappa");
-          double t0 = get_arg_val<real_argument>(parser, "method", "sample",
-                                                 "adapt", "t0");
-          unsigned int init_buffer = get_arg_val<u_int_argument>(
-              parser, "method", "sample", "adapt", "init_buffer");
-          unsigned int term_buffer = get_arg_val<u_int_argument>(
-              parser, "method", "sample", "adapt", "term_buffer");
-          unsigned int window = get_arg_val<u_int_argument>(
-              parser, "method", "sample", "adapt", "window");
-
-          if (metric == "dense_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_nuts_dense_e_adapt(
-                model, num_chains, init_contexts, metric_contexts, random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, max_depth, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers, sample_writers, diagnostic_csv_writers,
-                metric_json_writers);
-          } else if (metric == "dense_e") {
-            return_code = stan::services::sample::hmc_nuts_dense_e_adapt(
-                model, num_chains, init_contexts, random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, max_depth, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers, sample_writers, diagnostic_csv_writers,
-                metric_json_writers);
-          } else if (metric == "diag_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_nuts_diag_e_adapt(
-                model, num_chains, init_contexts, metric_contexts, random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, max_depth, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers, sample_writers, diagnostic_csv_writers,
-                metric_json_writers);
-          } else if (metric == "diag_e") {
-            return_code = stan::services::sample::hmc_nuts_diag_e_adapt(
-                model, num_chains, init_contexts, random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, max_depth, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers, sample_writers, diagnostic_csv_writers,
-                metric_json_writers);
-          } else if (metric == "unit_e") {
-            return_code = stan::services::sample::hmc_nuts_unit_e_adapt(
-                model, num_chains, init_contexts, random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, max_depth, delta, gamma, kappa, t0, interrupt,
-                logger, init_writers, sample_writers, diagnostic_csv_writers,
-                metric_json_writers);
-          }
+    try {
+      if (!resume_from.empty()) {
+        return_code = services_resume_sample(
+            model, parser, resume_from, random_seed, id, interrupt, logger,
+            init_writers, sample_writers, diagnostic_csv_writers);
+      } else if (algo_name == "fixed_param") {
+        return_code = stan::services::sample::fixed_param(
+            model, num_chains, init_contexts, random_seed, id, init_radius,
+            num_samples, num_thin, refresh, interrupt, logger, init_writers,
+            sample_writers, diagnostic_csv_writers);
+      } else if (algo_name == "hmc") {
+        list_argument *metric_arg
+            = dynamic_cast<list_argument *>(parser.arg("method")
+                                                ->arg("sample")
+                                                ->arg("algorithm")
+                                                ->arg("hmc")
+                                                ->arg("metric"));
+        std::string metric = metric_arg->value();
+        std::string metric_file = get_arg_val<string_argument>(
+            parser, "method", "sample", "algorithm", "hmc", "metric_file");
+        bool metric_supplied = !metric_file.empty();
+        context_vector metric_contexts;
+        if (metric_supplied) {
+          metric_contexts = get_vec_var_context(metric_file, num_chains, id,
+                                                number_chains);
+        } else if (!warm_start_metrics.empty()) {
+          metric_contexts = warm_start_metrics;
+          metric_supplied = true;
         }
-      } else if (engine == "static") {
-        double int_time = get_arg_val<real_argument>(
-            parser, "method", "sample", "algorithm", "hmc", "engine", "static",
-            "int_time");
-        if (adapt_engaged == false) {  // static, no adaptation
-          if (metric == "dense_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_static_dense_e(
-                model, *(init_contexts[0]), *(metric_contexts[0]), random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, int_time, interrupt, logger,
-                init_writers[0], sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "dense_e") {
-            return_code = stan::services::sample::hmc_static_dense_e(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, int_time, interrupt, logger, init_writers[0],
-                sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "diag_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_static_diag_e(
-                model, *(init_contexts[0]), *(metric_contexts[0]), random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, int_time, interrupt, logger,
-                init_writers[0], sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "diag_e") {
-            return_code = stan::services::sample::hmc_static_diag_e(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, int_time, interrupt, logger, init_writers[0],
-                sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "unit_e") {
-            return_code = stan::services::sample::hmc_static_unit_e(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, int_time, interrupt, logger, init_writers[0],
-                sample_writers[0], diagnostic_csv_writers[0]);
+        double stepsize = get_arg_val<real_argument>(
+            parser, "method", "sample", "algorithm", "hmc", "stepsize");
+        double jitter = get_arg_val<real_argument>(
+            parser, "method", "sample", "algorithm", "hmc", "stepsize_jitter");
+        list_argument *hmc_engine
+            = dynamic_cast<list_argument *>(algo->arg("hmc")->arg("engine"));
+        std::string engine = hmc_engine->value();
+        if (engine == "nuts") {
+          int max_depth = get_arg_val<int_argument>(
+              parser, "method", "sample", "algorithm", "hmc", "engine", "nuts",
+              "max_depth");
+          if (adapt_engaged == false) {
+            // NUTS, no adaptation
+            if (metric == "dense_e" && metric_supplied == true) {
+              return_code = stan::services::sample::hmc_nuts_dense_e(
+                  model, num_chains, init_contexts, metric_contexts,
+                  random_seed, id, init_radius, num_warmup, num_samples,
+                  num_thin, save_warmup, refresh, stepsize, jitter, max_depth,
+                  interrupt, logger, init_writers, sample_writers,
+                  diagnostic_csv_writers);
+            } else if (metric == "dense_e") {
+              return_code = stan::services::sample::hmc_nuts_dense_e(
+                  model, num_chains, init_contexts, random_seed, id,
+                  init_radius, num_warmup, num_samples, num_thin, save_warmup,
+                  refresh, stepsize, jitter, max_depth, interrupt, logger,
+                  init_writers, sample_writers, diagnostic_csv_writers);
+            } else if (metric == "diag_e" && metric_supplied == true) {
+              return_code = stan::services::sample::hmc_nuts_diag_e(
+                  model, num_chains, init_contexts, metric_contexts,
+                  random_seed, id, init_radius, num_warmup, num_samples,
+                  num_thin, save_warmup, refresh, stepsize, jitter, max_depth,
+                  interrupt, logger, init_writers, sample_writers,
+                  diagnostic_csv_writers);
+            } else if (metric == "diag_e") {
+              return_code = stan::services::sample::hmc_nuts_diag_e(
+                  model, num_chains, init_contexts, random_seed, id,
+                  init_radius, num_warmup, num_samples, num_thin, save_warmup,
+                  refresh, stepsize, jitter, max_depth, interrupt, logger,
+                  init_writers, sample_writers, diagnostic_csv_writers);
+            } else if (metric == "unit_e") {
+              return_code = stan::services::sample::hmc_nuts_unit_e(
+                  model, num_chains, init_contexts, random_seed, id,
+                  init_radius, num_warmup, num_samples, num_thin, save_warmup,
+                  refresh, stepsize, jitter, max_depth, interrupt, logger,
+                  init_writers, sample_writers, diagnostic_csv_writers);
+            }
+          } else {
+            // NUTS adaptation
+            double delta = get_arg_val<real_argument>(
+                parser, "method", "sample", "adapt", "delta");
+            double gamma = get_arg_val<real_argument>(
+                parser, "method", "sample", "adapt", "gamma");
+            double kappa = get_arg_val<real_argument>(
+                parser, "method", "sample", "adapt", "kappa");
+            double t0 = get_arg_val<real_argument>(parser, "method", "sample",
+                                                   "adapt", "t0");
+            unsigned int init_buffer = get_arg_val<u_int_argument>(
+                parser, "method", "sample", "adapt", "init_buffer");
+            unsigned int term_buffer = get_arg_val<u_int_argument>(
+                parser, "method", "sample", "adapt", "term_buffer");
+            unsigned int window = get_arg_val<u_int_argument>(
+                parser, "method", "sample", "adapt", "window");
+
+            if (metric == "dense_e" && metric_supplied == true) {
+              return_code = stan::services::sample::hmc_nuts_dense_e_adapt(
+                  model, num_chains, init_contexts, metric_contexts,
+                  random_seed, id, init_radius, num_warmup, num_samples,
+                  num_thin, save_warmup, refresh, stepsize, jitter, max_depth,
+                  delta, gamma, kappa, t0, init_buffer, term_buffer, window,
+                  interrupt, logger, init_writers, sample_writers,
+                  diagnostic_csv_writers, metric_json_writers);
+            } else if (metric == "dense_e") {
+              return_code = stan::services::sample::hmc_nuts_dense_e_adapt(
+                  model, num_chains, init_contexts, random_seed, id,
+                  init_radius, num_warmup, num_samples, num_thin, save_warmup,
+                  refresh, stepsize, jitter, max_depth, delta, gamma, kappa, t0,
+                  init_buffer, term_buffer, window, interrupt, logger,
+                  init_writers, sample_writers, diagnostic_csv_writers,
+                  metric_json_writers);
+            } else if (metric == "diag_e" && metric_supplied == true) {
+              return_code = stan::services::sample::hmc_nuts_diag_e_adapt(
+                  model, num_chains, init_contexts, metric_contexts,
+                  random_seed, id, init_radius, num_warmup, num_samples,
+                  num_thin, save_warmup, refresh, stepsize, jitter, max_depth,
+                  delta, gamma, kappa, t0, init_buffer, term_buffer, window,
+                  interrupt, logger, init_writers, sample_writers,
+                  diagnostic_csv_writers, metric_json_writers);
+            } else if (metric == "diag_e") {
+              return_code = stan::services::sample::hmc_nuts_diag_e_adapt(
+                  model, num_chains, init_contexts, random_seed, id,
+                  init_radius, num_warmup, num_samples, num_thin, save_warmup,
+                  refresh, stepsize, jitter, max_depth, delta, gamma, kappa, t0,
+                  init_buffer, term_buffer, window, interrupt, logger,
+                  init_writers, sample_writers, diagnostic_csv_writers,
+                  metric_json_writers);
+            } else if (metric == "unit_e") {
+              return_code = stan::services::sample::hmc_nuts_unit_e_adapt(
+                  model, num_chains, init_contexts, random_seed, id,
+                  init_radius, num_warmup, num_samples, num_thin, save_warmup,
+                  refresh, stepsize, jitter, max_depth, delta, gamma, kappa, t0,
+                  interrupt, logger, init_writers, sample_writers,
+                  diagnostic_csv_writers, metric_json_writers);
+            }
           }
-        } else {  // static adaptation
-          double delta = get_arg_val<real_argument>(parser, "method", "sample",
-                                                    "adapt", "delta");
-          double gamma = get_arg_val<real_argument>(parser, "method", "sample",
-                                                    "adapt", "gamma");
-          double kappa = get_arg_val<real_argument>(parser, "method", "sample",
-                                                    "adapt", "kappa");
-          double t0 = get_arg_val<real_argument>(parser, "method", "sample",
-                                                 "adapt", "t0");
-          unsigned int init_buffer = get_arg_val<u_int_argument>(
-              parser, "method", "sample", "adapt", "init_buffer");
-          unsigned int term_buffer = get_arg_val<u_int_argument>(
-              parser, "method", "sample", "adapt", "term_buffer");
-          unsigned int window = get_arg_val<u_int_argument>(
-              parser, "method", "sample", "adapt", "window");
-          if (metric == "dense_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_static_dense_e_adapt(
-                model, *(init_contexts[0]), *(metric_contexts[0]), random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, int_time, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers[0], sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "dense_e") {
-            return_code = stan::services::sample::hmc_static_dense_e_adapt(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, int_time, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers[0], sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "diag_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_static_diag_e_adapt(
-                model, *(init_contexts[0]), *(metric_contexts[0]), random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, int_time, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers[0], sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "diag_e") {
-            return_code = stan::services::sample::hmc_static_diag_e_adapt(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, int_time, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers[0], sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "unit_e") {
-            return_code = stan::services::sample::hmc_static_unit_e_adapt(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, int_time, delta, gamma, kappa, t0, interrupt,
-                logger, init_writers[0], sample_writers[0],
-                diagnostic_csv_writers[0]);
+        } else if (engine == "static") {
+          double int_time = get_arg_val<real_argument>(
+              parser, "method", "sample", "algorithm", "hmc", "engine",
+              "static", "int_time");
+          if (adapt_engaged == false) {  // static, no adaptation
+            return_code = internal::run_chains(num_chains, [&](size_t i) {
+              int chain_code = stan::services::error_codes::OK;
+              if (metric == "dense_e" && metric_supplied == true) {
+                chain_code = stan::services::sample::hmc_static_dense_e(
+                    model, *(init_contexts[i]), *(metric_contexts[i]),
+                    random_seed, id + i, init_radius, num_warmup, num_samples,
+                    num_thin, save_warmup, refresh, stepsize, jitter, int_time,
+                    interrupt, logger, init_writers[i], sample_writers[i],
+                    diagnostic_csv_writers[i]);
+              } else if (metric == "dense_e") {
+                chain_code = stan::services::sample::hmc_static_dense_e(
+                    model, *(init_contexts[i]), random_seed, id + i,
+                    init_radius, num_warmup, num_samples, num_thin,
+                    save_warmup, refresh, stepsize, jitter, int_time,
+                    interrupt, logger, init_writers[i], sample_writers[i],
+                    diagnostic_csv_writers[i]);
+              } else if (metric == "diag_e" && metric_supplied == true) {
+                chain_code = stan::services::sample::hmc_static_diag_e(
+                    model, *(init_contexts[i]), *(metric_contexts[i]),
+                    random_seed, id + i, init_radius, num_warmup, num_samples,
+                    num_thin, save_warmup, refresh, stepsize, jitter, int_time,
+                    interrupt, logger, init_writers[i], sample_writers[i],
+                    diagnostic_csv_writers[i]);
+              } else if (metric == "diag_e") {
+                chain_code = stan::services::sample::hmc_static_diag_e(
+                    model, *(init_contexts[i]), random_seed, id + i,
+                    init_radius, num_warmup, num_samples, num_thin,
+                    save_warmup, refresh, stepsize, jitter, int_time,
+                    interrupt, logger, init_writers[i], sample_writers[i],
+                    diagnostic_csv_writers[i]);
+              } else if (metric == "unit_e") {
+                chain_code = stan::services::sample::hmc_static_unit_e(
+                    model, *(init_contexts[i]), random_seed, id + i,
+                    init_radius, num_warmup, num_samples, num_thin,
+                    save_warmup, refresh, stepsize, jitter, int_time,
+                    interrupt, logger, init_writers[i], sample_writers[i],
+                    diagnostic_csv_writers[i]);
+              }
+              return chain_code;
+            });
+          } else {  // static adaptation
+            double delta = get_arg_val<real_argument>(
+                parser, "method", "sample", "adapt", "delta");
+            double gamma = get_arg_val<real_argument>(
+                parser, "method", "sample", "adapt", "gamma");
+            double kappa = get_arg_val<real_argument>(
+                parser, "method", "sample", "adapt", "kappa");
+            double t0 = get_arg_val<real_argument>(parser, "method", "sample",
+                                                   "adapt", "t0");
+            unsigned int init_buffer = get_arg_val<u_int_argument>(
+                parser, "method", "sample", "adapt", "init_buffer");
+            unsigned int term_buffer = get_arg_val<u_int_argument>(
+                parser, "method", "sample", "adapt", "term_buffer");
+            unsigned int window = get_arg_val<u_int_argument>(
+                parser, "method", "sample", "adapt", "window");
+            return_code = internal::run_chains(num_chains, [&](size_t i) {
+              int chain_code = stan::services::error_codes::OK;
+              if (metric == "dense_e" && metric_supplied == true) {
+                chain_code = stan::services::sample::hmc_static_dense_e_adapt(
+                    model, *(init_contexts[i]), *(metric_contexts[i]),
+                    random_seed, id + i, init_radius, num_warmup, num_samples,
+                    num_thin, save_warmup, refresh, stepsize, jitter, int_time,
+                    delta, gamma, kappa, t0, init_buffer, term_buffer, window,
+                    interrupt, logger, init_writers[i], sample_writers[i],
+                    diagnostic_csv_writers[i]);
+              } else if (metric == "dense_e") {
+                chain_code = stan::services::sample::hmc_static_dense_e_adapt(
+                    model, *(init_contexts[i]), random_seed, id + i,
+                    init_radius, num_warmup, num_samples, num_thin,
+                    save_warmup, refresh, stepsize, jitter, int_time, delta,
+                    gamma, kappa, t0, init_buffer, term_buffer, window,
+                    interrupt, logger, init_writers[i], sample_writers[i],
+                    diagnostic_csv_writers[i]);
+              } else if (metric == "diag_e" && metric_supplied == true) {
+                chain_code = stan::services::sample::hmc_static_diag_e_adapt(
+                    model, *(init_contexts[i]), *(metric_contexts[i]),
+                    random_seed, id + i, init_radius, num_warmup, num_samples,
+                    num_thin, save_warmup, refresh, stepsize, jitter, int_time,
+                    delta, gamma, kappa, t0, init_buffer, term_buffer, window,
+                    interrupt, logger, init_writers[i], sample_writers[i],
+                    diagnostic_csv_writers[i]);
+              } else if (metric == "diag_e") {
+                chain_code = stan::services::sample::hmc_static_diag_e_adapt(
+                    model, *(init_contexts[i]), random_seed, id + i,
+                    init_radius, num_warmup, num_samples, num_thin,
+                    save_warmup, refresh, stepsize, jitter, int_time, delta,
+                    gamma, kappa, t0, init_buffer, term_buffer, window,
+                    interrupt, logger, init_writers[i], sample_writers[i],
+                    diagnostic_csv_writers[i]);
+              } else if (metric == "unit_e") {
+                chain_code = stan::services::sample::hmc_static_unit_e_adapt(
+                    model, *(init_contexts[i]), random_seed, id + i,
+                    init_radius, num_warmup, num_samples, num_thin,
+                    save_warmup, refresh, stepsize, jitter, int_time, delta,
+                    gamma, kappa, t0, interrupt, logger, init_writers[i],
+                    sample_writers[i], diagnostic_csv_writers[i]);
+              }
+              return chain_code;
+            });
           }
-        }
-      }  // end static HMC
-    }    // ---- sample end ---- //
+        }  // end static HMC
+      }
+    } catch (const early_stop &e) {
+      // all chains have stopped at the same draw
+      std::stringstream stop_msg;
+      stop_msg << "Sampling stopped early after " << monitor->num_draws()
+               << " draws per chain: minimum ESS = " << monitor->min_ess()
+               << ", maximum R-hat = " << monitor->max_rhat();
+      logger.info(stop_msg.str());
+      for (size_t i = 0; i < sample_writers.size(); ++i) {
+        sample_writers[i](stop_msg.str());
+        monitor->write_timing(i, sample_writers[i]);
+      }
+      return_code = return_codes::OK;
+    } catch (...) {
+      if (monitor) {
+        monitor->finish(false);
+      }
+      throw;
+    }
+    if (monitor) {
+      // chains of other processes may still be checked
+      monitor->finish(return_code == return_codes::OK);
+    }
+    if (checkpoint_io) {
+      for (auto *writer : checkpoint_writers) {
+        writer->finish();
+      }
+      checkpoint_io->close();
+    }
+    if (return_code == return_codes::OK) {
+      for (const auto &fname : interrupted_files) {
+        std::remove(fname.c_str());
+      }
+    }
+    // ---- sample end ---- //
   } else if (user_method->arg("variational")) {
     // ---- variational start ---- //
     list_argument *algo = dynamic_cast<list_argument *>(
@@ -808,25 +1151,58 @@ int command(int argc, const char *argv[]) {
                                               "eval_elbo");
     int output_samples = get_arg_val<int_argument>(
         parser, "method", "variational", "output_samples");
-    if (algorithm == "fullrank") {
-      return_code = stan::services::experimental::advi::fullrank(
-          model, *(init_contexts[0]), random_seed, id, init_radius,
-          grad_samples, elbo_samples, max_iterations, tol_rel_obj, eta,
-          adapt_engaged, adapt_iterations, eval_elbo, output_samples, interrupt,
-          logger, init_writers[0], sample_writers[0],
-          diagnostic_csv_writers[0]);
-    } else if (algorithm == "meanfield") {
-      return_code = stan::services::experimental::advi::meanfield(
-          model, *(init_contexts[0]), random_seed, id, init_radius,
-          grad_samples, elbo_samples, max_iterations, tol_rel_obj, eta,
-          adapt_engaged, adapt_iterations, eval_elbo, output_samples, interrupt,
-          logger, init_writers[0], sample_writers[0],
+    unsigned int num_runs = get_arg_val<int_argument>(
+        parser, "method", "variational", "num_runs");
+    auto fit = [&](stan::io::var_context &init_context, unsigned int chain,
+                   stan::callbacks::writer &init_writer,
+                   stan::callbacks::writer &parameter_writer,
+                   stan::callbacks::writer &diagnostic_writer) -> int {
+      if (algorithm == "fullrank") {
+        return stan::services::experimental::advi::fullrank(
+            model, init_context, random_seed, chain, init_radius,
+            grad_samples, elbo_samples, max_iterations, tol_rel_obj, eta,
+            adapt_engaged, adapt_iterations, eval_elbo, output_samples,
+            interrupt, logger, init_writer, parameter_writer,
+            diagnostic_writer);
+      } else if (algorithm == "meanfield") {
+        return stan::services::experimental::advi::meanfield(
+            model, init_context, random_seed, chain, init_radius,
+            grad_samples, elbo_samples, max_iterations, tol_rel_obj, eta,
+            adapt_engaged, adapt_iterations, eval_elbo, output_samples,
+            interrupt, logger, init_writer, parameter_writer,
+            diagnostic_writer);
+      }
+      return return_codes::NOT_OK;
+    };
+    if (num_runs == 1) {
+      return_code = fit(*(init_contexts[0]), id, init_writers[0],
+                        sample_writers[0], diagnostic_csv_writers[0]);
+    } else {
+      // each run has its own initial values and ELBO trace
+      context_vector run_contexts = get_vec_var_context(init, num_runs, id);
+      std::vector<output_writer> trace_writers;
+      init_csv_writers(trace_writers, num_runs, id, output_file, "_elbo",
+                       sig_figs, compression_opts);
+      return_code = services_multi_run_variational(
+          run_contexts, id,
+          [&](stan::io::var_context &init_context, unsigned int chain,
+              stan::callbacks::writer &parameter_writer,
+              stan::callbacks::writer &diagnostic_writer) {
+            stan::callbacks::writer no_init_writer;
+            return fit(init_context, chain, no_init_writer, parameter_writer,
+                       diagnostic_writer);
+          },
+          logger, trace_writers, sample_writers[0],
           diagnostic_csv_writers[0]);
     }
 
     // ---- variational end ---- //
   }
   //////////////////////////////////////////////////
+  if (async_io) {
+    // write out what is still queued and report any write errors
+    async_io->close();
+  }
 
   stan::math::profile_map &profile_data = get_stan_profile_data();
   if (profile_data.size() > 0) {
@@ -838,6 +1214,10 @@ int command(int argc, const char *argv[]) {
     }
     write_profiling(profile_stream, profile_data);
     profile_stream.close();
+    if (models != nullptr) {
+      // each server job reports its own profiles
+      profile_data.clear();
+    }
   }
   for (size_t i = 0; i < valid_arguments.size(); ++i) {
     delete valid_arguments.at(i);
@@ -3,27 +3,63 @@
 
 #include <cmdstan/arguments/argument_parser.hpp>
 #include <cmdstan/arguments/arg_sample.hpp>
+#include <cmdstan/async_writer.hpp>
+#include <cmdstan/binary_format.hpp>
+#include <cmdstan/binary_reader.hpp>
+#include <cmdstan/binary_writer.hpp>
+#include <cmdstan/checkpoint.hpp>
+#include <cmdstan/compression.hpp>
+#include <cmdstan/convergence_monitor.hpp>
+#include <cmdstan/draws_reader.hpp>
 #include <cmdstan/file.hpp>
+#include <cmdstan/number_format.hpp>
+#include <cmdstan/output_writer.hpp>
+#include <cmdstan/param_matrix.hpp>
 #include <stan/callbacks/unique_stream_writer.hpp>
 #include <stan/callbacks/json_writer.hpp>
+#include <stan/callbacks/logger.hpp>
 #include <stan/callbacks/writer.hpp>
 #include <stan/io/dump.hpp>
+#include <stan/io/array_var_context.hpp>
 #include <stan/io/empty_var_context.hpp>
 #include <stan/io/json/json_data.hpp>
 #include <stan/io/stan_csv_reader.hpp>
 #include <stan/math/prim/fun/Eigen.hpp>
+#include <stan/math/prim/prob/std_normal_rng.hpp>
 #include <stan/model/log_prob_grad.hpp>
 #include <stan/model/model_base.hpp>
-#include <stan/services/sample/standalone_gqs.hpp>
+#include <stan/services/error_codes.hpp>
+#include <stan/services/sample/hmc_nuts_dense_e.hpp>
+#include <stan/services/sample/hmc_nuts_diag_e.hpp>
+#include <stan/services/sample/hmc_nuts_unit_e.hpp>
+#include <stan/services/sample/hmc_static_dense_e.hpp>
+#include <stan/services/sample/hmc_static_diag_e.hpp>
+#include <stan/services/sample/hmc_static_unit_e.hpp>
+#include <stan/services/util/create_rng.hpp>
+#include <stan/services/util/gq_writer.hpp>
+#include <stan/services/util/initialize.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <tuple>
+#include <utility>
 #include <vector>
 #include <rapidjson/document.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
 
 namespace cmdstan {
 namespace internal {
@@ -139,12 +175,15 @@ using context_vector = std::vector<shared_context_ptr>;
  *  {file_name}_1{file_ending} and if that fails try to use the named file as
  *  the data for each chain.
  * @param num_chains The number of chains to run
+ * @param id id of first chain
+ * @param number_single number the file name of a single chain
  * @return a std vector of shared pointers to var contexts
  */
 context_vector get_vec_var_context(const std::string &file, size_t num_chains,
-                                   unsigned int id) {
+                                   unsigned int id,
+                                   bool number_single = false) {
   using stan::io::var_context;
-  if (num_chains == 1) {
+  if (num_chains == 1 && !number_single) {
     return context_vector(1, get_var_context(file));
   }
   auto make_context = [](auto &&file, auto &&stream,
@@ -191,8 +230,8 @@ context_vector get_vec_var_context(const std::string &file, size_t num_chains,
           << std::endl;
     }
 
-    auto filenames
-        = file::make_filenames(file_name, "", file_ending, num_chains, id);
+    auto filenames = file::make_filenames(file_name, "", file_ending,
+                                          num_chains, id, number_single);
     auto &file_1 = filenames[0];
     std::fstream stream_1(file_1.c_str(), std::fstream::in);
     // if file_1 exists we'll assume num_chains of these files exist
@@ -263,9 +302,45 @@ std::vector<std::string> get_constrained_param_names(
   return param_names;
 }
 
+/**
+ * Return the first column of the model parameters in the header of a
+ * StanCSV output file, which follows the sampler columns.
+ * Throws an exception if the parameter columns don't match the model.
+ *
+ * @param fname name of file, for error messages
+ * @param header column names
+ * @param param_names constrained parameter names of the model
+ * @return first column of model outputs
+ */
+inline size_t get_param_col_offset(
+    const std::string &fname, const std::vector<std::string> &header,
+    const std::vector<std::string> &param_names) {
+  size_t col_offset = 0;
+  for (auto col_name : header) {
+    if (boost::algorithm::ends_with(col_name, "__")) {
+      col_offset++;
+    } else {
+      break;
+    }
+  }
+  bool match = param_names.size() + col_offset <= header.size();
+  for (size_t i = 0; match && i < param_names.size(); ++i) {
+    match = param_names[i] == header[i + col_offset];
+  }
+  if (!match) {
+    std::stringstream msg;
+    msg << "Mismatch between model and fitted_parameters csv file \"" << fname
+        << "\"" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  return col_offset;
+}
+
 /**
  * Parse a StanCSV output file and identify the rows and columns in the
  * data table which contain the fitted estimates of the model parameters.
+ * Files written with `output format=binary` are read by the binary reader,
+ * gzip and zstd compressed files are decompressed while reading.
  * Throws an exception if the StanCSV parser cannot process the file.
  *
  * @param fname name of file which exists and has read perms
@@ -282,44 +357,29 @@ void parse_stan_csv(const std::string &fname,
                     stan::io::stan_csv &fitted_params, size_t &col_offset,
                     size_t &num_rows, size_t &num_cols) {
   std::stringstream msg;
-  // parse CSV contents
-  std::ifstream stream = file::safe_open(fname);
-  stan::io::stan_csv_reader::read_metadata(stream, fitted_params.metadata);
-  if (!stan::io::stan_csv_reader::read_header(stream, fitted_params.header,
-                                              false)) {
-    msg << "Error reading fitted param names from sample csv file \"" << fname
-        << "\"" << std::endl;
-    throw std::invalid_argument(msg.str());
-  }
-  stan::io::stan_csv_reader::read_adaptation(stream, fitted_params.adaptation);
-  fitted_params.timing.warmup = 0;
-  fitted_params.timing.sampling = 0;
-  stan::io::stan_csv_reader::read_samples(stream, fitted_params.samples,
-                                          fitted_params.timing);
-  stream.close();
-  // compute offset, size of parameters block
-  col_offset = 0;
-  for (auto col_name : fitted_params.header) {
-    if (boost::algorithm::ends_with(col_name, "__")) {
-      col_offset++;
-    } else {
-      break;
+  if (is_binary_output(fname)) {
+    fitted_params = read_binary_output(fname, false);
+  } else {
+    // parse CSV contents
+    auto input = compression::open_input(fname);
+    std::istream &stream = *input;
+    stan::io::stan_csv_reader::read_metadata(stream, fitted_params.metadata);
+    if (!stan::io::stan_csv_reader::read_header(stream, fitted_params.header,
+                                                false)) {
+      msg << "Error reading fitted param names from sample csv file \""
+          << fname << "\"" << std::endl;
+      throw std::invalid_argument(msg.str());
     }
+    stan::io::stan_csv_reader::read_adaptation(stream,
+                                               fitted_params.adaptation);
+    fitted_params.timing.warmup = 0;
+    fitted_params.timing.sampling = 0;
+    stan::io::stan_csv_reader::read_samples(stream, fitted_params.samples,
+                                            fitted_params.timing);
   }
+  col_offset = get_param_col_offset(fname, fitted_params.header, param_names);
   num_cols = param_names.size();
   num_rows = fitted_params.samples.rows();
-  if (num_cols + col_offset > fitted_params.header.size()) {
-    msg << "Mismatch between model and fitted_parameters csv file \"" << fname
-        << "\"" << std::endl;
-    throw std::invalid_argument(msg.str());
-  }
-  for (size_t i = 0; i < num_cols; ++i) {
-    if (param_names[i].compare(fitted_params.header[i + col_offset]) != 0) {
-      msg << "Mismatch between model and fitted_parameters csv file \"" << fname
-          << "\"" << std::endl;
-      throw std::invalid_argument(msg.str());
-    }
-  }
 }
 
 /**
@@ -403,6 +463,342 @@ std::vector<double> unconstrain_params_var_context(
   return params;
 }
 
+namespace internal {
+
+/**
+ * Run the chains of a method in parallel on the TBB pool, one task per
+ * chain.
+ *
+ * @tparam F type of function which runs a chain
+ * @param num_chains number of chains
+ * @param run_chain function which runs the chain of a given index and
+ *   returns its error code
+ * @return error code, that of the first chain which failed if any
+ */
+template <typename F>
+inline int run_chains(size_t num_chains, F &&run_chain) {
+  std::vector<int> return_codes(num_chains, stan::services::error_codes::OK);
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, num_chains, 1),
+      [&](const tbb::blocked_range<size_t> &r) {
+        for (size_t i = r.begin(); i < r.end(); ++i) {
+          return_codes[i] = run_chain(i);
+        }
+      },
+      tbb::simple_partitioner());
+  for (int return_code : return_codes) {
+    if (return_code != stan::services::error_codes::OK) {
+      return return_code;
+    }
+  }
+  return stan::services::error_codes::OK;
+}
+
+using draw_rng_t = decltype(stan::services::util::create_rng(0, 0));
+
+/**
+ * Create the random number generator of one draw of a chain, for draws
+ * generated in parallel.  The MIXMAX generator of `create_rng` is seeded
+ * directly from the seed, the chain id and the index of the draw, so the
+ * stream of any draw is set up in constant time.  The draw words start
+ * at 1, apart from the words of the chain's own stream.
+ *
+ * @param seed random seed
+ * @param chain_id id of chain
+ * @param draw index of draw
+ * @return random number generator
+ */
+inline draw_rng_t create_draw_rng(unsigned int seed, unsigned int chain_id,
+                                  size_t draw) {
+  std::uint64_t word = static_cast<std::uint64_t>(draw) + 1;
+  return draw_rng_t(seed, chain_id, static_cast<std::uint32_t>(word >> 32),
+                    static_cast<std::uint32_t>(word));
+}
+
+/**
+ * Writer which holds the output for one draw until the draws before it
+ * have been written.  The messages logged for the draw, such as the
+ * output of print statements, are held with it through a `logger`.
+ */
+class gq_draw_buffer : public stan::callbacks::writer {
+  struct record {
+    enum kind_t {
+      VALUES,
+      COMMENT,
+      LOG_DEBUG,
+      LOG_INFO,
+      LOG_WARN,
+      LOG_ERROR,
+      LOG_FATAL
+    } kind;
+    std::string message;
+    std::vector<double> values;
+  };
+
+ public:
+  using stan::callbacks::writer::operator();
+
+  void operator()(const std::vector<double> &values) {
+    records_.push_back({record::VALUES, std::string(), values});
+  }
+
+  void operator()(const std::string &message) {
+    records_.push_back({record::COMMENT, message, {}});
+  }
+
+  /**
+   * Logger which holds messages in a draw buffer, in order with the
+   * draw's output.
+   */
+  class buffer_logger : public stan::callbacks::logger {
+   public:
+    explicit buffer_logger(gq_draw_buffer &buffer) : buffer_(buffer) {}
+
+    void debug(const std::string &message) {
+      log(record::LOG_DEBUG, message);
+    }
+    void debug(const std::stringstream &message) {
+      log(record::LOG_DEBUG, message.str());
+    }
+    void info(const std::string &message) { log(record::LOG_INFO, message); }
+    void info(const std::stringstream &message) {
+      log(record::LOG_INFO, message.str());
+    }
+    void warn(const std::string &message) { log(record::LOG_WARN, message); }
+    void warn(const std::stringstream &message) {
+      log(record::LOG_WARN, message.str());
+    }
+    void error(const std::string &message) {
+      log(record::LOG_ERROR, message);
+    }
+    void error(const std::stringstream &message) {
+      log(record::LOG_ERROR, message.str());
+    }
+    void fatal(const std::string &message) {
+      log(record::LOG_FATAL, message);
+    }
+    void fatal(const std::stringstream &message) {
+      log(record::LOG_FATAL, message.str());
+    }
+
+   private:
+    gq_draw_buffer &buffer_;
+
+    void log(record::kind_t kind, const std::string &message) {
+      buffer_.records_.push_back({kind, message, {}});
+    }
+  };
+
+  /**
+   * Forward the held output and messages, in the order they were
+   * written.
+   *
+   * @param writer writer to forward output to
+   * @param logger logger to forward messages to
+   */
+  void replay(stan::callbacks::writer &writer,
+              stan::callbacks::logger &logger) const {
+    for (const auto &r : records_) {
+      switch (r.kind) {
+        case record::VALUES:
+          writer(r.values);
+          break;
+        case record::COMMENT:
+          writer(r.message);
+          break;
+        case record::LOG_DEBUG:
+          logger.debug(r.message);
+          break;
+        case record::LOG_INFO:
+          logger.info(r.message);
+          break;
+        case record::LOG_WARN:
+          logger.warn(r.message);
+          break;
+        case record::LOG_ERROR:
+          logger.error(r.message);
+          break;
+        case record::LOG_FATAL:
+          logger.fatal(r.message);
+          break;
+      }
+    }
+  }
+
+  // messages from a failed unconstraining transform
+  std::string model_msg;
+  std::string error;
+
+ private:
+  std::vector<record> records_;
+};
+
+/**
+ * Generate quantities for the draws of one fitted params file, reading
+ * and processing them a chunk at a time.
+ *
+ * By default the draws of a chunk are processed in order on one random
+ * number stream per chain, as by `stan::services::standalone_generate`.
+ * With `parallel_draws`, the draws of a chunk are processed in parallel
+ * on the TBB pool instead.  Each draw then has its own random number
+ * stream, determined by the seed, the chain id and the index of the
+ * draw in the file, so the output doesn't depend on the number of
+ * threads or the chunk size.  Output, and the messages logged for each
+ * draw, are still written in draw order.
+ *
+ * @param model Stan model
+ * @param reader reader positioned at the first draw
+ * @param col_offset first column of the model parameters
+ * @param num_params number of constrained model parameters
+ * @param seed random seed
+ * @param chain_id id of chain, which selects its random number stream
+ * @param chunk_size number of draws read at a time
+ * @param parallel_draws flag to process the draws of a chunk in parallel
+ * @param interrupt interrupt callback, called once per draw
+ * @param logger logger for messages
+ * @param sample_writer writer for the generated quantities
+ * @return error code
+ */
+inline int generate_quantities_chain(
+    const stan::model::model_base &model, draws_reader &reader,
+    size_t col_offset, size_t num_params, unsigned int seed,
+    unsigned int chain_id, size_t chunk_size, bool parallel_draws,
+    stan::callbacks::interrupt &interrupt, stan::callbacks::logger &logger,
+    stan::callbacks::writer &sample_writer) {
+  stan::services::util::gq_writer writer(sample_writer, logger, num_params);
+  writer.write_gq_names(model);
+  auto rng = stan::services::util::create_rng(seed, chain_id);
+  const size_t num_cols = reader.header().size();
+  std::vector<double> draws;
+  std::vector<double> cparams(num_params);
+  std::vector<double> uparams;
+  std::vector<gq_draw_buffer> buffers;
+  size_t num_draws = 0;
+  size_t num_read;
+  while ((num_read = reader.read(chunk_size, draws)) > 0) {
+    if (parallel_draws) {
+      buffers.clear();
+      buffers.resize(num_read);
+      tbb::parallel_for(
+          tbb::blocked_range<size_t>(0, num_read),
+          [&](const tbb::blocked_range<size_t> &r) {
+            std::vector<double> cparams(num_params);
+            std::vector<double> uparams;
+            for (size_t i = r.begin(); i < r.end(); ++i) {
+              auto first = draws.begin() + i * num_cols + col_offset;
+              cparams.assign(first, first + num_params);
+              std::stringstream msg;
+              try {
+                model.unconstrain_array(cparams, uparams, &msg);
+              } catch (const std::exception &e) {
+                buffers[i].model_msg = msg.str();
+                buffers[i].error = e.what();
+                continue;
+              }
+              auto draw_rng = create_draw_rng(seed, chain_id, num_draws + i);
+              gq_draw_buffer::buffer_logger draw_logger(buffers[i]);
+              stan::services::util::gq_writer draw_writer(
+                  buffers[i], draw_logger, num_params);
+              draw_writer.write_gq_values(model, draw_rng, uparams);
+            }
+          });
+      for (const auto &buffer : buffers) {
+        if (!buffer.error.empty()) {
+          if (buffer.model_msg.length() > 0)
+            logger.error(buffer.model_msg);
+          logger.error(buffer.error);
+          return stan::services::error_codes::DATAERR;
+        }
+        interrupt();
+        buffer.replay(sample_writer, logger);
+      }
+      num_draws += num_read;
+      continue;
+    }
+    for (size_t i = 0; i < num_read; ++i) {
+      auto first = draws.begin() + i * num_cols + col_offset;
+      cparams.assign(first, first + num_params);
+      std::stringstream msg;
+      try {
+        model.unconstrain_array(cparams, uparams, &msg);
+      } catch (const std::exception &e) {
+        if (msg.str().length() > 0)
+          logger.error(msg);
+        logger.error(e.what());
+        return stan::services::error_codes::DATAERR;
+      }
+      interrupt();
+      writer.write_gq_values(model, rng, uparams);
+    }
+    num_draws += num_read;
+  }
+  if (num_draws == 0) {
+    logger.error("Empty set of draws from fitted model.");
+    return stan::services::error_codes::DATAERR;
+  }
+  return stan::services::error_codes::OK;
+}
+
+}  // namespace internal
+
+/**
+ * Run standalone generated quantities for the draws in one fitted
+ * params file per chain.
+ *
+ * This does what `stan::services::standalone_generate` does with the
+ * same random number streams, but streams the draws: each file is read
+ * a chunk at a time and the output of each draw is written as soon as
+ * it is generated, so memory use is bounded by the chunk size rather
+ * than by the number of draws.  Chains run concurrently on the TBB
+ * pool, and with `parallel_draws` the draws of each chunk are also
+ * processed in parallel (see `internal::generate_quantities_chain`).
+ * Files may be Stan CSV or binary output files, compressed or not.
+ * Saved warmup draws are processed along with the others.
+ *
+ * @param model Stan model
+ * @param fnames names of the fitted params files, one per chain
+ * @param seed random seed
+ * @param id id of the first chain, used for the random number streams
+ *   of parallel draws
+ * @param chunk_size number of draws read at a time
+ * @param parallel_draws flag to process the draws of a chunk in parallel
+ * @param interrupt interrupt callback
+ * @param logger logger for messages
+ * @param sample_writers writers for the generated quantities, one per
+ *   chain
+ * @return error code
+ * @throw std::invalid_argument if a file doesn't match the model or
+ *   can't be read
+ */
+inline int services_generate_quantities(
+    const stan::model::model_base &model,
+    const std::vector<std::string> &fnames, unsigned int seed,
+    unsigned int id, size_t chunk_size, bool parallel_draws,
+    stan::callbacks::interrupt &interrupt,
+    stan::callbacks::logger &logger,
+    std::vector<output_writer> &sample_writers) {
+  std::vector<std::string> param_names = get_constrained_param_names(model);
+  std::vector<std::string> gq_names;
+  model.constrained_param_names(gq_names, false, true);
+  if (gq_names.size() <= param_names.size()) {
+    logger.error("Model doesn't generate any quantities of interest.");
+    return stan::services::error_codes::CONFIG;
+  }
+  std::vector<std::unique_ptr<draws_reader>> readers;
+  std::vector<size_t> col_offsets;
+  for (const auto &fname : fnames) {
+    readers.emplace_back(std::make_unique<draws_reader>(fname));
+    col_offsets.push_back(
+        get_param_col_offset(fname, readers.back()->header(), param_names));
+  }
+  return internal::run_chains(fnames.size(), [&](size_t i) {
+    return internal::generate_quantities_chain(
+        model, *readers[i], col_offsets[i], param_names.size(), seed,
+        parallel_draws ? id + i : i + 1, chunk_size, parallel_draws,
+        interrupt, logger, sample_writers[i]);
+  });
+}
+
 /**
  * Parse a StanCSV output file created by the optimizer and return a vector
  * containing the estimates of the model parameters on the unconstrained scale.
@@ -544,67 +940,577 @@ std::vector<std::vector<double>> get_uparams_r(
         << num_upars << " parameters but " << u_params_cols << " were found.";
     throw std::invalid_argument(msg.str());
   }
-  // brute force reshape
-  std::vector<std::vector<double>> params_r_ind(
-      u_params_rows, std::vector<double>(u_params_cols));
-  size_t idx = 0;
+  std::vector<std::vector<double>> params_r_ind(u_params_rows);
   for (size_t i = 0; i < u_params_rows; ++i) {
-    for (size_t j = 0; j < u_params_cols; ++j) {
-      params_r_ind[i][j] = *(u_params_r.data() + idx);
-      ++idx;
-    }
+    auto row = u_params_r.begin() + i * u_params_cols;
+    params_r_ind[i].assign(row, row + u_params_cols);
   }
   return params_r_ind;
 }
 
+namespace internal {
+
+/**
+ * Rows of unconstrained parameter values held in memory, with the
+ * interface of `param_matrix`.
+ */
+class param_rows {
+ public:
+  explicit param_rows(const std::vector<std::vector<double>> &rows)
+      : rows_(rows) {}
+
+  size_t rows() const { return rows_.size(); }
+
+  std::vector<double> &row(size_t i, std::vector<double> &row) const {
+    row = rows_[i];
+    return row;
+  }
+
+  void release(size_t, size_t) {}
+
+ private:
+  const std::vector<std::vector<double>> &rows_;
+};
+
+/**
+ * Return the log density and its gradient at one parameter set.
+ *
+ * @param model Stan model
+ * @param jacobian jacobian adjustment flag
+ * @param params_r unconstrained parameter values
+ * @param[out] gradients gradient
+ * @return log density
+ */
+inline double log_prob_grad(const stan::model::model_base &model,
+                            bool jacobian, std::vector<double> &params_r,
+                            std::vector<double> &gradients) {
+  std::vector<int> dummy_params_i;
+  if (jacobian) {
+    return stan::model::log_prob_grad<true, true>(model, params_r,
+                                                  dummy_params_i, gradients);
+  }
+  return stan::model::log_prob_grad<true, false>(model, params_r,
+                                                 dummy_params_i, gradients);
+}
+
+/**
+ * Return the Hessian of the log density at one parameter set.  Column j
+ * is the central finite difference of the gradient along parameter j,
+ * with a step of the cube root of machine epsilon scaled by the
+ * parameter's magnitude, and the result is symmetrized.
+ *
+ * @param model Stan model
+ * @param jacobian jacobian adjustment flag
+ * @param params_r unconstrained parameter values, perturbed and restored
+ * @return Hessian
+ */
+inline Eigen::MatrixXd log_prob_hessian(const stan::model::model_base &model,
+                                        bool jacobian,
+                                        std::vector<double> &params_r) {
+  const double epsilon = std::cbrt(std::numeric_limits<double>::epsilon());
+  size_t num_params = params_r.size();
+  Eigen::MatrixXd hessian(num_params, num_params);
+  std::vector<double> grad_plus;
+  std::vector<double> grad_minus;
+  for (size_t j = 0; j < num_params; ++j) {
+    double x = params_r[j];
+    double h = epsilon * std::max(1.0, std::fabs(x));
+    params_r[j] = x + h;
+    log_prob_grad(model, jacobian, params_r, grad_plus);
+    params_r[j] = x - h;
+    log_prob_grad(model, jacobian, params_r, grad_minus);
+    params_r[j] = x;
+    for (size_t i = 0; i < num_params; ++i) {
+      hessian(i, j) = (grad_plus[i] - grad_minus[i]) / (2 * h);
+    }
+  }
+  return 0.5 * (hessian + hessian.transpose());
+}
+
+/**
+ * Call the model's log_prob_grad method for a range of parameter sets
+ * and append lp, the gradient and optionally the packed Hessian of each
+ * to a flat vector.
+ *
+ * @tparam Params type of parameter sets, `param_rows` or `param_matrix`
+ * @param model Stan model
+ * @param jacobian jacobian adjustment flag
+ * @param hessian flag to append the Hessian
+ * @param params_set parameter sets
+ * @param begin index of first parameter set
+ * @param end index past last parameter set
+ * @param values vector to append to
+ */
+template <typename Params>
+void log_prob_grad_rows(const stan::model::model_base &model, bool jacobian,
+                        bool hessian, const Params &params_set, size_t begin,
+                        size_t end, std::vector<double> &values) {
+  std::vector<double> scratch;
+  std::vector<double> gradients;
+  for (size_t i = begin; i < end; ++i) {
+    std::vector<double> &params_r = params_set.row(i, scratch);
+    values.push_back(log_prob_grad(model, jacobian, params_r, gradients));
+    values.insert(values.end(), gradients.begin(), gradients.end());
+    if (hessian) {
+      // upper triangle, row by row
+      Eigen::MatrixXd h = log_prob_hessian(model, jacobian, params_r);
+      for (Eigen::Index r = 0; r < h.rows(); ++r) {
+        for (Eigen::Index c = r; c < h.cols(); ++c) {
+          values.push_back(h(r, c));
+        }
+      }
+    }
+  }
+}
+
+}  // namespace internal
+
 /**
- * Given a set of parameter values, call model's log_prob_grad
- * method and send output to a CSV file.
+ * Given sets of parameter values, call model's log_prob_grad method
+ * and write lp and the gradient of each set as one row of output.
+ * If requested, the row also holds the upper triangle of the Hessian,
+ * in columns "h_<row param>:<col param>".
+ * A CSV writer gets the rows formatted directly on its stream; any
+ * other writer, e.g. a binary writer, gets a header of column names
+ * and one draw per row.
  *
+ * Rows are evaluated in blocks.  When CmdStan is built with
+ * STAN_THREADS, blocks are evaluated in parallel on the TBB pool, each
+ * thread on its own autodiff stack.  Evaluated blocks are held in a
+ * reorder buffer of a few blocks per thread and written out in their
+ * original order, after which their parameter sets are released, so
+ * memory use doesn't grow with the number of rows.
+ *
+ * @tparam Params type of parameter sets, `internal::param_rows` or
+ *   `param_matrix`
  * @param model Stan model
  * @param jacobian jacobian adjustment flag
- * @param params_set array of unconstrained parameter values
- * @
+ * @param hessian flag to also write the Hessian
+ * @param params_set parameter sets
+ * @param sig_figs number of significant digits, or -1 for shortest
+ *   round-trip output
+ * @param writer output writer
  */
+template <typename Params>
 void services_log_prob_grad(const stan::model::model_base &model, bool jacobian,
-                            std::vector<std::vector<double>> &params_set,
-                            int sig_figs, std::ostream &output_stream) {
-  // header row
-  output_stream << std::setprecision(sig_figs) << "lp__,";
+                            bool hessian, Params &params_set, int sig_figs,
+                            output_writer &writer) {
+  std::vector<std::string> names{"lp__"};
   std::vector<std::string> p_names;
   model.unconstrained_param_names(p_names, false, false);
-  for (size_t i = 0; i < p_names.size(); ++i) {
-    output_stream << "g_" << p_names[i];
-    if (i == p_names.size() - 1)
-      output_stream << "\n";
-    else
-      output_stream << ",";
+  for (const auto &name : p_names) {
+    names.push_back("g_" + name);
+  }
+  if (hessian) {
+    for (size_t i = 0; i < p_names.size(); ++i) {
+      for (size_t j = i; j < p_names.size(); ++j) {
+        names.push_back("h_" + p_names[i] + ":" + p_names[j]);
+      }
+    }
+  }
+  std::ostream *output_stream
+      = writer.has_stream() ? &writer.get_stream() : nullptr;
+  if (output_stream) {
+    *output_stream << boost::algorithm::join(names, ",") << "\n";
+  } else {
+    writer(names);
   }
   // data row(s)
-  std::vector<int> dummy_params_i;
-  double lp;
-  std::vector<double> gradients;
-  for (auto &&params : params_set) {
-    if (jacobian) {
-      lp = stan::model::log_prob_grad<true, true>(model, params, dummy_params_i,
-                                                  gradients);
-    } else {
-      lp = stan::model::log_prob_grad<true, false>(model, params,
-                                                   dummy_params_i, gradients);
+  const size_t block_size = 64;
+  size_t num_cols = names.size();
+  size_t num_rows = params_set.rows();
+  size_t num_blocks = (num_rows + block_size - 1) / block_size;
+#ifdef STAN_THREADS
+  size_t buffer_size = 4 * tbb::this_task_arena::max_concurrency();
+#else
+  size_t buffer_size = 1;
+#endif
+  struct block_output {
+    std::vector<double> values;
+    std::string lines;
+  };
+  std::vector<block_output> blocks(std::min(buffer_size, num_blocks));
+  auto eval_block = [&](size_t block, block_output &out) {
+    out.values.clear();
+    out.lines.clear();
+    internal::log_prob_grad_rows(model, jacobian, hessian, params_set,
+                                 block * block_size,
+                                 std::min(num_rows, (block + 1) * block_size),
+                                 out.values);
+    if (output_stream) {
+      for (size_t i = 0; i < out.values.size(); ++i) {
+        append_double(out.lines, out.values[i], sig_figs);
+        out.lines += (i + 1) % num_cols == 0 ? '\n' : ',';
+      }
+    }
+  };
+  std::vector<double> row(num_cols);
+  for (size_t first = 0; first < num_blocks; first += blocks.size()) {
+    size_t last = std::min(num_blocks, first + blocks.size());
+#ifdef STAN_THREADS
+    tbb::parallel_for(tbb::blocked_range<size_t>(first, last, 1),
+                      [&](const tbb::blocked_range<size_t> &r) {
+                        for (size_t b = r.begin(); b < r.end(); ++b) {
+                          eval_block(b, blocks[b - first]);
+                        }
+                      });
+#else
+    for (size_t b = first; b < last; ++b) {
+      eval_block(b, blocks[b - first]);
+    }
+#endif
+    for (size_t b = first; b < last; ++b) {
+      const block_output &out = blocks[b - first];
+      if (output_stream) {
+        output_stream->write(out.lines.data(), out.lines.size());
+        continue;
+      }
+      for (size_t i = 0; i < out.values.size(); i += num_cols) {
+        row.assign(out.values.begin() + i, out.values.begin() + i + num_cols);
+        writer(row);
+      }
+    }
+    params_set.release(first * block_size,
+                       std::min(num_rows, last * block_size));
+  }
+}
+
+namespace internal {
+
+/**
+ * Return the indices of the unconstrained parameters whose gradients
+ * are tested by `diagnose test=gradient`, in increasing order.
+ *
+ * @param model Stan model
+ * @param params comma-separated names of unconstrained parameters, or
+ *   of variables to select all their elements, empty to select all
+ * @param num_params number of the selected parameters to keep, chosen
+ *   at random, or 0 to keep all
+ * @param rng random number generator for the choice
+ * @return indices of parameters
+ * @throw std::invalid_argument if a name matches no parameter
+ */
+template <typename RNG>
+std::vector<size_t> gradient_test_indices(const stan::model::model_base &model,
+                                          const std::string &params,
+                                          size_t num_params, RNG &rng) {
+  std::vector<std::string> names;
+  model.unconstrained_param_names(names, false, false);
+  std::vector<size_t> indices;
+  if (params.empty()) {
+    for (size_t k = 0; k < names.size(); ++k) {
+      indices.push_back(k);
+    }
+  } else {
+    std::vector<std::string> selected;
+    boost::algorithm::split(selected, params, boost::is_any_of(","),
+                            boost::token_compress_on);
+    std::vector<bool> in_test(names.size(), false);
+    for (std::string &name : selected) {
+      boost::algorithm::trim(name);
+      if (name.empty()) {
+        continue;
+      }
+      bool found = false;
+      for (size_t k = 0; k < names.size(); ++k) {
+        if (names[k] == name || boost::starts_with(names[k], name + ".")) {
+          in_test[k] = true;
+          found = true;
+        }
+      }
+      if (!found) {
+        std::stringstream msg;
+        msg << "Parameter '" << name << "' selected for the gradient test "
+            << "is not an unconstrained parameter of the model.";
+        throw std::invalid_argument(msg.str());
+      }
+    }
+    for (size_t k = 0; k < names.size(); ++k) {
+      if (in_test[k]) {
+        indices.push_back(k);
+      }
+    }
+  }
+  if (num_params > 0 && num_params < indices.size()) {
+    // partial Fisher-Yates shuffle
+    for (size_t i = 0; i < num_params; ++i) {
+      boost::random::uniform_int_distribution<size_t> pick(
+          i, indices.size() - 1);
+      std::swap(indices[i], indices[pick(rng)]);
+    }
+    indices.resize(num_params);
+    std::sort(indices.begin(), indices.end());
+  }
+  return indices;
+}
+
+}  // namespace internal
+
+/**
+ * Test the gradient of the log density at the initial values against
+ * finite differences, as `stan::services::diagnose::diagnose` does, with
+ * the same output.
+ *
+ * The finite differences of the tested parameters are evaluated in
+ * parallel on the TBB pool.  They only need the log density in double
+ * precision, so no autodiff stack is used.  The test may be restricted
+ * to named parameters and to a random subset of them, chosen on the
+ * random number stream of the chain after the initial values.
+ *
+ * @param model Stan model
+ * @param init initial values
+ * @param seed random seed
+ * @param id chain id, which selects the random number stream
+ * @param init_radius radius of random initial values
+ * @param epsilon finite difference step size
+ * @param error error threshold, larger differences are reported as
+ *   failures
+ * @param params comma-separated names of the parameters to test, empty
+ *   for all
+ * @param num_params number of parameters to test, chosen at random, or
+ *   0 for all selected ones
+ * @param interrupt interrupt callback
+ * @param logger logger for messages
+ * @param init_writer writer for the initial values
+ * @param parameter_writer writer for the test results
+ * @return error code
+ */
+inline int services_diagnose_gradient(
+    const stan::model::model_base &model, const stan::io::var_context &init,
+    unsigned int seed, unsigned int id, double init_radius, double epsilon,
+    double error, const std::string &params, size_t num_params,
+    stan::callbacks::interrupt &interrupt, stan::callbacks::logger &logger,
+    stan::callbacks::writer &init_writer,
+    stan::callbacks::writer &parameter_writer) {
+  auto rng = stan::services::util::create_rng(seed, id);
+  std::vector<double> cont_vector = stan::services::util::initialize(
+      model, init, rng, init_radius, false, logger, init_writer);
+  logger.info("TEST GRADIENT MODE");
+  std::vector<size_t> indices
+      = internal::gradient_test_indices(model, params, num_params, rng);
+  if (indices.size() < cont_vector.size()) {
+    std::stringstream msg;
+    msg << "Testing " << indices.size() << " of " << cont_vector.size()
+        << " parameters.";
+    logger.info(msg.str());
+  }
+
+  std::stringstream msg;
+  std::vector<double> grad;
+  std::vector<int> params_i;
+  double lp = stan::model::log_prob_grad<true, true>(model, cont_vector,
+                                                     params_i, grad, &msg);
+  if (msg.str().length() > 0) {
+    logger.info(msg.str());
+    parameter_writer(msg.str());
+  }
+
+  interrupt();
+  std::vector<double> grad_fd(indices.size());
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, indices.size()),
+                    [&](const tbb::blocked_range<size_t> &r) {
+                      Eigen::VectorXd perturbed
+                          = Eigen::Map<const Eigen::VectorXd>(
+                              cont_vector.data(), cont_vector.size());
+                      for (size_t j = r.begin(); j < r.end(); ++j) {
+                        size_t k = indices[j];
+                        perturbed(k) = cont_vector[k] + epsilon;
+                        double lp_plus
+                            = model.log_prob_jacobian(perturbed, nullptr);
+                        perturbed(k) = cont_vector[k] - epsilon;
+                        double lp_minus
+                            = model.log_prob_jacobian(perturbed, nullptr);
+                        perturbed(k) = cont_vector[k];
+                        grad_fd[j] = (lp_plus - lp_minus) / (2 * epsilon);
+                      }
+                    });
+
+  std::stringstream lp_msg;
+  lp_msg << " Log probability=" << lp;
+  parameter_writer();
+  parameter_writer(lp_msg.str());
+  parameter_writer();
+  logger.info("");
+  logger.info(lp_msg.str());
+  logger.info("");
+
+  std::stringstream header;
+  header << std::setw(10) << "param idx" << std::setw(16) << "value"
+         << std::setw(16) << "model" << std::setw(16) << "finite diff"
+         << std::setw(16) << "error";
+  parameter_writer(header.str());
+  logger.info(header.str());
+  size_t num_failed = 0;
+  for (size_t j = 0; j < indices.size(); ++j) {
+    size_t k = indices[j];
+    std::stringstream line;
+    line << std::setw(10) << k << std::setw(16) << cont_vector[k]
+         << std::setw(16) << grad[k] << std::setw(16) << grad_fd[j]
+         << std::setw(16) << (grad[k] - grad_fd[j]);
+    parameter_writer(line.str());
+    logger.info(line.str());
+    if (std::fabs(grad[k] - grad_fd[j]) > error) {
+      ++num_failed;
+    }
+  }
+  if (num_failed > 0) {
+    std::stringstream failed;
+    failed << num_failed << " of " << indices.size()
+           << " gradients differ from their finite differences by more "
+              "than error="
+           << error << ".";
+    logger.info(failed.str());
+  }
+  return stan::services::error_codes::OK;
+}
+
+/**
+ * Draw from the normal approximation to the posterior at a mode, as
+ * `stan::services::laplace_sample` does, generating and evaluating the
+ * draws in parallel.
+ *
+ * The covariance of the approximation on the unconstrained scale is
+ * the negative inverse of the Hessian of the log density at the mode,
+ * computed as by `log_prob hessian=1`.  Its value, gradient and Hessian
+ * at the mode are written to the diagnostic writer.  Each output row
+ * holds the log density of the model at the draw (NaN unless
+ * `calculate_lp`), the log density of the approximation, and the
+ * constrained parameters, transformed parameters and generated
+ * quantities.
+ *
+ * Draws are generated in blocks on the TBB pool.  Each draw has its own
+ * random number stream, determined by the seed, the id and the index of
+ * the draw, so the output doesn't depend on the number of threads.
+ * Blocks are held in a reorder buffer of a few blocks per thread and
+ * written out in order, so memory use doesn't grow with the number of
+ * draws.
+ *
+ * @tparam DiagWriter type of diagnostic writer
+ * @param model Stan model
+ * @param jacobian jacobian adjustment flag
+ * @param theta_hat mode on the unconstrained scale
+ * @param draws number of draws
+ * @param calculate_lp flag to evaluate the log density of each draw
+ * @param seed random seed
+ * @param id id of the run, which selects its random number streams
+ * @param refresh number of draws between progress messages
+ * @param interrupt interrupt callback, called once per draw
+ * @param logger logger for messages
+ * @param sample_writer writer for the draws
+ * @param diagnostic_writer writer for the Hessian at the mode
+ * @return error code
+ */
+template <typename DiagWriter>
+int services_laplace_sample(const stan::model::model_base &model,
+                            bool jacobian, const Eigen::VectorXd &theta_hat,
+                            int draws, bool calculate_lp, unsigned int seed,
+                            unsigned int id, int refresh,
+                            stan::callbacks::interrupt &interrupt,
+                            stan::callbacks::logger &logger,
+                            stan::callbacks::writer &sample_writer,
+                            DiagWriter &diagnostic_writer) {
+  std::vector<std::string> names{"log_p__", "log_g__"};
+  model.constrained_param_names(names, true, true);
+  sample_writer(names);
+
+  auto log_density = [&](Eigen::VectorXd &params_r, std::ostream *msgs) {
+    return jacobian ? model.log_prob_jacobian(params_r, msgs)
+                    : model.log_prob(params_r, msgs);
+  };
+  if (refresh > 0) {
+    logger.info("Calculating Hessian");
+  }
+  interrupt();
+  std::vector<double> params_r(theta_hat.data(),
+                               theta_hat.data() + theta_hat.size());
+  std::vector<double> gradient;
+  internal::log_prob_grad(model, jacobian, params_r, gradient);
+  Eigen::MatrixXd hessian
+      = internal::log_prob_hessian(model, jacobian, params_r);
+  std::stringstream msg;
+  Eigen::VectorXd mode = theta_hat;
+  diagnostic_writer.begin_record();
+  diagnostic_writer.write("log_density", log_density(mode, &msg));
+  diagnostic_writer.write("gradient", gradient);
+  diagnostic_writer.write("Hessian", hessian);
+  diagnostic_writer.end_record();
+
+  Eigen::LLT<Eigen::MatrixXd> llt(-hessian.inverse());
+  if (llt.info() != Eigen::Success || !hessian.allFinite()) {
+    logger.error(
+        "The Hessian at the mode is not negative definite, can't draw "
+        "from the Laplace approximation.");
+    return stan::services::error_codes::SOFTWARE;
+  }
+  Eigen::MatrixXd L = llt.matrixL();
+
+  if (refresh > 0) {
+    logger.info("Generating draws");
+  }
+  const size_t block_size = 64;
+  size_t num_cols = names.size();
+  size_t num_draws = draws;
+  size_t num_blocks = (num_draws + block_size - 1) / block_size;
+  size_t buffer_size = 4 * tbb::this_task_arena::max_concurrency();
+  struct block_output {
+    std::vector<double> values;
+    std::string msgs;
+  };
+  std::vector<block_output> blocks(std::min(buffer_size, num_blocks));
+  auto eval_block = [&](size_t block, block_output &out) {
+    out.values.clear();
+    std::stringstream msgs;
+    Eigen::VectorXd z(theta_hat.size());
+    Eigen::VectorXd unc_draw;
+    Eigen::VectorXd cparams;
+    size_t end = std::min(num_draws, (block + 1) * block_size);
+    for (size_t m = block * block_size; m < end; ++m) {
+      auto rng = internal::create_draw_rng(seed, id, m);
+      for (Eigen::Index n = 0; n < z.size(); ++n) {
+        z(n) = stan::math::std_normal_rng(rng);
+      }
+      unc_draw = theta_hat + L * z;
+      out.values.push_back(calculate_lp
+                               ? log_density(unc_draw, &msgs)
+                               : std::numeric_limits<double>::quiet_NaN());
+      out.values.push_back(-0.5 * z.squaredNorm());
+      model.write_array(rng, unc_draw, cparams, true, true, &msgs);
+      out.values.insert(out.values.end(), cparams.data(),
+                        cparams.data() + cparams.size());
+    }
+    out.msgs = msgs.str();
+  };
+  std::vector<double> row(num_cols);
+  for (size_t first = 0; first < num_blocks; first += blocks.size()) {
+    size_t last = std::min(num_blocks, first + blocks.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(first, last, 1),
+                      [&](const tbb::blocked_range<size_t> &r) {
+                        for (size_t b = r.begin(); b < r.end(); ++b) {
+                          eval_block(b, blocks[b - first]);
+                        }
+                      });
+    for (size_t b = first; b < last; ++b) {
+      const block_output &out = blocks[b - first];
+      if (!out.msgs.empty()) {
+        logger.info(out.msgs);
+      }
+      for (size_t i = 0; i < out.values.size(); i += num_cols) {
+        size_t m = b * block_size + i / num_cols;
+        interrupt();
+        if (refresh > 0 && m % refresh == 0) {
+          logger.info("iteration: " + std::to_string(m));
+        }
+        row.assign(out.values.begin() + i, out.values.begin() + i + num_cols);
+        sample_writer(row);
+      }
     }
-    output_stream << lp << ",";
-    std::copy(gradients.begin(), gradients.end() - 1,
-              std::ostream_iterator<double>(output_stream, ","));
-    output_stream << gradients.back() << "\n";
   }
+  return stan::services::error_codes::OK;
 }
 
 /**
  * For sample and pathfinder methods, return number of
  * chains or pathfinders to run, otherwise return 1.
- * For the sampler, only adaptive NUTS-HMC with non-unit metric
- * supports multi-chain parallelization; if sampler config is invalid,
- * this will throw an error.
  *
  * @param parser user config
  * @param id id of initial chain or path. Only used for generated quantities
@@ -626,19 +1532,7 @@ inline unsigned int get_num_chains(argument_parser &parser, unsigned int id) {
     return 1;
   }
 
-  unsigned int num_chains
-      = get_arg_val<int_argument>(*sample_arg, "num_chains");
-
-  if (num_chains > 1) {
-    list_argument *algo
-        = dynamic_cast<list_argument *>(sample_arg->arg("algorithm"));
-    if (algo->value() != "fixed_param"
-        && get_arg_val<list_argument>(*algo, "hmc", "engine") == "static") {
-      throw std::invalid_argument(
-          "Argument 'num_chains' is unavailable for the 'static' HMC engine.");
-    }
-  }
-  return num_chains;
+  return get_arg_val<int_argument>(*sample_arg, "num_chains");
 }
 
 /**
@@ -692,13 +1586,1194 @@ void init_null_writers(std::vector<T> &writers, size_t num_chains) {
   }
 }
 
+/**
+ * Return the settings of the `output compression` argument.
+ * Throws an exception if the codec isn't available in this build.
+ *
+ * @param parser user config
+ * @return codec, level and frame size in bytes
+ */
+inline compression::options get_compression_options(argument_parser &parser) {
+  compression::options opts;
+  opts.codec = get_arg_val<list_argument>(parser, "output", "compression");
+  if (opts.codec != "none") {
+    compression::check_available(opts.codec);
+    opts.level = get_arg_val<int_argument>(parser, "output", "compression",
+                                           opts.codec.c_str(), "level");
+    opts.frame_size
+        = 1024
+          * static_cast<size_t>(get_arg_val<int_argument>(
+              parser, "output", "compression", opts.codec.c_str(),
+              "frame_size"));
+  }
+  return opts;
+}
+
+/**
+ * Create per-chain writers for output in Stan CSV format.
+ *
+ * @param writers vector of writers to fill
+ * @param num_chains number of chains
+ * @param id id of first chain
+ * @param filename output filename
+ * @param tag distinguishing tag
+ * @param sig_figs number of significant digits, or -1 for shortest
+ *   round-trip output
+ * @param compression codec of the files, whose suffix is appended to
+ *   the filenames
+ * @param number_single number the file name of a single chain
+ */
+inline void init_csv_writers(std::vector<output_writer> &writers,
+                             unsigned int num_chains, unsigned int id,
+                             const std::string &filename,
+                             const std::string &tag, int sig_figs,
+                             const compression::options &compression,
+                             bool number_single = false) {
+  writers.reserve(num_chains);
+  auto filenames
+      = file::make_filenames(compression::split_suffix(filename).first, tag,
+                             ".csv", num_chains, id, number_single);
+  bool compressed = compression.codec != "none";
+  for (size_t i = 0; i < num_chains; ++i) {
+    auto ofs = file::safe_create(
+        filenames[i] + compression::suffix(compression.codec), sig_figs,
+        compressed);
+    writers.emplace_back(compression::compress(std::move(ofs), compression),
+                         "# ", sig_figs);
+  }
+}
+
+/**
+ * Create per-chain writers for output in the binary draws format.
+ *
+ * @param writers vector of writers to fill
+ * @param num_chains number of chains
+ * @param id id of first chain
+ * @param filename output filename, its suffix is replaced by ".bin"
+ * @param tag distinguishing tag
+ * @param compression codec of the files, whose suffix is appended to
+ *   the filenames
+ * @param number_single number the file name of a single chain
+ */
+inline void init_binary_writers(std::vector<output_writer> &writers,
+                                unsigned int num_chains, unsigned int id,
+                                const std::string &filename,
+                                const std::string &tag,
+                                const compression::options &compression,
+                                bool number_single = false) {
+  writers.reserve(num_chains);
+  auto filenames = file::make_filenames(
+      compression::split_suffix(filename).first, tag, binary_format::SUFFIX,
+      num_chains, id, number_single);
+  for (size_t i = 0; i < num_chains; ++i) {
+    auto ofs = file::safe_create(
+        filenames[i] + compression::suffix(compression.codec), -1, true);
+    writers.emplace_back(std::make_unique<binary_writer>(
+        compression::compress(std::move(ofs), compression)));
+  }
+}
+
+/**
+ * Hand the per-chain writers over to a background I/O thread.  Each
+ * writer is replaced by one which queues its output; null writers are
+ * left as they are.
+ *
+ * @param writers vector of writers to wrap
+ * @param io thread which writes the queued output
+ */
+inline void init_async_writers(std::vector<output_writer> &writers,
+                               const std::shared_ptr<async_writer_thread> &io) {
+  for (auto &writer : writers) {
+    if (writer.get() != nullptr) {
+      writer = output_writer(
+          std::make_unique<async_writer>(io, std::move(writer)));
+    }
+  }
+}
+
+/**
+ * Data and output files of one run of a batch, see
+ * `read_batch_jobs`.  The console output of the run goes to a log file
+ * next to its output file.
+ */
+struct batch_job {
+  std::string data_file;
+  std::string output_file;
+  std::string diagnostic_file;
+  std::string profile_file;
+  std::string log_file;
+};
+
+/**
+ * Read the data files listed in the batch file, one per line, and
+ * derive the numbered output files of each run from the configured
+ * ones.  Empty lines and lines starting with '#' are skipped.
+ * Throws an exception if the batch file lists no data files.
+ *
+ * @param parser user config
+ * @return runs of the batch in the order listed
+ */
+inline std::vector<batch_job> read_batch_jobs(argument_parser &parser) {
+  std::string batch_file
+      = get_arg_val<string_argument>(parser, "data", "batch_file");
+  std::ifstream in = file::safe_open(batch_file);
+  std::vector<std::string> data_files;
+  std::string line;
+  while (std::getline(in, line)) {
+    boost::algorithm::trim(line);
+    if (!line.empty() && line[0] != '#') {
+      data_files.push_back(line);
+    }
+  }
+  if (data_files.empty()) {
+    throw std::invalid_argument("Batch file \"" + batch_file
+                                + "\" lists no data files.");
+  }
+  auto make_names = [&](const char *arg_name, const std::string &type) {
+    std::string filename
+        = get_arg_val<string_argument>(parser, "output", arg_name);
+    if (filename.empty()) {
+      return std::vector<std::string>(data_files.size());
+    }
+    return file::make_filenames(filename, "", type, data_files.size(), 1);
+  };
+  std::string output_file
+      = get_arg_val<string_argument>(parser, "output", "file");
+  std::vector<std::string> output_files = make_names("file", ".csv");
+  std::vector<std::string> diagnostic_files
+      = make_names("diagnostic_file", ".csv");
+  std::vector<std::string> profile_files = make_names("profile_file", ".csv");
+  std::vector<std::string> log_files = file::make_filenames(
+      output_file, "", ".log", data_files.size(), 1);
+  std::vector<batch_job> jobs(data_files.size());
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    jobs[i] = {data_files[i], output_files[i], diagnostic_files[i],
+               profile_files[i], log_files[i]};
+  }
+  return jobs;
+}
+
+/**
+ * Configure the parsed arguments for one run of a batch.
+ *
+ * @param parser user config, parsed from the arguments of the batch
+ * @param job data and output files of the run
+ */
+inline void apply_batch_job(argument_parser &parser, const batch_job &job) {
+  dynamic_cast<string_argument *>(get_arg(parser, "data", "batch_file"))
+      ->set_value("");
+  dynamic_cast<string_argument *>(get_arg(parser, "data", "file"))
+      ->set_value(job.data_file);
+  dynamic_cast<string_argument *>(get_arg(parser, "output", "file"))
+      ->set_value(job.output_file);
+  dynamic_cast<string_argument *>(get_arg(parser, "output", "diagnostic_file"))
+      ->set_value(job.diagnostic_file);
+  dynamic_cast<string_argument *>(get_arg(parser, "output", "profile_file"))
+      ->set_value(job.profile_file);
+}
+
+/**
+ * Configure the parsed arguments for one process of a run whose chains
+ * are spread over MPI processes.  Each process runs a contiguous block
+ * of the chains, whose ids and file names are those of the whole run,
+ * and writes its profiles to a file tagged with its rank.
+ *
+ * @param parser user config
+ * @param rank rank of the process
+ * @param num_procs number of processes
+ * @return true if the file names of a single chain of the process must
+ *   still be numbered, which is the case for a run of several chains
+ */
+inline bool apply_mpi_chains(argument_parser &parser, int rank,
+                             int num_procs) {
+  unsigned int id = get_arg_val<int_argument>(parser, "id");
+  unsigned int num_chains
+      = get_arg_val<int_argument>(parser, "method", "sample", "num_chains");
+  if (num_chains < static_cast<unsigned int>(num_procs)) {
+    std::stringstream msg;
+    msg << "Argument 'mpi_chains' needs at least one chain per MPI process, "
+        << "found num_chains=" << num_chains << " for " << num_procs
+        << " processes.";
+    throw std::invalid_argument(msg.str());
+  }
+  unsigned int first = rank * num_chains / num_procs;
+  unsigned int last = (rank + 1) * num_chains / num_procs;
+  dynamic_cast<int_argument *>(get_arg(parser, "id"))->set_value(id + first);
+  dynamic_cast<int_argument *>(
+      get_arg(parser, "method", "sample", "num_chains"))
+      ->set_value(last - first);
+  if (num_procs > 1) {
+    std::string profile_file
+        = get_arg_val<string_argument>(parser, "output", "profile_file");
+    dynamic_cast<string_argument *>(get_arg(parser, "output", "profile_file"))
+        ->set_value(file::make_filenames(profile_file, "_rank", ".csv",
+                                         num_procs, 0)[rank]);
+  }
+  return num_chains > 1;
+}
+
+/**
+ * Create the convergence monitor for the sample method's stop rule
+ * and wrap the per-chain sample writers so that it sees their draws.
+ * Returns nullptr if sampling runs for all iterations.
+ *
+ * @param parser user config
+ * @param writers per-chain sample writers
+ * @return convergence monitor or nullptr
+ */
+inline std::shared_ptr<convergence_monitor> init_convergence_monitor(
+    argument_parser &parser, std::vector<output_writer> &writers) {
+  if (get_arg_val<list_argument>(parser, "method", "sample", "stop_rule")
+          != "ess"
+      || get_arg_val<list_argument>(parser, "method", "sample", "algorithm")
+             == "fixed_param") {
+    return nullptr;
+  }
+  int num_warmup
+      = get_arg_val<int_argument>(parser, "method", "sample", "num_warmup");
+  int num_samples
+      = get_arg_val<int_argument>(parser, "method", "sample", "num_samples");
+  int num_thin = get_arg_val<int_argument>(parser, "method", "sample", "thin");
+  bool save_warmup
+      = get_arg_val<bool_argument>(parser, "method", "sample", "save_warmup");
+  // draws are saved on iterations 0, thin, 2 * thin, ...
+  size_t num_warmup_draws
+      = save_warmup ? (num_warmup + num_thin - 1) / num_thin : 0;
+  size_t num_sampling_draws = (num_samples + num_thin - 1) / num_thin;
+  auto monitor = std::make_shared<convergence_monitor>(
+      writers.size(), num_warmup_draws, num_sampling_draws,
+      get_arg_val<real_argument>(parser, "method", "sample", "stop_rule",
+                                 "ess", "target_ess"),
+      get_arg_val<real_argument>(parser, "method", "sample", "stop_rule",
+                                 "ess", "max_rhat"),
+      get_arg_val<int_argument>(parser, "method", "sample", "stop_rule", "ess",
+                                "check_every"));
+  for (size_t i = 0; i < writers.size(); ++i) {
+    writers[i] = output_writer(
+        std::make_unique<monitored_writer>(monitor, i, std::move(writers[i])));
+  }
+  return monitor;
+}
+
+namespace internal {
+
+/**
+ * Return a var context holding values of the model parameters, for use
+ * as inits.
+ *
+ * @param model model
+ * @param values constrained parameter values, in the order of the
+ *   output columns
+ * @return var context
+ */
+inline shared_context_ptr param_values_context(
+    const stan::model::model_base &model, const std::vector<double> &values) {
+  std::vector<std::string> names;
+  std::vector<std::vector<size_t>> dims;
+  model.get_param_names(names, false, false);
+  model.get_dims(dims, false, false);
+  return std::make_shared<stan::io::array_var_context>(names, values, dims);
+}
+
+/**
+ * Return a var context holding an inverse metric, as read from a
+ * `metric_file`.
+ *
+ * @param values diagonal, or dense matrix in either order
+ * @param num_params number of unconstrained parameters
+ * @param dense true for a dense metric
+ * @return var context
+ */
+inline shared_context_ptr inv_metric_context(const std::vector<double> &values,
+                                             size_t num_params, bool dense) {
+  std::vector<size_t> dims{num_params};
+  if (dense) {
+    dims.push_back(num_params);
+  }
+  return std::make_shared<stan::io::array_var_context>(
+      std::vector<std::string>{"inv_metric"}, values,
+      std::vector<std::vector<size_t>>{dims});
+}
+
+/**
+ * Read the step size and inverse metric saved by `save_metric`.
+ *
+ * @param fname name of JSON file
+ * @param[out] stepsize step size
+ * @param[out] inv_metric inverse metric, dense matrices in row-major
+ *   order
+ * @return false if the file doesn't exist
+ * @throw std::invalid_argument if the file can't be parsed
+ */
+inline bool read_metric_json(const std::string &fname, double &stepsize,
+                             std::vector<double> &inv_metric) {
+  std::ifstream in(fname);
+  if (!in.is_open()) {
+    return false;
+  }
+  std::string json((std::istreambuf_iterator<char>(in)),
+                   std::istreambuf_iterator<char>());
+  rapidjson::Document doc;
+  doc.Parse(json.c_str());
+  if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("stepsize")
+      || !doc["stepsize"].IsNumber() || !doc.HasMember("inv_metric")
+      || !doc["inv_metric"].IsArray()) {
+    throw std::invalid_argument("Can't read step size and metric from \""
+                                + fname + "\"");
+  }
+  stepsize = doc["stepsize"].GetDouble();
+  inv_metric.clear();
+  for (const auto &row : doc["inv_metric"].GetArray()) {
+    if (row.IsNumber()) {
+      inv_metric.push_back(row.GetDouble());
+      continue;
+    }
+    if (!row.IsArray()) {
+      throw std::invalid_argument("Can't read step size and metric from \""
+                                  + fname + "\"");
+    }
+    for (const auto &x : row.GetArray()) {
+      if (!x.IsNumber()) {
+        throw std::invalid_argument("Can't read step size and metric from \""
+                                    + fname + "\"");
+      }
+      inv_metric.push_back(x.GetDouble());
+    }
+  }
+  return true;
+}
+
+/**
+ * Return the name of a chain's output file, whichever of the CSV and
+ * binary formats and compression codecs it was written with.
+ *
+ * @param base name of the file without format and compression suffix
+ * @return name of existing file, empty if there is none
+ */
+inline std::string find_output_file(const std::string &base) {
+  for (const char *format : {".csv", binary_format::SUFFIX}) {
+    for (const char *codec : {"none", "gzip", "zstd"}) {
+      std::string fname = base + format + compression::suffix(codec);
+      if (std::ifstream(fname).good()) {
+        return fname;
+      }
+    }
+  }
+  return "";
+}
+
+}  // namespace internal
+
+/**
+ * Set up a sample run to start from the adaptation and last draws of a
+ * previous run with the same number of chains (`warm_start`).
+ *
+ * Each chain starts from the last draw of the matching chain of the
+ * previous run, with its inverse metric.  The metric and step size are
+ * read from the `_metric.json` files if the previous run saved them,
+ * otherwise from the adaptation comments of its output.  The chains
+ * share one initial step size, the mean of the previous chains'.  The
+ * full warmup is replaced by `warm_start_warmup` iterations, during
+ * which adaptation only tunes the step size: the adaptation windows are
+ * set to a single terminal buffer, so the metric isn't re-estimated.
+ * These settings are made in the parser, so that the output config
+ * records the run as it is done.
+ *
+ * @param parser user command
+ * @param model model
+ * @param num_chains number of chains
+ * @param id id of first chain
+ * @param[out] init_contexts inits of each chain
+ * @param number_single number the file names of a single chain
+ * @return inverse metric of each chain, empty for the unit metric or if
+ *   there is no warm start
+ * @throw std::invalid_argument if the previous run can't be read or
+ *   doesn't match the model and arguments
+ */
+inline context_vector apply_warm_start(argument_parser &parser,
+                                       const stan::model::model_base &model,
+                                       unsigned int num_chains, unsigned int id,
+                                       context_vector &init_contexts,
+                                       bool number_single = false) {
+  std::string warm_start
+      = get_arg_val<string_argument>(parser, "method", "sample", "warm_start");
+  if (warm_start.empty()) {
+    return {};
+  }
+  auto algorithm = get_arg(parser, "method", "sample", "algorithm");
+  if (dynamic_cast<list_argument *>(algorithm)->value() != "hmc") {
+    throw std::invalid_argument(
+        "A warm start (warm_start) is only available for the hmc "
+        "algorithm.");
+  }
+  auto hmc = algorithm->arg("hmc");
+  std::string metric = get_arg_val<list_argument>(*hmc, "metric");
+  if (!get_arg_val<string_argument>(*hmc, "metric_file").empty()) {
+    throw std::invalid_argument(
+        "A warm start (warm_start) takes the metric from the previous run, "
+        "it can't be used with a metric_file.");
+  }
+  if (get_arg_val<bool_argument>(parser, "method", "sample", "resume")) {
+    throw std::invalid_argument(
+        "An interrupted run can't be resumed with a warm start.");
+  }
+  std::string init = get_arg_val<string_argument>(parser, "init");
+  bool init_file = false;
+  try {
+    std::stod(init);
+  } catch (const std::logic_error &e) {
+    init_file = !init.empty();
+  }
+  if (init_file) {
+    throw std::invalid_argument(
+        "A warm start (warm_start) takes the inits from the previous run, "
+        "it can't be used with an init file.");
+  }
+
+  std::vector<std::string> param_names;
+  model.constrained_param_names(param_names, false, false);
+  const size_t num_params = model.num_params_r();
+  std::string warm_start_base = compression::split_suffix(warm_start).first;
+  auto bases = file::make_filenames(warm_start_base, "", "", num_chains, id,
+                                    number_single);
+  auto metric_files = file::make_filenames(warm_start_base, "_metric", ".json",
+                                           num_chains, id, number_single);
+  context_vector metric_contexts;
+  double stepsize_sum = 0;
+  for (size_t i = 0; i < num_chains; ++i) {
+    std::string fname = internal::find_output_file(bases[i]);
+    if (fname.empty()) {
+      throw std::invalid_argument("Can't find output file of chain "
+                                  + std::to_string(id + i)
+                                  + " of the previous run \"" + warm_start
+                                  + "\" for a warm start.");
+    }
+    stan::io::stan_csv previous;
+    size_t col_offset = 0;
+    size_t num_rows = 0;
+    size_t num_cols = 0;
+    parse_stan_csv(fname, model, param_names, previous, col_offset, num_rows,
+                   num_cols);
+    if (num_rows == 0) {
+      throw std::invalid_argument("Output file \"" + fname
+                                  + "\" has no draws to warm start from.");
+    }
+    std::vector<double> last_draw(num_cols);
+    for (size_t j = 0; j < num_cols; ++j) {
+      last_draw[j] = previous.samples(num_rows - 1, col_offset + j);
+    }
+    init_contexts[i] = internal::param_values_context(model, last_draw);
+
+    double stepsize = previous.adaptation.step_size;
+    std::vector<double> inv_metric(previous.adaptation.metric.data(),
+                                   previous.adaptation.metric.data()
+                                       + previous.adaptation.metric.size());
+    internal::read_metric_json(metric_files[i], stepsize, inv_metric);
+    if (!(stepsize > 0)) {
+      throw std::invalid_argument("Output file \"" + fname
+                                  + "\" has no adapted step size.");
+    }
+    stepsize_sum += stepsize;
+    if (metric == "unit_e") {
+      continue;
+    }
+    size_t size = metric == "dense_e" ? num_params * num_params : num_params;
+    if (inv_metric.size() != size) {
+      throw std::invalid_argument("The previous run \"" + warm_start
+                                  + "\" doesn't have a " + metric
+                                  + " metric for a warm start.");
+    }
+    metric_contexts.push_back(internal::inv_metric_context(
+        inv_metric, num_params, metric == "dense_e"));
+  }
+
+  dynamic_cast<real_argument *>(hmc->arg("stepsize"))
+      ->set_value(stepsize_sum / num_chains);
+  int num_warmup = get_arg_val<int_argument>(parser, "method", "sample",
+                                             "warm_start_warmup");
+  dynamic_cast<int_argument *>(get_arg(parser, "method", "sample",
+                                       "num_warmup"))
+      ->set_value(num_warmup);
+  auto adapt = get_arg(parser, "method", "sample", "adapt");
+  dynamic_cast<u_int_argument *>(adapt->arg("init_buffer"))->set_value(0);
+  dynamic_cast<u_int_argument *>(adapt->arg("window"))->set_value(0);
+  dynamic_cast<u_int_argument *>(adapt->arg("term_buffer"))
+      ->set_value(num_warmup);
+  return metric_contexts;
+}
+
+/**
+ * Return the names of the per-chain checkpoint files.
+ *
+ * @param parser user command
+ * @param num_chains number of chains
+ * @param id id of first chain
+ * @param number_single number the file name of a single chain
+ * @return file names, empty if checkpoints are off
+ */
+inline std::vector<std::string> get_checkpoint_filenames(
+    argument_parser &parser, unsigned int num_chains, unsigned int id,
+    bool number_single = false) {
+  std::string checkpoint_file = get_arg_val<string_argument>(
+      parser, "method", "sample", "checkpoint_file");
+  if (checkpoint_file.empty()) {
+    return {};
+  }
+  return file::make_filenames(checkpoint_file, "", ".ckpt", num_chains, id,
+                              number_single);
+}
+
+/**
+ * Check the checkpoint arguments of the sample method and, for a run
+ * which resumes, read the checkpoint of each chain and move the output
+ * files of the interrupted run aside as "<name>.interrupted".  This must
+ * be done before the output files are created.
+ *
+ * An output file is only moved if it holds all the draws counted by its
+ * checkpoint, so that a resumed run which is itself interrupted before
+ * copying the earlier draws doesn't replace the complete file.
+ *
+ * @param parser user command
+ * @param num_chains number of chains
+ * @param id id of first chain
+ * @param output_file output filename
+ * @param binary_output true if output is in the binary format
+ * @param compression compression options of the output
+ * @param async_output true if output is written asynchronously
+ * @param[out] interrupted_files names of the moved output files
+ * @param number_single number the file names of a single chain
+ * @return checkpoints, one per chain, or empty if not resuming
+ * @throw std::invalid_argument if the arguments don't allow checkpoints
+ *   or the checkpoints can't be resumed
+ */
+inline std::vector<chain_checkpoint> load_checkpoints(
+    argument_parser &parser, unsigned int num_chains, unsigned int id,
+    const std::string &output_file, bool binary_output,
+    const compression::options &compression, bool async_output,
+    std::vector<std::string> &interrupted_files, bool number_single = false) {
+  std::vector<std::string> checkpoint_files
+      = get_checkpoint_filenames(parser, num_chains, id, number_single);
+  bool resume
+      = get_arg_val<bool_argument>(parser, "method", "sample", "resume");
+  if (checkpoint_files.empty()) {
+    if (resume) {
+      throw std::invalid_argument(
+          "Resuming (resume=1) requires the checkpoint files of the "
+          "interrupted run (checkpoint_file).");
+    }
+    return {};
+  }
+  if (get_arg_val<list_argument>(parser, "method", "sample", "algorithm")
+      != "hmc") {
+    throw std::invalid_argument(
+        "Checkpoints are only available for the hmc algorithm.");
+  }
+  if (async_output) {
+    throw std::invalid_argument(
+        "Checkpoints (checkpoint_file) can't be used with asynchronous "
+        "output (async=1).");
+  }
+  if (!resume) {
+    return {};
+  }
+  if (get_arg_val<list_argument>(parser, "method", "sample", "stop_rule")
+      != "none") {
+    throw std::invalid_argument(
+        "An interrupted run can't be resumed with a stop rule.");
+  }
+  auto output_files = file::make_filenames(
+      compression::split_suffix(output_file).first, "",
+      binary_output ? binary_format::SUFFIX : ".csv", num_chains, id,
+      number_single);
+  std::vector<chain_checkpoint> checkpoints;
+  interrupted_files.clear();
+  for (size_t i = 0; i < num_chains; ++i) {
+    chain_checkpoint state = read_checkpoint(checkpoint_files[i]);
+    std::string fname
+        = output_files[i] + compression::suffix(compression.codec);
+    std::string interrupted = fname + ".interrupted";
+    if (std::ifstream(interrupted).good()) {
+      std::vector<double> draws;
+      size_t num_rows = 0;
+      try {
+        draws_reader reader(fname);
+        while (num_rows < state.num_rows) {
+          size_t num_read = reader.read(1000, draws);
+          if (num_read == 0) {
+            break;
+          }
+          num_rows += num_read;
+        }
+      } catch (const std::invalid_argument &e) {
+      }
+      if (num_rows >= state.num_rows) {
+        std::remove(interrupted.c_str());
+      }
+    }
+    if (!std::ifstream(interrupted).good()
+        && std::rename(fname.c_str(), interrupted.c_str()) != 0) {
+      throw std::invalid_argument("Can't find output file \"" + fname
+                                  + "\" of the interrupted run.");
+    }
+    interrupted_files.push_back(interrupted);
+    checkpoints.push_back(std::move(state));
+  }
+  return checkpoints;
+}
+
+/**
+ * Wrap the per-chain sample writers in writers which save checkpoints,
+ * and start the thread which writes them.  Nothing is done if
+ * checkpoints are off.
+ *
+ * @param parser user command
+ * @param model model
+ * @param writers vector of writers to wrap
+ * @param id id of first chain
+ * @param resume_from checkpoints to resume from, or empty
+ * @param interrupted_files output files of the interrupted run
+ * @param[out] io thread which writes the checkpoints
+ * @param number_single number the file name of a single chain
+ * @return checkpoint writers, owned by the sample writers
+ */
+inline std::vector<checkpoint_writer *> init_checkpoint_writers(
+    argument_parser &parser, const stan::model::model_base &model,
+    std::vector<output_writer> &writers, unsigned int id,
+    const std::vector<chain_checkpoint> &resume_from,
+    const std::vector<std::string> &interrupted_files,
+    std::shared_ptr<checkpoint_thread> &io, bool number_single = false) {
+  std::vector<std::string> checkpoint_files
+      = get_checkpoint_filenames(parser, writers.size(), id, number_single);
+  std::vector<checkpoint_writer *> checkpoint_writers;
+  if (checkpoint_files.empty()) {
+    return checkpoint_writers;
+  }
+  int every = get_arg_val<int_argument>(parser, "method", "sample",
+                                        "checkpoint_every");
+  bool draw_stepsize
+      = get_arg_val<real_argument>(parser, "method", "sample", "algorithm",
+                                   "hmc", "stepsize_jitter")
+        == 0;
+  std::vector<std::string> param_names;
+  model.constrained_param_names(param_names, false, false);
+  io = std::make_shared<checkpoint_thread>();
+  for (size_t i = 0; i < writers.size(); ++i) {
+    auto writer = std::make_unique<checkpoint_writer>(
+        io, checkpoint_files[i], every, param_names.size(), draw_stepsize,
+        std::move(writers[i]));
+    if (!resume_from.empty()) {
+      writer->resume(resume_from[i], interrupted_files[i]);
+    }
+    checkpoint_writers.push_back(writer.get());
+    writers[i] = output_writer(std::move(writer));
+  }
+  return checkpoint_writers;
+}
+
+/**
+ * Resume the chains of an interrupted sample run from their checkpoints.
+ *
+ * Each chain runs on its own on the TBB pool, without warmup and with
+ * the step size and inverse metric of its checkpoint, from the position
+ * of its last saved draw, for the sampling iterations still to do.  The
+ * draws are thinned as before, so that the output holds the number of
+ * draws of an uninterrupted run.  The sampler's random number generator
+ * can't be restored, so a chain's generator is seeded with the random
+ * seed plus the number of draws already saved; the resumed chain is a
+ * valid continuation of the Markov chain, but not the same draws as an
+ * uninterrupted run.  The position is read from the output, so it has
+ * the precision of the output (`sig_figs`), which is exact in the
+ * binary format.
+ *
+ * @param model model
+ * @param parser user command
+ * @param checkpoints checkpoints, one per chain
+ * @param random_seed random seed
+ * @param id id of first chain
+ * @param interrupt interrupt callback
+ * @param logger logger
+ * @param init_writers per-chain writers for initial values
+ * @param sample_writers per-chain writers for draws
+ * @param diagnostic_writers per-chain writers for diagnostics
+ * @return error code, non-zero if any chain failed
+ */
+template <typename InitWriter, typename SampleWriter, typename DiagWriter>
+int services_resume_sample(stan::model::model_base &model,
+                           argument_parser &parser,
+                           const std::vector<chain_checkpoint> &checkpoints,
+                           unsigned int random_seed, unsigned int id,
+                           stan::callbacks::interrupt &interrupt,
+                           stan::callbacks::logger &logger,
+                           std::vector<InitWriter> &init_writers,
+                           std::vector<SampleWriter> &sample_writers,
+                           std::vector<DiagWriter> &diagnostic_writers) {
+  int num_samples
+      = get_arg_val<int_argument>(parser, "method", "sample", "num_samples");
+  int num_thin = get_arg_val<int_argument>(parser, "method", "sample", "thin");
+  int refresh = get_arg_val<int_argument>(parser, "output", "refresh");
+  auto hmc = parser.arg("method")->arg("sample")->arg("algorithm")->arg("hmc");
+  std::string metric = get_arg_val<list_argument>(*hmc, "metric");
+  std::string engine = get_arg_val<list_argument>(*hmc, "engine");
+  double jitter = get_arg_val<real_argument>(*hmc, "stepsize_jitter");
+  size_t num_params = model.num_params_r();
+
+  std::vector<int> return_codes(checkpoints.size(),
+                                stan::services::error_codes::OK);
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, checkpoints.size(), 1),
+      [&](const tbb::blocked_range<size_t> &r) {
+        for (size_t i = r.begin(); i < r.end(); ++i) {
+          const chain_checkpoint &state = checkpoints[i];
+          std::stringstream msg;
+          if ((metric == "unit_e") != (state.metric == chain_checkpoint::UNIT_E)
+              || (metric == "diag_e"
+                  && state.inv_metric.size() != num_params)
+              || (metric == "dense_e"
+                  && state.inv_metric.size() != num_params * num_params)) {
+            msg << "Checkpoint of chain " << id + i
+                << " doesn't match metric=" << metric
+                << ", can't resume sampling.";
+            throw std::invalid_argument(msg.str());
+          }
+          if (state.stepsize <= 0) {
+            msg << "Checkpoint of chain " << id + i
+                << " was taken before adaptation ended, can't resume "
+                   "sampling.";
+            throw std::invalid_argument(msg.str());
+          }
+          shared_context_ptr init_context
+              = internal::param_values_context(model, state.params);
+          shared_context_ptr metric_context = internal::inv_metric_context(
+              state.inv_metric, num_params, metric == "dense_e");
+          stan::io::var_context &init = *init_context;
+          stan::io::var_context &inv_metric = *metric_context;
+          int num_done = state.num_sampling_rows() * num_thin;
+          int num_remaining = std::max(0, num_samples - num_done);
+          unsigned int seed = random_seed + state.num_sampling_rows();
+          unsigned int chain = id + i;
+          if (engine == "nuts") {
+            int max_depth = get_arg_val<int_argument>(*hmc, "engine", "nuts",
+                                                      "max_depth");
+            if (metric == "dense_e") {
+              return_codes[i] = stan::services::sample::hmc_nuts_dense_e(
+                  model, init, inv_metric, seed, chain, 0, 0, num_remaining,
+                  num_thin, false, refresh, state.stepsize, jitter, max_depth,
+                  interrupt, logger, init_writers[i], sample_writers[i],
+                  diagnostic_writers[i]);
+            } else if (metric == "diag_e") {
+              return_codes[i] = stan::services::sample::hmc_nuts_diag_e(
+                  model, init, inv_metric, seed, chain, 0, 0, num_remaining,
+                  num_thin, false, refresh, state.stepsize, jitter, max_depth,
+                  interrupt, logger, init_writers[i], sample_writers[i],
+                  diagnostic_writers[i]);
+            } else {
+              return_codes[i] = stan::services::sample::hmc_nuts_unit_e(
+                  model, init, seed, chain, 0, 0, num_remaining, num_thin,
+                  false, refresh, state.stepsize, jitter, max_depth,
+                  interrupt, logger, init_writers[i], sample_writers[i],
+                  diagnostic_writers[i]);
+            }
+          } else {
+            double int_time = get_arg_val<real_argument>(*hmc, "engine",
+                                                         "static", "int_time");
+            if (metric == "dense_e") {
+              return_codes[i] = stan::services::sample::hmc_static_dense_e(
+                  model, init, inv_metric, seed, chain, 0, 0, num_remaining,
+                  num_thin, false, refresh, state.stepsize, jitter, int_time,
+                  interrupt, logger, init_writers[i], sample_writers[i],
+                  diagnostic_writers[i]);
+            } else if (metric == "diag_e") {
+              return_codes[i] = stan::services::sample::hmc_static_diag_e(
+                  model, init, inv_metric, seed, chain, 0, 0, num_remaining,
+                  num_thin, false, refresh, state.stepsize, jitter, int_time,
+                  interrupt, logger, init_writers[i], sample_writers[i],
+                  diagnostic_writers[i]);
+            } else {
+              return_codes[i] = stan::services::sample::hmc_static_unit_e(
+                  model, init, seed, chain, 0, 0, num_remaining, num_thin,
+                  false, refresh, state.stepsize, jitter, int_time, interrupt,
+                  logger, init_writers[i], sample_writers[i],
+                  diagnostic_writers[i]);
+            }
+          }
+        }
+      });
+  for (int code : return_codes) {
+    if (code != stan::services::error_codes::OK) {
+      return code;
+    }
+  }
+  return stan::services::error_codes::OK;
+}
+
+namespace internal {
+
+/**
+ * Writer which keeps the column names and the last values written by an
+ * optimizer, which are those of the mode it found, and forwards all
+ * output to another writer.
+ */
+class mode_writer : public stan::callbacks::writer {
+ public:
+  using stan::callbacks::writer::operator();
+
+  explicit mode_writer(stan::callbacks::writer &writer) : writer_(writer) {}
+
+  void operator()(const std::vector<std::string> &names) {
+    names_ = names;
+    writer_(names);
+  }
+
+  void operator()(const std::vector<double> &values) {
+    values_ = values;
+    writer_(values);
+  }
+
+  void operator()() { writer_(); }
+
+  void operator()(const std::string &message) { writer_(message); }
+
+  const std::vector<std::string> &names() const { return names_; }
+  const std::vector<double> &values() const { return values_; }
+
+ private:
+  stan::callbacks::writer &writer_;
+  std::vector<std::string> names_;
+  std::vector<double> values_;
+};
+
+/**
+ * Return true if two modes found by the optimizer are the same, that is
+ * if their first values all match to a relative tolerance.
+ *
+ * @param a values of first mode
+ * @param b values of second mode
+ * @param num_values number of leading values compared, the log density
+ *   and the parameters; generated quantities may differ between starts
+ * @param tol relative tolerance
+ * @return true if the modes match
+ */
+inline bool same_mode(const std::vector<double> &a,
+                      const std::vector<double> &b, size_t num_values,
+                      double tol = 1e-3) {
+  if (a.size() < num_values || b.size() < num_values) {
+    return false;
+  }
+  for (size_t i = 0; i < num_values; ++i) {
+    double scale = 1 + std::max(std::fabs(a[i]), std::fabs(b[i]));
+    if (!(std::fabs(a[i] - b[i]) <= tol * scale)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace internal
+
+/**
+ * Run optimizations from several initial values in parallel on the TBB
+ * pool and write the mode with the highest log density.
+ *
+ * Start `i` uses the random number stream of chain `id + i` for its
+ * random initial values and writes its own output to `start_writers[i]`.
+ * The main output gets the column names and the best mode, followed by
+ * comment lines listing the distinct modes found, highest first, and
+ * the starts which failed.
+ *
+ * @tparam Optimize type of function which runs one optimization
+ * @param model Stan model
+ * @param init_contexts initial values of each start
+ * @param id id of first start
+ * @param optimize function which runs an optimization, given its
+ *   initial values, chain id and output writer, and returns its error
+ *   code
+ * @param logger logger for messages
+ * @param start_writers writers for the output of each start
+ * @param parameter_writer writer for the best mode
+ * @return error code, OK if any start succeeded
+ */
+template <typename Optimize>
+int services_multi_start_optimize(const stan::model::model_base &model,
+                                  const context_vector &init_contexts,
+                                  unsigned int id, Optimize &&optimize,
+                                  stan::callbacks::logger &logger,
+                                  std::vector<output_writer> &start_writers,
+                                  stan::callbacks::writer &parameter_writer) {
+  const int OK = stan::services::error_codes::OK;
+  size_t num_starts = init_contexts.size();
+  std::vector<internal::mode_writer> mode_writers;
+  mode_writers.reserve(num_starts);
+  for (size_t i = 0; i < num_starts; ++i) {
+    mode_writers.emplace_back(start_writers[i]);
+  }
+  std::vector<int> return_codes(num_starts, OK);
+  internal::run_chains(num_starts, [&](size_t i) {
+    return_codes[i] = optimize(*init_contexts[i], id + i, mode_writers[i]);
+    return return_codes[i];
+  });
+
+  std::vector<std::string> param_names;
+  model.constrained_param_names(param_names, false, false);
+  size_t num_compared = param_names.size() + 1;  // lp__ and parameters
+  struct found_mode {
+    std::vector<double> values;
+    std::vector<unsigned int> starts;
+  };
+  std::vector<found_mode> modes;
+  std::stringstream failed;
+  int failed_code = OK;
+  for (size_t i = 0; i < num_starts; ++i) {
+    const std::vector<double> &values = mode_writers[i].values();
+    if (return_codes[i] != OK || values.empty()) {
+      failed << (failed_code == OK ? "" : ", ") << id + i << " ("
+             << return_codes[i] << ")";
+      failed_code = return_codes[i] != OK
+                        ? return_codes[i]
+                        : stan::services::error_codes::SOFTWARE;
+      continue;
+    }
+    auto mode = std::find_if(modes.begin(), modes.end(), [&](const auto &m) {
+      return internal::same_mode(m.values, values, num_compared);
+    });
+    if (mode == modes.end()) {
+      modes.push_back(found_mode{values, {}});
+      mode = modes.end() - 1;
+    } else if (values[0] > mode->values[0]) {
+      mode->values = values;
+    }
+    mode->starts.push_back(id + i);
+  }
+  if (modes.empty()) {
+    std::stringstream msg;
+    msg << "All " << num_starts << " optimizations failed.";
+    logger.error(msg.str());
+    return failed_code;
+  }
+  std::stable_sort(modes.begin(), modes.end(),
+                   [](const found_mode &a, const found_mode &b) {
+                     return a.values[0] > b.values[0];
+                   });
+
+  unsigned int best_start = modes[0].starts[0];
+  parameter_writer(mode_writers[best_start - id].names());
+  parameter_writer(modes[0].values);
+  std::stringstream msg;
+  msg << "Multi-start optimization: " << num_starts << " starts, "
+      << modes.size() << " distinct modes";
+  parameter_writer(msg.str());
+  for (size_t k = 0; k < modes.size(); ++k) {
+    msg.str("");
+    msg << "Mode " << k + 1 << ": lp__ = " << modes[k].values[0]
+        << ", found by starts ";
+    for (size_t j = 0; j < modes[k].starts.size(); ++j) {
+      msg << (j == 0 ? "" : ", ") << modes[k].starts[j];
+    }
+    parameter_writer(msg.str());
+  }
+  if (failed_code != OK) {
+    parameter_writer("Failed starts (return code): " + failed.str());
+  }
+  msg.str("");
+  msg << "Best mode of " << num_starts << " optimizations: lp__ = "
+      << modes[0].values[0] << ", found by " << modes[0].starts.size()
+      << " of them, " << modes.size() << " distinct modes found.";
+  logger.info(msg.str());
+  return OK;
+}
+
+namespace internal {
+
+/**
+ * Writer which holds all output in memory, in the order it was written,
+ * and also forwards it to another writer if one is given.
+ */
+class output_buffer : public stan::callbacks::writer {
+ public:
+  using stan::callbacks::writer::operator();
+
+  output_buffer() = default;
+
+  explicit output_buffer(stan::callbacks::writer &target)
+      : target_(&target) {}
+
+  void operator()(const std::vector<std::string> &names) {
+    names_ = names;
+    records_.push_back({record::NAMES, std::string(), {}});
+    if (target_)
+      (*target_)(names);
+  }
+
+  void operator()(const std::vector<double> &values) {
+    records_.push_back({record::VALUES, std::string(), values});
+    if (target_)
+      (*target_)(values);
+  }
+
+  void operator()() {
+    records_.push_back({record::BLANK, std::string(), {}});
+    if (target_)
+      (*target_)();
+  }
+
+  void operator()(const std::string &message) {
+    records_.push_back({record::MESSAGE, message, {}});
+    if (target_)
+      (*target_)(message);
+  }
+
+  /**
+   * Return the last values written, or an empty vector if none were.
+   */
+  std::vector<double> last_values() const {
+    for (auto it = records_.rbegin(); it != records_.rend(); ++it) {
+      if (it->kind == record::VALUES) {
+        return it->values;
+      }
+    }
+    return {};
+  }
+
+  /**
+   * Forward the held output, in the order it was written.
+   *
+   * @param writer writer to forward to
+   */
+  void replay(stan::callbacks::writer &writer) const {
+    for (const auto &rec : records_) {
+      switch (rec.kind) {
+        case record::NAMES:
+          writer(names_);
+          break;
+        case record::VALUES:
+          writer(rec.values);
+          break;
+        case record::BLANK:
+          writer();
+          break;
+        case record::MESSAGE:
+          writer(rec.message);
+          break;
+      }
+    }
+  }
+
+ private:
+  struct record {
+    enum { NAMES, VALUES, BLANK, MESSAGE } kind;
+    std::string message;
+    std::vector<double> values;
+  };
+  stan::callbacks::writer *target_ = nullptr;
+  std::vector<std::string> names_;
+  std::vector<record> records_;
+};
+
+}  // namespace internal
+
+/**
+ * Run ADVI fits in parallel on the TBB pool and write the output of the
+ * fit with the highest final ELBO.
+ *
+ * Run `i` uses the random number stream of chain `id + i`, so the runs
+ * are reproducible for a given seed.  The ELBO trace of each run goes to
+ * `trace_writers[i]` as it is computed.  The selected run's approximation
+ * and draws are written to the main output, followed by comment lines
+ * giving the final ELBO of each run, and its ELBO trace to the
+ * diagnostic output.
+ *
+ * @tparam Fit type of function which runs one ADVI fit
+ * @param init_contexts initial values of each run
+ * @param id id of first run
+ * @param fit function which runs a fit, given its initial values, chain
+ *   id, output writer and ELBO trace writer, and returns its error code
+ * @param logger logger for messages
+ * @param trace_writers writers for the ELBO trace of each run
+ * @param parameter_writer writer for the selected approximation
+ * @param diagnostic_writer writer for the selected ELBO trace
+ * @return error code, OK if any run succeeded
+ */
+template <typename Fit>
+int services_multi_run_variational(const context_vector &init_contexts,
+                                   unsigned int id, Fit &&fit,
+                                   stan::callbacks::logger &logger,
+                                   std::vector<output_writer> &trace_writers,
+                                   stan::callbacks::writer &parameter_writer,
+                                   stan::callbacks::writer &diagnostic_writer) {
+  const int OK = stan::services::error_codes::OK;
+  size_t num_runs = init_contexts.size();
+  std::vector<internal::output_buffer> outputs(num_runs);
+  std::vector<internal::output_buffer> traces;
+  traces.reserve(num_runs);
+  for (size_t i = 0; i < num_runs; ++i) {
+    traces.emplace_back(trace_writers[i]);
+  }
+  std::vector<int> return_codes(num_runs, OK);
+  internal::run_chains(num_runs, [&](size_t i) {
+    return_codes[i] = fit(*init_contexts[i], id + i, outputs[i], traces[i]);
+    return return_codes[i];
+  });
+
+  // the trace rows are iteration, time and ELBO
+  std::vector<double> elbos(num_runs,
+                            -std::numeric_limits<double>::infinity());
+  size_t best = num_runs;
+  for (size_t i = 0; i < num_runs; ++i) {
+    std::vector<double> last = traces[i].last_values();
+    if (return_codes[i] != OK || last.size() < 3 || std::isnan(last[2])) {
+      continue;
+    }
+    elbos[i] = last[2];
+    if (best == num_runs || elbos[i] > elbos[best]) {
+      best = i;
+    }
+  }
+  if (best == num_runs) {
+    std::stringstream msg;
+    msg << "All " << num_runs << " ADVI runs failed.";
+    logger.error(msg.str());
+    for (int return_code : return_codes) {
+      if (return_code != OK) {
+        return return_code;
+      }
+    }
+    return stan::services::error_codes::SOFTWARE;
+  }
+
+  outputs[best].replay(parameter_writer);
+  traces[best].replay(diagnostic_writer);
+  std::stringstream msg;
+  msg << "Multi-run ADVI: " << num_runs << " runs, selected run " << id + best
+      << " with the highest final ELBO";
+  parameter_writer(msg.str());
+  for (size_t i = 0; i < num_runs; ++i) {
+    msg.str("");
+    msg << "Run " << id + i << ": ";
+    if (return_codes[i] != OK) {
+      msg << "failed with return code " << return_codes[i];
+    } else if (std::isinf(elbos[i])) {
+      msg << "no ELBO computed";
+    } else {
+      msg << "final ELBO = " << elbos[i];
+    }
+    parameter_writer(msg.str());
+  }
+  msg.str("");
+  msg << "Selected ADVI run " << id + best << " of " << num_runs
+      << ", final ELBO = " << elbos[best] << ".";
+  logger.info(msg.str());
+  return OK;
+}
+
 template <typename T, typename... Ts>
 void init_filestream_writers(std::vector<T> &writers, unsigned int num_chains,
-                             unsigned int id, std::string &filename,
-                             std::string tag, std::string suffix, int sig_figs,
-                             Ts &&... args) {
+                             unsigned int id, bool number_single,
+                             std::string &filename, std::string tag,
+                             std::string suffix, int sig_figs, Ts &&... args) {
   writers.reserve(num_chains);
-  auto filenames = file::make_filenames(filename, tag, suffix, num_chains, id);
+  // side files of compressed output are named after the uncompressed name
+  auto filenames
+      = file::make_filenames(compression::split_suffix(filename).first, tag,
+                             suffix, num_chains, id, number_single);
 
   for (size_t i = 0; i < num_chains; ++i) {
     auto ofs = file::safe_create(filenames[i], sig_figs);
@@ -0,0 +1,474 @@
+#ifndef CMDSTAN_COMPRESSION_HPP
+#define CMDSTAN_COMPRESSION_HPP
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+#ifdef CMDSTAN_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CMDSTAN_ZSTD
+#include <zstd.h>
+#endif
+
+namespace cmdstan {
+
+/**
+ * Streaming compression of output files and transparent decompression
+ * of input files.
+ *
+ * Output is compressed in frames: every `frame_size` bytes written are
+ * compressed independently, as one gzip member or one zstd frame, and
+ * written out in one piece.  Concatenated members and frames are valid
+ * gzip and zstd files, and a run which is killed leaves a file whose
+ * complete frames can be read, so at most the last `frame_size` bytes
+ * of output are lost.  Flushing the stream doesn't cut a frame short;
+ * otherwise every CSV comment line would become a frame of its own.
+ *
+ * gzip requires building with CMDSTAN_ZLIB=true, zstd with
+ * CMDSTAN_ZSTD=true.
+ */
+namespace compression {
+
+constexpr const char *GZIP_SUFFIX = ".gz";
+constexpr const char *ZSTD_SUFFIX = ".zst";
+
+/**
+ * Settings of `output compression`.
+ */
+struct options {
+  std::string codec = "none";  // "none", "gzip" or "zstd"
+  int level = 0;
+  size_t frame_size = 0;  // bytes
+};
+
+/**
+ * Return the filename suffix of a codec.
+ *
+ * @param codec "none", "gzip" or "zstd"
+ * @return suffix, empty for "none"
+ */
+inline std::string suffix(const std::string &codec) {
+  if (codec == "gzip")
+    return GZIP_SUFFIX;
+  if (codec == "zstd")
+    return ZSTD_SUFFIX;
+  return "";
+}
+
+/**
+ * Split a filename into the name of the uncompressed file and the
+ * compression suffix, e.g. "output.csv.zst" into "output.csv" and
+ * ".zst".
+ *
+ * @param fname filename
+ * @return filename without compression suffix and the suffix, which is
+ *   empty if there is none
+ */
+inline std::pair<std::string, std::string> split_suffix(
+    const std::string &fname) {
+  for (const char *sfx : {GZIP_SUFFIX, ZSTD_SUFFIX}) {
+    if (boost::algorithm::ends_with(fname, sfx)) {
+      return {fname.substr(0, fname.size() - std::strlen(sfx)), sfx};
+    }
+  }
+  return {fname, ""};
+}
+
+/**
+ * Throw an exception if support for a codec wasn't compiled in.
+ *
+ * @param codec "none", "gzip" or "zstd"
+ */
+inline void check_available(const std::string &codec) {
+  std::stringstream msg;
+#ifndef CMDSTAN_ZLIB
+  if (codec == "gzip") {
+    msg << "gzip compression is not available, CmdStan must be built with "
+        << "CMDSTAN_ZLIB=true." << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+#endif
+#ifndef CMDSTAN_ZSTD
+  if (codec == "zstd") {
+    msg << "zstd compression is not available, CmdStan must be built with "
+        << "CMDSTAN_ZSTD=true." << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+#endif
+}
+
+namespace internal {
+
+/**
+ * Compress a block of data as one self-contained gzip member or zstd
+ * frame.
+ *
+ * @param codec "gzip" or "zstd"
+ * @param level compression level
+ * @param data start of data
+ * @param size number of bytes
+ * @param[out] out compressed data
+ */
+inline void compress_frame(const std::string &codec, int level,
+                           const char *data, size_t size, std::string &out) {
+#ifdef CMDSTAN_ZLIB
+  if (codec == "gzip") {
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    // 15 + 16: largest window, with gzip header and trailer
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY)
+        != Z_OK) {
+      throw std::runtime_error("Can't initialize gzip compression.");
+    }
+    out.resize(deflateBound(&zs, size));
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    zs.avail_in = size;
+    zs.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+      throw std::runtime_error("gzip compression failed.");
+    }
+    out.resize(zs.total_out);
+    return;
+  }
+#endif
+#ifdef CMDSTAN_ZSTD
+  if (codec == "zstd") {
+    out.resize(ZSTD_compressBound(size));
+    size_t ret = ZSTD_compress(&out[0], out.size(), data, size, level);
+    if (ZSTD_isError(ret)) {
+      throw std::runtime_error(std::string("zstd compression failed: ")
+                               + ZSTD_getErrorName(ret));
+    }
+    out.resize(ret);
+    return;
+  }
+#endif
+  check_available(codec);
+  throw std::invalid_argument("Unknown compression codec: " + codec);
+}
+
+/**
+ * Output stream buffer which compresses its contents a frame at a time
+ * into another stream.
+ */
+class compressing_buf : public std::streambuf {
+ public:
+  compressing_buf(std::unique_ptr<std::ostream> &&sink, const options &opts)
+      : sink_(std::move(sink)),
+        codec_(opts.codec),
+        level_(opts.level),
+        frame_(opts.frame_size > 0 ? opts.frame_size : 1) {
+    setp(frame_.data(), frame_.data() + frame_.size());
+  }
+
+  /**
+   * Compress what is buffered as a final frame and flush the sink.
+   */
+  void finish() {
+    write_frame();
+    sink_->flush();
+  }
+
+  /**
+   * Compress what is buffered as a frame of its own and flush the sink,
+   * so that the output can be read up to this point.
+   */
+  void end_frame() {
+    write_frame();
+    sink_->flush();
+  }
+
+ protected:
+  int_type overflow(int_type ch) {
+    write_frame();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(ch);
+      pbump(1);
+    }
+    return traits_type::not_eof(ch);
+  }
+
+ private:
+  std::unique_ptr<std::ostream> sink_;
+  std::string codec_;
+  int level_;
+  std::vector<char> frame_;
+  std::string compressed_;
+
+  void write_frame() {
+    size_t size = pptr() - pbase();
+    if (size == 0) {
+      return;
+    }
+    compress_frame(codec_, level_, pbase(), size, compressed_);
+    sink_->write(compressed_.data(), compressed_.size());
+    setp(frame_.data(), frame_.data() + frame_.size());
+  }
+};
+
+/**
+ * Input stream buffer which decompresses a gzip or zstd stream made of
+ * any number of concatenated members or frames.  Input which ends in
+ * the middle of a frame is read up to the last complete block.
+ */
+class decompressing_buf : public std::streambuf {
+ public:
+  decompressing_buf(std::unique_ptr<std::istream> &&source,
+                    const std::string &codec)
+      : source_(std::move(source)),
+        codec_(codec),
+        in_(1 << 17),
+        out_(1 << 17) {
+    check_available(codec);
+#ifdef CMDSTAN_ZLIB
+    if (codec_ == "gzip") {
+      std::memset(&zs_, 0, sizeof(zs_));
+      // 15 + 16: largest window, gzip header
+      if (inflateInit2(&zs_, 15 + 16) != Z_OK) {
+        throw std::runtime_error("Can't initialize gzip decompression.");
+      }
+    }
+#endif
+#ifdef CMDSTAN_ZSTD
+    if (codec_ == "zstd") {
+      ds_ = ZSTD_createDStream();
+      ZSTD_initDStream(ds_);
+    }
+#endif
+    setg(out_.data(), out_.data(), out_.data());
+  }
+
+  ~decompressing_buf() {
+#ifdef CMDSTAN_ZLIB
+    if (codec_ == "gzip") {
+      inflateEnd(&zs_);
+    }
+#endif
+#ifdef CMDSTAN_ZSTD
+    if (ds_ != nullptr) {
+      ZSTD_freeDStream(ds_);
+    }
+#endif
+  }
+
+ protected:
+  int_type underflow() {
+    if (gptr() < egptr()) {
+      return traits_type::to_int_type(*gptr());
+    }
+    size_t size = 0;
+    while (size == 0) {
+      if (in_pos_ == in_size_) {
+        source_->read(in_.data(), in_.size());
+        in_size_ = source_->gcount();
+        in_pos_ = 0;
+        if (in_size_ == 0) {
+          return traits_type::eof();
+        }
+      }
+      size = decompress();
+    }
+    setg(out_.data(), out_.data(), out_.data() + size);
+    return traits_type::to_int_type(*gptr());
+  }
+
+ private:
+  std::unique_ptr<std::istream> source_;
+  std::string codec_;
+  std::vector<char> in_;
+  std::vector<char> out_;
+  size_t in_pos_ = 0;
+  size_t in_size_ = 0;
+#ifdef CMDSTAN_ZLIB
+  z_stream zs_;
+#endif
+#ifdef CMDSTAN_ZSTD
+  ZSTD_DStream *ds_ = nullptr;
+#endif
+
+  /**
+   * Decompress from the pending input into the output buffer.
+   *
+   * @return number of bytes of output
+   */
+  size_t decompress() {
+#ifdef CMDSTAN_ZLIB
+    if (codec_ == "gzip") {
+      zs_.next_in = reinterpret_cast<Bytef *>(in_.data() + in_pos_);
+      zs_.avail_in = in_size_ - in_pos_;
+      zs_.next_out = reinterpret_cast<Bytef *>(out_.data());
+      zs_.avail_out = out_.size();
+      int ret = inflate(&zs_, Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+        throw std::runtime_error("Corrupt gzip data.");
+      }
+      in_pos_ = in_size_ - zs_.avail_in;
+      if (ret == Z_STREAM_END) {
+        inflateReset(&zs_);  // next member
+      }
+      return out_.size() - zs_.avail_out;
+    }
+#endif
+#ifdef CMDSTAN_ZSTD
+    if (codec_ == "zstd") {
+      ZSTD_inBuffer input = {in_.data(), in_size_, in_pos_};
+      ZSTD_outBuffer output = {out_.data(), out_.size(), 0};
+      size_t ret = ZSTD_decompressStream(ds_, &output, &input);
+      if (ZSTD_isError(ret)) {
+        throw std::runtime_error(std::string("Corrupt zstd data: ")
+                                 + ZSTD_getErrorName(ret));
+      }
+      in_pos_ = input.pos;
+      return output.pos;
+    }
+#endif
+    return 0;
+  }
+};
+
+}  // namespace internal
+
+/**
+ * Output stream which compresses what is written to it into another
+ * stream.  Destroying the stream writes the last frame.
+ */
+class compressed_ostream : public std::ostream {
+ public:
+  compressed_ostream(std::unique_ptr<std::ostream> &&sink, const options &opts)
+      : std::ostream(nullptr), buf_(std::move(sink), opts) {
+    rdbuf(&buf_);
+  }
+
+  ~compressed_ostream() {
+    try {
+      buf_.finish();
+    } catch (...) {
+    }
+  }
+
+  /**
+   * End the current frame early, see `compressing_buf::end_frame`.
+   */
+  void end_frame() { buf_.end_frame(); }
+
+ private:
+  internal::compressing_buf buf_;
+};
+
+/**
+ * Flush an output stream so that a reader sees all that was written to
+ * it.  A compressed stream ends its current frame, as flushing alone
+ * keeps the partial frame buffered.
+ *
+ * @param out stream to flush
+ */
+inline void flush(std::ostream &out) {
+  if (auto *compressed = dynamic_cast<compressed_ostream *>(&out)) {
+    compressed->end_frame();
+  } else {
+    out.flush();
+  }
+}
+
+/**
+ * Input stream which decompresses another stream.
+ */
+class decompressed_istream : public std::istream {
+ public:
+  decompressed_istream(std::unique_ptr<std::istream> &&source,
+                       const std::string &codec)
+      : std::istream(nullptr), buf_(std::move(source), codec) {
+    rdbuf(&buf_);
+  }
+
+ private:
+  internal::decompressing_buf buf_;
+};
+
+/**
+ * Wrap an output stream in a compressing stream, unless the codec is
+ * "none".  The returned stream throws on write errors, as the streams
+ * created by `file::safe_create` do.
+ *
+ * @param out stream to write the compressed output to
+ * @param opts codec, level and frame size
+ * @return stream to write uncompressed output to
+ */
+inline std::unique_ptr<std::ostream> compress(
+    std::unique_ptr<std::ostream> &&out, const options &opts) {
+  if (opts.codec == "none" || opts.codec.empty()) {
+    return std::move(out);
+  }
+  check_available(opts.codec);
+  std::streamsize precision = out->precision();
+  auto compressed = std::make_unique<compressed_ostream>(std::move(out), opts);
+  compressed->precision(precision);
+  compressed->exceptions(std::ostream::badbit);
+  return compressed;
+}
+
+/**
+ * Return the codec a file was compressed with, from its magic bytes.
+ *
+ * @param in stream positioned at the start of the file
+ * @return "gzip", "zstd" or "none"; the stream position is unchanged
+ */
+inline std::string detect(std::istream &in) {
+  unsigned char magic[4] = {0, 0, 0, 0};
+  std::streampos start = in.tellg();
+  in.read(reinterpret_cast<char *>(magic), sizeof(magic));
+  in.clear();
+  in.seekg(start);
+  if (magic[0] == 0x1f && magic[1] == 0x8b) {
+    return "gzip";
+  }
+  if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f
+      && magic[3] == 0xfd) {
+    return "zstd";
+  }
+  return "none";
+}
+
+/**
+ * Open a file for reading, decompressing it if it is gzip or zstd
+ * compressed.  Throws an exception if the file can't be opened.
+ *
+ * @param fname name of file which exists and has read perms
+ * @param binary if true, an uncompressed file is read in binary mode
+ * @return stream of the uncompressed contents
+ */
+inline std::unique_ptr<std::istream> open_input(const std::string &fname,
+                                                bool binary = false) {
+  auto in = std::make_unique<std::ifstream>(fname.c_str(), std::ios::binary);
+  if (!in->is_open()) {
+    std::stringstream msg;
+    msg << "Can't open specified file, \"" << fname << "\"" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  std::string codec = detect(*in);
+  if (codec == "none") {
+    if (binary) {
+      return in;
+    }
+    // reopen in text mode for the line ending conversions
+    return std::make_unique<std::ifstream>(fname.c_str());
+  }
+  return std::make_unique<decompressed_istream>(std::move(in), codec);
+}
+
+}  // namespace compression
+}  // namespace cmdstan
+#endif
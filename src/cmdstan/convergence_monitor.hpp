@@ -0,0 +1,504 @@
+#ifndef CMDSTAN_CONVERGENCE_MONITOR_HPP
+#define CMDSTAN_CONVERGENCE_MONITOR_HPP
+
+#include <cmdstan/output_writer.hpp>
+#include <stan/callbacks/interrupt.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/io/ends_with.hpp>
+#include <stan/io/stan_csv_reader.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <stan/mcmc/chainset.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * Thrown from a chain's sample writer to end sampling once the
+ * convergence targets of a `convergence_monitor` have been met.
+ */
+class early_stop : public std::exception {
+ public:
+  const char *what() const noexcept { return "Sampling stopped early"; }
+};
+
+/**
+ * Collective operations between the convergence monitors of processes
+ * which each run some of the chains of a run, e.g. the processes of an
+ * MPI job.  Every process makes the same calls in the same order.
+ */
+class convergence_exchange {
+ public:
+  virtual ~convergence_exchange() {}
+
+  /**
+   * Return the smallest of a number over all processes.
+   */
+  virtual size_t reduce_min(size_t n) = 0;
+
+  /**
+   * Return the largest of a number over all processes.
+   */
+  virtual size_t reduce_max(size_t n) = 0;
+
+  /**
+   * Gather values from all processes on the first process.
+   *
+   * @param values values of this process
+   * @return values of each process on the first process, empty on the
+   *   others
+   */
+  virtual std::vector<std::vector<double>> gather(
+      const std::vector<double> &values)
+      = 0;
+
+  /**
+   * Replace values by those of the first process.
+   *
+   * @param[in, out] values values
+   */
+  virtual void broadcast(std::vector<double> &values) = 0;
+
+  /**
+   * End all processes, because this process can't make its calls.
+   */
+  virtual void abort() = 0;
+};
+
+/**
+ * Interrupt which ends sampling once the draws of all chains together
+ * reach a target effective sample size and R-hat.
+ *
+ * The chains' sample writers are wrapped by `monitored_writer`, which
+ * hands each saved draw to the monitor.  Every `check_every` draws per
+ * chain, the first chain to call the interrupt evaluates the split
+ * rank-normalized bulk and tail ESS and R-hat of `lp__` and all model
+ * parameters over the draws which all chains have in common.  Once the
+ * targets are met, each chain runs on to the number of draws of the
+ * furthest chain and its writer throws `early_stop` instead of writing
+ * another draw, so that all output files hold the same number of draws.
+ * Chains wait for each other before throwing, because an exception in
+ * one chain cancels any parallel computation still running in the
+ * others.
+ *
+ * When the chains are spread over processes, each process monitors its
+ * own chains and shares its checks through a `convergence_exchange`.
+ * Checks are then made over the draws which the chains of all processes
+ * have in common, evaluated by the first process, and all processes stop
+ * at the draws of the furthest chain of any process.  A process whose
+ * chains have ended takes part in the remaining checks in `finish`.
+ */
+class convergence_monitor : public stan::callbacks::interrupt {
+ public:
+  /**
+   * Construct a monitor.
+   *
+   * @param num_chains number of chains
+   * @param num_warmup_draws number of warmup draws written before the
+   *   sampling draws of each chain
+   * @param num_sampling_draws number of sampling draws of each chain
+   * @param target_ess minimum bulk and tail ESS of all parameters
+   * @param max_rhat maximum R-hat of all parameters
+   * @param check_every number of draws per chain between checks
+   */
+  convergence_monitor(size_t num_chains, size_t num_warmup_draws,
+                      size_t num_sampling_draws, double target_ess,
+                      double max_rhat, size_t check_every)
+      : num_warmup_draws_(num_warmup_draws),
+        num_sampling_draws_(num_sampling_draws),
+        target_ess_(target_ess),
+        max_rhat_(max_rhat),
+        check_every_(check_every),
+        next_check_(check_every) {
+    for (size_t i = 0; i < num_chains; ++i) {
+      chains_.emplace_back(std::make_unique<chain_draws>());
+    }
+  }
+
+  /**
+   * Check convergence if all chains have reached the next checkpoint
+   * and no other chain is already checking.
+   */
+  void operator()() {
+    if (stop_at_ > 0 || min_draws() < next_check_) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(check_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+      return;
+    }
+    size_t num_draws = min_draws();
+    if (stop_at_ > 0 || num_draws < next_check_) {
+      return;
+    }
+    check(num_draws);
+  }
+
+  /**
+   * Share the checks of this monitor with the monitors of other
+   * processes.  Must be called before the chains start.
+   *
+   * @param exchange exchange with the other processes
+   */
+  void share(std::shared_ptr<convergence_exchange> exchange) {
+    exchange_ = std::move(exchange);
+  }
+
+  /**
+   * Take part in the checks which the chains of other processes still
+   * make once the chains of this process have ended.  If they failed,
+   * the other processes are ended instead, as they would wait for this
+   * one.  Does nothing unless the checks are shared.
+   *
+   * @param complete true if the chains of this process have all their
+   *   draws or were stopped early
+   */
+  void finish(bool complete) {
+    if (!exchange_) {
+      return;
+    }
+    if (!complete) {
+      exchange_->abort();
+      return;
+    }
+    std::lock_guard<std::mutex> lock(check_mutex_);
+    while (stop_at_ == 0 && next_check_ <= num_sampling_draws_) {
+      check(min_draws());
+    }
+  }
+
+  /**
+   * Record the column names of a chain's draws.
+   *
+   * @param chain index of chain
+   * @param names column names
+   */
+  void record_header(size_t chain, const std::vector<std::string> &names) {
+    chain_draws &draws = *chains_[chain];
+    std::lock_guard<std::mutex> lock(draws.mutex);
+    if (draws.header.empty()) {
+      draws.header = names;
+      // the sampler writes the header once the chain is initialized
+      draws.start = std::chrono::steady_clock::now();
+    }
+  }
+
+  /**
+   * Record a draw of a chain, or throw `early_stop` if the chain has
+   * all the draws it needs.  Warmup draws are passed over.
+   *
+   * @param chain index of chain
+   * @param draw values of draw
+   */
+  void record_draw(size_t chain, const std::vector<double> &draw) {
+    chain_draws &draws = *chains_[chain];
+    if (draws.num_warmup_seen < num_warmup_draws_) {
+      ++draws.num_warmup_seen;
+      return;
+    }
+    std::unique_lock<std::mutex> lock(draws.mutex);
+    if (stop_at_ > 0 && draws.num_draws >= stop_at_) {
+      draws.end = std::chrono::steady_clock::now();
+      lock.unlock();
+      wait_for_chains();
+      throw early_stop();
+    }
+    if (draws.num_draws == 0) {
+      draws.sampling_start = std::chrono::steady_clock::now();
+    }
+    draws.values.insert(draws.values.end(), draw.begin(), draw.end());
+    ++draws.num_draws;
+  }
+
+  /**
+   * Write the elapsed time of a chain which was stopped early, in the
+   * format of the footer which the sampler writes at the end of a run.
+   * Warmup is timed up to the chain's first sampling draw.
+   *
+   * @param chain index of chain
+   * @param writer writer for the footer
+   */
+  void write_timing(size_t chain, stan::callbacks::writer &writer) const {
+    const chain_draws &draws = *chains_[chain];
+    std::chrono::duration<double> warmup = draws.sampling_start - draws.start;
+    std::chrono::duration<double> sampling = draws.end - draws.sampling_start;
+    std::string title(" Elapsed Time: ");
+    std::stringstream warmup_msg;
+    warmup_msg << title << warmup.count() << " seconds (Warm-up)";
+    std::stringstream sampling_msg;
+    sampling_msg << std::string(title.size(), ' ') << sampling.count()
+                 << " seconds (Sampling)";
+    std::stringstream total_msg;
+    total_msg << std::string(title.size(), ' ')
+              << warmup.count() + sampling.count() << " seconds (Total)";
+    writer();
+    writer(warmup_msg.str());
+    writer(sampling_msg.str());
+    writer(total_msg.str());
+    writer();
+  }
+
+  /**
+   * Return true if sampling was stopped early.
+   */
+  bool stopped() const { return stop_at_ > 0; }
+
+  /**
+   * Return the number of sampling draws per chain when sampling was
+   * stopped early.
+   */
+  size_t num_draws() const { return stop_at_; }
+
+  /**
+   * Return the smallest ESS found by the last check.
+   */
+  double min_ess() const { return min_ess_; }
+
+  /**
+   * Return the largest R-hat found by the last check.
+   */
+  double max_rhat() const { return max_rhat_found_; }
+
+ private:
+  struct chain_draws {
+    std::mutex mutex;
+    std::vector<std::string> header;
+    std::vector<double> values;  // row-major
+    std::atomic<size_t> num_draws{0};
+    size_t num_warmup_seen = 0;  // only touched by the chain
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point sampling_start;
+    std::chrono::steady_clock::time_point end;
+  };
+
+  size_t num_warmup_draws_;
+  size_t num_sampling_draws_;
+  double target_ess_;
+  double max_rhat_;
+  size_t check_every_;
+  std::vector<std::unique_ptr<chain_draws>> chains_;
+  std::shared_ptr<convergence_exchange> exchange_;
+  std::atomic<size_t> next_check_;
+  std::atomic<size_t> stop_at_{0};
+  std::mutex check_mutex_;
+  std::mutex wait_mutex_;
+  std::condition_variable wait_cv_;
+  size_t num_waiting_ = 0;
+  double min_ess_ = std::numeric_limits<double>::quiet_NaN();
+  double max_rhat_found_ = std::numeric_limits<double>::quiet_NaN();
+
+  size_t min_draws() const {
+    size_t num_draws = std::numeric_limits<size_t>::max();
+    for (const auto &draws : chains_) {
+      num_draws = std::min(num_draws, draws->num_draws.load());
+    }
+    return num_draws;
+  }
+
+  /**
+   * Check convergence, with the check lock held, and stop the chains
+   * once the targets are met.
+   *
+   * @param num_draws number of draws which all chains of this process
+   *   have
+   */
+  void check(size_t num_draws) {
+    if (exchange_) {
+      num_draws = exchange_->reduce_min(num_draws);
+    }
+    next_check_ = num_draws + check_every_;
+    if (converged(num_draws)) {
+      stop();
+    }
+  }
+
+  /**
+   * Evaluate ESS and R-hat over the first draws of all chains, those of
+   * all processes if the checks are shared.
+   *
+   * @param num_draws number of draws per chain to use
+   * @return true if all parameters meet the targets
+   */
+  bool converged(size_t num_draws) {
+    if (num_draws < 4) {
+      return false;
+    }
+    std::vector<stan::io::stan_csv> csvs(chains_.size());
+    bool complete = true;
+    for (size_t i = 0; i < chains_.size() && complete; ++i) {
+      chain_draws &draws = *chains_[i];
+      std::lock_guard<std::mutex> lock(draws.mutex);
+      Eigen::Index num_cols = draws.header.size();
+      complete = num_cols > 0 && draws.values.size() >= num_draws * num_cols;
+      if (complete) {
+        csvs[i].header = draws.header;
+        csvs[i].samples = Eigen::Map<const Eigen::Matrix<
+            double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>(
+            draws.values.data(), num_draws, num_cols);
+      }
+    }
+    if (!exchange_) {
+      return complete && evaluate(csvs);
+    }
+    // the first process evaluates the draws of all chains, which are
+    // sent row-major, chain after chain
+    std::vector<double> values;
+    if (complete) {
+      for (const auto &csv : csvs) {
+        Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+            rows = csv.samples;
+        values.insert(values.end(), rows.data(), rows.data() + rows.size());
+      }
+    }
+    std::vector<std::vector<double>> all_values = exchange_->gather(values);
+    std::vector<double> result{0, min_ess_, max_rhat_found_};
+    if (!all_values.empty()) {
+      bool all_complete = complete;
+      Eigen::Index num_cols = complete ? csvs[0].header.size() : 0;
+      for (size_t p = 1; p < all_values.size() && all_complete; ++p) {
+        size_t chain_size = num_draws * num_cols;
+        all_complete = !all_values[p].empty()
+                       && all_values[p].size() % chain_size == 0;
+        for (size_t k = 0; all_complete && k < all_values[p].size();
+             k += chain_size) {
+          stan::io::stan_csv csv;
+          csv.header = csvs[0].header;
+          csv.samples = Eigen::Map<const Eigen::Matrix<
+              double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>(
+              all_values[p].data() + k, num_draws, num_cols);
+          csvs.push_back(std::move(csv));
+        }
+      }
+      result[0] = all_complete && evaluate(csvs);
+      result[1] = min_ess_;
+      result[2] = max_rhat_found_;
+    }
+    exchange_->broadcast(result);
+    min_ess_ = result[1];
+    max_rhat_found_ = result[2];
+    return result[0] != 0;
+  }
+
+  /**
+   * Evaluate ESS and R-hat over the draws of chains.
+   *
+   * @param csvs draws of each chain, all with the same number of draws
+   * @return true if all parameters meet the targets
+   */
+  bool evaluate(const std::vector<stan::io::stan_csv> &csvs) {
+    stan::mcmc::chainset chains(csvs);
+    double min_ess = std::numeric_limits<double>::infinity();
+    double max_rhat = 0;
+    size_t num_checked = 0;
+    for (int i = 0; i < chains.num_params(); ++i) {
+      const std::string &name = chains.param_name(i);
+      if (name != "lp__" && stan::io::ends_with("__", name)) {
+        continue;
+      }
+      auto ess = chains.split_rank_normalized_ess(i);
+      auto rhat = chains.split_rank_normalized_rhat(i);
+      // constant columns, e.g. of fixed transformed parameters
+      if (!std::isfinite(ess.first) || !std::isfinite(ess.second)
+          || !std::isfinite(rhat.first) || !std::isfinite(rhat.second)) {
+        continue;
+      }
+      min_ess = std::min({min_ess, ess.first, ess.second});
+      max_rhat = std::max({max_rhat, rhat.first, rhat.second});
+      ++num_checked;
+    }
+    min_ess_ = min_ess;
+    max_rhat_found_ = max_rhat;
+    return num_checked > 0 && min_ess >= target_ess_ && max_rhat <= max_rhat_;
+  }
+
+  /**
+   * Set the number of draws at which all chains stop.  The chain locks
+   * are held so that no chain records a draw past that number.  Nothing
+   * is stopped if a chain already has all its draws, because every
+   * chain must come back to its writer to be stopped.  With shared
+   * checks, that is the furthest chain of any process.
+   */
+  void stop() {
+    std::vector<std::unique_lock<std::mutex>> locks;
+    size_t num_draws = 0;
+    for (auto &draws : chains_) {
+      locks.emplace_back(draws->mutex);
+      num_draws = std::max(num_draws, draws->num_draws.load());
+    }
+    if (exchange_) {
+      num_draws = exchange_->reduce_max(num_draws);
+    }
+    if (num_draws < num_sampling_draws_) {
+      stop_at_ = num_draws;
+    }
+  }
+
+  void wait_for_chains() {
+    std::unique_lock<std::mutex> lock(wait_mutex_);
+    ++num_waiting_;
+    wait_cv_.notify_all();
+    wait_cv_.wait(lock, [this] { return num_waiting_ == chains_.size(); });
+  }
+};
+
+/**
+ * Writer which hands the header and draws of a chain to a
+ * `convergence_monitor` before forwarding them to the chain's output.
+ */
+class monitored_writer : public stan::callbacks::writer {
+ public:
+  /**
+   * Construct a monitored writer.
+   *
+   * @param monitor convergence monitor of all chains
+   * @param chain index of chain
+   * @param target writer which receives the output
+   */
+  monitored_writer(std::shared_ptr<convergence_monitor> monitor, size_t chain,
+                   output_writer &&target)
+      : monitor_(std::move(monitor)), chain_(chain), target_(std::move(target)) {}
+
+  void operator()(const std::vector<std::string> &names) {
+    monitor_->record_header(chain_, names);
+    target_(names);
+  }
+
+  void operator()(const std::vector<double> &state) {
+    monitor_->record_draw(chain_, state);
+    target_(state);
+  }
+
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, -1, -1>> &values) {
+    target_(values);
+  }
+
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, 1, -1>> &values) {
+    target_(values);
+  }
+
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, -1, 1>> &values) {
+    target_(values);
+  }
+
+  void operator()() { target_(); }
+
+  void operator()(const std::string &message) { target_(message); }
+
+ private:
+  std::shared_ptr<convergence_monitor> monitor_;
+  size_t chain_;
+  output_writer target_;
+};
+
+}  // namespace cmdstan
+#endif
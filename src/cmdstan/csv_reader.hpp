@@ -0,0 +1,574 @@
+#ifndef CMDSTAN_CSV_READER_HPP
+#define CMDSTAN_CSV_READER_HPP
+
+#include <cmdstan/mapped_file.hpp>
+#include <stan/io/ends_with.hpp>
+#include <stan/io/stan_csv_reader.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+namespace internal {
+
+/**
+ * Extract the time in seconds from a CSV timing comment such as
+ * " Elapsed Time: 0.012 seconds (Warm-up)".
+ */
+inline double parse_elapsed_seconds(const std::string &line) {
+  size_t end = line.find(" seconds");
+  if (end == std::string::npos || end == 0)
+    return 0;
+  size_t start = line.find_last_of(" :", end - 1);
+  try {
+    return std::stod(line.substr(start + 1, end - start - 1));
+  } catch (const std::exception &e) {
+    return 0;
+  }
+}
+
+/**
+ * Return a pointer to the next newline at or after `pos`, or `end` if
+ * there is none.  `memchr` is vectorized by the C library, so this
+ * scans many bytes per instruction.
+ */
+inline const char *find_newline(const char *pos, const char *end) {
+  const void *nl = std::memchr(pos, '\n', end - pos);
+  return nl ? static_cast<const char *>(nl) : end;
+}
+
+/**
+ * Return the end of the line starting at `pos`, excluding the newline
+ * and any carriage return before it.
+ */
+inline const char *line_end(const char *pos, const char *newline) {
+  if (newline > pos && newline[-1] == '\r')
+    return newline - 1;
+  return newline;
+}
+
+/**
+ * Parse a CSV field as a double, ignoring surrounding spaces.
+ *
+ * @param first start of field
+ * @param last one past the end of field
+ * @param[out] x parsed value
+ * @return true if the whole field is a number
+ */
+inline bool parse_csv_double(const char *first, const char *last, double &x) {
+  while (first < last && *first == ' ')
+    ++first;
+  while (last > first && last[-1] == ' ')
+    --last;
+  if (first == last)
+    return false;
+#ifdef __cpp_lib_to_chars
+  auto res = std::from_chars(first, last, x);
+  if (res.ec == std::errc() && res.ptr == last)
+    return true;
+  // from_chars rejects a leading '+' and reports out-of-range values as
+  // errors, where strtod returns +/-inf or 0; fall through to strtod
+#endif
+  char buf[64];
+  size_t len = last - first;
+  if (len >= sizeof(buf))
+    return false;
+  std::memcpy(buf, first, len);
+  buf[len] = '\0';
+  char *parsed_end = nullptr;
+  x = std::strtod(buf, &parsed_end);
+  return parsed_end == buf + len;
+}
+
+/**
+ * Parse a line of comma separated numbers.
+ *
+ * @param pos start of line
+ * @param last end of line
+ * @param[out] out where the first value is stored
+ * @param stride distance between stored values, so that a row can be
+ *   written straight into a column-major matrix
+ * @param num_cols expected number of values
+ * @param keep for each value, its index in the output or -1 to skip it
+ *   without parsing; if empty, every value is kept
+ * @return number of values read before a malformed value or the end
+ *   of the line, or `num_cols + 1` if there are too many values
+ */
+inline Eigen::Index parse_csv_row(const char *pos, const char *last,
+                                  double *out, Eigen::Index stride,
+                                  Eigen::Index num_cols,
+                                  const std::vector<int> &keep = {}) {
+  Eigen::Index cols = 0;
+  while (pos <= last) {
+    if (cols == num_cols)
+      return num_cols + 1;
+    const char *comma = std::find(pos, last, ',');
+    const Eigen::Index idx = keep.empty() ? cols : keep[cols];
+    if (idx >= 0 && !parse_csv_double(pos, comma, out[idx * stride]))
+      return cols;
+    ++cols;
+    pos = comma + 1;
+  }
+  return cols;
+}
+
+/**
+ * Parse some fields of a line of comma separated numbers, skipping over
+ * the others without converting them.
+ *
+ * @param pos start of the field of column `col`
+ * @param last end of line
+ * @param col column of the field at `pos`
+ * @param cols columns to parse, ascending and none before `col`
+ * @param[out] out where the first value is stored
+ * @param stride distance between stored values
+ * @return start of the field after the last one parsed, or nullptr if
+ *   a field is missing or malformed
+ */
+inline const char *parse_csv_fields(const char *pos, const char *last,
+                                    int col, const std::vector<int> &cols,
+                                    double *out, Eigen::Index stride) {
+  for (size_t i = 0; i < cols.size(); ++i) {
+    for (; col < cols[i]; ++col) {
+      if (pos > last)
+        return nullptr;
+      pos = std::find(pos, last, ',') + 1;
+    }
+    if (pos > last)
+      return nullptr;
+    const char *comma = std::find(pos, last, ',');
+    if (!parse_csv_double(pos, comma, out[i * stride]))
+      return nullptr;
+    pos = comma + 1;
+    ++col;
+  }
+  return pos;
+}
+
+/**
+ * Split a CSV header line into column names.
+ */
+inline std::vector<std::string> split_csv_header(const char *pos,
+                                                 const char *end,
+                                                 bool prettify_names) {
+  std::vector<std::string> names;
+  while (true) {
+    const char *comma = std::find(pos, end, ',');
+    std::string name(pos, comma);
+    if (prettify_names) {
+      stan::io::prettify_stan_csv_name(name);
+    }
+    names.push_back(name);
+    if (comma == end)
+      break;
+    pos = comma + 1;
+  }
+  return names;
+}
+
+/**
+ * Select the columns of a Stan CSV header to read.  `lp__` and the
+ * other sampler columns, whose names end in `__`, are always kept,
+ * along with the named model columns.
+ *
+ * @param[in,out] header column names, replaced by the kept names
+ * @param include_params names of model columns to keep; if empty, all
+ *   columns are kept
+ * @return for each original column, its index among the kept columns
+ *   or -1, or an empty vector if all columns are kept
+ */
+inline std::vector<int> project_columns(
+    std::vector<std::string> &header,
+    const std::vector<std::string> &include_params) {
+  std::vector<int> keep;
+  if (include_params.empty()) {
+    return keep;
+  }
+  std::vector<std::string> kept;
+  for (const auto &name : header) {
+    if (stan::io::ends_with("__", name)
+        || std::find(include_params.begin(), include_params.end(), name)
+               != include_params.end()) {
+      keep.push_back(kept.size());
+      kept.push_back(name);
+    } else {
+      keep.push_back(-1);
+    }
+  }
+  header.swap(kept);
+  return keep;
+}
+
+}  // namespace internal
+
+/**
+ * Read a Stan CSV file into the same structure as
+ * `stan::io::stan_csv_reader::parse`, without going through iostreams.
+ *
+ * The file is memory-mapped (see `mapped_file`).  A first pass finds
+ * the start of every draw and collects the config, adaptation and
+ * timing comments, which are handed to the Stan CSV reader as text so
+ * that metadata parsing stays in one place.  The draws matrix is then
+ * allocated once at its final size and filled in place, each field
+ * converted with `std::from_chars`.
+ *
+ * When `include_params` is given, only those model columns plus `lp__`
+ * and the sampler columns are stored; the other fields are skipped over
+ * without being converted, so the time and memory needed to summarize a
+ * few parameters of a wide model don't grow with the model's width.
+ *
+ * As with the Stan CSV reader, saved warmup draws are not returned.  A
+ * last line without a newline, as left by a run that is still writing
+ * or was interrupted, is used only if it has every column.
+ *
+ * @param fname name of file which exists and has read perms
+ * @param prettify_names if true, column names are converted from the
+ *   `theta.1` to the `theta[1]` style, as by the Stan CSV reader
+ * @param include_params names of the model columns to read, in the same
+ *   style as the header; if empty, all columns are read
+ * @param[out] draw_offsets if not null, set to the offset in the file of
+ *   each returned draw
+ * @return parsed draws, header, metadata, adaptation and timing
+ * @throw std::invalid_argument if the file can't be read or a draw
+ *   doesn't match the header
+ */
+inline stan::io::stan_csv read_stan_csv(
+    const std::string &fname, bool prettify_names = true,
+    const std::vector<std::string> &include_params = {},
+    std::vector<size_t> *draw_offsets = nullptr) {
+  mapped_file file(fname);
+  const char *pos = file.data();
+  const char *const end = file.end();
+  stan::io::stan_csv result;
+
+  std::string config;
+  while (pos < end && (*pos == '#' || *pos == '\n' || *pos == '\r')) {
+    const char *newline = internal::find_newline(pos, end);
+    config.append(pos, internal::line_end(pos, newline));
+    config += '\n';
+    pos = newline < end ? newline + 1 : end;
+  }
+  std::stringstream config_stream(config);
+  stan::io::stan_csv_reader::read_metadata(config_stream, result.metadata);
+  if (pos == end) {
+    return result;
+  }
+  const char *newline = internal::find_newline(pos, end);
+  result.header = internal::split_csv_header(
+      pos, internal::line_end(pos, newline), prettify_names);
+  pos = newline < end ? newline + 1 : end;
+  const Eigen::Index num_cols = result.header.size();
+  const std::vector<int> keep
+      = internal::project_columns(result.header, include_params);
+
+  std::vector<const char *> rows;
+  std::stringstream adaptation;
+  bool in_adaptation = false;
+  while (pos < end) {
+    newline = internal::find_newline(pos, end);
+    const char *last = internal::line_end(pos, newline);
+    if (*pos == '#') {
+      std::string line(pos, last);
+      if (line.find("Adaptation terminated") != std::string::npos)
+        in_adaptation = true;
+      if (in_adaptation) {
+        adaptation << line << "\n";
+      }
+      if (line.find("(Warm-up)") != std::string::npos) {
+        result.timing.warmup = internal::parse_elapsed_seconds(line);
+      } else if (line.find("(Sampling)") != std::string::npos) {
+        result.timing.sampling = internal::parse_elapsed_seconds(line);
+      }
+    } else if (last > pos) {
+      in_adaptation = false;
+      if (newline < end) {
+        rows.push_back(pos);
+      } else {
+        std::vector<double> scratch(num_cols);
+        if (internal::parse_csv_row(pos, last, scratch.data(), 1, num_cols)
+            == num_cols)
+          rows.push_back(pos);
+      }
+    }
+    pos = newline < end ? newline + 1 : end;
+  }
+  if (!adaptation.str().empty()) {
+    stan::io::stan_csv_reader::read_adaptation(adaptation, result.adaptation);
+  }
+
+  size_t skip_rows = 0;
+  if (result.metadata.save_warmup && result.metadata.thin > 0) {
+    skip_rows = (result.metadata.num_warmup + result.metadata.thin - 1)
+                / result.metadata.thin;
+    skip_rows = std::min(skip_rows, rows.size());
+  }
+  result.samples.resize(rows.size() - skip_rows, result.header.size());
+  const Eigen::Index stride = result.samples.rows();
+  for (size_t row = skip_rows; row < rows.size(); ++row) {
+    pos = rows[row];
+    const char *last
+        = internal::line_end(pos, internal::find_newline(pos, end));
+    double *out = result.samples.data() + (row - skip_rows);
+    Eigen::Index cols
+        = internal::parse_csv_row(pos, last, out, stride, num_cols, keep);
+    if (cols != num_cols) {
+      std::stringstream msg;
+      msg << "Error reading file \"" << fname << "\": draw " << row + 1
+          << " has a missing or malformed value in column " << cols + 1
+          << ", expecting " << num_cols << " numbers" << std::endl;
+      throw std::invalid_argument(msg.str());
+    }
+  }
+  if (draw_offsets != nullptr) {
+    draw_offsets->clear();
+    for (size_t row = skip_rows; row < rows.size(); ++row) {
+      draw_offsets->push_back(rows[row] - file.data());
+    }
+  }
+  return result;
+}
+
+/**
+ * Read some columns of the draws of a Stan CSV file, starting each draw
+ * at a saved position and saving where each one stopped, so that the
+ * columns of a wide file can be read a block at a time without going
+ * over the same fields again.  Fields of the columns in between are
+ * skipped over without being converted.
+ *
+ * @param fname name of file which exists and has read perms
+ * @param[in,out] positions for each draw, offset in the file of its
+ *   field of column `col`; set to the offsets of the fields after the
+ *   last column read
+ * @param[in,out] col column of the fields at `positions`; set to the
+ *   column after the last one read
+ * @param cols columns to read, ascending and none before `col`
+ * @return draws of the columns, one matrix column per entry of `cols`
+ * @throw std::invalid_argument if the file can't be read or a draw has
+ *   a missing or malformed value
+ */
+inline Eigen::MatrixXd read_stan_csv_columns(const std::string &fname,
+                                             std::vector<size_t> &positions,
+                                             int &col,
+                                             const std::vector<int> &cols) {
+  mapped_file file(fname);
+  const char *const end = file.end();
+  Eigen::MatrixXd draws(positions.size(), cols.size());
+  std::vector<size_t> next(positions.size());
+  for (size_t row = 0; row < positions.size(); ++row) {
+    const char *pos = file.data() + std::min(positions[row], file.size());
+    const char *last
+        = internal::line_end(pos, internal::find_newline(pos, end));
+    const char *stop = internal::parse_csv_fields(
+        pos, last, col, cols, draws.data() + row, draws.rows());
+    if (stop == nullptr) {
+      std::stringstream msg;
+      msg << "Error reading file \"" << fname << "\": draw " << row + 1
+          << " has a missing or malformed value" << std::endl;
+      throw std::invalid_argument(msg.str());
+    }
+    next[row] = stop - file.data();
+  }
+  positions.swap(next);
+  if (!cols.empty()) {
+    col = cols.back() + 1;
+  }
+  return draws;
+}
+
+/**
+ * Read the column names of a Stan CSV file without reading its draws.
+ *
+ * @param fname name of file which exists and has read perms
+ * @param prettify_names if true, column names are converted from the
+ *   `theta.1` to the `theta[1]` style, as by the Stan CSV reader
+ * @return column names, empty if the file has no header
+ */
+inline std::vector<std::string> read_stan_csv_header(
+    const std::string &fname, bool prettify_names = true) {
+  mapped_file file(fname);
+  const char *pos = file.data();
+  const char *const end = file.end();
+  while (pos < end && (*pos == '#' || *pos == '\n' || *pos == '\r')) {
+    const char *newline = internal::find_newline(pos, end);
+    pos = newline < end ? newline + 1 : end;
+  }
+  if (pos == end) {
+    return {};
+  }
+  const char *newline = internal::find_newline(pos, end);
+  return internal::split_csv_header(pos, internal::line_end(pos, newline),
+                                    prettify_names);
+}
+
+/**
+ * Incremental reader for a Stan CSV file which is still being written.
+ *
+ * Each call to `poll` reads only the bytes appended since the previous
+ * call and parses the complete lines among them; a partly written last
+ * line is kept until the rest of it arrives.  Draws are kept in memory,
+ * saved warmup draws are skipped as by `read_stan_csv`, and the file is
+ * finished once the sampler has written its timing footer.  Compressed
+ * files can't be followed.
+ */
+class stan_csv_tail {
+ public:
+  /**
+   * Open a file for following.
+   *
+   * @param fname name of file which exists and has read perms
+   * @param prettify_names if true, column names are converted from the
+   *   `theta.1` to the `theta[1]` style, as by the Stan CSV reader
+   */
+  explicit stan_csv_tail(const std::string &fname, bool prettify_names = true)
+      : fname_(fname),
+        prettify_names_(prettify_names),
+        in_(fname, std::ios::binary) {
+    if (!in_.is_open()) {
+      std::stringstream msg;
+      msg << "Can't open specified file, \"" << fname << "\"" << std::endl;
+      throw std::invalid_argument(msg.str());
+    }
+  }
+
+  /**
+   * Read and parse whatever has been appended to the file.
+   *
+   * @return number of new draws
+   * @throw std::invalid_argument if a complete draw doesn't match the
+   *   header
+   */
+  size_t poll() {
+    size_t old_draws = num_draws();
+    char buf[1 << 16];
+    in_.clear();
+    while (in_.read(buf, sizeof(buf)) || in_.gcount() > 0) {
+      pending_.append(buf, in_.gcount());
+    }
+    size_t start = 0;
+    size_t newline;
+    while ((newline = pending_.find('\n', start)) != std::string::npos) {
+      const char *first = pending_.data() + start;
+      process_line(first,
+                   internal::line_end(first, pending_.data() + newline));
+      start = newline + 1;
+    }
+    pending_.erase(0, start);
+    return num_draws() - old_draws;
+  }
+
+  /**
+   * Return true once the header has been read.
+   */
+  bool has_header() const { return !header_.empty(); }
+
+  /**
+   * Return true once the timing footer has been read.
+   */
+  bool finished() const { return finished_; }
+
+  const std::string &filename() const { return fname_; }
+  const std::vector<std::string> &header() const { return header_; }
+  const stan::io::stan_csv_metadata &metadata() const { return metadata_; }
+  const stan::io::stan_csv_timing &timing() const { return timing_; }
+
+  /**
+   * Return the number of draws read so far, excluding saved warmup.
+   */
+  size_t num_draws() const {
+    return header_.empty() ? 0 : draws_.size() / header_.size();
+  }
+
+  /**
+   * Return a pointer to the values of a draw, one per column.
+   *
+   * @param i draw index, less than `num_draws()`
+   */
+  const double *draw(size_t i) const {
+    return draws_.data() + i * header_.size();
+  }
+
+  /**
+   * Return the first draws read so far in the structure produced by
+   * `read_stan_csv`.
+   *
+   * @param num_draws number of draws, at most `num_draws()`
+   */
+  stan::io::stan_csv to_stan_csv(size_t num_draws) const {
+    stan::io::stan_csv result;
+    result.metadata = metadata_;
+    result.header = header_;
+    result.timing = timing_;
+    result.samples = Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic,
+                                                    Eigen::Dynamic,
+                                                    Eigen::RowMajor>>(
+        draws_.data(), num_draws, header_.size());
+    return result;
+  }
+
+ private:
+  std::string fname_;
+  bool prettify_names_;
+  std::ifstream in_;
+  std::string pending_;  // bytes after the last complete line
+  std::string config_;   // comments before the header
+  stan::io::stan_csv_metadata metadata_;
+  stan::io::stan_csv_timing timing_;
+  std::vector<std::string> header_;
+  std::vector<double> draws_;  // row-major
+  size_t skip_rows_ = 0;
+  bool finished_ = false;
+
+  void process_line(const char *pos, const char *last) {
+    if (pos == last) {
+      return;
+    }
+    if (*pos == '#') {
+      std::string line(pos, last);
+      if (header_.empty()) {
+        config_ += line + "\n";
+      } else if (line.find("(Warm-up)") != std::string::npos) {
+        timing_.warmup = internal::parse_elapsed_seconds(line);
+      } else if (line.find("(Sampling)") != std::string::npos) {
+        timing_.sampling = internal::parse_elapsed_seconds(line);
+      } else if (line.find("(Total)") != std::string::npos) {
+        finished_ = true;
+      }
+      return;
+    }
+    if (header_.empty()) {
+      header_ = internal::split_csv_header(pos, last, prettify_names_);
+      std::stringstream config(config_);
+      stan::io::stan_csv_reader::read_metadata(config, metadata_);
+      if (metadata_.save_warmup && metadata_.thin > 0) {
+        skip_rows_
+            = (metadata_.num_warmup + metadata_.thin - 1) / metadata_.thin;
+      }
+      return;
+    }
+    if (skip_rows_ > 0) {
+      --skip_rows_;
+      return;
+    }
+    const Eigen::Index num_cols = header_.size();
+    draws_.resize(draws_.size() + num_cols);
+    double *out = draws_.data() + draws_.size() - num_cols;
+    if (internal::parse_csv_row(pos, last, out, 1, num_cols) != num_cols) {
+      draws_.resize(draws_.size() - num_cols);
+      std::stringstream msg;
+      msg << "Error reading file \"" << fname_ << "\": draw "
+          << num_draws() + 1 << " does not have " << num_cols << " numbers"
+          << std::endl;
+      throw std::invalid_argument(msg.str());
+    }
+  }
+};
+
+}  // namespace cmdstan
+#endif
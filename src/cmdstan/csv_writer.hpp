@@ -0,0 +1,141 @@
+#ifndef CMDSTAN_CSV_WRITER_HPP
+#define CMDSTAN_CSV_WRITER_HPP
+
+#include <cmdstan/number_format.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * Writer for Stan CSV files.
+ *
+ * Produces the same layout as `stan::callbacks::unique_stream_writer`,
+ * but each line is assembled in a reused buffer with `format_double`
+ * and handed to the stream in a single write, so that the cost of a
+ * draw is the number conversion rather than the stream machinery.
+ */
+class csv_writer : public stan::callbacks::writer {
+ public:
+  /**
+   * Construct a CSV writer.
+   *
+   * @param output stream to write to
+   * @param comment_prefix prefix for comment lines
+   * @param sig_figs number of significant digits, or -1 for shortest
+   *   round-trip output
+   */
+  explicit csv_writer(std::unique_ptr<std::ostream> &&output,
+                      const std::string &comment_prefix = "",
+                      int sig_figs = -1)
+      : output_(std::move(output)),
+        comment_prefix_(comment_prefix),
+        sig_figs_(sig_figs) {}
+
+  csv_writer(csv_writer &&other) = default;
+
+  /**
+   * Write a comma separated list of column names.
+   *
+   * @param names names to write
+   */
+  void operator()(const std::vector<std::string> &names) {
+    if (output_ == nullptr) {
+      return;
+    }
+    line_.clear();
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (i > 0)
+        line_ += ',';
+      line_ += names[i];
+    }
+    line_ += '\n';
+    output_->write(line_.data(), line_.size());
+  }
+
+  /**
+   * Write a comma separated list of values.
+   *
+   * @param state values to write
+   */
+  void operator()(const std::vector<double> &state) {
+    write_values(state, state.size());
+  }
+
+  /**
+   * Write each row of a matrix as a line of comma separated values.
+   *
+   * @param values matrix to write
+   */
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, -1, -1>> &values) {
+    if (output_ == nullptr) {
+      return;
+    }
+    for (Eigen::Index i = 0; i < values.rows(); ++i) {
+      write_values(values.row(i), values.cols());
+    }
+  }
+
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, 1, -1>> &values) {
+    write_values(values, values.size());
+  }
+
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, -1, 1>> &values) {
+    write_values(values, values.size());
+  }
+
+  /**
+   * Write the comment prefix on an otherwise empty line.
+   */
+  void operator()() {
+    if (output_ == nullptr) {
+      return;
+    }
+    *output_ << comment_prefix_ << std::endl;
+  }
+
+  /**
+   * Write a comment line.
+   *
+   * @param message text of the comment
+   */
+  void operator()(const std::string &message) {
+    if (output_ == nullptr) {
+      return;
+    }
+    *output_ << comment_prefix_ << message << std::endl;
+  }
+
+  /**
+   * Return the underlying stream.
+   */
+  std::ostream &get_stream() { return *output_; }
+
+ private:
+  std::unique_ptr<std::ostream> output_;
+  std::string comment_prefix_;
+  int sig_figs_;
+  std::string line_;  // reused for each line written
+
+  template <typename T>
+  void write_values(const T &values, size_t size) {
+    if (output_ == nullptr) {
+      return;
+    }
+    line_.clear();
+    for (size_t i = 0; i < size; ++i) {
+      if (i > 0)
+        line_ += ',';
+      append_double(line_, values[i], sig_figs_);
+    }
+    line_ += '\n';
+    output_->write(line_.data(), line_.size());
+  }
+};
+
+}  // namespace cmdstan
+#endif
@@ -1,3 +1,5 @@
+#include <cmdstan/binary_reader.hpp>
+#include <cmdstan/csv_reader.hpp>
 #include <cmdstan/return_codes.hpp>
 #include <cmdstan/stansummary_helper.hpp>
 #include <stan/mcmc/chainset.hpp>
@@ -55,15 +57,12 @@ int main(int argc, const char *argv[]) {
 
   std::vector<stan::io::stan_csv> csv_parsed;
   for (int i = 0; i < filenames.size(); ++i) {
-    std::ifstream infile;
-    std::stringstream out;
     stan::io::stan_csv sample;
-    infile.open(filenames[i].c_str());
     try {
-      sample = stan::io::stan_csv_reader::parse(infile, &out);
-      // csv_reader warnings are errors - fail fast.
-      if (!out.str().empty()) {
-        throw std::invalid_argument(out.str());
+      if (cmdstan::is_binary_output(filenames[i])) {
+        sample = cmdstan::read_binary_output(filenames[i]);
+      } else {
+        sample = cmdstan::read_stan_csv(filenames[i]);
       }
       csv_parsed.push_back(sample);
     } catch (const std::invalid_argument &e) {
@@ -0,0 +1,206 @@
+#ifndef CMDSTAN_DRAWS_READER_HPP
+#define CMDSTAN_DRAWS_READER_HPP
+
+#include <cmdstan/binary_format.hpp>
+#include <cmdstan/binary_reader.hpp>
+#include <cmdstan/compression.hpp>
+#include <cmdstan/csv_reader.hpp>
+#include <stan/io/stan_csv_reader.hpp>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * Sequential reader for the draws of a Stan CSV or binary output file,
+ * for methods which process every draw once and need not hold them all
+ * in memory.
+ *
+ * The metadata and column names are read on construction, after which
+ * each call to `read` returns the next draws, up to a given number.
+ * Comment lines and records between draws are passed over.  Unlike
+ * `read_stan_csv`, saved warmup draws are returned, as they are by the
+ * Stan CSV reader's `read_samples`.  Compressed files are decompressed
+ * while reading.
+ */
+class draws_reader {
+ public:
+  /**
+   * Open a file and read its metadata and header.
+   *
+   * @param fname name of file which exists and has read perms
+   * @throw std::invalid_argument if the file can't be read or has no
+   *   header
+   */
+  explicit draws_reader(const std::string &fname) : fname_(fname) {
+    binary_ = is_binary_output(fname);
+    in_ = compression::open_input(fname, binary_);
+    stan::io::stan_csv csv;
+    if (binary_) {
+      internal::read_binary_header(*in_, fname, false, csv);
+      header_ = csv.header;
+      metadata_ = csv.metadata;
+      return;
+    }
+    std::string config;
+    std::string line;
+    while (std::getline(*in_, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      if (line.empty() || line[0] == '#') {
+        config += line + "\n";
+        continue;
+      }
+      header_ = internal::split_csv_header(line.data(),
+                                           line.data() + line.size(), false);
+      break;
+    }
+    if (header_.empty()) {
+      std::stringstream msg;
+      msg << "Error reading fitted param names from sample csv file \""
+          << fname << "\"" << std::endl;
+      throw std::invalid_argument(msg.str());
+    }
+    std::stringstream config_stream(config);
+    stan::io::stan_csv_reader::read_metadata(config_stream, metadata_);
+  }
+
+  const std::string &filename() const { return fname_; }
+  const std::vector<std::string> &header() const { return header_; }
+  const stan::io::stan_csv_metadata &metadata() const { return metadata_; }
+
+  /**
+   * Read the next draws.  A last draw cut short by an interrupted run
+   * is ignored.
+   *
+   * @param max_draws maximum number of draws to read
+   * @param[out] draws values of the draws read, row-major, one value
+   *   per column of the header
+   * @return number of draws read, 0 at the end of the file
+   * @throw std::invalid_argument if a draw doesn't match the header
+   */
+  size_t read(size_t max_draws, std::vector<double> &draws) {
+    const size_t num_cols = header_.size();
+    draws.clear();
+    size_t num_draws = 0;
+    while (num_draws < max_draws) {
+      if (binary_) {
+        if (pending_pos_ == pending_rows_ && !read_record()) {
+          break;
+        }
+        // records are column-major
+        for (size_t j = 0; j < num_cols; ++j) {
+          draws.push_back(pending_[j * pending_rows_ + pending_pos_]);
+        }
+        ++pending_pos_;
+        ++num_draws;
+        continue;
+      }
+      std::string line;
+      if (!std::getline(*in_, line)) {
+        break;
+      }
+      bool complete = !in_->eof();
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      draws.resize(draws.size() + num_cols);
+      Eigen::Index cols = internal::parse_csv_row(
+          line.data(), line.data() + line.size(),
+          draws.data() + draws.size() - num_cols, 1, num_cols);
+      if (cols != static_cast<Eigen::Index>(num_cols)) {
+        draws.resize(draws.size() - num_cols);
+        if (!complete) {
+          break;
+        }
+        std::stringstream msg;
+        msg << "Error reading file \"" << fname_ << "\": draw "
+            << num_read_ + num_draws + 1
+            << " has a missing or malformed value in column " << cols + 1
+            << ", expecting " << num_cols << " numbers" << std::endl;
+        throw std::invalid_argument(msg.str());
+      }
+      ++num_draws;
+    }
+    num_read_ += num_draws;
+    return num_draws;
+  }
+
+ private:
+  std::string fname_;
+  bool binary_ = false;
+  std::unique_ptr<std::istream> in_;
+  std::vector<std::string> header_;
+  stan::io::stan_csv_metadata metadata_;
+  size_t num_read_ = 0;
+  std::vector<double> pending_;  // current binary draws record
+  size_t pending_rows_ = 0;
+  size_t pending_pos_ = 0;
+
+  /**
+   * Read records of a binary file up to the next draws record.
+   *
+   * @return false at the end of the file or at a record cut short
+   */
+  bool read_record() {
+    while (true) {
+      char tag;
+      if (!in_->get(tag)) {
+        return false;
+      }
+      if (tag == binary_format::COMMENT_RECORD) {
+        std::uint64_t size = 0;
+        if (!binary_format::read_le(*in_, size)
+            || !in_->ignore(size).good()) {
+          return false;
+        }
+        continue;
+      }
+      if (tag != binary_format::DRAWS_RECORD) {
+        std::stringstream msg;
+        msg << "Corrupt record in binary output file: \"" << fname_ << "\""
+            << std::endl;
+        throw std::invalid_argument(msg.str());
+      }
+      std::uint64_t rows = 0;
+      std::uint64_t cols = 0;
+      if (!binary_format::read_le(*in_, rows)
+          || !binary_format::read_le(*in_, cols)) {
+        return false;
+      }
+      if (cols != header_.size()) {
+        std::stringstream msg;
+        msg << "Mismatch between header and draws in binary output file: \""
+            << fname_ << "\"" << std::endl;
+        throw std::invalid_argument(msg.str());
+      }
+      std::vector<char> bytes(rows * cols * sizeof(double));
+      if (!in_->read(bytes.data(), bytes.size())) {
+        return false;
+      }
+      pending_.resize(rows * cols);
+      const char *pos = bytes.data();
+      for (double &x : pending_) {
+        x = binary_format::decode_le<double>(pos);
+        pos += sizeof(double);
+      }
+      pending_rows_ = rows;
+      pending_pos_ = 0;
+      if (rows > 0) {
+        return true;
+      }
+    }
+  }
+};
+
+}  // namespace cmdstan
+#endif
@@ -185,12 +185,15 @@ void validate_output_filename(const std::string &fname) {
  * @param type suffix string corresponding to types CSV, JSON
  * @param num_chains number of names to return
  * @param id numbering offset
+ * @param number_single number the name of a single chain, as done when
+ *   the chains of a run are spread over MPI processes
  */
 std::vector<std::string> make_filenames(const std::string &filename,
                                         const std::string &tag,
                                         const std::string &type,
                                         unsigned int num_chains,
-                                        unsigned int id) {
+                                        unsigned int id,
+                                        bool number_single = false) {
   std::pair<std::string, std::string> base_sfx;
   base_sfx = get_basename_suffix(filename);
   if (type != ".csv" || base_sfx.second.empty()) {
@@ -198,8 +201,8 @@ std::vector<std::string> make_filenames(const std::string &filename,
   }
 
   std::vector<std::string> names(num_chains);
-  auto name_iterator = [num_chains, id](auto i) {
-    if (num_chains == 1) {
+  auto name_iterator = [num_chains, id, number_single](auto i) {
+    if (num_chains == 1 && !number_single) {
       return std::string("");
     } else {
       return std::string("_" + std::to_string(i + id));
@@ -233,11 +236,13 @@ std::ifstream safe_open(const std::string &fname) {
  *
  * @param fname name of file which exists and has read perms.
  * @param sig_figs number of digits to print
+ * @param binary if true, open the file in binary mode
  * @return Unique pointer to the output stream
  */
 std::unique_ptr<std::ofstream> safe_create(const std::string &fname,
-                                           int sig_figs) {
-  auto ofs = std::make_unique<std::ofstream>(fname.c_str());
+                                           int sig_figs, bool binary = false) {
+  auto ofs = std::make_unique<std::ofstream>(
+      fname.c_str(), binary ? std::ios::out | std::ios::binary : std::ios::out);
   ofs->exceptions(std::ofstream::badbit);
   if (sig_figs > -1) {
     ofs->precision(sig_figs);
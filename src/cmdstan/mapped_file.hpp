@@ -0,0 +1,134 @@
+#ifndef CMDSTAN_MAPPED_FILE_HPP
+#define CMDSTAN_MAPPED_FILE_HPP
+
+#include <cmdstan/compression.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#if !(defined(WIN32) || defined(_WIN32) \
+      || defined(__WIN32) && !defined(__CYGWIN__))
+#define CMDSTAN_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace cmdstan {
+
+/**
+ * Read-only view of the contents of a file.
+ *
+ * Uncompressed files are memory-mapped where the platform supports it,
+ * so pages are read on demand and no copy of the file is made.
+ * Compressed files, and all files on platforms without mmap, are read
+ * into memory.
+ */
+class mapped_file {
+ public:
+  /**
+   * Map a file.  Throws an exception if it can't be opened.
+   *
+   * @param fname name of file which exists and has read perms
+   */
+  explicit mapped_file(const std::string &fname) {
+    std::ifstream probe(fname.c_str(), std::ios::binary);
+    if (!probe.is_open()) {
+      std::stringstream msg;
+      msg << "Can't open specified file, \"" << fname << "\"" << std::endl;
+      throw std::invalid_argument(msg.str());
+    }
+    bool compressed = compression::detect(probe) != "none";
+    probe.close();
+#ifdef CMDSTAN_HAS_MMAP
+    if (!compressed && map(fname)) {
+      return;
+    }
+#endif
+    auto in = compression::open_input(fname, true);
+    buffer_.assign(std::istreambuf_iterator<char>(*in),
+                   std::istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+  }
+
+  mapped_file(const mapped_file &) = delete;
+  mapped_file &operator=(const mapped_file &) = delete;
+
+  ~mapped_file() {
+#ifdef CMDSTAN_HAS_MMAP
+    if (mapped_) {
+      munmap(const_cast<char *>(data_), size_);
+    }
+#endif
+  }
+
+  const char *data() const { return data_; }
+  const char *end() const { return data_ + size_; }
+  size_t size() const { return size_; }
+
+  /**
+   * Drop the pages of a mapped range which won't be read again, so that
+   * a file scanned once doesn't stay resident.  Pages are read back in
+   * if the range is accessed later.  Does nothing for unmapped files.
+   *
+   * @param offset start of range
+   * @param length length of range
+   */
+  void release(size_t offset, size_t length) {
+#ifdef CMDSTAN_HAS_MMAP
+    if (!mapped_) {
+      return;
+    }
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t first = (offset + page - 1) / page * page;
+    size_t last = std::min(offset + length, size_) / page * page;
+    if (first < last) {
+      madvise(const_cast<char *>(data_) + first, last - first, MADV_DONTNEED);
+    }
+#endif
+  }
+
+ private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  std::string buffer_;
+
+#ifdef CMDSTAN_HAS_MMAP
+  /**
+   * Map the whole file.
+   *
+   * @return false if the file can't be mapped, e.g. because it is empty
+   *   or a pipe
+   */
+  bool map(const std::string &fname) {
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+      close(fd);
+      return false;
+    }
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      return false;
+    }
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    data_ = static_cast<const char *>(addr);
+    size_ = st.st_size;
+    mapped_ = true;
+    return true;
+  }
+#endif
+};
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,75 @@
+#ifndef CMDSTAN_MPI_CONVERGENCE_EXCHANGE_HPP
+#define CMDSTAN_MPI_CONVERGENCE_EXCHANGE_HPP
+
+#include <cmdstan/convergence_monitor.hpp>
+#include <boost/mpi/collectives.hpp>
+#include <boost/mpi/communicator.hpp>
+#include <boost/mpi/environment.hpp>
+#include <boost/mpi/operations.hpp>
+#include <boost/serialization/vector.hpp>
+#include <stdexcept>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * Exchange of the convergence checks of chains spread over the
+ * processes of an MPI job.
+ *
+ * A process checks from whichever of its chains' threads reaches the
+ * next check first, one check at a time, so MPI must be initialized
+ * with at least MPI_THREAD_SERIALIZED.
+ */
+class mpi_convergence_exchange : public convergence_exchange {
+ public:
+  /**
+   * Construct an exchange between the processes of a communicator.
+   * Throws std::invalid_argument if the MPI library doesn't provide
+   * the threading level needed.
+   *
+   * @param world communicator of the processes
+   */
+  explicit mpi_convergence_exchange(const boost::mpi::communicator &world)
+      : world_(world) {
+    if (boost::mpi::environment::thread_level()
+        < boost::mpi::threading::serialized) {
+      throw std::invalid_argument(
+          "Argument 'mpi_chains' with stop_rule=ess needs an MPI library "
+          "which supports MPI_THREAD_SERIALIZED.");
+    }
+  }
+
+  size_t reduce_min(size_t n) {
+    size_t result;
+    boost::mpi::all_reduce(world_, n, result, boost::mpi::minimum<size_t>());
+    return result;
+  }
+
+  size_t reduce_max(size_t n) {
+    size_t result;
+    boost::mpi::all_reduce(world_, n, result, boost::mpi::maximum<size_t>());
+    return result;
+  }
+
+  std::vector<std::vector<double>> gather(const std::vector<double> &values) {
+    std::vector<std::vector<double>> all_values;
+    if (world_.rank() == 0) {
+      boost::mpi::gather(world_, values, all_values, 0);
+    } else {
+      boost::mpi::gather(world_, values, 0);
+    }
+    return all_values;
+  }
+
+  void broadcast(std::vector<double> &values) {
+    boost::mpi::broadcast(world_, values, 0);
+  }
+
+  void abort() { world_.abort(1); }
+
+ private:
+  boost::mpi::communicator world_;
+};
+
+}  // namespace cmdstan
+#endif
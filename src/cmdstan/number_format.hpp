@@ -0,0 +1,74 @@
+#ifndef CMDSTAN_NUMBER_FORMAT_HPP
+#define CMDSTAN_NUMBER_FORMAT_HPP
+
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+
+namespace cmdstan {
+
+/**
+ * Maximum number of characters `append_double` writes for one value,
+ * e.g. "-2.2250738585072014e-308" for 17 significant digits.
+ */
+constexpr int MAX_DOUBLE_CHARS = 32;
+
+/**
+ * Format a double into a buffer without going through iostreams, which
+ * are locale-aware and much slower than the number conversion itself.
+ *
+ * With `sig_figs` of -1 the output is the shortest string which reads
+ * back as the same double.  Otherwise it is the same as streaming the
+ * value with precision `sig_figs`, i.e. printf's "%.*g".  Infinities and
+ * NaN are written as "inf", "-inf" and "nan".
+ *
+ * Uses `std::to_chars` where the standard library supports it for
+ * floating point values, otherwise `snprintf`, whose round-trip output
+ * may have a digit or two more than the shortest.
+ *
+ * @param buf buffer of at least `MAX_DOUBLE_CHARS` characters
+ * @param x value to format
+ * @param sig_figs number of significant digits, or -1 for shortest
+ *   round-trip output
+ * @return number of characters written, not null-terminated
+ */
+inline int format_double(char *buf, double x, int sig_figs = -1) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+  std::to_chars_result result;
+  if (sig_figs < 0) {
+    result = std::to_chars(buf, buf + MAX_DOUBLE_CHARS, x);
+  } else {
+    result = std::to_chars(buf, buf + MAX_DOUBLE_CHARS, x,
+                           std::chars_format::general, sig_figs);
+  }
+  return static_cast<int>(result.ptr - buf);
+#else
+  if (sig_figs >= 0) {
+    return std::snprintf(buf, MAX_DOUBLE_CHARS, "%.*g", sig_figs, x);
+  }
+  // 15 digits are enough for most values, 17 always are
+  int size = std::snprintf(buf, MAX_DOUBLE_CHARS, "%.15g", x);
+  if (std::strtod(buf, nullptr) != x && x == x) {
+    size = std::snprintf(buf, MAX_DOUBLE_CHARS, "%.17g", x);
+  }
+  return size;
+#endif
+}
+
+/**
+ * Append the formatted value of a double to a string.
+ *
+ * @param out string to append to
+ * @param x value to format
+ * @param sig_figs number of significant digits, or -1 for shortest
+ *   round-trip output
+ */
+inline void append_double(std::string &out, double x, int sig_figs = -1) {
+  char buf[MAX_DOUBLE_CHARS];
+  out.append(buf, format_double(buf, x, sig_figs));
+}
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,139 @@
+#ifndef CMDSTAN_OUTPUT_WRITER_HPP
+#define CMDSTAN_OUTPUT_WRITER_HPP
+
+#include <cmdstan/binary_writer.hpp>
+#include <cmdstan/compression.hpp>
+#include <cmdstan/csv_writer.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * Owning handle for the writer behind one per-chain output.
+ *
+ * The services take vectors of writers of a single type, while the
+ * format of each output is chosen at runtime.  This handle forwards all
+ * callbacks to the writer it owns, so CSV, binary and null writers can
+ * be held in the same vector.
+ */
+class output_writer : public stan::callbacks::writer {
+ public:
+  /**
+   * Construct a writer which discards all output.
+   */
+  explicit output_writer(std::nullptr_t) {}
+
+  /**
+   * Construct a Stan CSV writer.
+   *
+   * @param output stream to write to
+   * @param comment_prefix prefix for comment lines
+   * @param sig_figs number of significant digits, or -1 for shortest
+   *   round-trip output
+   */
+  output_writer(std::unique_ptr<std::ostream> &&output,
+                const std::string &comment_prefix, int sig_figs = -1) {
+    auto writer = std::make_unique<csv_writer>(std::move(output),
+                                               comment_prefix, sig_figs);
+    stream_ = &writer->get_stream();
+    writer_ = std::move(writer);
+  }
+
+  /**
+   * Take ownership of an arbitrary writer.
+   *
+   * @param writer writer to forward to
+   * @param stream text stream underlying the writer, if any
+   */
+  explicit output_writer(std::unique_ptr<stan::callbacks::writer> &&writer,
+                         std::ostream *stream = nullptr)
+      : writer_(std::move(writer)), stream_(stream) {}
+
+  output_writer(output_writer &&other) = default;
+  output_writer &operator=(output_writer &&other) = default;
+
+  void operator()(const std::vector<std::string> &names) {
+    if (writer_)
+      (*writer_)(names);
+  }
+
+  void operator()(const std::vector<double> &state) {
+    if (writer_)
+      (*writer_)(state);
+  }
+
+  void operator()() {
+    if (writer_)
+      (*writer_)();
+  }
+
+  void operator()(const std::string &message) {
+    if (writer_)
+      (*writer_)(message);
+  }
+
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, -1, -1>> &values) {
+    if (writer_)
+      (*writer_)(values);
+  }
+
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, 1, -1>> &values) {
+    if (writer_)
+      (*writer_)(values);
+  }
+
+  void operator()(const Eigen::Ref<Eigen::Matrix<double, -1, 1>> &values) {
+    if (writer_)
+      (*writer_)(values);
+  }
+
+  /**
+   * Return true if the output is a text stream.
+   */
+  bool has_stream() const { return stream_ != nullptr; }
+
+  /**
+   * Return the text stream of a CSV writer, for methods such as log_prob
+   * which format their output directly.
+   * Throws an exception if the output isn't a text stream.
+   */
+  std::ostream &get_stream() {
+    if (stream_ == nullptr) {
+      throw std::invalid_argument(
+          "This method can only write its output in CSV format.");
+    }
+    return *stream_;
+  }
+
+  /**
+   * Write out what is buffered, so that the output file holds everything
+   * written so far.  Asynchronous writers are not flushed.
+   */
+  void flush() {
+    if (stream_ != nullptr) {
+      compression::flush(*stream_);
+    } else if (auto *binary = dynamic_cast<binary_writer *>(writer_.get())) {
+      binary->flush();
+    }
+  }
+
+  /**
+   * Return the writer this handle forwards to, or nullptr.
+   */
+  stan::callbacks::writer *get() { return writer_.get(); }
+
+ private:
+  std::unique_ptr<stan::callbacks::writer> writer_;
+  std::ostream *stream_ = nullptr;
+};
+
+}  // namespace cmdstan
+#endif
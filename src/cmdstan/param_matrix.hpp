@@ -0,0 +1,199 @@
+#ifndef CMDSTAN_PARAM_MATRIX_HPP
+#define CMDSTAN_PARAM_MATRIX_HPP
+
+#include <cmdstan/binary_format.hpp>
+#include <cmdstan/mapped_file.hpp>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+namespace internal {
+
+/**
+ * Return the value of a key in the header of a NumPy .npy file, which
+ * is a Python dict literal such as
+ * "{'descr': '<f8', 'fortran_order': False, 'shape': (1000, 3), }".
+ *
+ * @param header dict literal
+ * @param key name of key
+ * @return text of value, without surrounding whitespace
+ */
+inline std::string npy_header_value(const std::string &header,
+                                    const std::string &key) {
+  size_t pos = header.find("'" + key + "'");
+  if (pos == std::string::npos) {
+    return "";
+  }
+  pos = header.find(':', pos);
+  if (pos == std::string::npos) {
+    return "";
+  }
+  pos = header.find_first_not_of(" ", pos + 1);
+  if (pos == std::string::npos) {
+    return "";
+  }
+  size_t end;
+  if (header[pos] == '(') {
+    end = header.find(')', pos);
+    return header.substr(pos, end == std::string::npos ? end : end + 1 - pos);
+  }
+  end = header.find_first_of(",}", pos);
+  std::string value = header.substr(pos, end - pos);
+  return value.substr(0, value.find_last_not_of(" ") + 1);
+}
+
+}  // namespace internal
+
+/**
+ * Read-only matrix of parameter values stored in a binary file, for
+ * methods which evaluate the model at many points.
+ *
+ * Two layouts are read:
+ *  - NumPy .npy files holding a 1-d or 2-d array of little-endian
+ *    doubles ('<f8'), in C or Fortran order.
+ *  - Raw files of little-endian doubles in row-major order, whose number
+ *    of columns is the number of model parameters.
+ *
+ * The file is memory-mapped where possible, so rows are read on demand
+ * and the pages of rows already evaluated can be released.
+ */
+class param_matrix {
+ public:
+  /**
+   * Map a parameter file.  Throws an exception if the file can't be
+   * read or doesn't hold a matrix with the expected number of columns.
+   *
+   * @param fname name of file, ".npy" files are read as NumPy arrays
+   * @param num_cols number of parameters per row
+   */
+  param_matrix(const std::string &fname, size_t num_cols)
+      : file_(fname), cols_(num_cols) {
+    std::stringstream msg;
+    const char npy_magic[] = "\x93NUMPY";
+    size_t offset = 0;
+    size_t cols = num_cols;
+    if (file_.size() >= 10 && std::memcmp(file_.data(), npy_magic, 6) == 0) {
+      unsigned char major = file_.data()[6];
+      size_t header_len;
+      if (major == 1) {
+        header_len = binary_format::decode_le<std::uint16_t>(file_.data() + 8);
+        offset = 10;
+      } else if (file_.size() >= 12) {
+        header_len = binary_format::decode_le<std::uint32_t>(file_.data() + 8);
+        offset = 12;
+      } else {
+        header_len = file_.size();
+      }
+      if (offset + header_len > file_.size()) {
+        msg << "Truncated NumPy file " << fname;
+        throw std::invalid_argument(msg.str());
+      }
+      std::string header(file_.data() + offset, header_len);
+      offset += header_len;
+      std::string descr = internal::npy_header_value(header, "descr");
+      if (descr != "'<f8'") {
+        msg << "NumPy file " << fname << " must hold little-endian doubles "
+            << "('<f8'), found " << descr;
+        throw std::invalid_argument(msg.str());
+      }
+      fortran_order_
+          = internal::npy_header_value(header, "fortran_order") == "True";
+      std::vector<size_t> shape;
+      std::string shape_text = internal::npy_header_value(header, "shape");
+      for (size_t pos = shape_text.find_first_of("0123456789");
+           pos != std::string::npos;
+           pos = shape_text.find_first_of("0123456789", pos)) {
+        size_t end = shape_text.find_first_not_of("0123456789", pos);
+        shape.push_back(std::stoull(shape_text.substr(pos, end - pos)));
+        pos = end;
+      }
+      if (shape.size() == 1) {
+        rows_ = 1;
+        cols = shape[0];
+      } else if (shape.size() == 2) {
+        rows_ = shape[0];
+        cols = shape[1];
+      } else {
+        msg << "NumPy file " << fname << " must hold a 1-d or 2-d array, "
+            << "found shape " << shape_text;
+        throw std::invalid_argument(msg.str());
+      }
+      if (offset + rows_ * cols * sizeof(double) > file_.size()) {
+        msg << "Truncated NumPy file " << fname;
+        throw std::invalid_argument(msg.str());
+      }
+    } else {
+      if (file_.size() >= sizeof(binary_format::MAGIC)
+          && std::memcmp(file_.data(), binary_format::MAGIC,
+                         sizeof(binary_format::MAGIC))
+                 == 0) {
+        msg << "File " << fname << " is a CmdStan binary output file, "
+            << "not a matrix of unconstrained parameter values";
+        throw std::invalid_argument(msg.str());
+      }
+      if (num_cols == 0 || file_.size() % (num_cols * sizeof(double)) != 0) {
+        msg << "Size of binary file " << fname << " is not a multiple of "
+            << num_cols << " doubles";
+        throw std::invalid_argument(msg.str());
+      }
+      rows_ = file_.size() / (num_cols * sizeof(double));
+    }
+    if (cols != num_cols) {
+      msg << "Incorrect number of unconstrained parameters provided! "
+             "Model has "
+          << num_cols << " parameters but " << cols << " were found.";
+      throw std::invalid_argument(msg.str());
+    }
+    values_ = file_.data() + offset;
+  }
+
+  size_t rows() const { return rows_; }
+  size_t cols() const { return cols_; }
+
+  /**
+   * Copy a row.
+   *
+   * @param i index of row
+   * @param[out] row values of row
+   * @return row
+   */
+  std::vector<double> &row(size_t i, std::vector<double> &row) const {
+    row.resize(cols_);
+    for (size_t j = 0; j < cols_; ++j) {
+      size_t k = fortran_order_ ? j * rows_ + i : i * cols_ + j;
+      row[j] = binary_format::decode_le<double>(values_ + k * sizeof(double));
+    }
+    return row;
+  }
+
+  /**
+   * Release the mapped pages of a range of rows which have been read.
+   * Only C ordered files are released, because the rows of Fortran
+   * ordered files are spread over the whole file.
+   *
+   * @param begin first row
+   * @param end row past the last row
+   */
+  void release(size_t begin, size_t end) {
+    if (!fortran_order_ && end > begin) {
+      size_t row_bytes = cols_ * sizeof(double);
+      file_.release(values_ - file_.data() + begin * row_bytes,
+                    (end - begin) * row_bytes);
+    }
+  }
+
+ private:
+  mapped_file file_;
+  const char *values_ = nullptr;
+  size_t rows_ = 0;
+  size_t cols_;
+  bool fortran_order_ = false;
+};
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,346 @@
+#ifndef CMDSTAN_SERVER_HPP
+#define CMDSTAN_SERVER_HPP
+
+#include <cmdstan/file.hpp>
+#include <stan/model/model_base.hpp>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if !(defined(WIN32) || defined(_WIN32) \
+      || defined(__WIN32) && !defined(__CYGWIN__))
+#define CMDSTAN_HAS_UNIX_SOCKETS
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace cmdstan {
+
+/**
+ * Instantiated models kept by the server for reuse across jobs.
+ *
+ * A model is determined by its data and by the seed, which transformed
+ * data may use to generate random numbers.  Models are keyed on a hash
+ * of the contents of the data file and on the seed, so that a job with
+ * the same data and seed skips parsing the data and constructing the
+ * model.  Jobs which don't set a seed run with the server's, so that
+ * they share models too.  The least recently used model is released
+ * once more than `max_models` are held.
+ */
+class model_cache {
+ public:
+  using model_factory = std::function<std::unique_ptr<stan::model::model_base>(
+      const std::string &, unsigned int)>;
+
+  /**
+   * Construct an empty cache.
+   *
+   * @param make_model function which instantiates the model, given the
+   *   name of a data file and a seed
+   * @param max_models maximum number of models held
+   * @param seed seed of jobs which don't set one
+   */
+  model_cache(model_factory make_model, size_t max_models, unsigned int seed)
+      : make_model_(std::move(make_model)),
+        max_models_(max_models),
+        seed_(seed) {}
+
+  /**
+   * Return the model for a data file and seed, instantiating it if it
+   * isn't held already.
+   *
+   * @param data_file name of data file, or empty for no data
+   * @param seed seed for transformed data
+   * @return model
+   */
+  stan::model::model_base &get(const std::string &data_file,
+                               unsigned int seed) {
+    std::string contents;
+    if (!data_file.empty()) {
+      std::ifstream in = file::safe_open(data_file);
+      contents.assign(std::istreambuf_iterator<char>(in),
+                      std::istreambuf_iterator<char>());
+    }
+    std::stringstream key;
+    key << std::hash<std::string>{}(contents) << ':' << contents.size() << ':'
+        << seed;
+    for (auto it = models_.begin(); it != models_.end(); ++it) {
+      if (it->first == key.str()) {
+        models_.splice(models_.begin(), models_, it);
+        ++num_hits_;
+        return *models_.front().second;
+      }
+    }
+    models_.emplace_front(key.str(), make_model_(data_file, seed));
+    if (models_.size() > max_models_) {
+      models_.pop_back();
+    }
+    return *models_.front().second;
+  }
+
+  /**
+   * Return the number of models held.
+   */
+  size_t size() const { return models_.size(); }
+
+  /**
+   * Return the number of requests served by a model already held.
+   */
+  size_t num_hits() const { return num_hits_; }
+
+  /**
+   * Return the seed of jobs which don't set one.
+   */
+  unsigned int seed() const { return seed_; }
+
+ private:
+  model_factory make_model_;
+  size_t max_models_;
+  unsigned int seed_;
+  size_t num_hits_ = 0;
+  // most recently used first
+  std::list<std::pair<std::string, std::unique_ptr<stan::model::model_base>>>
+      models_;
+};
+
+namespace internal {
+
+/**
+ * Split a job request into arguments at whitespace.  Double quotes
+ * group an argument containing whitespace, e.g. a file name.
+ *
+ * @param line job request
+ * @return arguments
+ */
+inline std::vector<std::string> split_job_args(const std::string &line) {
+  std::vector<std::string> args;
+  std::string arg;
+  bool in_arg = false;
+  bool quoted = false;
+  for (char c : line) {
+    if (c == '"') {
+      quoted = !quoted;
+      in_arg = true;
+    } else if (!quoted && std::isspace(static_cast<unsigned char>(c))) {
+      if (in_arg) {
+        args.push_back(arg);
+        arg.clear();
+        in_arg = false;
+      }
+    } else {
+      arg += c;
+      in_arg = true;
+    }
+  }
+  if (quoted) {
+    throw std::invalid_argument("Unterminated quote in job request");
+  }
+  if (in_arg) {
+    args.push_back(arg);
+  }
+  return args;
+}
+
+#ifdef CMDSTAN_HAS_UNIX_SOCKETS
+/**
+ * Stream buffer reading from and writing to a connected socket.
+ */
+class socket_streambuf : public std::streambuf {
+ public:
+  explicit socket_streambuf(int fd) : fd_(fd) {
+    setg(in_, in_, in_);
+    setp(out_, out_ + sizeof(out_));
+  }
+
+  ~socket_streambuf() { sync(); }
+
+ protected:
+  int_type underflow() {
+    ssize_t n;
+    do {
+      n = ::read(fd_, in_, sizeof(in_));
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+      return traits_type::eof();
+    }
+    setg(in_, in_, in_ + n);
+    return traits_type::to_int_type(*gptr());
+  }
+
+  int_type overflow(int_type c) {
+    if (sync() != 0) {
+      return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  int sync() {
+    const char *pos = pbase();
+    while (pos < pptr()) {
+      ssize_t n = ::write(fd_, pos, pptr() - pos);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return -1;
+      }
+      pos += n;
+    }
+    setp(out_, out_ + sizeof(out_));
+    return 0;
+  }
+
+ private:
+  int fd_;
+  char in_[4096];
+  char out_[4096];
+};
+#endif
+
+}  // namespace internal
+
+/**
+ * Function which runs one job, given its arguments, and returns its
+ * return code.
+ */
+using job_runner = std::function<int(const std::vector<std::string> &)>;
+
+/**
+ * Run the jobs read from a stream, one per line, and write one reply
+ * line per job: "ok" if the job succeeded, otherwise "error" followed by
+ * the reason.  Empty lines and lines starting with '#' are skipped.
+ *
+ * @param in stream of job requests
+ * @param out stream for replies
+ * @param run_job function which runs a job
+ * @return true if the request "quit" was read, false at end of input
+ */
+inline bool serve(std::istream &in, std::ostream &out,
+                  const job_runner &run_job) {
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line[start] == '#') {
+      continue;
+    }
+    if (line.compare(start, std::string::npos, "quit") == 0) {
+      return true;
+    }
+    try {
+      int return_code = run_job(internal::split_job_args(line));
+      if (return_code == 0) {
+        out << "ok" << std::endl;
+      } else {
+        out << "error: return code " << return_code << std::endl;
+      }
+    } catch (const std::exception &e) {
+      std::string what(e.what());
+      for (char &c : what) {
+        if (c == '\n' || c == '\r') {
+          c = ' ';
+        }
+      }
+      out << "error: " << what << std::endl;
+    }
+  }
+  return false;
+}
+
+/**
+ * Run the jobs read from stdin and reply on stdout.  The console output
+ * of the jobs goes to stderr, so that stdout only holds replies.
+ *
+ * @param run_job function which runs a job
+ */
+inline void serve_stdin(const job_runner &run_job) {
+  std::streambuf *stdout_buf = std::cout.rdbuf(std::cerr.rdbuf());
+  std::ostream replies(stdout_buf);
+  try {
+    serve(std::cin, replies, run_job);
+  } catch (...) {
+    std::cout.rdbuf(stdout_buf);
+    throw;
+  }
+  std::cout.rdbuf(stdout_buf);
+}
+
+/**
+ * Listen on a Unix socket and run the jobs of each connection in turn,
+ * replying on the connection, until a client sends "quit".
+ * Throws an exception if the socket can't be set up.
+ *
+ * @param path path of socket, which is replaced if it exists
+ * @param run_job function which runs a job
+ */
+inline void serve_socket(const std::string &path, const job_runner &run_job) {
+#ifdef CMDSTAN_HAS_UNIX_SOCKETS
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    throw std::invalid_argument("Socket path is too long: " + path);
+  }
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    throw std::runtime_error("Can't create socket: "
+                             + std::string(std::strerror(errno)));
+  }
+  ::unlink(path.c_str());
+  if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0
+      || ::listen(fd, 16) != 0) {
+    std::string reason(std::strerror(errno));
+    ::close(fd);
+    throw std::runtime_error("Can't listen on socket \"" + path
+                             + "\": " + reason);
+  }
+  bool quit = false;
+  while (!quit) {
+    int conn = ::accept(fd, nullptr, nullptr);
+    if (conn < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::string reason(std::strerror(errno));
+      ::close(fd);
+      ::unlink(path.c_str());
+      throw std::runtime_error("Can't accept connection: " + reason);
+    }
+    {
+      internal::socket_streambuf buf(conn);
+      std::iostream stream(&buf);
+      quit = serve(stream, stream, run_job);
+    }
+    ::close(conn);
+  }
+  ::close(fd);
+  ::unlink(path.c_str());
+#else
+  throw std::invalid_argument(
+      "Unix sockets are not supported on this platform, "
+      "leave 'socket' empty to read jobs from stdin.");
+#endif
+}
+
+}  // namespace cmdstan
+#endif
@@ -2,13 +2,18 @@
 #include <cmdstan/stansummary_helper.hpp>
 #include <stan/io/ends_with.hpp>
 #include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <iomanip>
 #include <ios>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <thread>
 #include <vector>
 #include <boost/algorithm/string.hpp>
 #include <CLI11/CLI11.hpp>
+#include <tbb/global_control.h>
 
 using cmdstan::return_codes;
 
@@ -26,6 +31,7 @@ using cmdstan::return_codes;
 int main(int argc, const char *argv[]) {
   std::string usage = R"(Usage: stansummary [OPTIONS] stan_csv_file(s)
 Report statistics for one or more Stan csv files from a HMC sampler run.
+Files written with "output format=binary" are also accepted.
 Example:  stansummary model_chain_1.csv model_chain_2.csv
 Options:
   -a, --autocorr [n]          Display the chain autocorrelation for the n-th
@@ -41,6 +47,23 @@ Options:
                               By default, all parameters in the file are summarized,
                               passing this argument one or more times will filter
                               the output down to just the requested arguments.
+  -t, --threads [n]           Number of threads used to read the input files and
+                              compute the statistics. Default is 1.
+                              Use -1 for all available cores.
+  --streaming                 Summarize files too large to fit in memory by
+                              reading the draws a block of parameters at a time.
+                              Requires uncompressed csv files; not available
+                              with --autocorr.
+  --max_memory [MB]           Memory budget for draws with --streaming.
+                              Default is 1024.
+  --follow                    Follow csv files which are still being written,
+                              printing a summary every --refresh seconds, and
+                              the full summary once all chains have finished.
+  --refresh [seconds]         Time between summaries with --follow.
+                              Default is 5.
+  --recompute [n]             With --follow, recompute all statistics every n-th
+                              summary; in between only Mean and StdDev are
+                              updated. Default is 6.
 )";
   if (argc < 2) {
     std::cout << usage << std::endl;
@@ -54,6 +77,12 @@ Options:
   std::string percentiles_spec = "5,50,95";
   std::vector<std::string> filenames;
   std::vector<std::string> requested_params_vec;
+  int num_threads = 1;
+  bool streaming = false;
+  size_t max_memory_mb = 1024;
+  bool follow = false;
+  double refresh_seconds = 5;
+  int recompute_every = 6;
 
   CLI::App app{"Allowed options"};
   app.add_option("--sig_figs,-s", sig_figs, "Significant figures, default 2.",
@@ -78,6 +107,21 @@ Options:
         return token;
       })
       ->take_all();
+  app.add_option("--threads,-t", num_threads,
+                 "Number of threads, default 1, -1 for all cores.", true);
+  app.add_flag("--streaming", streaming,
+               "Read the draws a block of parameters at a time.");
+  app.add_option("--max_memory", max_memory_mb,
+                 "Memory budget for draws with --streaming, in MB.", true)
+      ->check(CLI::PositiveNumber);
+  app.add_flag("--follow", follow, "Follow csv files which are being written.");
+  app.add_option("--refresh", refresh_seconds,
+                 "Seconds between summaries with --follow, default 5.", true)
+      ->check(CLI::PositiveNumber);
+  app.add_option("--recompute", recompute_every,
+                 "Recompute all statistics every n-th summary, default 6.",
+                 true)
+      ->check(CLI::PositiveNumber);
   app.add_option("input_files", filenames, "Sampler csv files.", true)
       ->required()
       ->check(CLI::ExistingFile);
@@ -95,6 +139,26 @@ Options:
               << " not a valid chain id." << std::endl;
     return return_codes::NOT_OK;
   }
+  if (streaming && app.count("--autocorr")) {
+    std::cout << "Option --autocorr is not available with --streaming."
+              << std::endl;
+    return return_codes::NOT_OK;
+  }
+  if (streaming && follow) {
+    std::cout << "Options --streaming and --follow can't be used together."
+              << std::endl;
+    return return_codes::NOT_OK;
+  }
+  if (num_threads < 1 && num_threads != -1) {
+    std::cout << "Option --threads: " << num_threads
+              << " must be positive or -1." << std::endl;
+    return return_codes::NOT_OK;
+  }
+  std::unique_ptr<tbb::global_control> max_threads;
+  if (num_threads > 0) {
+    max_threads = std::make_unique<tbb::global_control>(
+        tbb::global_control::max_allowed_parallelism, num_threads);
+  }
   std::vector<std::string> percentiles;
   Eigen::VectorXd probs;
   boost::algorithm::trim(percentiles_spec);
@@ -136,151 +200,75 @@ Options:
     Eigen::VectorXd warmup_times(filenames.size());
     Eigen::VectorXd sampling_times(filenames.size());
     Eigen::VectorXi thin(filenames.size());
+    auto report = [&](const auto &chains) {
+      return summarize(chains, metadata, warmup_times, sampling_times, thin,
+                       percentiles, probs, requested_params_vec, sig_figs,
+                       app.count("--autocorr") ? autocorr_idx : 0,
+                       app.count("--csv_filename") ? csv_filename : "",
+                       app.count("--sig_figs") ? sig_figs : 6);
+    };
 
-    // check for stan csv file parse errors written to output stream
-    std::stringstream cout_ss;
-    auto chains = parse_csv_files(filenames, metadata, warmup_times,
-                                  sampling_times, thin, &std::cout);
-
-    // Get column headers for sampler, model params
-    size_t max_name_length = 0;
-    size_t num_sampler_params = 0;
-    for (int i = 0; i < chains.num_params(); ++i) {
-      if (chains.param_name(i).length() > max_name_length)
-        max_name_length = chains.param_name(i).length();
-      if (stan::io::ends_with("__", chains.param_name(i)))
-        num_sampler_params++;
-    }
-    // don't count name 'lp__'
-    if (num_sampler_params > 0) {
-      num_sampler_params--;
-    }
-
-    // Get column indices for the sampler params
-    std::vector<int> sampler_params_idxes(num_sampler_params);
-    std::iota(sampler_params_idxes.begin(), sampler_params_idxes.end(), 1);
-
-    size_t model_params_offset = num_sampler_params + 1;
-
-    size_t num_model_params = 0;
-    std::vector<int> model_param_idxes(0);
-
-    bool model_params_subset = requested_params_vec.size() > 0;
-    if (model_params_subset) {
-      std::set<std::string> requested_params(requested_params_vec.begin(),
-                                             requested_params_vec.end());
-
-      for (int i = model_params_offset; i < chains.num_params(); ++i) {
-        if (requested_params.erase(chains.param_name(i)) > 0) {
-          model_param_idxes.emplace_back(i);
-          num_model_params++;
+    if (follow) {
+      following_chains live(filenames);
+      std::vector<std::string> header = get_header(percentiles);
+      std::vector<int> cols;
+      Eigen::MatrixXd stats;
+      int num_refreshes = 0;
+      auto last_refresh = std::chrono::steady_clock::now();
+      bool checked_params = false;
+      while (true) {
+        live.poll();
+        // report unknown names as soon as the header is read, rather
+        // than once the run has finished
+        if (!checked_params && live.num_params() > 0) {
+          if (!check_requested_params(live, requested_params_vec,
+                                      &std::cout)) {
+            return return_codes::NOT_OK;
+          }
+          checked_params = true;
         }
-      }
-      // some params were requested but not found by above loop
-      if (requested_params.size() > 0) {
-        std::cout << "--include_param: Unrecognized parameter(s): ";
-        for (auto param : requested_params) {
-          std::cout << "'" << param << "' ";
+        if (live.finished()) {
+          break;
+        }
+        std::chrono::duration<double> elapsed
+            = std::chrono::steady_clock::now() - last_refresh;
+        if (elapsed.count() >= refresh_seconds && live.num_samples() > 0) {
+          if (cols.empty()) {
+            for (int i = 0; i < live.num_params(); ++i) {
+              if (requested_params_vec.empty()
+                  || stan::io::ends_with("__", live.param_name(i))
+                  || std::count(requested_params_vec.begin(),
+                                requested_params_vec.end(),
+                                live.param_name(i))) {
+                cols.push_back(i);
+              }
+            }
+            stats.setConstant(cols.size(), header.size(),
+                              std::numeric_limits<double>::quiet_NaN());
+          }
+          get_stats(live, probs, cols, num_refreshes % recompute_every == 0,
+                    stats);
+          write_follow_status(live, header, stats, cols, sig_figs,
+                              &std::cout);
+          ++num_refreshes;
+          last_refresh = std::chrono::steady_clock::now();
         }
-        std::cout << std::endl;
-        return return_codes::NOT_OK;
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
       }
-
-    } else {
-      // if none were requested, get all of the model parameters
-      num_model_params = chains.num_params() - num_sampler_params - 1;
-      model_param_idxes.resize(num_model_params);
-      std::iota(model_param_idxes.begin(), model_param_idxes.end(),
-                model_params_offset);
+      auto chains
+          = live.chainset(metadata, warmup_times, sampling_times, thin);
+      return report(chains);
     }
-
-    std::vector<std::string> header = get_header(percentiles);
-
-    // Compute statistics for sampler and model params
-    Eigen::MatrixXd lp_param(1, header.size());
-    Eigen::MatrixXd sampler_params(num_sampler_params, header.size());
-    Eigen::MatrixXd model_params(num_model_params, header.size());
-
-    get_stats(chains, sampling_times, probs, {0}, lp_param);
-    get_stats(chains, sampling_times, probs, sampler_params_idxes,
-              sampler_params);
-    get_stats(chains, sampling_times, probs, model_param_idxes, model_params);
-
-    // Console output formatting
-    Eigen::VectorXi column_sig_figs(header.size());
-    Eigen::Matrix<std::ios_base::fmtflags, Eigen::Dynamic, 1> sampler_formats(
-        header.size());
-    Eigen::VectorXi sampler_widths(header.size());
-    sampler_widths = calculate_column_widths(sampler_params, header, sig_figs,
-                                             sampler_formats);
-
-    Eigen::Matrix<std::ios_base::fmtflags, Eigen::Dynamic, 1> model_formats(
-        header.size());
-    Eigen::VectorXi model_widths(header.size());
-    model_widths = calculate_column_widths(model_params, header, sig_figs,
-                                           model_formats);
-
-    Eigen::VectorXi column_widths(header.size());
-    for (size_t i = 0; i < header.size(); ++i)
-      column_widths[i] = sampler_widths[i] > model_widths[i] ? sampler_widths[i]
-                                                             : model_widths[i];
-
-    // Print to console
-    write_timing(chains, metadata, warmup_times, sampling_times, thin, "",
-                 &std::cout);
-    std::cout << std::endl;
-
-    write_header(header, column_widths, max_name_length, false, &std::cout);
-    std::cout << std::endl;
-    write_params(chains, lp_param, column_widths, model_formats,
-                 max_name_length, sig_figs, {0}, false, &std::cout);
-    write_params(chains, sampler_params, column_widths, sampler_formats,
-                 max_name_length, sig_figs, sampler_params_idxes, false,
-                 &std::cout);
-    std::cout << std::endl;
-    if (model_params_subset)
-      write_params(chains, model_params, column_widths, model_formats,
-                   max_name_length, sig_figs, model_param_idxes, false,
-                   &std::cout);
-    else
-      write_all_model_params(chains, model_params, column_widths, model_formats,
-                             max_name_length, sig_figs, model_params_offset,
-                             false, &std::cout);
-    std::cout << std::endl;
-    write_sampler_info(metadata, "", &std::cout);
-
-    if (app.count("--autocorr")) {
-      autocorrelation(chains, metadata, autocorr_idx, max_name_length);
-      std::cout << std::endl;
-    }
-
-    // Write to csv file (optional)
-    if (app.count("--csv_filename")) {
-      std::ofstream csv_file(csv_filename.c_str(), std::ios_base::app);
-      csv_file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
-      csv_file << std::setprecision(app.count("--sig_figs") ? sig_figs : 6);
-
-      write_header(header, column_widths, max_name_length, true, &csv_file);
-      write_params(chains, lp_param, column_widths, model_formats,
-                   max_name_length, sig_figs, {0}, true, &csv_file);
-      write_params(chains, sampler_params, column_widths, sampler_formats,
-                   max_name_length, sig_figs, sampler_params_idxes, true,
-                   &csv_file);
-
-      if (model_params_subset)
-        write_params(chains, model_params, column_widths, model_formats,
-                     max_name_length, sig_figs, model_param_idxes, true,
-                     &csv_file);
-      else
-        write_all_model_params(chains, model_params, column_widths,
-                               model_formats, max_name_length, sig_figs,
-                               model_params_offset, true, &csv_file);
-
-      write_timing(chains, metadata, warmup_times, sampling_times, thin, "# ",
-                   &csv_file);
-      write_sampler_info(metadata, "# ", &csv_file);
-      csv_file.close();
+    if (streaming) {
+      streaming_chains chains(filenames, max_memory_mb * 1024 * 1024,
+                              metadata, warmup_times, sampling_times, thin);
+      return report(chains);
     }
+    // only the requested model params are read from the files
+    auto chains = parse_csv_files(filenames, metadata, warmup_times,
+                                  sampling_times, thin, &std::cout,
+                                  requested_params_vec);
+    return report(chains);
   } catch (const std::invalid_argument &e) {
     std::cout << "Error during processing. " << e.what() << std::endl;
     return return_codes::NOT_OK;
@@ -1,17 +1,30 @@
 #ifndef CMDSTAN_STANSUMMARY_HELPER_HPP
 #define CMDSTAN_STANSUMMARY_HELPER_HPP
 
+#include <cmdstan/binary_reader.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <cmdstan/compression.hpp>
+#include <cmdstan/csv_reader.hpp>
+#include <stan/io/ends_with.hpp>
 #include <stan/mcmc/chainset.hpp>
 #include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <ios>
 #include <cmath>
+#include <exception>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <set>
 #include <stdexcept>
 #include <string>
 #include <vector>
 #include <boost/algorithm/string.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 
 /**
  * Determine size, and number of decimals required
@@ -319,7 +332,11 @@ Eigen::VectorXd percentiles_to_probs(
 }
 
 /**
- * Assemble set of Stan csv files into a stan::mcmc::chains object
+ * Assemble set of Stan csv files into a stan::mcmc::chains object.
+ * CSV files are memory-mapped and parsed in place by `read_stan_csv`,
+ * several files at a time on the TBB thread pool.
+ * Files in the binary output format are recognized and read as well,
+ * and gzip or zstd compressed files are decompressed while reading.
  *
  * @param in vector of filenames of stan csv files
  * @param in out  metadata
@@ -327,21 +344,46 @@ Eigen::VectorXd percentiles_to_probs(
  * @param in out  sampling times for each chain
  * @param in out  thinning for each chain
  * @param out output stream
+ * @param in names of the model params to read; lp__ and the sampler
+ *   params are always read.  If empty, all params are read.
+ * @param out if not null, offsets of the draws in each csv file
  * @return stan::mcmc::chains object
  */
-stan::mcmc::chainset parse_csv_files(const std::vector<std::string> &filenames,
-                                     stan::io::stan_csv_metadata &metadata,
-                                     Eigen::VectorXd &warmup_times,
-                                     Eigen::VectorXd &sampling_times,
-                                     Eigen::VectorXi &thin, std::ostream *out) {
-  std::vector<stan::io::stan_csv> csvs;
-  csvs.reserve(filenames.size());
-  std::ifstream ifstream;
+stan::mcmc::chainset parse_csv_files(
+    const std::vector<std::string> &filenames,
+    stan::io::stan_csv_metadata &metadata, Eigen::VectorXd &warmup_times,
+    Eigen::VectorXd &sampling_times, Eigen::VectorXi &thin, std::ostream *out,
+    const std::vector<std::string> &include_params = {},
+    std::vector<std::vector<size_t>> *draw_offsets = nullptr) {
+  std::vector<stan::io::stan_csv> csvs(filenames.size());
+  std::vector<std::exception_ptr> errors(filenames.size());
+  if (draw_offsets != nullptr) {
+    draw_offsets->assign(filenames.size(), {});
+  }
 
+  // files are independent, read them concurrently
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, filenames.size(), 1),
+      [&](const tbb::blocked_range<size_t> &r) {
+        for (size_t chain = r.begin(); chain != r.end(); ++chain) {
+          try {
+            if (cmdstan::is_binary_output(filenames[chain])) {
+              csvs[chain] = cmdstan::read_binary_output(filenames[chain], true,
+                                                        include_params);
+            } else {
+              csvs[chain] = cmdstan::read_stan_csv(
+                  filenames[chain], true, include_params,
+                  draw_offsets ? &(*draw_offsets)[chain] : nullptr);
+            }
+          } catch (...) {
+            errors[chain] = std::current_exception();
+          }
+        }
+      });
   for (size_t chain = 0; chain < filenames.size(); chain++) {
-    ifstream.open(filenames[chain].c_str());
-    csvs.push_back(stan::io::stan_csv_reader::parse(ifstream, out));
-    ifstream.close();
+    if (errors[chain]) {
+      std::rethrow_exception(errors[chain]);
+    }
     auto &stan_csv = csvs[chain];
     if (stan_csv.samples.rows() < 1) {
       std::stringstream message_stream("");
@@ -385,6 +427,7 @@ std::vector<std::string> get_header(
 /**
  * Compute statistics for span of output columns
  *  Mean, MCSE,  StdDev, MAD, ... percentiles ..., ESS_bulk, ESS_tail, R_hat
+ * Columns are computed in parallel on the TBB thread pool.
  *
  * @param in set of samples from one or more chains
  * @param in vector of warmup times  (required for N_eff/S)
@@ -404,26 +447,418 @@ void get_stats(const stan::mcmc::chainset &chains,
     throw std::domain_error("get_stats: size mismatch");
   }
 
-  // Model parameters
-  int i = 0;
-  for (int i_chains : cols) {
-    params(i, 0) = chains.mean(i_chains);
-    params(i, 1) = chains.mcse_mean(i_chains);
-    params(i, 2) = chains.sd(i_chains);
-    params(i, 3) = chains.med_abs_deviation(i_chains);
-    Eigen::VectorXd quantiles = chains.quantiles(i_chains, probs);
-    for (int j = 0; j < quantiles.size(); j++)
-      params(i, 4 + j) = quantiles(j);
-
-    auto [ess_bulk, ess_tail] = chains.split_rank_normalized_ess(i_chains);
-
-    params(i, quantiles.size() + 4) = ess_bulk;
-    params(i, quantiles.size() + 5) = ess_tail;
-
-    auto [rhat_bulk, rhat_tail] = chains.split_rank_normalized_rhat(i_chains);
-    params(i, quantiles.size() + 6)
-        = rhat_bulk > rhat_tail ? rhat_bulk : rhat_tail;
-    i++;
+  // Model parameters, each independent of the others
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, cols.size()),
+      [&](const tbb::blocked_range<size_t> &r) {
+        for (size_t i = r.begin(); i != r.end(); ++i) {
+          int i_chains = cols[i];
+          params(i, 0) = chains.mean(i_chains);
+          params(i, 1) = chains.mcse_mean(i_chains);
+          params(i, 2) = chains.sd(i_chains);
+          params(i, 3) = chains.med_abs_deviation(i_chains);
+          Eigen::VectorXd quantiles = chains.quantiles(i_chains, probs);
+          for (int j = 0; j < quantiles.size(); j++)
+            params(i, 4 + j) = quantiles(j);
+
+          auto [ess_bulk, ess_tail]
+              = chains.split_rank_normalized_ess(i_chains);
+
+          params(i, quantiles.size() + 4) = ess_bulk;
+          params(i, quantiles.size() + 5) = ess_tail;
+
+          auto [rhat_bulk, rhat_tail]
+              = chains.split_rank_normalized_rhat(i_chains);
+          params(i, quantiles.size() + 6)
+              = rhat_bulk > rhat_tail ? rhat_bulk : rhat_tail;
+        }
+      });
+}
+
+/**
+ * Column names and draw counts of a set of Stan CSV files, standing in
+ * for a chainset when summarizing outputs too large to hold in memory.
+ *
+ * The files are memory-mapped, so reading them doesn't count against
+ * the process's memory.  `get_stats` reads the draws of the requested
+ * columns one block of columns at a time, sized so that the draws held
+ * in memory stay under a budget.  A block always holds every draw of
+ * its columns, since ESS and R_hat need the whole series, so the
+ * statistics, quantiles included, are the same as from a chainset.
+ *
+ * The first pass over the files saves where each draw starts, and each
+ * block saves where it stopped reading each draw.  A block of later
+ * columns picks up from there, so reading the columns in order goes
+ * over each file once in all, however many blocks it takes.
+ */
+class streaming_chains {
+ public:
+  /**
+   * Read the header, metadata, timing and sampler params of the files.
+   *
+   * @param in vector of filenames of uncompressed stan csv files
+   * @param in memory budget for draws, in bytes
+   * @param in out  metadata
+   * @param in out  warmup times for each chain
+   * @param in out  sampling times for each chain
+   * @param in out  thinning for each chain
+   */
+  streaming_chains(const std::vector<std::string> &filenames,
+                   size_t max_memory, stan::io::stan_csv_metadata &metadata,
+                   Eigen::VectorXd &warmup_times,
+                   Eigen::VectorXd &sampling_times, Eigen::VectorXi &thin)
+      : filenames_(filenames), max_memory_(max_memory) {
+    for (const auto &fname : filenames) {
+      std::ifstream in(fname, std::ios::binary);
+      if (cmdstan::is_binary_output(fname)
+          || cmdstan::compression::detect(in) != "none") {
+        std::stringstream msg;
+        msg << "Streaming summary requires uncompressed Stan CSV files, "
+            << "found: " << fname << ".";
+        throw std::invalid_argument(msg.str());
+      }
+    }
+    names_ = cmdstan::read_stan_csv_header(filenames[0]);
+    // requesting only lp__ reads just the sampler params
+    auto chains
+        = parse_csv_files(filenames, metadata, warmup_times, sampling_times,
+                          thin, nullptr, {"lp__"}, &draw_starts_);
+    num_samples_ = chains.num_samples();
+    positions_ = draw_starts_;
+    next_col_.assign(filenames.size(), 0);
+  }
+
+  std::string param_name(int index) const { return names_.at(index); }
+  int num_params() const { return names_.size(); }
+  int num_chains() const { return filenames_.size(); }
+  int num_samples() const { return num_samples_; }
+  const std::vector<std::string> &filenames() const { return filenames_; }
+
+  /**
+   * Return the number of params to read per block.  The draws of a
+   * block are held twice while its chainset is built.
+   */
+  size_t block_size() const {
+    size_t param_bytes = 2 * sizeof(double) * num_chains() * num_samples_;
+    return std::max(max_memory_ / std::max(param_bytes, size_t(1)),
+                    size_t(1));
+  }
+
+  /**
+   * Read the draws of some params from all files.  Reading starts
+   * where the previous block stopped if it ended before these params,
+   * otherwise at the start of each draw.
+   *
+   * @param in param column indices, ascending
+   * @return chainset holding just these params
+   */
+  stan::mcmc::chainset read_block(const std::vector<int> &cols) const {
+    std::vector<stan::io::stan_csv> csvs(filenames_.size());
+    std::vector<std::exception_ptr> errors(filenames_.size());
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, filenames_.size(), 1),
+        [&](const tbb::blocked_range<size_t> &r) {
+          for (size_t chain = r.begin(); chain != r.end(); ++chain) {
+            try {
+              if (!cols.empty() && next_col_[chain] > cols.front()) {
+                positions_[chain] = draw_starts_[chain];
+                next_col_[chain] = 0;
+              }
+              for (int col : cols) {
+                csvs[chain].header.push_back(names_.at(col));
+              }
+              csvs[chain].samples = cmdstan::read_stan_csv_columns(
+                  filenames_[chain], positions_[chain], next_col_[chain],
+                  cols);
+            } catch (...) {
+              errors[chain] = std::current_exception();
+            }
+          }
+        });
+    for (const auto &error : errors) {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+    }
+    return stan::mcmc::chainset(csvs);
+  }
+
+ private:
+  std::vector<std::string> filenames_;
+  size_t max_memory_;
+  std::vector<std::string> names_;
+  int num_samples_ = 0;
+  // for each file, offset of each draw, and where the last block
+  // stopped reading it
+  std::vector<std::vector<size_t>> draw_starts_;
+  mutable std::vector<std::vector<size_t>> positions_;
+  mutable std::vector<int> next_col_;
+};
+
+/**
+ * Compute statistics for span of output columns, as above, reading the
+ * draws from the files one block of columns at a time.  Blocks go
+ * through the columns in file order, so that each one continues from
+ * where the previous one stopped.
+ *
+ * @param in column names and files
+ * @param in vector of sampling times (required for N_eff/S)
+ * @param in vector of probabilities
+ * @param in vector of param column indices in chains object
+ * @param in out matrix of param statistics
+ */
+void get_stats(const streaming_chains &chains,
+               const Eigen::VectorXd &sampling_times,
+               const Eigen::VectorXd &probs, std::vector<int> cols,
+               Eigen::MatrixXd &params) {
+  if (params.rows() != cols.size()) {
+    throw std::domain_error("get_stats: size mismatch");
+  }
+  std::vector<int> sorted_cols(cols);
+  std::sort(sorted_cols.begin(), sorted_cols.end());
+  sorted_cols.erase(std::unique(sorted_cols.begin(), sorted_cols.end()),
+                    sorted_cols.end());
+  const size_t block_size = chains.block_size();
+  for (size_t start = 0; start < sorted_cols.size(); start += block_size) {
+    size_t end = std::min(start + block_size, sorted_cols.size());
+    std::vector<int> block_cols(sorted_cols.begin() + start,
+                                sorted_cols.begin() + end);
+    auto block = chains.read_block(block_cols);
+    std::vector<int> block_index(end - start);
+    for (size_t i = 0; i < block_index.size(); ++i) {
+      block_index[i] = i;
+    }
+    Eigen::MatrixXd block_params(end - start, params.cols());
+    get_stats(block, sampling_times, probs, block_index, block_params);
+    for (size_t i = 0; i < cols.size(); ++i) {
+      size_t k = std::lower_bound(sorted_cols.begin(), sorted_cols.end(),
+                                  cols[i])
+                 - sorted_cols.begin();
+      if (k >= start && k < end) {
+        params.row(i) = block_params.row(k - start);
+      }
+    }
+  }
+}
+
+/**
+ * Draws of Stan CSV files which are still being written, for watching
+ * a run while it's going.  Stands in for a chainset in the report
+ * functions.
+ *
+ * `poll` reads only what was appended to each file since the last poll
+ * (see `cmdstan::stan_csv_tail`) and folds the new draws into running
+ * means and variances, so these stay current at little cost.  Statistics
+ * which need the whole series, such as ESS and R_hat, are recomputed
+ * by `get_stats` from the draws held in memory.
+ */
+class following_chains {
+ public:
+  /**
+   * @param in vector of filenames of stan csv files
+   */
+  explicit following_chains(const std::vector<std::string> &filenames) {
+    for (const auto &fname : filenames) {
+      tails_.emplace_back(std::make_unique<cmdstan::stan_csv_tail>(fname));
+    }
+    moments_.resize(filenames.size());
+  }
+
+  /**
+   * Read new draws from all files and update the running moments.
+   *
+   * @return number of new draws
+   */
+  size_t poll() {
+    size_t new_draws = 0;
+    for (size_t chain = 0; chain < tails_.size(); ++chain) {
+      auto &tail = *tails_[chain];
+      size_t added = tail.poll();
+      if (!tail.has_header()) {
+        continue;
+      }
+      // chains start independently, so compare against the first one
+      // which has written its header
+      const auto &first = *first_with_header();
+      if (tail.header() != first.header()) {
+        std::stringstream msg;
+        msg << "Column names of " << tail.filename() << " don't match "
+            << first.filename() << ".";
+        throw std::invalid_argument(msg.str());
+      }
+      auto &m = moments_[chain];
+      if (m.mean.size() == 0) {
+        m.mean = Eigen::VectorXd::Zero(tail.header().size());
+        m.m2 = Eigen::VectorXd::Zero(tail.header().size());
+      }
+      // Welford's update
+      for (size_t i = tail.num_draws() - added; i < tail.num_draws(); ++i) {
+        Eigen::Map<const Eigen::VectorXd> draw(tail.draw(i), m.mean.size());
+        ++m.count;
+        Eigen::VectorXd delta = draw - m.mean;
+        m.mean += delta / m.count;
+        m.m2 += delta.cwiseProduct(draw - m.mean);
+      }
+      new_draws += added;
+    }
+    return new_draws;
+  }
+
+  /**
+   * Return true once every file has its timing footer.
+   */
+  bool finished() const {
+    for (const auto &tail : tails_) {
+      if (!tail->finished())
+        return false;
+    }
+    return true;
+  }
+
+  std::string param_name(int index) const {
+    return first_with_header()->header().at(index);
+  }
+  int num_params() const {
+    const cmdstan::stan_csv_tail *first = first_with_header();
+    return first == nullptr ? 0 : first->header().size();
+  }
+  int num_chains() const { return tails_.size(); }
+
+  /**
+   * Return the number of draws common to all chains.
+   */
+  int num_samples() const {
+    size_t draws = tails_[0]->num_draws();
+    for (const auto &tail : tails_) {
+      draws = std::min(draws, tail->num_draws());
+    }
+    return draws;
+  }
+
+  /**
+   * Return the number of draws read from each chain.
+   */
+  Eigen::VectorXi num_draws() const {
+    Eigen::VectorXi draws(tails_.size());
+    for (size_t chain = 0; chain < tails_.size(); ++chain) {
+      draws(chain) = tails_[chain]->num_draws();
+    }
+    return draws;
+  }
+
+  /**
+   * Return the running mean of a param over all draws of all chains.
+   */
+  double mean(int index) const {
+    double count = 0;
+    double mean = 0;
+    for (const auto &m : moments_) {
+      if (m.count > 0) {
+        count += m.count;
+        mean += (m.mean(index) - mean) * m.count / count;
+      }
+    }
+    return count > 0 ? mean : std::numeric_limits<double>::quiet_NaN();
+  }
+
+  /**
+   * Return the running standard deviation of a param over all draws of
+   * all chains, pooling the per-chain moments.
+   */
+  double sd(int index) const {
+    double count = 0;
+    double mean = 0;
+    double m2 = 0;
+    for (const auto &m : moments_) {
+      if (m.count > 0) {
+        double delta = m.mean(index) - mean;
+        double total = count + m.count;
+        mean += delta * m.count / total;
+        m2 += m.m2(index) + delta * delta * count * m.count / total;
+        count = total;
+      }
+    }
+    return count > 1 ? std::sqrt(m2 / (count - 1))
+                     : std::numeric_limits<double>::quiet_NaN();
+  }
+
+  /**
+   * Assemble the draws common to all chains into a chainset.
+   *
+   * @param out metadata
+   * @param out warmup times for each chain
+   * @param out sampling times for each chain
+   * @param out thinning for each chain
+   * @return stan::mcmc::chainset object
+   */
+  stan::mcmc::chainset chainset(stan::io::stan_csv_metadata &metadata,
+                                Eigen::VectorXd &warmup_times,
+                                Eigen::VectorXd &sampling_times,
+                                Eigen::VectorXi &thin) const {
+    std::vector<stan::io::stan_csv> csvs;
+    size_t draws = num_samples();
+    for (size_t chain = 0; chain < tails_.size(); ++chain) {
+      csvs.push_back(tails_[chain]->to_stan_csv(draws));
+      warmup_times(chain) = csvs.back().timing.warmup;
+      sampling_times(chain) = csvs.back().timing.sampling;
+      thin(chain) = csvs.back().metadata.thin;
+    }
+    metadata = csvs[0].metadata;
+    return stan::mcmc::chainset(csvs);
+  }
+
+ private:
+  struct running_moments {
+    size_t count = 0;
+    Eigen::VectorXd mean;
+    Eigen::VectorXd m2;
+  };
+  std::vector<std::unique_ptr<cmdstan::stan_csv_tail>> tails_;
+  std::vector<running_moments> moments_;
+
+  /**
+   * Return the first tail which has its header, or nullptr if none
+   * has.
+   */
+  const cmdstan::stan_csv_tail *first_with_header() const {
+    for (const auto &tail : tails_) {
+      if (tail->has_header())
+        return tail.get();
+    }
+    return nullptr;
+  }
+};
+
+/**
+ * Compute statistics for span of output columns of chains which are
+ * still being written.  Mean and StdDev are always current.  The other
+ * statistics are recomputed from the draws common to all chains when
+ * `recompute` is set, and otherwise left as they are in `params`.
+ *
+ * @param in chains being followed
+ * @param in vector of probabilities
+ * @param in vector of param column indices in chains object
+ * @param in recompute the statistics which need the whole series
+ * @param in out matrix of param statistics
+ */
+void get_stats(const following_chains &chains, const Eigen::VectorXd &probs,
+               std::vector<int> cols, bool recompute,
+               Eigen::MatrixXd &params) {
+  if (params.rows() != cols.size()) {
+    throw std::domain_error("get_stats: size mismatch");
+  }
+  // ESS and R_hat need a few draws from every chain
+  if (recompute && chains.num_samples() >= 4) {
+    stan::io::stan_csv_metadata metadata;
+    Eigen::VectorXd warmup_times(chains.num_chains());
+    Eigen::VectorXd sampling_times(chains.num_chains());
+    Eigen::VectorXi thin(chains.num_chains());
+    get_stats(chains.chainset(metadata, warmup_times, sampling_times, thin),
+              sampling_times, probs, cols, params);
+  }
+  for (size_t i = 0; i < cols.size(); ++i) {
+    params(i, 0) = chains.mean(cols[i]);
+    params(i, 2) = chains.sd(cols[i]);
   }
 }
 
@@ -458,6 +893,7 @@ void write_header(const std::vector<std::string> &header,
  * Output statistics for a set of parameters
  * either as fixed-width text columns or in csv format.
  *
+ * @tparam Tchains - either a mcmc::chainset or streaming_chains object
  * @param in set of samples from one or more chains
  * @param in matrix of statistics
  * @param in vector of output column widths
@@ -468,8 +904,8 @@ void write_header(const std::vector<std::string> &header,
  * @param in output format flag:  true for csv; false for plain text
  * @param in output stream
  */
-void write_params(const stan::mcmc::chainset &chains,
-                  const Eigen::MatrixXd &params,
+template <typename Tchains>
+void write_params(const Tchains &chains, const Eigen::MatrixXd &params,
                   const Eigen::VectorXi &col_widths,
                   const Eigen::Matrix<std::ios_base::fmtflags, Eigen::Dynamic,
                                       1> &col_formats,
@@ -504,6 +940,7 @@ void write_params(const stan::mcmc::chainset &chains,
  * either as fixed-width text columns or in csv format.
  * Containers are re-ordered as first-index-major order
  *
+ * @tparam Tchains - either a mcmc::chainset or streaming_chains object
  * @param in set of samples from one or more chains
  * @param in matrix of statistics
  * @param in vector of output column widths
@@ -514,7 +951,8 @@ void write_params(const stan::mcmc::chainset &chains,
  * @param in output format flag:  true for csv; false for plain text
  * @param in output stream
  */
-void write_all_model_params(const stan::mcmc::chainset &chains,
+template <typename Tchains>
+void write_all_model_params(const Tchains &chains,
                             const Eigen::MatrixXd &params,
                             const Eigen::VectorXi &col_widths,
                             const Eigen::Matrix<std::ios_base::fmtflags,
@@ -581,9 +1019,77 @@ void write_all_model_params(const stan::mcmc::chainset &chains,
   }
 }
 
+/**
+ * Check that the requested params are model params of the chains, and
+ * output the names which aren't.
+ *
+ * @tparam Tchains - either a mcmc::chainset or following_chains object
+ * @param in chains whose column names are known
+ * @param in names of the requested params
+ * @param in output stream
+ * @return true if every name was found
+ */
+template <typename Tchains>
+bool check_requested_params(const Tchains &chains,
+                            const std::vector<std::string> &requested_params,
+                            std::ostream *out) {
+  std::set<std::string> unknown(requested_params.begin(),
+                                requested_params.end());
+  for (int i = 0; i < chains.num_params(); ++i) {
+    if (!stan::io::ends_with("__", chains.param_name(i)))
+      unknown.erase(chains.param_name(i));
+  }
+  if (unknown.empty())
+    return true;
+  *out << "--include_param: Unrecognized parameter(s): ";
+  for (const auto &param : unknown) {
+    *out << "'" << param << "' ";
+  }
+  *out << std::endl;
+  return false;
+}
+
+/**
+ * Output the statistics of chains which are still being written, as
+ * fixed-width text columns, preceded by the number of draws so far.
+ *
+ * @param in chains being followed
+ * @param in vector of output column labels
+ * @param in matrix of statistics
+ * @param in vector of column indexes to output from chains
+ * @param in significant digits required
+ * @param in output stream
+ */
+void write_follow_status(const following_chains &chains,
+                         const std::vector<std::string> &header,
+                         const Eigen::MatrixXd &params,
+                         const std::vector<int> &cols, int sig_figs,
+                         std::ostream *out) {
+  Eigen::VectorXi draws = chains.num_draws();
+  *out << "Draws so far:";
+  for (int chain = 0; chain < draws.size(); ++chain) {
+    *out << " " << draws(chain);
+  }
+  *out << std::endl << std::endl;
+
+  size_t max_name_length = 0;
+  for (int i : cols) {
+    max_name_length = std::max(max_name_length, chains.param_name(i).size());
+  }
+  Eigen::Matrix<std::ios_base::fmtflags, Eigen::Dynamic, 1> formats(
+      header.size());
+  Eigen::VectorXi widths
+      = calculate_column_widths(params, header, sig_figs, formats);
+  write_header(header, widths, max_name_length, false, out);
+  write_params(chains, params, widths, formats, max_name_length, sig_figs,
+               cols, false, out);
+  *out << std::endl;
+}
+
 /**
  * Output timing statistics for all chains
  *
+ * @tparam Tchains - either a mcmc::chainset or streaming_chains object
  * @param in set of samples from one or more chains
  * @param in metadata
  * @param in warmup times for each chain
@@ -592,7 +1098,8 @@ void write_all_model_params(const stan::mcmc::chainset &chains,
  * @param in prefix string - used to output as comments in csv file
  * @param out output stream
  */
-void write_timing(const stan::mcmc::chainset &chains,
+template <typename Tchains>
+void write_timing(const Tchains &chains,
                   const stan::io::stan_csv_metadata &metadata,
                   const Eigen::VectorXd &warmup_times,
                   const Eigen::VectorXd &sampling_times,
@@ -746,4 +1253,187 @@ void autocorrelation(const stan::mcmc::chainset &chains,
   }
 }
 
+/**
+ * Autocorrelations need every draw in memory, so they aren't available
+ * when streaming.
+ */
+void autocorrelation(const streaming_chains &chains,
+                     const stan::io::stan_csv_metadata &metadata,
+                     int autocorr_idx, int max_name_length) {
+  throw std::invalid_argument(
+      "Autocorrelations are not available with streaming.");
+}
+
+/**
+ * Write the summary of a set of chains to the console, and optionally
+ * to a csv file.
+ *
+ * @tparam Tchains - either a mcmc::chainset or streaming_chains object
+ * @param in set of samples from one or more chains
+ * @param in metadata
+ * @param in warmup times for each chain
+ * @param in sampling times for each chain
+ * @param in thinning for each chain
+ * @param in vector of percentile values as strings
+ * @param in vector of probabilities
+ * @param in names of the model params to report, or empty for all
+ * @param in significant digits reported
+ * @param in chain whose autocorrelations are reported, or 0 for none
+ * @param in name of csv file to append to, or empty for none
+ * @param in precision of values written to the csv file
+ * @return OK for success, NOT_OK if a requested param isn't found
+ */
+template <typename Tchains>
+int summarize(const Tchains &chains,
+              const stan::io::stan_csv_metadata &metadata,
+              const Eigen::VectorXd &warmup_times,
+              const Eigen::VectorXd &sampling_times,
+              const Eigen::VectorXi &thin,
+              const std::vector<std::string> &percentiles,
+              const Eigen::VectorXd &probs,
+              const std::vector<std::string> &requested_params_vec,
+              int sig_figs, int autocorr_idx, const std::string &csv_filename,
+              int csv_sig_figs) {
+  // Get column headers for sampler, model params
+  size_t max_name_length = 0;
+  size_t num_sampler_params = 0;
+  for (int i = 0; i < chains.num_params(); ++i) {
+    if (chains.param_name(i).length() > max_name_length)
+      max_name_length = chains.param_name(i).length();
+    if (stan::io::ends_with("__", chains.param_name(i)))
+      num_sampler_params++;
+  }
+  // don't count name 'lp__'
+  if (num_sampler_params > 0) {
+    num_sampler_params--;
+  }
+
+  // Get column indices for the sampler params
+  std::vector<int> sampler_params_idxes(num_sampler_params);
+  std::iota(sampler_params_idxes.begin(), sampler_params_idxes.end(), 1);
+
+  size_t model_params_offset = num_sampler_params + 1;
+
+  size_t num_model_params = 0;
+  std::vector<int> model_param_idxes(0);
+
+  bool model_params_subset = requested_params_vec.size() > 0;
+  if (model_params_subset) {
+    std::set<std::string> requested_params(requested_params_vec.begin(),
+                                           requested_params_vec.end());
+
+    for (int i = model_params_offset; i < chains.num_params(); ++i) {
+      if (requested_params.erase(chains.param_name(i)) > 0) {
+        model_param_idxes.emplace_back(i);
+        num_model_params++;
+      }
+    }
+    // some params were requested but not found by above loop
+    if (requested_params.size() > 0) {
+      std::cout << "--include_param: Unrecognized parameter(s): ";
+      for (auto param : requested_params) {
+        std::cout << "'" << param << "' ";
+      }
+      std::cout << std::endl;
+      return cmdstan::return_codes::NOT_OK;
+    }
+
+  } else {
+    // if none were requested, get all of the model parameters
+    num_model_params = chains.num_params() - num_sampler_params - 1;
+    model_param_idxes.resize(num_model_params);
+    std::iota(model_param_idxes.begin(), model_param_idxes.end(),
+              model_params_offset);
+  }
+
+  std::vector<std::string> header = get_header(percentiles);
+
+  // Compute statistics for sampler and model params
+  Eigen::MatrixXd lp_param(1, header.size());
+  Eigen::MatrixXd sampler_params(num_sampler_params, header.size());
+  Eigen::MatrixXd model_params(num_model_params, header.size());
+
+  get_stats(chains, sampling_times, probs, {0}, lp_param);
+  get_stats(chains, sampling_times, probs, sampler_params_idxes,
+            sampler_params);
+  get_stats(chains, sampling_times, probs, model_param_idxes, model_params);
+
+  // Console output formatting
+  Eigen::VectorXi column_sig_figs(header.size());
+  Eigen::Matrix<std::ios_base::fmtflags, Eigen::Dynamic, 1> sampler_formats(
+      header.size());
+  Eigen::VectorXi sampler_widths(header.size());
+  sampler_widths = calculate_column_widths(sampler_params, header, sig_figs,
+                                           sampler_formats);
+
+  Eigen::Matrix<std::ios_base::fmtflags, Eigen::Dynamic, 1> model_formats(
+      header.size());
+  Eigen::VectorXi model_widths(header.size());
+  model_widths = calculate_column_widths(model_params, header, sig_figs,
+                                         model_formats);
+
+  Eigen::VectorXi column_widths(header.size());
+  for (size_t i = 0; i < header.size(); ++i)
+    column_widths[i] = sampler_widths[i] > model_widths[i] ? sampler_widths[i]
+                                                           : model_widths[i];
+
+  // Print to console
+  write_timing(chains, metadata, warmup_times, sampling_times, thin, "",
+               &std::cout);
+  std::cout << std::endl;
+
+  write_header(header, column_widths, max_name_length, false, &std::cout);
+  std::cout << std::endl;
+  write_params(chains, lp_param, column_widths, model_formats,
+               max_name_length, sig_figs, {0}, false, &std::cout);
+  write_params(chains, sampler_params, column_widths, sampler_formats,
+               max_name_length, sig_figs, sampler_params_idxes, false,
+               &std::cout);
+  std::cout << std::endl;
+  if (model_params_subset)
+    write_params(chains, model_params, column_widths, model_formats,
+                 max_name_length, sig_figs, model_param_idxes, false,
+                 &std::cout);
+  else
+    write_all_model_params(chains, model_params, column_widths,
+                           model_formats, max_name_length, sig_figs,
+                           model_params_offset, false, &std::cout);
+  std::cout << std::endl;
+  write_sampler_info(metadata, "", &std::cout);
+
+  if (autocorr_idx > 0) {
+    autocorrelation(chains, metadata, autocorr_idx, max_name_length);
+    std::cout << std::endl;
+  }
+
+  // Write to csv file (optional)
+  if (!csv_filename.empty()) {
+    std::ofstream csv_file(csv_filename.c_str(), std::ios_base::app);
+    csv_file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+    csv_file << std::setprecision(csv_sig_figs);
+
+    write_header(header, column_widths, max_name_length, true, &csv_file);
+    write_params(chains, lp_param, column_widths, model_formats,
+                 max_name_length, sig_figs, {0}, true, &csv_file);
+    write_params(chains, sampler_params, column_widths, sampler_formats,
+                 max_name_length, sig_figs, sampler_params_idxes, true,
+                 &csv_file);
+
+    if (model_params_subset)
+      write_params(chains, model_params, column_widths, model_formats,
+                   max_name_length, sig_figs, model_param_idxes, true,
+                   &csv_file);
+    else
+      write_all_model_params(chains, model_params, column_widths,
+                             model_formats, max_name_length, sig_figs,
+                             model_params_offset, true, &csv_file);
+
+    write_timing(chains, metadata, warmup_times, sampling_times, thin, "# ",
+                 &csv_file);
+    write_sampler_info(metadata, "# ", &csv_file);
+    csv_file.close();
+  }
+  return cmdstan::return_codes::OK;
+}
+
 #endif
@@ -0,0 +1,104 @@
+#include <cmdstan/async_writer.hpp>
+#include <cmdstan/stansummary_helper.hpp>
+#include <stan/callbacks/unique_stream_writer.hpp>
+#include <test/utility.hpp>
+#include <gtest/gtest.h>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using cmdstan::test::convert_model_path;
+using cmdstan::test::run_command;
+using cmdstan::test::run_command_output;
+
+namespace {
+using stream_writer = stan::callbacks::unique_stream_writer<std::stringstream>;
+
+// write the same callbacks a chain would to a writer
+void write_chain(stan::callbacks::writer &writer, int chain, int num_draws) {
+  writer("chain = " + std::to_string(chain));
+  writer(std::vector<std::string>{"lp__", "x", "y"});
+  for (int i = 0; i < num_draws; ++i) {
+    writer(std::vector<double>{-1.0 * i, 0.5 * chain, 0.25 * i});
+  }
+  Eigen::MatrixXd m(2, 3);
+  m << 1, 2, 3, 4, 5, 6;
+  writer(Eigen::Ref<Eigen::MatrixXd>(m));
+  writer();
+  writer("done");
+}
+}  // namespace
+
+TEST(async_writer, same_output_as_sync) {
+  const int num_chains = 4;
+  const int num_draws = 2000;
+  std::vector<std::stringstream *> expected;
+  std::vector<std::stringstream *> actual;
+  std::vector<stream_writer> sync_writers;
+  std::vector<cmdstan::output_writer> async_writers;
+  // tiny queues so that the chains regularly hit back-pressure
+  auto io = std::make_shared<cmdstan::async_writer_thread>(4, 2);
+  for (int i = 0; i < num_chains; ++i) {
+    sync_writers.emplace_back(std::make_unique<std::stringstream>(), "# ");
+    expected.push_back(&sync_writers.back().get_stream());
+    auto target = std::make_unique<stream_writer>(
+        std::make_unique<std::stringstream>(), "# ");
+    actual.push_back(&target->get_stream());
+    async_writers.emplace_back(std::move(target));
+  }
+  cmdstan::init_async_writers(async_writers, io);
+  std::vector<std::thread> chains;
+  for (int i = 0; i < num_chains; ++i) {
+    write_chain(sync_writers[i], i, num_draws);
+    chains.emplace_back(
+        [&async_writers, i] { write_chain(async_writers[i], i, num_draws); });
+  }
+  for (auto &chain : chains) {
+    chain.join();
+  }
+  io->close();
+  for (int i = 0; i < num_chains; ++i) {
+    EXPECT_EQ(expected[i]->str(), actual[i]->str());
+  }
+}
+
+TEST(async_writer, rethrows_write_error) {
+  struct failing_writer : public stan::callbacks::writer {
+    void operator()(const std::string &message) {
+      throw std::runtime_error("disk full");
+    }
+  };
+  auto io = std::make_shared<cmdstan::async_writer_thread>();
+  cmdstan::async_writer writer(
+      io, cmdstan::output_writer(std::make_unique<failing_writer>()));
+  for (int i = 0; i < 100; ++i) {
+    writer("message");
+  }
+  EXPECT_THROW(io->close(), std::runtime_error);
+}
+
+TEST(async_writer, sample_multi_chain) {
+  std::vector<std::string> model_path
+      = {"src", "test", "test-models", "test_model"};
+  std::vector<std::string> output_path = {"test", "async_output"};
+  std::string command
+      = convert_model_path(model_path)
+        + " sample num_samples=100 num_chains=2 random seed=1234"
+        + " output async=1 file=" + convert_model_path(output_path) + ".csv"
+        + " diagnostic_file=" + convert_model_path(output_path) + "_diag.csv";
+  run_command_output out = run_command(command);
+  ASSERT_FALSE(out.hasError) << out.output;
+  for (int i = 1; i <= 2; ++i) {
+    std::vector<std::string> filenames{convert_model_path(output_path) + "_"
+                                       + std::to_string(i) + ".csv"};
+    stan::io::stan_csv_metadata metadata;
+    Eigen::VectorXd warmup_times(1);
+    Eigen::VectorXd sampling_times(1);
+    Eigen::VectorXi thin(1);
+    auto chains = parse_csv_files(filenames, metadata, warmup_times,
+                                  sampling_times, thin, &std::cout);
+    EXPECT_EQ(100, chains.num_samples(0));
+  }
+}
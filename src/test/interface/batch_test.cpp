@@ -0,0 +1,71 @@
+#include <cmdstan/csv_reader.hpp>
+#include <test/utility.hpp>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using cmdstan::test::convert_model_path;
+using cmdstan::test::run_command;
+using cmdstan::test::run_command_output;
+
+class CmdStan : public testing::Test {
+ public:
+  void SetUp() {
+    bern_model = convert_model_path(
+        {"src", "test", "test-models", "bern_gq_model"});
+    bern_data = convert_model_path(
+        {"src", "test", "test-models", "bern.data.json"});
+    output = convert_model_path({"test", "batch_output.csv"});
+  }
+  std::string bern_model;
+  std::string bern_data;
+  std::string output;
+
+  std::string write_batch_file(const std::string &text) {
+    std::string fname = convert_model_path({"test", "batch_data.txt"});
+    std::ofstream out(fname);
+    out << text;
+    return fname;
+  }
+
+  run_command_output run_batch(const std::string &batch_file) {
+    std::stringstream ss;
+    ss << bern_model << " sample num_samples=20 num_warmup=20"
+       << " data batch_file=" << batch_file << " output file=" << output;
+    return run_command(ss.str());
+  }
+};
+
+TEST_F(CmdStan, batch_file) {
+  std::string batch_file = write_batch_file("# two runs\n" + bern_data
+                                            + "\n\n" + bern_data + "\n");
+  run_command_output out = run_batch(batch_file);
+  ASSERT_FALSE(out.hasError) << out.output;
+  EXPECT_NE(std::string::npos, out.output.find("Completed 2 of 2 runs."));
+  for (std::string run : {"_1", "_2"}) {
+    std::string csv_file = convert_model_path({"test", "batch_output" + run});
+    stan::io::stan_csv csv = cmdstan::read_stan_csv(csv_file + ".csv");
+    EXPECT_EQ(20, csv.samples.rows());
+    std::ifstream log(csv_file + ".log");
+    std::stringstream log_text;
+    log_text << log.rdbuf();
+    EXPECT_NE(std::string::npos, log_text.str().find("Elapsed Time"));
+  }
+}
+
+TEST_F(CmdStan, batch_file_failed_run) {
+  std::string batch_file
+      = write_batch_file(bern_data + "\ntest/no_such_data.json\n");
+  run_command_output out = run_batch(batch_file);
+  EXPECT_TRUE(out.hasError);
+  EXPECT_NE(std::string::npos, out.output.find("Completed 1 of 2 runs."));
+  EXPECT_NE(std::string::npos,
+            out.output.find("Run for data file test/no_such_data.json failed"));
+}
+
+TEST_F(CmdStan, batch_file_empty) {
+  run_command_output out = run_batch(write_batch_file("# nothing\n"));
+  EXPECT_TRUE(out.hasError);
+  EXPECT_NE(std::string::npos, out.output.find("lists no data files"));
+}
@@ -0,0 +1,140 @@
+#include <cmdstan/binary_reader.hpp>
+#include <cmdstan/binary_writer.hpp>
+#include <cmdstan/stansummary_helper.hpp>
+#include <stan/services/error_codes.hpp>
+#include <test/utility.hpp>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using cmdstan::test::convert_model_path;
+using cmdstan::test::run_command;
+using cmdstan::test::run_command_output;
+
+class CmdStan : public testing::Test {
+ public:
+  void SetUp() {
+    proper_model = {"src", "test", "test-models", "proper"};
+    output_path = {"test", "binary_output.csv"};
+    binary_path = {"test", "binary_output.bin"};
+    roundtrip_path = {"test", "binary_roundtrip.bin"};
+  }
+  std::vector<std::string> proper_model;
+  std::vector<std::string> output_path;
+  std::vector<std::string> binary_path;
+  std::vector<std::string> roundtrip_path;
+};
+
+TEST_F(CmdStan, binary_writer_roundtrip) {
+  std::string fname = convert_model_path(roundtrip_path);
+  {
+    auto ofs = std::make_unique<std::ofstream>(
+        fname, std::ios::binary | std::ios::trunc);
+    // small chunks so the draws span several records
+    cmdstan::binary_writer writer(std::move(ofs), 4 * 3 * sizeof(double));
+    writer("method = sample (Default)");
+    writer("  num_samples = 10");
+    writer("  num_warmup = 5");
+    writer("  save_warmup = false");
+    writer("  thin = 1 (Default)");
+    writer(std::vector<std::string>{"lp__", "theta.1", "theta.2"});
+    writer("Adaptation terminated");
+    writer("Step size = 0.5");
+    for (int i = 0; i < 10; ++i) {
+      writer(std::vector<double>{-1.0 * i, 0.1 * i, 1e300 * i});
+    }
+    writer();
+    writer(" Elapsed Time: 0.25 seconds (Warm-up)");
+    writer("               0.75 seconds (Sampling)");
+  }
+  ASSERT_TRUE(cmdstan::is_binary_output(fname));
+
+  stan::io::stan_csv parsed = cmdstan::read_binary_output(fname);
+  ASSERT_EQ(3, parsed.header.size());
+  EXPECT_EQ("lp__", parsed.header[0]);
+  EXPECT_EQ("theta[1]", parsed.header[1]);
+  EXPECT_EQ("theta[2]", parsed.header[2]);
+  EXPECT_EQ(10, parsed.metadata.num_samples);
+  EXPECT_EQ(5, parsed.metadata.num_warmup);
+  EXPECT_FLOAT_EQ(0.5, parsed.adaptation.step_size);
+  EXPECT_FLOAT_EQ(0.25, parsed.timing.warmup);
+  EXPECT_FLOAT_EQ(0.75, parsed.timing.sampling);
+  ASSERT_EQ(10, parsed.samples.rows());
+  ASSERT_EQ(3, parsed.samples.cols());
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(-1.0 * i, parsed.samples(i, 0));
+    EXPECT_EQ(0.1 * i, parsed.samples(i, 1));
+    EXPECT_EQ(1e300 * i, parsed.samples(i, 2));
+  }
+
+  stan::io::stan_csv raw = cmdstan::read_binary_output(fname, false);
+  EXPECT_EQ("theta.1", raw.header[1]);
+}
+
+TEST_F(CmdStan, binary_reader_truncated) {
+  std::string fname = convert_model_path(roundtrip_path);
+  {
+    auto ofs = std::make_unique<std::ofstream>(
+        fname, std::ios::binary | std::ios::trunc);
+    cmdstan::binary_writer writer(std::move(ofs), 2 * 2 * sizeof(double));
+    writer(std::vector<std::string>{"lp__", "mu"});
+    for (int i = 0; i < 4; ++i) {
+      writer(std::vector<double>{1.0 * i, 2.0 * i});
+    }
+  }
+  // cut off the middle of the second draws record
+  std::string bytes;
+  {
+    std::ifstream in(fname, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in),
+                 std::istreambuf_iterator<char>());
+  }
+  {
+    std::ofstream out(fname, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size() - 5);
+  }
+  stan::io::stan_csv parsed = cmdstan::read_binary_output(fname);
+  ASSERT_EQ(2, parsed.samples.rows());
+  EXPECT_EQ(1.0, parsed.samples(1, 0));
+  EXPECT_EQ(2.0, parsed.samples(1, 1));
+
+  std::string csv_name = convert_model_path(proper_model) + ".stan";
+  EXPECT_FALSE(cmdstan::is_binary_output(csv_name));
+  EXPECT_THROW(cmdstan::read_binary_output(csv_name), std::invalid_argument);
+}
+
+TEST_F(CmdStan, binary_output_sample) {
+  std::stringstream ss;
+  ss << convert_model_path(proper_model)
+     << " sample num_samples=100 random seed=1234"
+     << " output file=" << convert_model_path(output_path) << " format=binary";
+  run_command_output out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError) << out.output;
+
+  std::string fname = convert_model_path(binary_path);
+  ASSERT_TRUE(cmdstan::is_binary_output(fname));
+  stan::io::stan_csv parsed = cmdstan::read_binary_output(fname);
+  EXPECT_EQ(100, parsed.samples.rows());
+  EXPECT_EQ("lp__", parsed.header.front());
+  EXPECT_EQ("mu", parsed.header.back());
+  EXPECT_EQ(1234, parsed.metadata.seed);
+  EXPECT_GT(parsed.adaptation.step_size, 0);
+
+  std::vector<std::string> stansummary_path = {"bin", "stansummary"};
+  run_command_output summary
+      = run_command(convert_model_path(stansummary_path) + " " + fname);
+  ASSERT_FALSE(summary.hasError) << summary.output;
+  EXPECT_NE(summary.output.find("mu "), std::string::npos);
+}
+
+TEST_F(CmdStan, binary_output_unavailable) {
+  std::stringstream ss;
+  ss << convert_model_path(proper_model) << " pathfinder"
+     << " output file=" << convert_model_path(output_path) << " format=binary";
+  run_command_output out = run_command(ss.str());
+  ASSERT_TRUE(out.hasError);
+  EXPECT_NE(out.output.find("Output format 'binary' is not available"),
+            std::string::npos);
+}
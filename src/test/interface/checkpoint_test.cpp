@@ -0,0 +1,211 @@
+#include <cmdstan/checkpoint.hpp>
+#include <cmdstan/csv_reader.hpp>
+#include <cmdstan/output_writer.hpp>
+#include <stan/services/error_codes.hpp>
+#include <test/utility.hpp>
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using cmdstan::test::convert_model_path;
+
+namespace {
+const std::vector<std::string> header{"lp__", "accept_stat__", "stepsize__",
+                                      "mu", "sigma", "z"};
+
+/**
+ * Write what a chain with two warmup draws and `num_samples` sampling
+ * draws writes to its sample writer, or without warmup what a resumed
+ * chain writes, which doesn't adapt.
+ */
+void write_chain(cmdstan::checkpoint_writer &writer, int num_samples,
+                 bool with_warmup = true) {
+  writer("model = m");
+  writer(header);
+  if (with_warmup) {
+    writer(std::vector<double>{-1, 0.9, 1, 0.1, 1.1, 5});
+    writer(std::vector<double>{-2, 0.8, 2, 0.2, 1.2, 5});
+    writer("Adaptation terminated");
+    writer("Step size = 0.523457");
+    writer("Diagonal elements of inverse mass matrix:");
+    writer("0.25, 4");
+  }
+  for (int i = 1; i <= num_samples; ++i) {
+    writer(std::vector<double>{-3.0 - i, 0.7, 0.523456789, 1.0 * i,
+                               1.0 + i, 5});
+  }
+  writer();
+  writer("Elapsed Time: 1 seconds (Total)");
+}
+}  // namespace
+
+TEST(checkpoint, format_round_trip) {
+  cmdstan::chain_checkpoint state;
+  state.num_rows = 12;
+  state.num_warmup_rows = 2;
+  state.stepsize = 0.125;
+  state.metric = cmdstan::chain_checkpoint::DENSE_E;
+  state.inv_metric = {1, 0.5, 0.5, 2};
+  state.params = {-1.5, 1e-300};
+  std::string fname = convert_model_path({"test", "checkpoint_format.ckpt"});
+  {
+    std::ofstream out(fname, std::ios::binary);
+    cmdstan::write_checkpoint(out, state);
+  }
+  cmdstan::chain_checkpoint read = cmdstan::read_checkpoint(fname);
+  EXPECT_EQ(12U, read.num_rows);
+  EXPECT_EQ(10U, read.num_sampling_rows());
+  EXPECT_EQ(0.125, read.stepsize);
+  EXPECT_EQ(cmdstan::chain_checkpoint::DENSE_E, read.metric);
+  EXPECT_EQ(state.inv_metric, read.inv_metric);
+  EXPECT_EQ(state.params, read.params);
+
+  {
+    std::ofstream out(fname, std::ios::binary);
+    out << "STANCKPT\x01";
+  }
+  EXPECT_THROW(cmdstan::read_checkpoint(fname), std::invalid_argument);
+  EXPECT_THROW(cmdstan::read_checkpoint("test/no_such_file.ckpt"),
+               std::invalid_argument);
+  std::remove(fname.c_str());
+}
+
+TEST(checkpoint, writer_saves_adapted_state) {
+  std::string fname = convert_model_path({"test", "checkpoint_writer.ckpt"});
+  auto io = std::make_shared<cmdstan::checkpoint_thread>();
+  auto out = std::make_unique<std::stringstream>();
+  std::stringstream *csv = out.get();
+  {
+    cmdstan::checkpoint_writer writer(io, fname, 2, 2, true,
+                                      cmdstan::output_writer(std::move(out),
+                                                             "# "));
+    write_chain(writer, 5);
+    writer.finish();
+  }
+  io->close();
+  cmdstan::chain_checkpoint state = cmdstan::read_checkpoint(fname);
+  EXPECT_EQ(7U, state.num_rows);
+  EXPECT_EQ(2U, state.num_warmup_rows);
+  // without jitter the step size of the draws is exact
+  EXPECT_EQ(0.523456789, state.stepsize);
+  EXPECT_EQ(cmdstan::chain_checkpoint::DIAG_E, state.metric);
+  std::vector<double> inv_metric{0.25, 4};
+  EXPECT_EQ(inv_metric, state.inv_metric);
+  std::vector<double> params{5, 6};
+  EXPECT_EQ(params, state.params);
+  EXPECT_NE(std::string::npos, csv->str().find("# Step size = 0.523457"));
+  std::remove(fname.c_str());
+}
+
+TEST(checkpoint, writer_resumes_interrupted_output) {
+  std::string fname = convert_model_path({"test", "checkpoint_resume.ckpt"});
+  std::string interrupted
+      = convert_model_path({"test", "checkpoint_resume.csv.interrupted"});
+  auto io = std::make_shared<cmdstan::checkpoint_thread>();
+  {
+    // interrupted after the checkpoint at 4 sampling draws
+    cmdstan::checkpoint_writer writer(
+        io, fname, 4, 2, false,
+        cmdstan::output_writer(std::make_unique<std::ofstream>(interrupted),
+                               "# "));
+    write_chain(writer, 5);
+  }
+  io->close();
+  cmdstan::chain_checkpoint state = cmdstan::read_checkpoint(fname);
+  ASSERT_EQ(6U, state.num_rows);
+  EXPECT_EQ(0.523457, state.stepsize);
+
+  io = std::make_shared<cmdstan::checkpoint_thread>();
+  std::string resumed = convert_model_path({"test", "checkpoint_resume.csv"});
+  {
+    cmdstan::checkpoint_writer writer(
+        io, fname, 4, 2, false,
+        cmdstan::output_writer(std::make_unique<std::ofstream>(resumed),
+                               "# "));
+    writer.resume(state, interrupted);
+    write_chain(writer, 4, false);
+    writer.finish();
+  }
+  io->close();
+  stan::io::stan_csv csv = cmdstan::read_stan_csv(resumed);
+  EXPECT_EQ(header, csv.header);
+  // 2 warmup draws, 4 copied draws and 4 new draws
+  ASSERT_EQ(10, csv.samples.rows());
+  EXPECT_EQ(0.2, csv.samples(1, 3));
+  EXPECT_EQ(4, csv.samples(5, 3));
+  EXPECT_EQ(1, csv.samples(6, 3));
+  // the adaptation of the checkpoint follows the warmup draws
+  EXPECT_EQ(0.523457, csv.adaptation.step_size);
+  ASSERT_EQ(2, csv.adaptation.metric.size());
+  EXPECT_EQ(0.25, csv.adaptation.metric(0));
+  EXPECT_EQ(4, csv.adaptation.metric(1));
+  state = cmdstan::read_checkpoint(fname);
+  EXPECT_EQ(10U, state.num_rows);
+  EXPECT_EQ(2U, state.num_warmup_rows);
+
+  // the interrupted output must hold the draws of its checkpoint
+  state.num_rows = 100;
+  io = std::make_shared<cmdstan::checkpoint_thread>();
+  cmdstan::checkpoint_writer writer(io, fname, 4, 2, false,
+                                    cmdstan::output_writer(nullptr));
+  writer.resume(state, interrupted);
+  writer(header);
+  writer("Adaptation terminated");
+  EXPECT_THROW(writer.finish(), std::invalid_argument);
+  for (const auto &name : {fname, interrupted, resumed}) {
+    std::remove(name.c_str());
+  }
+}
+
+TEST(checkpoint, sample_resume) {
+  std::string model = convert_model_path(
+      {"src", "test", "test-models", "test_model"});
+  std::string output = model + "_checkpoint.csv";
+  std::string checkpoint = model + "_checkpoint.ckpt";
+  std::string command
+      = model
+        + " sample num_warmup=200 num_samples=100 num_chains=2"
+          " checkpoint_every=50 checkpoint_file="
+        + checkpoint + " random seed=1234 output file=" + output;
+  cmdstan::test::run_command_output out = cmdstan::test::run_command(command);
+  ASSERT_EQ(int(stan::services::error_codes::OK), out.err_code);
+  for (int i = 1; i <= 2; ++i) {
+    std::string suffix = "_" + std::to_string(i);
+    cmdstan::chain_checkpoint state
+        = cmdstan::read_checkpoint(model + "_checkpoint" + suffix + ".ckpt");
+    EXPECT_EQ(100U, state.num_sampling_rows());
+    EXPECT_EQ(cmdstan::chain_checkpoint::DIAG_E, state.metric);
+    EXPECT_EQ(2U, state.params.size());
+  }
+  stan::io::stan_csv interrupted
+      = cmdstan::read_stan_csv(model + "_checkpoint_1.csv");
+
+  // as if the run had been stopped after 100 of 300 draws
+  command = model
+            + " sample num_warmup=200 num_samples=300 num_chains=2"
+              " checkpoint_every=50 resume=1 checkpoint_file="
+            + checkpoint + " random seed=1234 output file=" + output;
+  out = cmdstan::test::run_command(command);
+  ASSERT_EQ(int(stan::services::error_codes::OK), out.err_code);
+  stan::io::stan_csv resumed
+      = cmdstan::read_stan_csv(model + "_checkpoint_1.csv");
+  ASSERT_EQ(300, resumed.samples.rows());
+  EXPECT_EQ(interrupted.header, resumed.header);
+  EXPECT_TRUE(interrupted.samples == resumed.samples.topRows(100));
+  EXPECT_EQ(interrupted.adaptation.step_size, resumed.adaptation.step_size);
+  EXPECT_TRUE(interrupted.adaptation.metric == resumed.adaptation.metric);
+  std::ifstream moved(model + "_checkpoint_1.csv.interrupted");
+  EXPECT_FALSE(moved.good());
+  cmdstan::chain_checkpoint state
+      = cmdstan::read_checkpoint(model + "_checkpoint_1.ckpt");
+  EXPECT_EQ(300U, state.num_sampling_rows());
+
+  command = model + " sample resume=1 output file=" + output;
+  out = cmdstan::test::run_command(command);
+  EXPECT_TRUE(out.hasError);
+}
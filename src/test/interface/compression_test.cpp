@@ -0,0 +1,154 @@
+#include <cmdstan/compression.hpp>
+#include <test/utility.hpp>
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using cmdstan::test::convert_model_path;
+using cmdstan::test::run_command;
+using cmdstan::test::run_command_output;
+
+namespace {
+std::string read_all(std::istream &in) {
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+// write lines through a compressing stream, return what was written
+std::string write_compressed(const std::string &fname,
+                             const cmdstan::compression::options &opts) {
+  std::string expected;
+  auto out = cmdstan::compression::compress(
+      std::make_unique<std::ofstream>(fname, std::ios::binary), opts);
+  for (int i = 0; i < 5000; ++i) {
+    std::string line = "0.123456789," + std::to_string(i * 7919) + "\n";
+    expected += line;
+    *out << line;
+    if (i % 10 == 0) {
+      *out << std::flush;
+    }
+  }
+  return expected;
+}
+
+void check_round_trip(const std::string &codec) {
+  cmdstan::compression::options opts;
+  opts.codec = codec;
+  opts.level = 3;
+  opts.frame_size = 4096;
+  std::string fname
+      = "test/compression_test.csv" + cmdstan::compression::suffix(codec);
+  std::string expected = write_compressed(fname, opts);
+
+  auto in = cmdstan::compression::open_input(fname);
+  EXPECT_EQ(expected, read_all(*in));
+
+  // a file cut off mid-frame still yields its complete frames
+  std::string raw;
+  {
+    std::ifstream f(fname, std::ios::binary);
+    raw = read_all(f);
+  }
+  EXPECT_LT(raw.size(), expected.size());
+  {
+    std::ofstream f(fname, std::ios::binary | std::ios::trunc);
+    f.write(raw.data(), raw.size() / 2);
+  }
+  auto truncated = cmdstan::compression::open_input(fname);
+  std::string partial = read_all(*truncated);
+  EXPECT_GE(partial.size(), opts.frame_size);
+  EXPECT_EQ(expected.substr(0, partial.size()), partial);
+}
+}  // namespace
+
+TEST(compression, split_suffix) {
+  auto split = cmdstan::compression::split_suffix("output.csv.zst");
+  EXPECT_EQ("output.csv", split.first);
+  EXPECT_EQ(".zst", split.second);
+  split = cmdstan::compression::split_suffix("output.bin.gz");
+  EXPECT_EQ("output.bin", split.first);
+  EXPECT_EQ(".gz", split.second);
+  split = cmdstan::compression::split_suffix("output.csv");
+  EXPECT_EQ("output.csv", split.first);
+  EXPECT_EQ("", split.second);
+}
+
+TEST(compression, uncompressed_input) {
+  std::string fname = "test/compression_test_plain.csv";
+  {
+    std::ofstream out(fname);
+    out << "# comment\nlp__,mu\n1,2\n";
+  }
+  auto in = cmdstan::compression::open_input(fname);
+  EXPECT_EQ("# comment\nlp__,mu\n1,2\n", read_all(*in));
+  EXPECT_THROW(cmdstan::compression::open_input("test/no_such_file.csv"),
+               std::invalid_argument);
+}
+
+#ifdef CMDSTAN_ZLIB
+TEST(compression, gzip_round_trip) { check_round_trip("gzip"); }
+#else
+TEST(compression, gzip_unavailable) {
+  EXPECT_THROW(cmdstan::compression::check_available("gzip"),
+               std::invalid_argument);
+}
+#endif
+
+#ifdef CMDSTAN_ZSTD
+TEST(compression, zstd_round_trip) { check_round_trip("zstd"); }
+
+TEST(compression, sample_zstd_stansummary) {
+  std::vector<std::string> model_path
+      = {"src", "test", "test-models", "proper"};
+  std::string output = convert_model_path({"test", "compressed_output.csv"});
+  std::stringstream ss;
+  ss << convert_model_path(model_path)
+     << " sample num_samples=100 output file=" << output
+     << " compression=zstd level=5";
+  run_command_output out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError) << out.output;
+
+  std::ifstream plain(output);
+  EXPECT_FALSE(plain.good());
+  std::vector<std::string> stansummary_path = {"bin", "stansummary"};
+  run_command_output summary = run_command(
+      convert_model_path(stansummary_path) + " " + output + ".zst");
+  ASSERT_FALSE(summary.hasError) << summary.output;
+  EXPECT_NE(summary.output.find("mu "), std::string::npos);
+}
+
+TEST(compression, side_files_of_compressed_output) {
+  std::vector<std::string> model_path
+      = {"src", "test", "test-models", "proper"};
+  std::string base = convert_model_path({"test", "compressed_side"});
+  std::stringstream ss;
+  ss << convert_model_path(model_path)
+     << " sample adapt save_metric=1 output file=" << base << ".csv.zst"
+     << " compression=zstd save_cmdstan_config=1";
+  run_command_output out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError) << out.output;
+  EXPECT_TRUE(std::ifstream(base + "_config.json").good());
+  EXPECT_TRUE(std::ifstream(base + "_metric.json").good());
+  EXPECT_FALSE(std::ifstream(base + ".csv_metric.json").good());
+
+  ss.str("");
+  ss << convert_model_path(model_path) << " sample warm_start=" << base
+     << " output file=" << base << "_warm.csv";
+  out = run_command(ss.str());
+  EXPECT_FALSE(out.hasError) << out.output;
+  for (const char *sfx :
+       {".csv.zst", "_config.json", "_metric.json", "_warm.csv"}) {
+    std::remove((base + sfx).c_str());
+  }
+}
+#else
+TEST(compression, zstd_unavailable) {
+  EXPECT_THROW(cmdstan::compression::check_available("zstd"),
+               std::invalid_argument);
+}
+#endif
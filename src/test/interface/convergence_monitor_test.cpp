@@ -0,0 +1,238 @@
+#include <cmdstan/convergence_monitor.hpp>
+#include <cmdstan/output_writer.hpp>
+#include <stan/callbacks/stream_writer.hpp>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+/**
+ * Feed iid draws of two standard normal parameters through a monitored
+ * writer, as a chain would, and return the number of sampling draws
+ * written before the chain was stopped.  Chains stay within a few
+ * iterations of each other, like chains of a real model.
+ */
+size_t run_chain(const std::shared_ptr<cmdstan::convergence_monitor> &monitor,
+                 size_t chain, size_t num_warmup, size_t num_samples,
+                 std::vector<std::atomic<size_t>> &progress) {
+  cmdstan::monitored_writer writer(monitor, chain,
+                                   cmdstan::output_writer(nullptr));
+  std::mt19937 rng(1234 + chain);
+  std::normal_distribution<double> normal;
+  writer(std::vector<std::string>{"lp__", "accept_stat__", "mu", "sigma"});
+  size_t num_draws = 0;
+  try {
+    for (size_t i = 0; i < num_warmup + num_samples; ++i) {
+      progress[chain] = i;
+      while (std::min_element(progress.begin(), progress.end())->load() + 10
+             < i) {
+        std::this_thread::yield();
+      }
+      (*monitor)();
+      double mu = normal(rng);
+      double sigma = normal(rng);
+      writer(std::vector<double>{-0.5 * (mu * mu + sigma * sigma), 0.9, mu,
+                                 sigma});
+      if (i >= num_warmup) {
+        ++num_draws;
+      }
+    }
+  } catch (const cmdstan::early_stop &e) {
+  }
+  progress[chain] = std::numeric_limits<size_t>::max() / 2;
+  return num_draws;
+}
+
+/**
+ * Values exchanged between threads standing in for the processes of an
+ * MPI job: each call returns the values of all threads once all have
+ * made it.
+ */
+class exchange_round {
+ public:
+  explicit exchange_round(size_t num_procs) : values_(num_procs) {}
+
+  std::vector<std::vector<double>> all_gather(
+      size_t proc, const std::vector<double> &values) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t round = round_;
+    values_[proc] = values;
+    if (++num_in_ == values_.size()) {
+      result_ = values_;
+      num_in_ = 0;
+      ++round_;
+      cv_.notify_all();
+    } else {
+      cv_.wait(lock, [&] { return round_ != round; });
+    }
+    return result_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::vector<double>> values_;
+  std::vector<std::vector<double>> result_;
+  size_t num_in_ = 0;
+  size_t round_ = 0;
+};
+
+class thread_exchange : public cmdstan::convergence_exchange {
+ public:
+  thread_exchange(std::shared_ptr<exchange_round> round, size_t proc)
+      : round_(std::move(round)), proc_(proc) {}
+
+  size_t reduce_min(size_t n) {
+    size_t result = n;
+    for (const auto &values : round_->all_gather(proc_, {1.0 * n})) {
+      result = std::min(result, static_cast<size_t>(values[0]));
+    }
+    return result;
+  }
+
+  size_t reduce_max(size_t n) {
+    size_t result = n;
+    for (const auto &values : round_->all_gather(proc_, {1.0 * n})) {
+      result = std::max(result, static_cast<size_t>(values[0]));
+    }
+    return result;
+  }
+
+  std::vector<std::vector<double>> gather(const std::vector<double> &values) {
+    auto all_values = round_->all_gather(proc_, values);
+    return proc_ == 0 ? all_values : std::vector<std::vector<double>>();
+  }
+
+  void broadcast(std::vector<double> &values) {
+    values = round_->all_gather(proc_, values)[0];
+  }
+
+  void abort() { ADD_FAILURE() << "process " << proc_ << " aborted"; }
+
+ private:
+  std::shared_ptr<exchange_round> round_;
+  size_t proc_;
+};
+
+/**
+ * Run the chains of several processes, each with its own monitor, and
+ * return the number of sampling draws of each chain.  Processes with
+ * more warmup draws end later.
+ */
+std::vector<std::vector<size_t>> run_processes(
+    const std::vector<std::shared_ptr<cmdstan::convergence_monitor>> &monitors,
+    size_t num_chains, const std::vector<size_t> &num_warmup,
+    size_t num_samples) {
+  auto round = std::make_shared<exchange_round>(monitors.size());
+  std::vector<std::vector<size_t>> num_draws(monitors.size());
+  std::vector<std::thread> procs;
+  for (size_t p = 0; p < monitors.size(); ++p) {
+    monitors[p]->share(std::make_shared<thread_exchange>(round, p));
+    procs.emplace_back([&, p] {
+      num_draws[p].resize(num_chains);
+      std::vector<std::atomic<size_t>> progress(num_chains);
+      std::vector<std::thread> chains;
+      for (size_t i = 0; i < num_chains; ++i) {
+        chains.emplace_back([&, i] {
+          num_draws[p][i] = run_chain(monitors[p], i, num_warmup[p],
+                                      num_samples, progress);
+        });
+      }
+      for (auto &chain : chains) {
+        chain.join();
+      }
+      monitors[p]->finish(true);
+    });
+  }
+  for (auto &proc : procs) {
+    proc.join();
+  }
+  return num_draws;
+}
+}  // namespace
+
+TEST(convergence_monitor, stops_all_chains_at_same_draw) {
+  auto monitor = std::make_shared<cmdstan::convergence_monitor>(
+      4, 100, 10000, 200, 1.05, 50);
+  std::vector<size_t> num_draws(4);
+  std::vector<std::atomic<size_t>> progress(4);
+  std::vector<std::thread> chains;
+  for (size_t i = 0; i < 4; ++i) {
+    chains.emplace_back(
+        [&, i] { num_draws[i] = run_chain(monitor, i, 100, 10000, progress); });
+  }
+  for (auto &chain : chains) {
+    chain.join();
+  }
+  ASSERT_TRUE(monitor->stopped());
+  EXPECT_GE(monitor->min_ess(), 200);
+  EXPECT_LE(monitor->max_rhat(), 1.05);
+  EXPECT_LT(monitor->num_draws(), 10000U);
+  for (size_t i = 0; i < 4; ++i) {
+    EXPECT_EQ(monitor->num_draws(), num_draws[i]);
+  }
+  std::stringstream timing;
+  stan::callbacks::stream_writer writer(timing);
+  monitor->write_timing(0, writer);
+  EXPECT_NE(std::string::npos, timing.str().find(" seconds (Warm-up)\n"));
+  EXPECT_NE(std::string::npos, timing.str().find(" seconds (Total)\n"));
+}
+
+TEST(convergence_monitor, runs_to_end_if_target_not_met) {
+  auto monitor = std::make_shared<cmdstan::convergence_monitor>(
+      2, 0, 200, 1e9, 1.01, 50);
+  std::vector<size_t> num_draws(2);
+  std::vector<std::atomic<size_t>> progress(2);
+  std::thread chain(
+      [&] { num_draws[1] = run_chain(monitor, 1, 0, 200, progress); });
+  num_draws[0] = run_chain(monitor, 0, 0, 200, progress);
+  chain.join();
+  EXPECT_FALSE(monitor->stopped());
+  EXPECT_EQ(200U, num_draws[0]);
+  EXPECT_EQ(200U, num_draws[1]);
+}
+
+TEST(convergence_monitor, shared_checks_stop_all_processes) {
+  std::vector<std::shared_ptr<cmdstan::convergence_monitor>> monitors;
+  for (size_t p = 0; p < 3; ++p) {
+    monitors.push_back(std::make_shared<cmdstan::convergence_monitor>(
+        2, 0, 10000, 300, 1.05, 50));
+  }
+  auto num_draws = run_processes(monitors, 2, {0, 0, 0}, 10000);
+  for (size_t p = 0; p < 3; ++p) {
+    ASSERT_TRUE(monitors[p]->stopped());
+    EXPECT_EQ(monitors[0]->num_draws(), monitors[p]->num_draws());
+    EXPECT_EQ(monitors[0]->min_ess(), monitors[p]->min_ess());
+    EXPECT_GE(monitors[p]->min_ess(), 300);
+    for (size_t i = 0; i < 2; ++i) {
+      EXPECT_EQ(monitors[p]->num_draws(), num_draws[p][i]);
+    }
+  }
+  EXPECT_LT(monitors[0]->num_draws(), 10000U);
+}
+
+TEST(convergence_monitor, shared_checks_outlast_finished_process) {
+  // the first process ends its chains long before the second one, and
+  // then takes part in the remaining checks
+  std::vector<std::shared_ptr<cmdstan::convergence_monitor>> monitors;
+  std::vector<size_t> num_warmup{0, 20000};
+  for (size_t p = 0; p < 2; ++p) {
+    monitors.push_back(std::make_shared<cmdstan::convergence_monitor>(
+        2, num_warmup[p], 300, 1e9, 1.01, 50));
+  }
+  auto num_draws = run_processes(monitors, 2, num_warmup, 300);
+  for (size_t p = 0; p < 2; ++p) {
+    EXPECT_FALSE(monitors[p]->stopped());
+    EXPECT_EQ(300U, num_draws[p][0]);
+    EXPECT_EQ(300U, num_draws[p][1]);
+  }
+}
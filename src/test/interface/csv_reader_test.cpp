@@ -0,0 +1,148 @@
+#include <cmdstan/csv_reader.hpp>
+#include <stan/io/stan_csv_reader.hpp>
+#include <test/utility.hpp>
+#include <gtest/gtest.h>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using cmdstan::test::convert_model_path;
+
+namespace {
+void expect_same_as_stan_csv_reader(const std::string &fname) {
+  std::ifstream in(fname);
+  stan::io::stan_csv expected = stan::io::stan_csv_reader::parse(in, nullptr);
+  stan::io::stan_csv actual = cmdstan::read_stan_csv(fname);
+  EXPECT_EQ(expected.metadata.model, actual.metadata.model);
+  EXPECT_EQ(expected.metadata.num_samples, actual.metadata.num_samples);
+  EXPECT_EQ(expected.metadata.thin, actual.metadata.thin);
+  EXPECT_EQ(expected.header, actual.header);
+  EXPECT_EQ(expected.adaptation.step_size, actual.adaptation.step_size);
+  EXPECT_EQ(expected.adaptation.metric, actual.adaptation.metric);
+  EXPECT_FLOAT_EQ(expected.timing.warmup, actual.timing.warmup);
+  EXPECT_FLOAT_EQ(expected.timing.sampling, actual.timing.sampling);
+  ASSERT_EQ(expected.samples.rows(), actual.samples.rows());
+  ASSERT_EQ(expected.samples.cols(), actual.samples.cols());
+  EXPECT_EQ(expected.samples, actual.samples);
+}
+
+std::string write_file(const std::string &name, const std::string &text) {
+  std::string fname = convert_model_path({"test", name});
+  std::ofstream out(fname, std::ios::binary);
+  out << text;
+  return fname;
+}
+}  // namespace
+
+TEST(csv_reader, matches_stan_csv_reader) {
+  for (const std::string name :
+       {"mix_output.1.csv", "eight_schools_output.csv",
+        "corr_gauss_output.csv", "bernoulli_chain_1.csv"}) {
+    SCOPED_TRACE(name);
+    expect_same_as_stan_csv_reader(convert_model_path(
+        {"src", "test", "interface", "example_output", name}));
+  }
+}
+
+TEST(csv_reader, partial_last_line) {
+  std::string fname = write_file("csv_reader_partial.csv",
+                                 "# model = m\r\nlp__,mu\r\n-1,0.5\r\n"
+                                 "-2,1e-3\r\n-3,");
+  stan::io::stan_csv csv = cmdstan::read_stan_csv(fname);
+  std::vector<std::string> header = {"lp__", "mu"};
+  EXPECT_EQ(header, csv.header);
+  ASSERT_EQ(2, csv.samples.rows());
+  EXPECT_EQ(-2, csv.samples(1, 0));
+  EXPECT_EQ(1e-3, csv.samples(1, 1));
+
+  fname = write_file("csv_reader_complete.csv", "lp__,mu\n-1,0.5\n-2,inf");
+  csv = cmdstan::read_stan_csv(fname);
+  ASSERT_EQ(2, csv.samples.rows());
+  EXPECT_TRUE(std::isinf(csv.samples(1, 1)));
+}
+
+TEST(csv_reader, errors) {
+  std::string fname
+      = write_file("csv_reader_short.csv", "lp__,mu\n-1,0.5\n-2\n-3,1\n");
+  EXPECT_THROW(cmdstan::read_stan_csv(fname), std::invalid_argument);
+  fname = write_file("csv_reader_bad.csv", "lp__,mu\n-1,0.5x\n");
+  EXPECT_THROW(cmdstan::read_stan_csv(fname), std::invalid_argument);
+  EXPECT_THROW(cmdstan::read_stan_csv("test/no_such_file.csv"),
+               std::invalid_argument);
+}
+
+TEST(csv_reader, include_params) {
+  std::string fname = write_file("csv_reader_projection.csv",
+                                 "lp__,accept_stat__,mu,theta.1,theta.2\n"
+                                 "-1,0.9,skipped,1,2\n-2,0.8,,3,4\n");
+  stan::io::stan_csv csv
+      = cmdstan::read_stan_csv(fname, false, {"theta.2", "lp__"});
+  std::vector<std::string> header = {"lp__", "accept_stat__", "theta.2"};
+  EXPECT_EQ(header, csv.header);
+  ASSERT_EQ(2, csv.samples.rows());
+  ASSERT_EQ(3, csv.samples.cols());
+  EXPECT_EQ(-2, csv.samples(1, 0));
+  EXPECT_EQ(0.9, csv.samples(0, 1));
+  EXPECT_EQ(4, csv.samples(1, 2));
+}
+
+TEST(csv_reader, read_columns) {
+  std::string fname = write_file("csv_reader_columns.csv",
+                                 "lp__,mu,theta.1,theta.2\r\n"
+                                 "-1,0.5,1,2\r\n-2,,3,4\r\n");
+  std::vector<size_t> offsets;
+  cmdstan::read_stan_csv(fname, false, {"theta.1"}, &offsets);
+  ASSERT_EQ(2U, offsets.size());
+  std::vector<size_t> positions = offsets;
+  int col = 0;
+  Eigen::MatrixXd draws
+      = cmdstan::read_stan_csv_columns(fname, positions, col, {0, 2});
+  EXPECT_EQ(3, col);
+  ASSERT_EQ(2, draws.rows());
+  ASSERT_EQ(2, draws.cols());
+  EXPECT_EQ(-2, draws(1, 0));
+  EXPECT_EQ(1, draws(0, 1));
+  // continues after theta.1, without going back over the empty mu
+  draws = cmdstan::read_stan_csv_columns(fname, positions, col, {3});
+  EXPECT_EQ(4, col);
+  EXPECT_EQ(2, draws(0, 0));
+  EXPECT_EQ(4, draws(1, 0));
+  EXPECT_THROW(cmdstan::read_stan_csv_columns(fname, positions, col, {4}),
+               std::invalid_argument);
+  positions = offsets;
+  col = 0;
+  EXPECT_THROW(cmdstan::read_stan_csv_columns(fname, positions, col, {1}),
+               std::invalid_argument);
+}
+
+TEST(csv_reader, tail) {
+  std::string fname = convert_model_path({"test", "csv_reader_tail.csv"});
+  std::ofstream out(fname, std::ios::binary);
+  out << "# model = m\n" << std::flush;
+  cmdstan::stan_csv_tail tail(fname, false);
+  EXPECT_EQ(0U, tail.poll());
+  EXPECT_FALSE(tail.has_header());
+
+  out << "lp__,theta.1\n-1,0.5\n-2,0." << std::flush;
+  EXPECT_EQ(1U, tail.poll());
+  std::vector<std::string> header = {"lp__", "theta.1"};
+  EXPECT_EQ(header, tail.header());
+
+  out << "25\n# \n#  Elapsed Time: 1.5 seconds (Warm-up)\n"
+      << "#                2.5 seconds (Sampling)\n" << std::flush;
+  EXPECT_EQ(1U, tail.poll());
+  EXPECT_FALSE(tail.finished());
+  EXPECT_EQ(1.5, tail.timing().warmup);
+  EXPECT_EQ(2.5, tail.timing().sampling);
+  EXPECT_EQ(0.25, tail.draw(1)[1]);
+
+  out << "#                4 seconds (Total)\n" << std::flush;
+  EXPECT_EQ(0U, tail.poll());
+  EXPECT_TRUE(tail.finished());
+  stan::io::stan_csv csv = tail.to_stan_csv(2);
+  ASSERT_EQ(2, csv.samples.rows());
+  EXPECT_EQ(-1, csv.samples(0, 0));
+  EXPECT_EQ(0.25, csv.samples(1, 1));
+}
@@ -0,0 +1,111 @@
+#include <cmdstan/csv_writer.hpp>
+#include <cmdstan/number_format.hpp>
+#include <stan/callbacks/unique_stream_writer.hpp>
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+std::string format(double x, int sig_figs = -1) {
+  std::string out;
+  cmdstan::append_double(out, x, sig_figs);
+  return out;
+}
+
+std::string stream_format(double x, int sig_figs) {
+  std::stringstream ss;
+  ss.precision(sig_figs);
+  ss << x;
+  return ss.str();
+}
+}  // namespace
+
+TEST(number_format, shortest_round_trip) {
+  EXPECT_EQ("0", format(0.0));
+  EXPECT_EQ("1", format(1.0));
+  EXPECT_EQ("-2.5", format(-2.5));
+  EXPECT_EQ("1e+300", format(1e300));
+  EXPECT_EQ("inf", format(std::numeric_limits<double>::infinity()));
+  EXPECT_EQ("-inf", format(-std::numeric_limits<double>::infinity()));
+  EXPECT_EQ("nan", format(std::numeric_limits<double>::quiet_NaN()));
+
+  std::mt19937 rng(1234);
+  std::normal_distribution<double> normal(0, 1);
+  for (int i = 0; i < 10000; ++i) {
+    double x = normal(rng) * std::pow(10.0, (i % 40) - 20);
+    EXPECT_EQ(x, std::strtod(format(x).c_str(), nullptr)) << format(x);
+  }
+}
+
+TEST(number_format, fixed_sig_figs_match_stream) {
+  std::mt19937 rng(1234);
+  std::normal_distribution<double> normal(0, 1);
+  for (int sig_figs = 0; sig_figs <= 18; ++sig_figs) {
+    for (int i = 0; i < 200; ++i) {
+      double x = normal(rng) * std::pow(10.0, (i % 20) - 10);
+      EXPECT_EQ(stream_format(x, sig_figs), format(x, sig_figs));
+    }
+  }
+}
+
+TEST(csv_writer, layout) {
+  auto out = std::make_unique<std::stringstream>();
+  std::stringstream &ss = *out;
+  cmdstan::csv_writer writer(std::move(out), "# ", 3);
+  writer("config");
+  writer(std::vector<std::string>{"lp__", "theta"});
+  writer(std::vector<double>{-1.23456, 0.5});
+  Eigen::MatrixXd m(2, 2);
+  m << 1, 2, 3.14159, 4;
+  writer(Eigen::Ref<Eigen::MatrixXd>(m));
+  writer();
+  EXPECT_EQ("# config\nlp__,theta\n-1.23,0.5\n1,2\n3.14,4\n# \n", ss.str());
+}
+
+// Run with --gtest_also_run_disabled_tests to compare draws per second
+// of the iostream based writer and csv_writer on a wide model.
+TEST(csv_writer, DISABLED_benchmark_wide_draws) {
+  const int num_draws = 2000;
+  const int num_cols = 5000;
+  std::mt19937 rng(1234);
+  std::normal_distribution<double> normal(0, 1);
+  std::vector<std::vector<double>> draws(num_draws,
+                                         std::vector<double>(num_cols));
+  for (auto &draw : draws) {
+    for (auto &x : draw) {
+      x = normal(rng);
+    }
+  }
+  auto time = [&](stan::callbacks::writer &writer) {
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &draw : draws) {
+      writer(draw);
+    }
+    std::chrono::duration<double> elapsed
+        = std::chrono::steady_clock::now() - start;
+    return num_draws / elapsed.count();
+  };
+  for (int sig_figs : {-1, 6, 18}) {
+    auto ss = std::make_unique<std::stringstream>();
+    if (sig_figs > -1) {
+      ss->precision(sig_figs);
+    }
+    stan::callbacks::unique_stream_writer<std::stringstream> stream_writer(
+        std::move(ss));
+    cmdstan::csv_writer fast_writer(std::make_unique<std::stringstream>(), "",
+                                    sig_figs);
+    double before = time(stream_writer);
+    double after = time(fast_writer);
+    std::cout << "sig_figs=" << sig_figs << ", " << num_cols
+              << " columns: " << before << " draws/sec with iostreams, "
+              << after << " draws/sec with csv_writer" << std::endl;
+  }
+}
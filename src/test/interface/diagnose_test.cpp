@@ -96,3 +96,41 @@ TEST(CommandDiagnose, mix) {
   ss << expected_output.rdbuf();
   EXPECT_EQ(1, count_matches(ss.str(), out.output));
 }
+
+TEST(CommandDiagnose, gradient_params_subset) {
+  std::string model = cmdstan::test::convert_model_path(
+      {"src", "test", "test-models", "test_model"});
+  std::string output = cmdstan::test::convert_model_path(
+      {"test", "diagnose_gradient.csv"});
+  auto read_rows = [&](const std::string &args) {
+    run_command_output out
+        = run_command(model + " num_threads=2 random seed=1234 output file="
+                      + output + " method=diagnose test=gradient " + args);
+    EXPECT_FALSE(out.hasError) << out.output;
+    std::ifstream in(output);
+    std::vector<std::string> rows;
+    std::string line;
+    bool in_table = false;
+    while (std::getline(in, line)) {
+      if (line.find("param idx") != std::string::npos) {
+        in_table = true;
+      } else if (in_table) {
+        rows.push_back(line);
+      }
+    }
+    return rows;
+  };
+  std::vector<std::string> all = read_rows("");
+  ASSERT_EQ(2U, all.size());
+  std::vector<std::string> named = read_rows("params=mu2");
+  ASSERT_EQ(1U, named.size());
+  EXPECT_EQ(all[1], named[0]);
+  std::vector<std::string> random = read_rows("num_params=1");
+  ASSERT_EQ(1U, random.size());
+  EXPECT_TRUE(random[0] == all[0] || random[0] == all[1]);
+
+  run_command_output out
+      = run_command(model + " output file=" + output
+                    + " method=diagnose test=gradient params=sigma");
+  EXPECT_TRUE(out.hasError);
+}
@@ -0,0 +1,86 @@
+#include <cmdstan/binary_writer.hpp>
+#include <cmdstan/draws_reader.hpp>
+#include <test/utility.hpp>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using cmdstan::test::convert_model_path;
+
+TEST(draws_reader, csv_chunks) {
+  std::string fname = convert_model_path({"test", "draws_reader.csv"});
+  {
+    std::ofstream out(fname, std::ios::binary);
+    out << "# model = m\n# save_warmup = true\nlp__,mu\n"
+        << "-1,0.5\n# Adaptation terminated\n# Step size = 1\n"
+        << "-2,1e-3\r\n\n-3,2\n-4,3\n# \n#  Elapsed Time: 1 seconds\n"
+        << "-5,";
+  }
+  cmdstan::draws_reader reader(fname);
+  std::vector<std::string> header = {"lp__", "mu"};
+  EXPECT_EQ(header, reader.header());
+  std::vector<double> draws;
+  ASSERT_EQ(3U, reader.read(3, draws));
+  std::vector<double> expected = {-1, 0.5, -2, 1e-3, -3, 2};
+  EXPECT_EQ(expected, draws);
+  ASSERT_EQ(1U, reader.read(3, draws));
+  expected = {-4, 3};
+  EXPECT_EQ(expected, draws);
+  EXPECT_EQ(0U, reader.read(3, draws));
+  EXPECT_TRUE(draws.empty());
+}
+
+TEST(draws_reader, csv_errors) {
+  std::string fname = convert_model_path({"test", "draws_reader_bad.csv"});
+  {
+    std::ofstream out(fname, std::ios::binary);
+    out << "lp__,mu\n-1,0.5\n-2\n-3,1\n";
+  }
+  cmdstan::draws_reader reader(fname);
+  std::vector<double> draws;
+  EXPECT_EQ(1U, reader.read(1, draws));
+  EXPECT_THROW(reader.read(1, draws), std::invalid_argument);
+
+  fname = convert_model_path({"test", "draws_reader_empty.csv"});
+  {
+    std::ofstream out(fname, std::ios::binary);
+    out << "# model = m\n";
+  }
+  EXPECT_THROW(cmdstan::draws_reader{fname}, std::invalid_argument);
+}
+
+TEST(draws_reader, binary_chunks) {
+  std::string fname = convert_model_path({"test", "draws_reader.bin"});
+  {
+    auto ofs = std::make_unique<std::ofstream>(
+        fname, std::ios::binary | std::ios::trunc);
+    // records of 3 draws, so reads cross record boundaries
+    cmdstan::binary_writer writer(std::move(ofs), 3 * 2 * sizeof(double));
+    writer("model = m");
+    writer(std::vector<std::string>{"lp__", "mu"});
+    for (int i = 0; i < 7; ++i) {
+      writer(std::vector<double>{-1.0 * i, 0.5 * i});
+      if (i == 3) {
+        writer("Adaptation terminated");
+      }
+    }
+  }
+  cmdstan::draws_reader reader(fname);
+  std::vector<std::string> header = {"lp__", "mu"};
+  EXPECT_EQ(header, reader.header());
+  std::vector<double> draws;
+  std::vector<double> all;
+  size_t num_read;
+  while ((num_read = reader.read(2, draws)) > 0) {
+    EXPECT_EQ(2 * num_read, draws.size());
+    all.insert(all.end(), draws.begin(), draws.end());
+  }
+  ASSERT_EQ(14U, all.size());
+  for (int i = 0; i < 7; ++i) {
+    EXPECT_EQ(-1.0 * i, all[2 * i]);
+    EXPECT_EQ(0.5 * i, all[2 * i + 1]);
+  }
+}
@@ -10,8 +10,10 @@
 #include <test/utility.hpp>
 #include <boost/algorithm/string.hpp>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 #include <gtest/gtest.h>
 
 using cmdstan::argument;
@@ -229,3 +231,38 @@ TEST(CommandHelper, check_same_file_test) {
   std::string dot_path_good = "a/b/file.txt";
   EXPECT_TRUE(cmdstan::file::check_approx_same_file(path, dot_path_good));
 }
+
+TEST(CommandHelper, apply_mpi_chains) {
+  std::vector<std::string> argv{"my_model", "id=1", "sample", "num_chains=5",
+                                "output",   "file=out.csv"};
+  std::vector<const char *> argv_prime;
+  for (const auto &arg : argv) {
+    argv_prime.push_back(arg.c_str());
+  }
+  std::vector<argument *> valid_arguments;
+  valid_arguments.push_back(new cmdstan::arg_id());
+  valid_arguments.push_back(new cmdstan::arg_output());
+  argument_parser parser(valid_arguments);
+  std::stringstream out;
+  stan::callbacks::stream_writer info(out);
+  stan::callbacks::stream_writer err(out);
+  ASSERT_EQ(0, parser.parse_args(argv.size(), argv_prime.data(), info, err));
+
+  // chains 3 to 5 of 5 run by the second of two processes
+  EXPECT_TRUE(cmdstan::apply_mpi_chains(parser, 1, 2));
+  EXPECT_EQ(3, cmdstan::get_arg_val<cmdstan::int_argument>(parser, "id"));
+  EXPECT_EQ(3, cmdstan::get_arg_val<cmdstan::int_argument>(
+                   parser, "method", "sample", "num_chains"));
+  EXPECT_EQ("profile_rank_1.csv",
+            cmdstan::get_arg_val<cmdstan::string_argument>(
+                parser, "output", "profile_file"));
+
+  // a single chain of such a run is still numbered
+  std::vector<std::string> names
+      = make_filenames("out.csv", "", ".csv", 1, 4, true);
+  ASSERT_EQ(1, names.size());
+  EXPECT_EQ("out_4.csv", names[0]);
+
+  EXPECT_THROW(cmdstan::apply_mpi_chains(parser, 0, 4),
+               std::invalid_argument);
+}
@@ -1,5 +1,8 @@
 #include <test/utility.hpp>
 #include <gtest/gtest.h>
+#include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <string>
 #include <stdexcept>
@@ -313,3 +316,115 @@ TEST_F(CmdStan, generate_quantities_thin) {
 
   ASSERT_EQ(fitted_params.samples.rows(), gq_output.samples.rows());
 }
+
+TEST_F(CmdStan, generate_quantities_multi_chunk_size) {
+  std::vector<std::vector<double>> outputs;
+  for (int chunk_size : {1000, 7}) {
+    std::stringstream ss;
+    ss << convert_model_path(bern_gq_model)
+       << " data file=" << convert_model_path(bern_data)
+       << " output file=" << convert_model_path({"test", "gq_chunks.csv"})
+       << " num_threads=4 random seed=1234"
+       << " method=generate_quantities fitted_params="
+       << convert_model_path(bern_fitted_params_multi)
+       << " num_chains=4 chunk_size=" << chunk_size;
+    run_command_output out = run_command(ss.str());
+    ASSERT_FALSE(out.hasError) << out.output;
+    std::vector<double> values;
+    for (int chain = 1; chain <= 4; ++chain) {
+      std::stringstream fname;
+      fname << "gq_chunks_" << chain << ".csv";
+      std::vector<std::string> config;
+      std::vector<std::string> header;
+      std::vector<double> chain_values;
+      cmdstan::test::parse_sample(convert_model_path({"test", fname.str()}),
+                                  config, header, chain_values);
+      ASSERT_FALSE(chain_values.empty());
+      values.insert(values.end(), chain_values.begin(), chain_values.end());
+    }
+    outputs.push_back(values);
+  }
+  EXPECT_EQ(outputs[0], outputs[1]);
+}
+
+TEST_F(CmdStan, generate_quantities_parallel_draws) {
+  auto run_gq = [&](const std::string &args, const std::string &output) {
+    std::stringstream ss;
+    ss << convert_model_path(bern_gq_model)
+       << " data file=" << convert_model_path(bern_data)
+       << " output file=" << convert_model_path({"test", output + ".csv"})
+       << " random seed=1234 " << args;
+    run_command_output out = run_command(ss.str());
+    EXPECT_FALSE(out.hasError) << out.output;
+  };
+  auto read_values = [&](const std::string &output) {
+    std::vector<std::string> config;
+    std::vector<std::string> header;
+    std::vector<double> values;
+    cmdstan::test::parse_sample(convert_model_path({"test", output + ".csv"}),
+                                config, header, values);
+    return values;
+  };
+  std::string multi_args
+      = " method=generate_quantities parallel_draws=1 num_chains=4"
+        " fitted_params="
+        + convert_model_path(bern_fitted_params_multi);
+  run_gq("num_threads=1" + multi_args + " chunk_size=1000", "gq_par_a");
+  run_gq("num_threads=4" + multi_args + " chunk_size=9", "gq_par_b");
+  for (int chain = 1; chain <= 4; ++chain) {
+    std::string suffix = "_" + std::to_string(chain);
+    std::vector<double> values = read_values("gq_par_a" + suffix);
+    ASSERT_FALSE(values.empty());
+    EXPECT_EQ(values, read_values("gq_par_b" + suffix));
+  }
+
+  // a chain run on its own has the same random numbers
+  std::vector<std::string> chain_2_params
+      = {"src", "test", "test-models", "bern_params_multi_2.csv"};
+  run_gq("id=2 method=generate_quantities parallel_draws=1 fitted_params="
+             + convert_model_path(chain_2_params),
+         "gq_par_c");
+  EXPECT_EQ(read_values("gq_par_a_2"), read_values("gq_par_c"));
+}
+
+TEST_F(CmdStan, generate_quantities_parallel_draws_print_order) {
+  std::vector<std::string> printer
+      = {"src", "test", "test-models", "printer"};
+  std::string fit_file = convert_model_path({"test", "gq_print_fit.csv"});
+  std::string gq_file = convert_model_path({"test", "gq_print.csv"});
+  run_command_output out
+      = run_command(convert_model_path(printer)
+                    + " sample num_samples=200 num_warmup=100 output file="
+                    + fit_file + " random seed=1234");
+  ASSERT_FALSE(out.hasError) << out.output;
+  out = run_command(convert_model_path(printer)
+                    + " method=generate_quantities parallel_draws=1"
+                      " fitted_params="
+                    + fit_file + " output file=" + gq_file
+                    + " num_threads=4 random seed=1234");
+  ASSERT_FALSE(out.hasError) << out.output;
+
+  // print statements of each draw come out in draw order
+  std::vector<double> printed;
+  std::stringstream console(out.output);
+  std::string line;
+  while (std::getline(console, line)) {
+    if (line.rfind("w=", 0) == 0) {
+      printed.push_back(std::stod(line.substr(2)));
+    }
+  }
+  std::vector<std::string> config;
+  std::vector<std::string> header;
+  std::vector<double> values;
+  cmdstan::test::parse_sample(gq_file, config, header, values);
+  std::vector<std::string> names;
+  boost::algorithm::split(names, header[0], boost::is_any_of(","));
+  size_t w = std::find(names.begin(), names.end(), "w") - names.begin();
+  ASSERT_LT(w, names.size());
+  ASSERT_EQ(values.size() / names.size(), printed.size());
+  for (size_t i = 0; i < printed.size(); ++i) {
+    EXPECT_NEAR(values[i * names.size() + w], printed[i],
+                1e-5 * (1 + std::fabs(printed[i])))
+        << "draw " << i;
+  }
+}
@@ -202,3 +202,23 @@ TEST_F(CmdStan, laplace_unconstrain) {
   out = run_command(cmd);
   ASSERT_TRUE(out.hasError);
 }
+
+TEST_F(CmdStan, laplace_num_threads_keeps_draws) {
+  std::vector<std::vector<double>> values(2);
+  std::vector<std::string> threads{"1", "4"};
+  std::vector<std::vector<std::string>> outputs{output1_csv, output2_csv};
+  for (size_t i = 0; i < 2; ++i) {
+    std::stringstream ss;
+    ss << convert_model_path(multi_normal_model) << " num_threads="
+       << threads[i] << " random seed=1234 method=laplace draws=5000 mode="
+       << convert_model_path(multi_normal_mode_json)
+       << " output file=" << convert_model_path(outputs[i]);
+    run_command_output out = run_command(ss.str());
+    ASSERT_FALSE(out.hasError);
+    std::vector<std::string> config;
+    std::vector<std::string> header;
+    parse_sample(convert_model_path(outputs[i]), config, header, values[i]);
+  }
+  ASSERT_FALSE(values[0].empty());
+  EXPECT_EQ(values[0], values[1]);
+}
@@ -1,5 +1,8 @@
+#include <cmdstan/binary_format.hpp>
+#include <cmdstan/binary_reader.hpp>
 #include <test/utility.hpp>
 #include <gtest/gtest.h>
+#include <cstdint>
 #include <fstream>
 #include <string>
 #include <stdexcept>
@@ -162,6 +165,28 @@ TEST_F(CmdStan, log_prob_cparams_csv) {
   ASSERT_EQ(values.size(), 2000);  // 1000 draws, 2 cols
 }
 
+TEST_F(CmdStan, log_prob_num_threads_keeps_row_order) {
+  std::vector<std::vector<double>> outputs;
+  for (int num_threads : {1, 4}) {
+    std::stringstream ss;
+    ss << convert_model_path(bern_gq_model)
+       << " data file=" << convert_model_path(bern_data)
+       << " output file=" << convert_model_path(test_output)
+       << " num_threads=" << num_threads << " method=log_prob"
+       << " constrained_params="
+       << convert_model_path(bern_constrained_params_csv);
+    run_command_output out = run_command(ss.str());
+    ASSERT_FALSE(out.hasError) << out.output;
+    std::vector<std::string> config;
+    std::vector<std::string> header;
+    std::vector<double> values;
+    parse_sample(convert_model_path(test_output), config, header, values);
+    outputs.push_back(values);
+  }
+  ASSERT_EQ(2000, outputs[0].size());
+  EXPECT_EQ(outputs[0], outputs[1]);
+}
+
 TEST_F(CmdStan, log_prob_no_params) {
   std::stringstream ss;
   ss << convert_model_path(bern_log_prob_model)
@@ -240,3 +265,163 @@ TEST_F(CmdStan, log_prob_conflict) {
   run_command_output out = run_command(cmd);
   ASSERT_TRUE(out.hasError);
 }
+
+namespace {
+// params_r of bern_unconstrained_params.json
+const std::vector<double> bern_uparams
+    = {1.38629436111989,   -1.03192029533272,  -0.479415242304312,
+       -1.01866970062961,  0.67699454858025,   2.15402112425165,
+       1.11815245534682,   0.176100961348628,  -1.47536938928953,
+       2.17309623676142,   -0.263993484783208, 0.704803511993464,
+       -1.04596396482332,  -0.711702526766766, -1.71856146447761,
+       0.596396994136899,  -0.454458757498793, -0.80021133760908,
+       -0.384149678939469};
+
+void write_doubles(std::ofstream &out, const std::vector<double> &values) {
+  for (double x : values) {
+    char buf[sizeof(double)];
+    cmdstan::binary_format::encode_le(x, buf);
+    out.write(buf, sizeof(buf));
+  }
+}
+
+std::string write_npy(const std::vector<std::string> &path,
+                      const std::string &shape, bool fortran_order,
+                      const std::vector<double> &values) {
+  std::string header = "{'descr': '<f8', 'fortran_order': ";
+  header += fortran_order ? "True" : "False";
+  header += ", 'shape': " + shape + ", }";
+  header.append(63 - (10 + header.size()) % 64, ' ');
+  header += '\n';
+  std::string fname = convert_model_path(path);
+  std::ofstream out(fname, std::ios::binary);
+  out.write("\x93NUMPY\x01\x00", 8);
+  char len[2];
+  cmdstan::binary_format::encode_le(static_cast<std::uint16_t>(header.size()),
+                                    len);
+  out.write(len, 2);
+  out << header;
+  write_doubles(out, values);
+  return fname;
+}
+}  // namespace
+
+TEST_F(CmdStan, log_prob_uparams_npy_bin) {
+  std::vector<std::vector<double>> outputs;
+  std::vector<double> two_rows(bern_uparams);
+  std::vector<double> second_row(bern_uparams);
+  second_row[0] = 0.5;
+  two_rows.insert(two_rows.end(), second_row.begin(), second_row.end());
+  std::vector<double> transposed;
+  for (size_t j = 0; j < bern_uparams.size(); ++j) {
+    transposed.push_back(bern_uparams[j]);
+    transposed.push_back(second_row[j]);
+  }
+  std::string raw_file = convert_model_path({"test", "uparams.bin"});
+  {
+    std::ofstream out(raw_file, std::ios::binary);
+    write_doubles(out, two_rows);
+  }
+  std::vector<std::string> inputs
+      = {convert_model_path(bern_unconstrained_params_json),
+         write_npy({"test", "uparams_1d.npy"}, "(19,)", false, bern_uparams),
+         write_npy({"test", "uparams_c.npy"}, "(2, 19)", false, two_rows),
+         write_npy({"test", "uparams_f.npy"}, "(2, 19)", true, transposed),
+         raw_file};
+  for (const auto &input : inputs) {
+    std::stringstream ss;
+    ss << convert_model_path(bern_log_prob_model)
+       << " data file=" << convert_model_path(bern_data)
+       << " output file=" << convert_model_path(test_output)
+       << " method=log_prob unconstrained_params=" << input;
+    run_command_output out = run_command(ss.str());
+    ASSERT_FALSE(out.hasError) << input << "\n" << out.output;
+    std::vector<std::string> config;
+    std::vector<std::string> header;
+    std::vector<double> values;
+    parse_sample(convert_model_path(test_output), config, header, values);
+    outputs.push_back(values);
+  }
+  ASSERT_EQ(20, outputs[0].size());
+  EXPECT_EQ(outputs[0], outputs[1]);
+  ASSERT_EQ(40, outputs[2].size());
+  EXPECT_EQ(outputs[2], outputs[3]);
+  EXPECT_EQ(outputs[2], outputs[4]);
+  EXPECT_EQ(outputs[0], std::vector<double>(outputs[2].begin(),
+                                            outputs[2].begin() + 20));
+  EXPECT_NE(outputs[2][0], outputs[2][20]);
+}
+
+TEST_F(CmdStan, log_prob_uparams_npy_bad_input) {
+  std::vector<double> short_row(bern_uparams.begin(), bern_uparams.end() - 1);
+  std::string fname
+      = write_npy({"test", "uparams_short.npy"}, "(1, 18)", false, short_row);
+  std::stringstream ss;
+  ss << convert_model_path(bern_log_prob_model)
+     << " data file=" << convert_model_path(bern_data)
+     << " output file=" << convert_model_path(dev_null_path)
+     << " method=log_prob unconstrained_params=" << fname;
+  run_command_output out = run_command(ss.str());
+  ASSERT_TRUE(out.hasError);
+  EXPECT_NE(out.output.find("Incorrect number of unconstrained parameters"),
+            std::string::npos);
+}
+
+TEST_F(CmdStan, log_prob_binary_output) {
+  std::vector<std::string> binary_output = {"test", "output.bin"};
+  std::stringstream ss;
+  ss << convert_model_path(bern_gq_model)
+     << " data file=" << convert_model_path(bern_data)
+     << " output file=" << convert_model_path(test_output) << " format=binary"
+     << " method=log_prob constrained_params="
+     << convert_model_path(bern_constrained_params_csv);
+  run_command_output out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError) << out.output;
+  stan::io::stan_csv parsed
+      = cmdstan::read_binary_output(convert_model_path(binary_output));
+  std::vector<std::string> header = {"lp__", "g_theta"};
+  EXPECT_EQ(header, parsed.header);
+  ASSERT_EQ(1000, parsed.samples.rows());
+
+  ss.str("");
+  ss << convert_model_path(bern_gq_model)
+     << " data file=" << convert_model_path(bern_data)
+     << " output file=" << convert_model_path(test_output)
+     << " sig_figs=18 method=log_prob constrained_params="
+     << convert_model_path(bern_constrained_params_csv);
+  out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError) << out.output;
+  std::vector<std::string> config;
+  std::vector<std::string> csv_header;
+  std::vector<double> values;
+  parse_sample(convert_model_path(test_output), config, csv_header, values);
+  ASSERT_EQ(2000, values.size());
+  for (size_t i = 0; i < 1000; ++i) {
+    EXPECT_DOUBLE_EQ(values[2 * i], parsed.samples(i, 0));
+    EXPECT_DOUBLE_EQ(values[2 * i + 1], parsed.samples(i, 1));
+  }
+}
+
+TEST_F(CmdStan, log_prob_hessian) {
+  std::stringstream ss;
+  ss << convert_model_path(bern_gq_model)
+     << " data file=" << convert_model_path(bern_data)
+     << " output file=" << convert_model_path(test_output)
+     << " sig_figs=12 method=log_prob hessian=1 constrained_params="
+     << convert_model_path(bern_constrained_params_csv);
+  run_command_output out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError) << out.output;
+  std::vector<std::string> config;
+  std::vector<std::string> header;
+  std::vector<double> values;
+  parse_sample(convert_model_path(test_output), config, header, values);
+  EXPECT_EQ("lp__,g_theta,h_theta:theta", header[0]);
+  ASSERT_EQ(3000, values.size());
+  // on the logit scale, with the Jacobian, lp = 3 log(theta)
+  // + 9 log(1 - theta), so the gradient is 3 - 12 theta and the
+  // Hessian is -12 theta (1 - theta)
+  for (size_t i = 0; i < values.size(); i += 3) {
+    double theta = (3 - values[i + 1]) / 12;
+    EXPECT_NEAR(-12 * theta * (1 - theta), values[i + 2], 1e-6);
+  }
+}
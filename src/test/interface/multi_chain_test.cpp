@@ -71,3 +71,66 @@ TEST(interface, output_multi) {
     EXPECT_TRUE(diag_file.good());
   }
 }
+
+TEST(interface, output_multi_stop_rule_ess) {
+  std::string model
+      = cmdstan::test::convert_model_path({"src", "test", "test-models",
+                                           "test_model"});
+  std::string output = model + "_stop_rule.csv";
+  std::string command
+      = model
+        + " sample num_warmup=200 num_samples=10000 num_chains=2"
+          " stop_rule=ess target_ess=200 check_every=100 random seed=1234"
+          " output file="
+        + output;
+
+  cmdstan::test::run_command_output out = cmdstan::test::run_command(command);
+  EXPECT_EQ(int(stan::services::error_codes::OK), out.err_code);
+  EXPECT_FALSE(out.hasError);
+  EXPECT_NE(std::string::npos, out.output.find("Sampling stopped early"));
+
+  std::vector<std::string> filenames{model + "_stop_rule_1.csv",
+                                     model + "_stop_rule_2.csv"};
+  stan::io::stan_csv_metadata metadata;
+  Eigen::VectorXd warmup_times(filenames.size());
+  Eigen::VectorXd sampling_times(filenames.size());
+  Eigen::VectorXi thin(filenames.size());
+  auto chains = parse_csv_files(filenames, metadata, warmup_times,
+                                sampling_times, thin, &std::cout);
+  EXPECT_EQ(2, chains.num_chains());
+  EXPECT_LT(chains.num_samples(), 10000);
+  EXPECT_GE(chains.num_samples(), 100);
+  // the timing footer follows the stop message
+  EXPECT_GT(sampling_times(0), 0);
+  EXPECT_GT(sampling_times(1), 0);
+}
+
+TEST(interface, output_multi_static) {
+  std::string model
+      = cmdstan::test::convert_model_path({"src", "test", "test-models",
+                                           "test_model"});
+  std::string output = model + "_static.csv";
+  std::string command
+      = model
+        + " id=3 sample num_warmup=200 num_samples=100 num_chains=2"
+          " algorithm=hmc engine=static random seed=1234 output file="
+        + output;
+
+  cmdstan::test::run_command_output out = cmdstan::test::run_command(command);
+  EXPECT_EQ(int(stan::services::error_codes::OK), out.err_code);
+  EXPECT_FALSE(out.hasError);
+
+  std::vector<stan::io::stan_csv> chains;
+  for (const std::string &suffix : {"_static_3.csv", "_static_4.csv"}) {
+    std::ifstream csv_stream(model + suffix);
+    ASSERT_TRUE(csv_stream.good());
+    chains.push_back(
+        stan::io::stan_csv_reader::parse(csv_stream, &std::cout));
+    EXPECT_EQ(100, chains.back().samples.rows());
+    EXPECT_EQ("static", chains.back().metadata.engine);
+  }
+  // each chain has its own random number stream
+  EXPECT_EQ(3U, chains[0].metadata.chain_id);
+  EXPECT_EQ(4U, chains[1].metadata.chain_id);
+  EXPECT_FALSE(chains[0].samples == chains[1].samples);
+}
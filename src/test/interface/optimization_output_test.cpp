@@ -178,3 +178,44 @@ TEST_F(CmdStan, optimize_jacobian_adjust) {
 
   ASSERT_NEAR(3.3, values2[1], 0.01);
 }
+
+TEST_F(CmdStan, optimize_num_starts) {
+  std::stringstream ss;
+  ss << convert_model_path(optimization_model) << " random seed=1234"
+     << " output file=" << convert_model_path(output1_csv)
+     << " method=optimize num_starts=4 save_starts=1 2>&1";
+  std::string cmd = ss.str();
+  run_command_output out = run_command(cmd);
+  ASSERT_EQ(0, out.err_code);
+  EXPECT_TRUE(boost::contains(out.output, "Best mode of 4 optimizations"));
+
+  std::vector<std::string> config;
+  std::vector<std::string> header;
+  std::vector<double> values;
+  parse_sample(convert_model_path(output1_csv), config, header, values);
+  ASSERT_EQ(5U, values.size());
+  ASSERT_NEAR(0, values[0], 0.00001);
+  EXPECT_FLOAT_EQ(1, values[1]);
+  EXPECT_FLOAT_EQ(1000000, values[4]);
+
+  std::ifstream output(convert_model_path(output1_csv));
+  std::stringstream contents;
+  contents << output.rdbuf();
+  EXPECT_TRUE(boost::contains(contents.str(),
+                              "# Multi-start optimization: 4 starts, "
+                              "1 distinct modes"));
+  EXPECT_TRUE(
+      boost::contains(contents.str(), "found by starts 1, 2, 3, 4"));
+
+  // each start has its own output
+  for (int i = 1; i <= 4; ++i) {
+    std::vector<std::string> start_config;
+    std::vector<double> start_values;
+    parse_sample(
+        convert_model_path({"test", "output1_start_" + std::to_string(i)
+                                        + ".csv"}),
+        start_config, header, start_values);
+    ASSERT_EQ(5U, start_values.size());
+    EXPECT_NEAR(0, start_values[0], 0.00001);
+  }
+}
@@ -106,3 +106,50 @@ TEST_F(CmdStan, save_metric_no_adapt) {
   run_command_output out = run_command(cmd);
   ASSERT_TRUE(out.hasError);
 }
+
+TEST_F(CmdStan, warm_start_from_saved_metric) {
+  std::stringstream ss;
+  ss << convert_model_path(simplex_model) << " random seed=1234"
+     << " method=sample adapt save_metric=1"
+     << " output file=" << convert_model_path(output_csv) << " 2>&1";
+  run_command_output out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError);
+
+  std::string warm_csv = convert_model_path({"test", "output_warm.csv"});
+  ss.str("");
+  ss << convert_model_path(simplex_model) << " random seed=4321"
+     << " method=sample warm_start=" << convert_model_path(output_csv)
+     << " warm_start_warmup=50 output file=" << warm_csv << " 2>&1";
+  out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError);
+
+  auto metric_line = [](const std::string &fname) {
+    std::ifstream in(fname);
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line == "# Diagonal elements of inverse mass matrix:") {
+        std::getline(in, line);
+        return line;
+      }
+    }
+    return std::string();
+  };
+  // only the step size is adapted during the short warmup
+  std::string metric = metric_line(convert_model_path(output_csv));
+  ASSERT_FALSE(metric.empty());
+  EXPECT_EQ(metric, metric_line(warm_csv));
+
+  std::ifstream warm_stream(warm_csv);
+  std::stringstream warm_output;
+  warm_output << warm_stream.rdbuf();
+  EXPECT_EQ(1, count_matches("num_warmup = 50", warm_output.str()));
+  EXPECT_EQ(1, count_matches("init_buffer = 0", warm_output.str()));
+  std::remove(warm_csv.c_str());
+
+  ss.str("");
+  ss << convert_model_path(simplex_model) << " method=sample"
+     << " warm_start=" << convert_model_path({"test", "no_such_output.csv"})
+     << " output file=" << warm_csv << " 2>&1";
+  out = run_command(ss.str());
+  EXPECT_TRUE(out.hasError);
+}
@@ -0,0 +1,155 @@
+#include <cmdstan/server.hpp>
+#include <test/utility.hpp>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using cmdstan::test::convert_model_path;
+using cmdstan::test::run_command;
+using cmdstan::test::run_command_output;
+
+namespace {
+class fake_model : public stan::model::model_base {};
+
+std::string write_file(const std::string &name, const std::string &text) {
+  std::string fname = convert_model_path({"test", name});
+  std::ofstream out(fname);
+  out << text;
+  return fname;
+}
+}  // namespace
+
+TEST(server, model_cache) {
+  int num_models = 0;
+  cmdstan::model_cache models(
+      [&](const std::string &data_file, unsigned int seed) {
+        ++num_models;
+        return std::unique_ptr<stan::model::model_base>(new fake_model());
+      },
+      2, 1234);
+  std::string data_1 = write_file("server_data_1.json", "{\"N\": 1}");
+  std::string data_2 = write_file("server_data_2.json", "{\"N\": 2}");
+  std::string data_copy = write_file("server_data_copy.json", "{\"N\": 1}");
+
+  stan::model::model_base &model_1 = models.get(data_1, 1234);
+  EXPECT_EQ(&model_1, &models.get(data_copy, 1234));
+  EXPECT_EQ(1, num_models);
+  EXPECT_NE(&model_1, &models.get(data_1, 4321));
+  EXPECT_NE(&model_1, &models.get(data_2, 1234));
+  EXPECT_EQ(3, num_models);
+  EXPECT_EQ(1234U, models.seed());
+  EXPECT_EQ(2U, models.size());
+  EXPECT_EQ(1U, models.num_hits());
+  // least recently used model was released
+  models.get(data_1, 1234);
+  EXPECT_EQ(4, num_models);
+}
+
+TEST(server, split_job_args) {
+  std::vector<std::string> args = cmdstan::internal::split_job_args(
+      "  sample num_samples=10  output file=\"out dir/a.csv\"");
+  std::vector<std::string> expected
+      = {"sample", "num_samples=10", "output", "file=out dir/a.csv"};
+  EXPECT_EQ(expected, args);
+  EXPECT_THROW(cmdstan::internal::split_job_args("data file=\"a.json"),
+               std::invalid_argument);
+}
+
+TEST(server, serve) {
+  std::vector<std::vector<std::string>> jobs;
+  cmdstan::job_runner run_job = [&](const std::vector<std::string> &args) {
+    jobs.push_back(args);
+    if (args[0] == "fail") {
+      throw std::invalid_argument("bad\narguments");
+    }
+    return args[0] == "sample" ? 0 : 1;
+  };
+  std::stringstream in("sample\n# comment\n\nfail\r\noptimize\nquit\nsample\n");
+  std::stringstream out;
+  EXPECT_TRUE(cmdstan::serve(in, out, run_job));
+  EXPECT_EQ("ok\nerror: bad arguments\nerror: return code 1\n", out.str());
+  EXPECT_EQ(3U, jobs.size());
+}
+
+#ifdef CMDSTAN_HAS_UNIX_SOCKETS
+TEST(server, serve_socket) {
+  std::string path = convert_model_path({"test", "server_test.sock"});
+  cmdstan::job_runner run_job
+      = [](const std::vector<std::string> &args) { return 0; };
+  std::thread server([&] { cmdstan::serve_socket(path, run_job); });
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_GE(fd, 0);
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  // wait for the server to listen
+  while (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))
+         != 0) {
+    std::this_thread::yield();
+  }
+  std::string request = "sample\nsample\nquit\n";
+  ASSERT_EQ(static_cast<ssize_t>(request.size()),
+            ::write(fd, request.data(), request.size()));
+  std::string reply;
+  char buf[64];
+  ssize_t n;
+  while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+    reply.append(buf, n);
+  }
+  ::close(fd);
+  server.join();
+  EXPECT_EQ("ok\nok\n", reply);
+}
+#endif
+
+TEST(server, runs_jobs_from_stdin) {
+  std::string model
+      = convert_model_path({"src", "test", "test-models", "test_model"});
+  std::string jobs = write_file(
+      "server_jobs.txt",
+      "sample num_samples=10 num_warmup=10 output file=" + model
+          + "_server_1.csv\n"
+            "sample num_samples=10 num_warmup=10 output file="
+          + model + "_server_2.csv\n"
+          + "sample num_samples=-1\n");
+  run_command_output out = run_command(model + " server < " + jobs);
+  EXPECT_EQ(0, out.err_code);
+  EXPECT_NE(std::string::npos, out.output.find("ok\n"));
+  EXPECT_NE(std::string::npos, out.output.find("error: return code"));
+  for (std::string output : {"_server_1.csv", "_server_2.csv"}) {
+    std::ifstream csv(model + output);
+    EXPECT_TRUE(csv.good()) << output;
+  }
+}
+
+TEST(server, jobs_without_seed_use_server_seed) {
+  std::string model
+      = convert_model_path({"src", "test", "test-models", "test_model"});
+  std::string jobs = write_file(
+      "server_seed_jobs.txt",
+      "sample num_samples=10 num_warmup=10 output file=" + model
+          + "_server_seed_1.csv\n"
+            "sample num_samples=10 num_warmup=10 random seed=99 output file="
+          + model + "_server_seed_2.csv\n");
+  run_command_output out
+      = run_command(model + " server random seed=1234 < " + jobs);
+  EXPECT_EQ(0, out.err_code);
+  std::vector<std::pair<std::string, std::string>> expected
+      = {{"_server_seed_1.csv", "seed = 1234"},
+         {"_server_seed_2.csv", "seed = 99"}};
+  for (const auto &output : expected) {
+    std::ifstream csv(model + output.first);
+    std::string contents((std::istreambuf_iterator<char>(csv)),
+                         std::istreambuf_iterator<char>());
+    EXPECT_NE(std::string::npos, contents.find(output.second))
+        << output.first;
+  }
+}
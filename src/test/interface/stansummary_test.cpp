@@ -1,8 +1,12 @@
 #include <cmdstan/stansummary_helper.hpp>
 #include <test/utility.hpp>
 #include <stan/io/ends_with.hpp>
+#include <chrono>
 #include <fstream>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 #include <boost/algorithm/string.hpp>
 #include <gtest/gtest.h>
 #include <CLI11/CLI11.hpp>
@@ -685,3 +689,255 @@ TEST(CommandStansummary, check_csv_output_include_param) {
   if (return_code != 0)
     FAIL();
 }
+
+TEST(CommandStansummary, threads) {
+  std::string path_separator;
+  path_separator.push_back(get_path_separator());
+  std::string command = "bin" + path_separator + "stansummary";
+  std::string csv_dir = "src" + path_separator + "test" + path_separator
+                        + "interface" + path_separator + "example_output"
+                        + path_separator;
+  std::string csv_files
+      = csv_dir + "mix_output.1.csv " + csv_dir + "mix_output.2.csv";
+
+  run_command_output serial = run_command(command + " " + csv_files);
+  ASSERT_FALSE(serial.hasError)
+      << "\"" << serial.command << "\" quit with an error";
+  run_command_output parallel
+      = run_command(command + " --threads 4 " + csv_files);
+  ASSERT_FALSE(parallel.hasError)
+      << "\"" << parallel.command << "\" quit with an error";
+  EXPECT_EQ(serial.output, parallel.output);
+  parallel = run_command(command + " --threads=-1 " + csv_files);
+  ASSERT_FALSE(parallel.hasError)
+      << "\"" << parallel.command << "\" quit with an error";
+  EXPECT_EQ(serial.output, parallel.output);
+
+  run_command_output out = run_command(command + " -t 0 " + csv_files);
+  ASSERT_TRUE(out.hasError)
+      << "\"" << out.command << "\" failed to quit with an error";
+}
+
+TEST(CommandStansummary, streaming) {
+  std::string path_separator;
+  path_separator.push_back(get_path_separator());
+  std::string command = "bin" + path_separator + "stansummary";
+  std::string csv_dir = "src" + path_separator + "test" + path_separator
+                        + "interface" + path_separator + "example_output"
+                        + path_separator;
+  // 1 MB holds about 65 of the 107 columns, so this reads two blocks
+  std::string csv_file = csv_dir + "eight_schools_output.csv";
+  run_command_output in_memory = run_command(command + " " + csv_file);
+  ASSERT_FALSE(in_memory.hasError)
+      << "\"" << in_memory.command << "\" quit with an error";
+  run_command_output streamed = run_command(
+      command + " --streaming --max_memory 1 " + csv_file);
+  ASSERT_FALSE(streamed.hasError)
+      << "\"" << streamed.command << "\" quit with an error";
+  EXPECT_EQ(in_memory.output, streamed.output);
+
+  std::string csv_files
+      = csv_dir + "mix_output.1.csv " + csv_dir + "mix_output.2.csv";
+  in_memory = run_command(command + " -i theta -i mu[2] " + csv_files);
+  streamed
+      = run_command(command + " --streaming -i theta -i mu[2] " + csv_files);
+  ASSERT_FALSE(streamed.hasError)
+      << "\"" << streamed.command << "\" quit with an error";
+  EXPECT_EQ(in_memory.output, streamed.output);
+
+  run_command_output out
+      = run_command(command + " --streaming --autocorr 1 " + csv_files);
+  ASSERT_TRUE(out.hasError)
+      << "\"" << out.command << "\" failed to quit with an error";
+}
+
+TEST(CommandStansummary, follow_finished_files) {
+  std::string path_separator;
+  path_separator.push_back(get_path_separator());
+  std::string command = "bin" + path_separator + "stansummary";
+  std::string csv_dir = "src" + path_separator + "test" + path_separator
+                        + "interface" + path_separator + "example_output"
+                        + path_separator;
+  std::string csv_files
+      = csv_dir + "mix_output.1.csv " + csv_dir + "mix_output.2.csv";
+
+  // files with their timing footer are read once and summarized in full
+  run_command_output in_memory = run_command(command + " " + csv_files);
+  ASSERT_FALSE(in_memory.hasError)
+      << "\"" << in_memory.command << "\" quit with an error";
+  run_command_output followed
+      = run_command(command + " --follow --refresh 1 " + csv_files);
+  ASSERT_FALSE(followed.hasError)
+      << "\"" << followed.command << "\" quit with an error";
+  EXPECT_EQ(in_memory.output, followed.output);
+
+  run_command_output out
+      = run_command(command + " --follow --streaming " + csv_files);
+  ASSERT_TRUE(out.hasError)
+      << "\"" << out.command << "\" failed to quit with an error";
+}
+
+namespace {
+/**
+ * Return the lines of a file, each with its newline.
+ */
+std::vector<std::string> read_lines(const std::string &fname) {
+  std::ifstream in(fname, std::ios::binary);
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(in, line)) {
+    lines.push_back(line + "\n");
+  }
+  return lines;
+}
+
+/**
+ * Append lines [first, last) to a file in a single write.
+ */
+void append_lines(const std::string &fname,
+                  const std::vector<std::string> &lines, size_t first,
+                  size_t last) {
+  std::string text;
+  for (size_t i = first; i < last; ++i) {
+    text += lines[i];
+  }
+  std::ofstream out(fname, std::ios::binary | std::ios::app);
+  out.write(text.data(), text.size());
+}
+}  // namespace
+
+TEST(CommandStansummary, following_chains_poll) {
+  std::string path_separator;
+  path_separator.push_back(get_path_separator());
+  std::string csv_dir = "src" + path_separator + "test" + path_separator
+                        + "interface" + path_separator + "example_output"
+                        + path_separator;
+  // config and header, then adaptation from line 39 and 1000 draws from
+  // line 43, then the timing footer
+  std::vector<std::vector<std::string>> lines
+      = {read_lines(csv_dir + "mix_output.1.csv"),
+         read_lines(csv_dir + "mix_output.2.csv")};
+  std::vector<std::string> files
+      = {"test" + path_separator + "following_1.csv",
+         "test" + path_separator + "following_2.csv"};
+  for (size_t chain = 0; chain < files.size(); ++chain) {
+    ASSERT_EQ(1047U, lines[chain].size());
+    std::ofstream(files[chain], std::ios::binary).close();
+  }
+  following_chains live(files);
+  EXPECT_EQ(0U, live.poll());
+  EXPECT_EQ(0, live.num_params());
+
+  // the second chain writes its header first
+  append_lines(files[1], lines[1], 0, 38);
+  EXPECT_EQ(0U, live.poll());
+  EXPECT_EQ(12, live.num_params());
+  EXPECT_EQ("lp__", live.param_name(0));
+
+  // a partly written draw isn't read until its line is complete
+  append_lines(files[0], lines[0], 0, 142);
+  std::string partial = lines[0][142].substr(0, lines[0][142].size() / 2);
+  {
+    std::ofstream out(files[0], std::ios::binary | std::ios::app);
+    out << partial;
+  }
+  append_lines(files[1], lines[1], 38, 92);
+  EXPECT_EQ(150U, live.poll());
+  EXPECT_EQ(100, live.num_draws()(0));
+  EXPECT_EQ(50, live.num_draws()(1));
+  EXPECT_EQ(50, live.num_samples());
+  {
+    std::ofstream out(files[0], std::ios::binary | std::ios::app);
+    out << lines[0][142].substr(partial.size());
+  }
+  append_lines(files[0], lines[0], 143, 542);
+  append_lines(files[1], lines[1], 92, 542);
+  EXPECT_EQ(850U, live.poll());
+  EXPECT_EQ(500, live.num_samples());
+  EXPECT_FALSE(live.finished());
+
+  // the running moments match those of the draws read so far
+  stan::io::stan_csv_metadata metadata;
+  Eigen::VectorXd warmup_times(2);
+  Eigen::VectorXd sampling_times(2);
+  Eigen::VectorXi thin(2);
+  auto chains = live.chainset(metadata, warmup_times, sampling_times, thin);
+  EXPECT_EQ(500, chains.num_samples());
+  for (int i = 0; i < live.num_params(); ++i) {
+    EXPECT_NEAR(chains.mean(i), live.mean(i), 1e-8);
+    EXPECT_NEAR(chains.sd(i), live.sd(i), 1e-8);
+  }
+
+  // the first chain stops early, the second one runs to the end
+  {
+    std::ofstream out(files[0], std::ios::binary | std::ios::app);
+    out << "# Sampling stopped early after 500 draws per chain: minimum "
+           "ESS = 412.3, maximum R-hat = 1.004\n";
+  }
+  append_lines(files[0], lines[0], 1042, 1047);
+  EXPECT_EQ(0U, live.poll());
+  EXPECT_FALSE(live.finished());
+  append_lines(files[1], lines[1], 542, 1047);
+  EXPECT_EQ(500U, live.poll());
+  EXPECT_TRUE(live.finished());
+  EXPECT_EQ(500, live.num_samples());
+  live.chainset(metadata, warmup_times, sampling_times, thin);
+  EXPECT_FLOAT_EQ(0.889234, sampling_times(0));
+
+  std::stringstream msg;
+  EXPECT_TRUE(check_requested_params(live, {"theta"}, &msg));
+  EXPECT_FALSE(check_requested_params(live, {"theta", "nope", "lp__"}, &msg));
+  EXPECT_EQ("--include_param: Unrecognized parameter(s): 'lp__' 'nope' \n",
+            msg.str());
+
+  // a file with other columns is rejected
+  std::string other = "test" + path_separator + "following_other.csv";
+  {
+    std::ofstream out(other, std::ios::binary);
+    out << "lp__,theta\n";
+  }
+  following_chains mismatched({files[0], other});
+  EXPECT_THROW(mismatched.poll(), std::invalid_argument);
+}
+
+TEST(CommandStansummary, follow_growing_files) {
+  std::string path_separator;
+  path_separator.push_back(get_path_separator());
+  std::string command = "bin" + path_separator + "stansummary";
+  std::string csv_dir = "src" + path_separator + "test" + path_separator
+                        + "interface" + path_separator + "example_output"
+                        + path_separator;
+  std::vector<std::vector<std::string>> lines
+      = {read_lines(csv_dir + "mix_output.1.csv"),
+         read_lines(csv_dir + "mix_output.2.csv")};
+  std::vector<std::string> files
+      = {"test" + path_separator + "follow_growing_1.csv",
+         "test" + path_separator + "follow_growing_2.csv"};
+  for (size_t chain = 0; chain < files.size(); ++chain) {
+    ASSERT_EQ(1047U, lines[chain].size());
+    std::ofstream(files[chain], std::ios::binary).close();
+  }
+
+  // the second chain has started, the first hasn't written anything
+  append_lines(files[1], lines[1], 0, 142);
+  run_command_output followed;
+  std::thread follow([&] {
+    followed = run_command(command + " --follow --refresh 1 " + files[0]
+                           + " " + files[1]);
+  });
+  // no assumptions about how many polls see each stage
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  append_lines(files[0], lines[0], 0, 542);
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  append_lines(files[0], lines[0], 542, 1047);
+  append_lines(files[1], lines[1], 142, 1047);
+  follow.join();
+
+  ASSERT_FALSE(followed.hasError)
+      << "\"" << followed.command << "\" quit with an error";
+  run_command_output in_memory
+      = run_command(command + " " + files[0] + " " + files[1]);
+  ASSERT_FALSE(in_memory.hasError)
+      << "\"" << in_memory.command << "\" quit with an error";
+  EXPECT_TRUE(boost::algorithm::ends_with(followed.output, in_memory.output));
+}
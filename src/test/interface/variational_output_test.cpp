@@ -74,3 +74,28 @@ TEST_F(CmdStan, variational_fullrank) {
   ASSERT_EQ(1, chains.num_chains());
   ASSERT_EQ(1000, chains.num_samples());
 }
+
+TEST_F(CmdStan, variational_num_runs) {
+  run_command_output out = run_command(
+      base_command + " random seed=1234 variational num_runs=3");
+
+  ASSERT_EQ(0, out.err_code);
+  EXPECT_NE(std::string::npos, out.output.find("Selected ADVI run"));
+
+  stan::mcmc::chains<> chains = parse_output_file();
+  ASSERT_EQ(1, chains.num_chains());
+  ASSERT_EQ(1000, chains.num_samples());
+
+  std::ifstream output_stream(output_file);
+  std::stringstream output;
+  output << output_stream.rdbuf();
+  EXPECT_NE(std::string::npos, output.str().find("# Multi-run ADVI: 3 runs"));
+  for (int i = 1; i <= 3; ++i) {
+    std::string run = std::to_string(i);
+    EXPECT_NE(std::string::npos, output.str().find("# Run " + run + ": "));
+    std::ifstream trace("test/output_elbo_" + run + ".csv");
+    std::string header;
+    std::getline(trace, header);
+    EXPECT_NE(std::string::npos, header.find("ELBO"));
+  }
+}